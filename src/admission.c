@@ -0,0 +1,275 @@
+/**
+ *
+ * /brief getdns admission control of requests
+ *
+ * Asynchronous requests start within the rate and the number in flight
+ * the context is limited to.  The others wait their turn in a bounded
+ * queue, and are failed right away when it is full or when they would
+ * not start before they time out.
+ *
+ */
+
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <sys/time.h>
+#include "types-internal.h"
+#include "util-internal.h"
+#include "context.h"
+#include "general.h"
+#include "admission.h"
+
+/* there is no room until a request is done */
+#define ADMISSION_WAIT_DONE ((uint64_t)-1)
+
+static uint64_t
+now_usec(void)
+{
+	struct timeval tv;
+
+	(void) gettimeofday(&tv, NULL);
+	return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static uint64_t
+token_interval(uint32_t qps)
+{
+	return qps >= 1000000 ? 1 : 1000000 / qps;
+}
+
+uint64_t
+priv_getdns_take_token(uint64_t *bucket_usec, uint32_t qps, uint32_t burst,
+    uint64_t now)
+{
+	uint64_t interval = token_interval(qps);
+	uint64_t tolerance = (burst ? burst - 1 : 0) * interval;
+
+	if (*bucket_usec < now)
+		*bucket_usec = now;
+	if (*bucket_usec > now + tolerance)
+		return *bucket_usec - now - tolerance;
+	*bucket_usec += interval;
+	return 0;
+}
+
+/* 0 when a request may start now, for which a token is taken, and
+ * otherwise the microseconds until one may, or ADMISSION_WAIT_DONE */
+static uint64_t
+take_room(struct getdns_context *context, uint64_t now)
+{
+	struct priv_getdns_admission *admission = context->admission;
+
+	if (context->request_max_in_flight &&
+	    admission->in_flight >= context->request_max_in_flight)
+		return ADMISSION_WAIT_DONE;
+	if (!context->request_qps)
+		return 0;
+	return priv_getdns_take_token(&admission->bucket_usec,
+	    context->request_qps, context->request_burst, now);
+}
+
+/* how long a request queued now waits for a token at least */
+static uint64_t
+queue_wait(struct getdns_context *context, uint64_t now)
+{
+	struct priv_getdns_admission *admission = context->admission;
+	uint64_t interval, tolerance, start;
+
+	if (!context->request_qps)
+		return 0;
+	interval = token_interval(context->request_qps);
+	tolerance = (context->request_burst - 1) * interval;
+	start = (admission->bucket_usec > now ? admission->bucket_usec : now) +
+	    admission->queued * interval;
+	return start > now + tolerance ? start - now - tolerance : 0;
+}
+
+static void
+unqueue(struct priv_getdns_admission *admission, getdns_dns_req *req)
+{
+	*req->admission_pprev = req->admission_next;
+	if (req->admission_next)
+		req->admission_next->admission_pprev = req->admission_pprev;
+	else
+		admission->tail = req->admission_pprev;
+	req->admission_next = NULL;
+	req->admission_pprev = NULL;
+	admission->queued--;
+}
+
+static void schedule_start(struct getdns_context *, uint64_t);
+
+/* start the waiting requests there is room for */
+static getdns_return_t
+start_timeout(void *arg)
+{
+	struct getdns_context *context = (struct getdns_context *) arg;
+	struct priv_getdns_admission *admission = context->admission;
+	getdns_dns_req *req;
+	uint64_t wait = 0;
+
+	(void) getdns_context_clear_timeout(context,
+	    GETDNS_TIMEOUT_ID_ADMISSION);
+	admission->scheduled = 0;
+	/* an error callback may make or cancel requests, so the head is
+	 * looked at again every time */
+	while ((req = admission->head) &&
+	    (wait = take_room(context, now_usec())) == 0) {
+		unqueue(admission, req);
+		req->admitted = 1;
+		admission->in_flight++;
+		priv_getdns_start_request(req);
+	}
+	if (admission->head && wait != ADMISSION_WAIT_DONE)
+		schedule_start(context, wait);
+	return GETDNS_RETURN_GOOD;
+}
+
+static void
+schedule_start(struct getdns_context *context, uint64_t wait)
+{
+	uint64_t ms = (wait + 999) / 1000;
+
+	if (context->admission->scheduled || context->destroying)
+		return;
+	if (getdns_context_schedule_timeout(context, GETDNS_TIMEOUT_ID_ADMISSION,
+	    ms > 0xffff ? 0xffff : ms, start_timeout, context) ==
+	    GETDNS_RETURN_GOOD)
+		context->admission->scheduled = 1;
+}
+
+int
+priv_getdns_admit(getdns_dns_req *req)
+{
+	struct getdns_context *context = req->context;
+	struct priv_getdns_admission *admission = context->admission;
+	uint64_t now, wait = ADMISSION_WAIT_DONE;
+
+	if (!admission)
+		return PRIV_GETDNS_ADMIT_START;
+	now = now_usec();
+	/* the waiting ones go first */
+	if (!admission->head && (wait = take_room(context, now)) == 0) {
+		req->admitted = 1;
+		admission->in_flight++;
+		return PRIV_GETDNS_ADMIT_START;
+	}
+	/* waiting is in vain when it times out before its turn */
+	if (admission->queued >= context->request_queue_size ||
+	    queue_wait(context, now) >= context->timeout * 1000) {
+		admission->rejected++;
+		return PRIV_GETDNS_ADMIT_REJECT;
+	}
+	req->admission_next = NULL;
+	req->admission_pprev = admission->tail;
+	*admission->tail = req;
+	admission->tail = &req->admission_next;
+	admission->queued++;
+	if (wait != ADMISSION_WAIT_DONE)
+		schedule_start(context, wait);
+	return PRIV_GETDNS_ADMIT_QUEUED;
+}
+
+void
+priv_getdns_admission_done(getdns_dns_req *req)
+{
+	struct priv_getdns_admission *admission = req->context->admission;
+
+	if (req->admission_pprev)
+		unqueue(admission, req);
+	else if (req->admitted) {
+		req->admitted = 0;
+		admission->in_flight--;
+		/* not started from here, as this is called from within the
+		 * callbacks of the request */
+		if (admission->head)
+			schedule_start(req->context, 0);
+	}
+}
+
+getdns_return_t
+priv_getdns_admission_stats(struct getdns_context *context,
+    struct getdns_dict *dict)
+{
+	struct priv_getdns_admission *admission = context->admission;
+	getdns_return_t r;
+
+	if (!admission)
+		return GETDNS_RETURN_GOOD;
+	r = getdns_dict_set_int(dict, "requests_in_flight",
+	    (uint32_t) admission->in_flight);
+	r |= getdns_dict_set_int(dict, "requests_queued",
+	    (uint32_t) admission->queued);
+	r |= getdns_dict_set_int(dict, "requests_rejected",
+	    (uint32_t) admission->rejected);
+	return r;
+}
+
+void
+priv_getdns_admission_destroy(struct getdns_context *context)
+{
+	if (!context->admission)
+		return;
+	if (context->admission->scheduled)
+		(void) getdns_context_clear_timeout(context,
+		    GETDNS_TIMEOUT_ID_ADMISSION);
+	GETDNS_FREE(context->my_mf, context->admission);
+	context->admission = NULL;
+}
+
+/*---------------------------------------- public */
+getdns_return_t
+getdns_context_set_request_limits(getdns_context *context, uint32_t qps,
+    uint32_t burst, uint32_t max_in_flight, uint32_t queue_size)
+{
+	struct priv_getdns_admission *admission;
+
+	if (!context || (qps && !burst))
+		return GETDNS_RETURN_INVALID_PARAMETER;
+	if (!context->admission && (qps || max_in_flight)) {
+		admission = GETDNS_MALLOC(context->my_mf,
+		    struct priv_getdns_admission);
+		if (!admission)
+			return GETDNS_RETURN_MEMORY_ERROR;
+		(void) memset(admission, 0,
+		    sizeof(struct priv_getdns_admission));
+		admission->tail = &admission->head;
+		context->admission = admission;
+	}
+	context->request_qps = qps;
+	context->request_burst = burst;
+	context->request_max_in_flight = max_in_flight;
+	context->request_queue_size = queue_size;
+	/* the waiting ones may fit the new limits */
+	if (context->admission && context->admission->head)
+		schedule_start(context, 0);
+	return GETDNS_RETURN_GOOD;
+}
+
+/* admission.c */
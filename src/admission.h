@@ -0,0 +1,88 @@
+/**
+ * \file
+ * \brief Admission control of the requests of a context
+ */
+
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _GETDNS_ADMISSION_H_
+#define _GETDNS_ADMISSION_H_
+
+#include <getdns/getdns.h>
+#include <getdns/getdns_extra.h>
+#include "types-internal.h"
+
+/* what priv_getdns_admit decided about a request */
+#define PRIV_GETDNS_ADMIT_START  0
+#define PRIV_GETDNS_ADMIT_QUEUED 1
+#define PRIV_GETDNS_ADMIT_REJECT 2
+
+/*
+ * The asynchronous requests of a context start at no more than
+ * request_qps per second, with a token bucket kept as the time the next
+ * one may start (a generic cell rate algorithm), and no more than
+ * request_max_in_flight at a time.  The others wait in a queue of at most
+ * request_queue_size, and are started from a timeout when there is room.
+ * Allocated once limits are set, NULL before.
+ */
+struct priv_getdns_admission {
+    /* in microseconds, see now_usec in admission.c */
+    uint64_t bucket_usec;
+    /* requests started and not yet done */
+    size_t in_flight;
+    /* waiting, the oldest first */
+    getdns_dns_req *head;
+    getdns_dns_req **tail;
+    size_t queued;
+    /* requests failed because the queue was full, or too slow */
+    uint64_t rejected;
+    /* whether the timeout to start the waiting ones is scheduled */
+    int scheduled;
+};
+
+/* take a token of a bucket of qps per second that holds burst, of which
+   *bucket_usec is the state.  Returns 0 when one was taken, and otherwise
+   the microseconds until there is one */
+uint64_t priv_getdns_take_token(uint64_t *bucket_usec, uint32_t qps,
+    uint32_t burst, uint64_t now);
+
+/* whether req may start now, has to wait its turn, or is to be failed */
+int priv_getdns_admit(getdns_dns_req *req);
+
+/* req is done or canceled, it leaves room for the next, or the queue */
+void priv_getdns_admission_done(getdns_dns_req *req);
+
+/* the number of requests in flight, waiting and rejected, for
+   getdns_context_get_api_information.  Nothing without limits */
+getdns_return_t priv_getdns_admission_stats(struct getdns_context *context,
+    struct getdns_dict *dict);
+
+/* after the requests are canceled */
+void priv_getdns_admission_destroy(struct getdns_context *context);
+
+#endif
@@ -42,13 +42,21 @@
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <unistd.h>
 #include <unbound.h>
 #include <assert.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 
 #include "context.h"
 #include "types-internal.h"
 #include "util-internal.h"
 #include "dnssec.h"
+#include "submission.h"
+#include "watcher.h"
+#include "stub.h"
+#include "admission.h"
 
 void *plain_mem_funcs_user_arg = MF_PLAIN;
 
@@ -66,9 +74,13 @@ static int timeout_cmp(const void *, const void *);
 static void dispatch_updated(struct getdns_context *, uint16_t);
 static void cancel_dns_req(getdns_dns_req *);
 static void cancel_outstanding_requests(struct getdns_context*, int);
+static void cancel_completions(struct getdns_context*);
 
 /* unbound helpers */
 static getdns_return_t rebuild_ub_ctx(struct getdns_context* context);
+static getdns_return_t renew_ub_ctx(struct getdns_context* context);
+static void release_ub_ctx(struct getdns_context*, getdns_dns_req*);
+static void reap_retired_ub_ctxs(struct getdns_context*);
 static void set_ub_string_opt(struct getdns_context *, char *, char *);
 static void set_ub_number_opt(struct getdns_context *, char *, uint16_t);
 static getdns_return_t set_ub_dns_transport(struct getdns_context*, getdns_transport_t);
@@ -176,7 +188,7 @@ add_ip_str(struct getdns_dict * ip)
 int
 filechg_check(struct getdns_context *context, struct filechg *fchg)
 {
-    struct stat *finfo;
+    struct stat finfo;
 
     if(fchg == NULL)
         return 0;
@@ -184,34 +196,34 @@ filechg_check(struct getdns_context *context, struct filechg *fchg)
     fchg->errors  = GETDNS_FCHG_NOERROR;
     fchg->changes = GETDNS_FCHG_NOCHANGES;
 
-    finfo = GETDNS_MALLOC(context->my_mf, struct stat);
-    if(finfo == NULL)
+    if(stat(fchg->fn, &finfo) != 0)
     {
         fchg->errors = errno;
         return GETDNS_FCHG_ERRORS;
-	}
-
-    if(stat(fchg->fn, finfo) != 0)
-    {
-		GETDNS_FREE(context->my_mf, finfo);
-        fchg->errors = errno;
-        return GETDNS_FCHG_ERRORS;
     }
 
     /* we want to consider a file that previously returned error for stat() as a
        change */
 
     if(fchg->prevstat == NULL)
+    {
+        /* allocated once, and reused by the following checks */
+        fchg->prevstat = GETDNS_MALLOC(context->my_mf, struct stat);
+        if(fchg->prevstat == NULL)
+        {
+            fchg->errors = errno;
+            return GETDNS_FCHG_ERRORS;
+        }
         fchg->changes = GETDNS_FCHG_MTIME | GETDNS_FCHG_CTIME;
+    }
     else
     {
-        if(fchg->prevstat->st_mtime != finfo->st_mtime)
+        if(fchg->prevstat->st_mtime != finfo.st_mtime)
             fchg->changes |= GETDNS_FCHG_MTIME;
-        if(fchg->prevstat->st_ctime != finfo->st_ctime)
+        if(fchg->prevstat->st_ctime != finfo.st_ctime)
             fchg->changes |= GETDNS_FCHG_CTIME;
-    	GETDNS_FREE(context->my_mf, fchg->prevstat);
     }
-    fchg->prevstat = finfo;
+    *fchg->prevstat = finfo;
 
     return fchg->changes;
 } /* filechg */
@@ -243,7 +255,8 @@ create_from_ldns_list(struct getdns_context *context, ldns_rdf ** ldns_list,
 {
     size_t i = 0;
     size_t idx = 0;
-    struct getdns_list *result = getdns_list_create_with_context(context);
+    struct getdns_list *result = getdns_list_create_with_capacity(context,
+        count);
     for (i = 0; i < count; ++i) {
         ldns_rdf *rdf = ldns_list[i];
         switch (ldns_rdf_get_type(rdf)) {
@@ -277,12 +290,13 @@ create_from_ldns_list(struct getdns_context *context, ldns_rdf ** ldns_list,
     return result;
 }
 
-/*---------------------------------------- set_os_defaults
+/*---------------------------------------- priv_getdns_read_resolvconf
   we use ldns to read the resolv.conf file - the ldns resolver is
   destroyed once the file is read
 */
-static getdns_return_t
-set_os_defaults(struct getdns_context *context)
+getdns_return_t
+priv_getdns_read_resolvconf(struct getdns_context *context,
+    struct getdns_list **upstreams, struct getdns_list **suffix)
 {
     ldns_resolver *lr = NULL;
     ldns_rdf      **rdf_list;
@@ -291,11 +305,43 @@ set_os_defaults(struct getdns_context *context)
     if (ldns_resolver_new_frm_file(&lr, NULL) != LDNS_STATUS_OK)
         return GETDNS_RETURN_GENERIC_ERROR;
 
+    *upstreams = NULL;
+    rdf_list    = ldns_resolver_nameservers(lr);
+    rdf_list_sz = ldns_resolver_nameserver_count(lr);
+    if (rdf_list_sz > 0) {
+        *upstreams = create_from_ldns_list(context, rdf_list, rdf_list_sz);
+    }
+
+    *suffix = NULL;
+    rdf_list = ldns_resolver_searchlist(lr);
+    rdf_list_sz = ldns_resolver_searchlist_count(lr);
+    if (rdf_list_sz > 0) {
+        *suffix = create_from_ldns_list(context, rdf_list, rdf_list_sz);
+    }
+    ldns_resolver_deep_free(lr);
+
+    return GETDNS_RETURN_GOOD;
+} /* priv_getdns_read_resolvconf */
+
+/*---------------------------------------- set_os_defaults */
+static getdns_return_t
+set_os_defaults(struct getdns_context *context)
+{
+    struct getdns_list *upstreams, *suffix;
+
+    if (priv_getdns_read_resolvconf(context, &upstreams, &suffix)
+        != GETDNS_RETURN_GOOD)
+        return GETDNS_RETURN_GENERIC_ERROR;
+
 	if(context->fchg_resolvconf == NULL)
 	{
 		context->fchg_resolvconf = GETDNS_MALLOC(context->my_mf, struct filechg);
 		if(context->fchg_resolvconf == NULL)
+		{
+			getdns_list_destroy(upstreams);
+			getdns_list_destroy(suffix);
 			return GETDNS_RETURN_MEMORY_ERROR;
+		}
 		context->fchg_resolvconf->fn       = "/etc/resolv.conf";
 		context->fchg_resolvconf->prevstat = NULL;
 		context->fchg_resolvconf->changes  = GETDNS_FCHG_NOCHANGES;
@@ -303,20 +349,8 @@ set_os_defaults(struct getdns_context *context)
 	}
 	filechg_check(context, context->fchg_resolvconf);
 
-    rdf_list    = ldns_resolver_nameservers(lr);
-    rdf_list_sz = ldns_resolver_nameserver_count(lr);
-    if (rdf_list_sz > 0) {
-        context->upstream_list =
-            create_from_ldns_list(context, rdf_list, rdf_list_sz);
-    }
-
-    rdf_list = ldns_resolver_searchlist(lr);
-    rdf_list_sz = ldns_resolver_searchlist_count(lr);
-    if (rdf_list_sz > 0) {
-        context->suffix = create_from_ldns_list(context, rdf_list,
-            rdf_list_sz);
-    }
-    ldns_resolver_deep_free(lr);
+    context->upstream_list = upstreams;
+    context->suffix = suffix;
 
     return GETDNS_RETURN_GOOD;
 } /* set_os_defaults */
@@ -389,13 +423,113 @@ create_ldns_rbtree(getdns_context * context,
 }
 
 /*
- * getdns_context_create
+ * Helper to copy a file change tracker, including the last seen stat
+ */
+static getdns_return_t
+copy_filechg(struct getdns_context *context,
+    struct filechg **dst, const struct filechg *src)
+{
+	if (!src)
+		return GETDNS_RETURN_GOOD;
+
+	*dst = GETDNS_MALLOC(context->my_mf, struct filechg);
+	if (!*dst)
+		return GETDNS_RETURN_MEMORY_ERROR;
+	**dst = *src;
+	if (src->prevstat) {
+		(*dst)->prevstat = GETDNS_MALLOC(context->my_mf, struct stat);
+		if (!(*dst)->prevstat)
+			return GETDNS_RETURN_MEMORY_ERROR;
+		*(*dst)->prevstat = *src->prevstat;
+	}
+	return GETDNS_RETURN_GOOD;
+}
+
+/*
+ * Helper to give a newly created context the settings of a template,
+ * replacing the defaults.  The unbound context is not touched.
+ */
+static getdns_return_t
+copy_context_settings(struct getdns_context *context,
+    const struct getdns_context *tmpl)
+{
+	getdns_return_t r;
+
+	context->update_callback = tmpl->update_callback;
+	context->mf = tmpl->mf;
+
+	context->resolution_type = tmpl->resolution_type;
+	GETDNS_FREE(context->my_mf, context->namespaces);
+	context->namespaces = GETDNS_XMALLOC(context->my_mf,
+	    getdns_namespace_t, tmpl->namespace_count ? tmpl->namespace_count : 1);
+	if (!context->namespaces)
+		return GETDNS_RETURN_MEMORY_ERROR;
+	memcpy(context->namespaces, tmpl->namespaces,
+	    tmpl->namespace_count * sizeof(getdns_namespace_t));
+	context->namespace_count = tmpl->namespace_count;
+
+	context->timeout = tmpl->timeout;
+	context->follow_redirects = tmpl->follow_redirects;
+	context->append_name = tmpl->append_name;
+	context->dns_transport = tmpl->dns_transport;
+	context->limit_outstanding_queries = tmpl->limit_outstanding_queries;
+	context->dnssec_allowed_skew = tmpl->dnssec_allowed_skew;
+	context->edns_maximum_udp_payload_size =
+	    tmpl->edns_maximum_udp_payload_size;
+	context->edns_extended_rcode = tmpl->edns_extended_rcode;
+	context->edns_version = tmpl->edns_version;
+	context->edns_do_bit = tmpl->edns_do_bit;
+	context->return_dnssec_status = tmpl->return_dnssec_status;
+	context->has_ta = tmpl->has_ta;
+	context->use_threads = tmpl->use_threads;
+	context->native_stub = tmpl->native_stub;
+	context->upstream_health_callback = tmpl->upstream_health_callback;
+	context->upstream_health_userarg = tmpl->upstream_health_userarg;
+	context->hedge_percentile = tmpl->hedge_percentile;
+	context->hedge_permille = tmpl->hedge_permille;
+	context->adaptive_timeout_factor = tmpl->adaptive_timeout_factor;
+	context->udp_pool_size = tmpl->udp_pool_size;
+	context->udp_rotate_ms = tmpl->udp_rotate_ms;
+	context->edns_negotiation_max = tmpl->edns_negotiation_max;
+	context->upstream_qps = tmpl->upstream_qps;
+	context->upstream_burst = tmpl->upstream_burst;
+	context->upstream_max_in_flight = tmpl->upstream_max_in_flight;
+	if ((r = getdns_context_set_request_limits(context, tmpl->request_qps,
+	    tmpl->request_burst, tmpl->request_max_in_flight,
+	    tmpl->request_queue_size)))
+		return r;
+
+	getdns_list_destroy(context->dns_root_servers);
+	context->dns_root_servers = NULL;
+	if ((r = getdns_list_copy(tmpl->dns_root_servers,
+	    &context->dns_root_servers)) ||
+	    (r = getdns_list_copy(tmpl->suffix, &context->suffix)) ||
+	    (r = getdns_list_copy(tmpl->dnssec_trust_anchors,
+	    &context->dnssec_trust_anchors)) ||
+	    (r = getdns_list_copy(tmpl->upstream_list,
+	    &context->upstream_list)))
+		return r;
+
+	if ((r = copy_filechg(context, &context->fchg_resolvconf,
+	    tmpl->fchg_resolvconf)) ||
+	    (r = copy_filechg(context, &context->fchg_hosts,
+	    tmpl->fchg_hosts)))
+		return r;
+
+	return GETDNS_RETURN_GOOD;
+}
+
+/*
+ * context_create
  *
- * Call this to initialize the context that is used in other getdns calls.
+ * Initialize a context with the defaults (and the settings from the OS
+ * when set_from_os), or with the settings of tmpl when given.  Cloning
+ * from a template skips reading resolv.conf and the trust anchor file.
  */
-getdns_return_t
-getdns_context_create_with_extended_memory_functions(
+static getdns_return_t
+context_create(
     struct getdns_context ** context,
+    const struct getdns_context *tmpl,
     int set_from_os,
     void *userarg,
     void *(*malloc)(void *userarg, size_t),
@@ -437,6 +571,44 @@ getdns_context_create_with_extended_memory_functions(
     result->timeouts_by_time = create_ldns_rbtree(result, timeout_cmp);
     result->timeouts_by_id = create_ldns_rbtree(result, transaction_id_cmp);
 
+    result->completion_queue = 0;
+    result->defer_callbacks = 0;
+    result->completions = NULL;
+    result->completions_head = 0;
+    result->num_completions = 0;
+    result->completions_alloc = 0;
+    result->submissions = NULL;
+    result->submission_producers = 0;
+    result->watcher = NULL;
+    result->native_stub = 0;
+    result->stub = NULL;
+    result->upstream_health_callback = NULL;
+    result->upstream_health_userarg = NULL;
+    result->hedge_percentile = 0;
+    result->hedge_permille = 0;
+    result->adaptive_timeout_factor = 0;
+    result->udp_pool_size = STUB_SOCKETS;
+    result->udp_rotate_ms = STUB_ROTATE_MS;
+    result->edns_negotiation_max = 0;
+    result->request_qps = 0;
+    result->request_burst = 0;
+    result->request_max_in_flight = 0;
+    result->request_queue_size = 0;
+    result->admission = NULL;
+    result->upstream_qps = 0;
+    result->upstream_burst = 0;
+    result->upstream_max_in_flight = 0;
+    (void) pthread_mutex_init(&result->resolution_lock, NULL);
+    result->unbound_ctx = NULL;
+    result->retired = NULL;
+    result->sync_requests = 0;
+#ifdef HAVE_SYS_EPOLL_H
+    result->ub_poll_fd = epoll_create(1);
+#else
+    result->ub_poll_fd = -1;
+#endif
+    result->use_threads = 0;
+
 
     result->resolution_type = GETDNS_RESOLUTION_RECURSING;
     if(create_default_namespaces(result) != GETDNS_RETURN_GOOD) {
@@ -446,7 +618,7 @@ getdns_context_create_with_extended_memory_functions(
 
     result->timeout = 5000;
     result->follow_redirects = GETDNS_REDIRECTS_FOLLOW;
-    result->dns_root_servers = create_default_root_servers();
+    result->dns_root_servers = tmpl ? NULL : create_default_root_servers();
     result->append_name = GETDNS_APPEND_NAME_ALWAYS;
     result->suffix = NULL;
 
@@ -462,7 +634,7 @@ getdns_context_create_with_extended_memory_functions(
 
 	result->fchg_resolvconf = NULL;
 	result->fchg_hosts      = NULL;
-    if (set_from_os) {
+    if (set_from_os && !tmpl) {
         if (GETDNS_RETURN_GOOD != set_os_defaults(result)) {
             getdns_context_destroy(result);
             return GETDNS_RETURN_GENERIC_ERROR;
@@ -472,16 +644,19 @@ getdns_context_create_with_extended_memory_functions(
     result->edns_maximum_udp_payload_size = 512;
     result->dns_transport = GETDNS_TRANSPORT_UDP_FIRST_AND_FALL_BACK_TO_TCP;
     result->limit_outstanding_queries = 0;
-    result->has_ta = priv_getdns_parse_ta_file(NULL, NULL);
+    /* a clone takes has_ta from tmpl.  Its unbound context still reads
+     * the trust anchor file itself, on the first resolution.
+     */
+    result->has_ta = tmpl ? 0 : priv_getdns_parse_ta_file(NULL, NULL);
     result->return_dnssec_status = GETDNS_EXTENSION_FALSE;
     if (!result->outbound_requests ||
         !result->timeouts_by_id ||
-        !result->timeouts_by_time) {
+        !result->timeouts_by_time ||
+        (tmpl && copy_context_settings(result, tmpl))) {
         getdns_context_destroy(result);
         return GETDNS_RETURN_MEMORY_ERROR;
     }
     /* unbound context is initialized here */
-    result->unbound_ctx = NULL;
     if (GETDNS_RETURN_GOOD != rebuild_ub_ctx(result)) {
         getdns_context_destroy(result);
         return GETDNS_RETURN_GENERIC_ERROR;
@@ -490,8 +665,46 @@ getdns_context_create_with_extended_memory_functions(
     *context = result;
 
     return GETDNS_RETURN_GOOD;
+} /* context_create */
+
+/*
+ * getdns_context_create
+ *
+ * Call this to initialize the context that is used in other getdns calls.
+ */
+getdns_return_t
+getdns_context_create_with_extended_memory_functions(
+    struct getdns_context ** context,
+    int set_from_os,
+    void *userarg,
+    void *(*malloc)(void *userarg, size_t),
+    void *(*realloc)(void *userarg, void *, size_t),
+    void (*free)(void *userarg, void *)
+    )
+{
+    return context_create(context, NULL, set_from_os,
+        userarg, malloc, realloc, free);
 } /* getdns_context_create_with_extended_memory_functions */
 
+/*
+ * getdns_context_clone
+ *
+ * Create a context with the settings of src, using the memory functions
+ * src was created with.  Requests, extension and queues are not copied.
+ */
+getdns_return_t
+getdns_context_clone(struct getdns_context *src, struct getdns_context **dst)
+{
+    RETURN_IF_NULL(src, GETDNS_RETURN_INVALID_PARAMETER);
+    RETURN_IF_NULL(dst, GETDNS_RETURN_INVALID_PARAMETER);
+    if (src->destroying) {
+        return GETDNS_RETURN_BAD_CONTEXT;
+    }
+    return context_create(dst, src, 0, src->my_mf.mf_arg,
+        src->my_mf.mf.ext.malloc, src->my_mf.mf.ext.realloc,
+        src->my_mf.mf.ext.free);
+} /* getdns_context_clone */
+
 /*
  * getdns_context_create
  *
@@ -546,8 +759,13 @@ getdns_context_destroy(struct getdns_context *context)
         return ;
     }
     context->destroying = 1;
+    priv_getdns_watcher_stop(context);
     cancel_outstanding_requests(context, 1);
+    cancel_completions(context);
+    priv_getdns_admission_destroy(context);
+    priv_getdns_stub_destroy(context);
     getdns_extension_detach_eventloop(context);
+    priv_getdns_submissions_destroy(context);
 
     if (context->namespaces)
         GETDNS_FREE(context->my_mf, context->namespaces);
@@ -569,9 +787,14 @@ getdns_context_destroy(struct getdns_context *context)
     getdns_list_destroy(context->dnssec_trust_anchors);
     getdns_list_destroy(context->upstream_list);
 
-    /* destroy the ub context */
+    /* destroy the ub contexts, retired ones have no requests left */
+    (void) pthread_mutex_lock(&context->resolution_lock);
+    reap_retired_ub_ctxs(context);
+    (void) pthread_mutex_unlock(&context->resolution_lock);
     if (context->unbound_ctx)
         ub_ctx_delete(context->unbound_ctx);
+    if (context->ub_poll_fd != -1)
+        close(context->ub_poll_fd);
 
     if (context->outbound_requests)
         GETDNS_FREE(context->my_mf, context->outbound_requests);
@@ -580,6 +803,7 @@ getdns_context_destroy(struct getdns_context *context)
     if (context->timeouts_by_time)
         GETDNS_FREE(context->my_mf, context->timeouts_by_time);
 
+    (void) pthread_mutex_destroy(&context->resolution_lock);
     GETDNS_FREE(context->my_mf, context);
 }               /* getdns_context_destroy */
 
@@ -616,25 +840,108 @@ set_ub_number_opt(struct getdns_context *ctx, char *opt, uint16_t value)
     set_ub_string_opt(ctx, opt, buffer);
 }
 
+static void
+count_ub_ctx_requests(ldns_rbnode_t* node, void* arg) {
+    struct priv_getdns_ub_generation *gen = arg;
+    if (((getdns_dns_req *) node->data)->unbound_ctx == gen->unbound_ctx)
+        gen->outstanding++;
+}
+
+/*
+ * Helper to set aside the current unbound context, with the requests in
+ * flight on it, so a new one can take its place.  The async ones can only
+ * stay when all unbound contexts can be watched with the one fd of the
+ * context, the sync ones always do.  Under the resolution_lock.
+ */
 static getdns_return_t
-rebuild_ub_ctx(struct getdns_context* context) {
-    if (context->unbound_ctx != NULL) {
-        /* cancel all requests and delete */
-        cancel_outstanding_requests(context, 1);
-        ub_ctx_delete(context->unbound_ctx);
-        context->unbound_ctx = NULL;
+retire_ub_ctx(struct getdns_context* context) {
+    struct priv_getdns_ub_generation *gen;
+
+    gen = GETDNS_MALLOC(context->my_mf, struct priv_getdns_ub_generation);
+    if (!gen)
+        return GETDNS_RETURN_MEMORY_ERROR;
+    gen->unbound_ctx = context->unbound_ctx;
+    gen->outstanding = 0;
+    gen->sync_outstanding = context->sync_requests;
+    context->sync_requests = 0;
+    ldns_traverse_postorder(context->outbound_requests,
+        count_ub_ctx_requests, gen);
+    gen->next = context->retired;
+    context->retired = gen;
+    return GETDNS_RETURN_GOOD;
+}
+
+/* a request started on a retired unbound context is done */
+static void
+release_ub_ctx(struct getdns_context* context, getdns_dns_req* req) {
+    struct priv_getdns_ub_generation *gen;
+
+    if (req->unbound_ctx == context->unbound_ctx)
+        return;
+    for (gen = context->retired; gen; gen = gen->next) {
+        if (gen->unbound_ctx == req->unbound_ctx) {
+            gen->outstanding--;
+            return;
+        }
+    }
+}
+
+/*
+ * Delete the retired unbound contexts without requests.  Not from within
+ * ub_process, which may be processing one of them.  Under the
+ * resolution_lock, for the sync requests.
+ */
+static void
+reap_retired_ub_ctxs(struct getdns_context* context) {
+    struct priv_getdns_ub_generation **gen = &context->retired, *done;
+
+    while (*gen) {
+        if ((*gen)->outstanding > 0 || (*gen)->sync_outstanding > 0) {
+            gen = &(*gen)->next;
+            continue;
+        }
+        done = *gen;
+        *gen = done->next;
+#ifdef HAVE_SYS_EPOLL_H
+        (void) epoll_ctl(context->ub_poll_fd, EPOLL_CTL_DEL,
+            ub_fd(done->unbound_ctx), NULL);
+#endif
+        ub_ctx_delete(done->unbound_ctx);
+        GETDNS_FREE(context->my_mf, done);
     }
+}
+
+static getdns_return_t
+setup_ub_ctx(struct getdns_context* context) {
+    /* stub or recursing and the namespaces are set up again */
+    context->resolution_type_set = 0;
     /* setup */
     context->unbound_ctx = ub_ctx_create();
     if (!context->unbound_ctx) {
         return GETDNS_RETURN_MEMORY_ERROR;
     }
+#ifdef HAVE_SYS_EPOLL_H
+    if (context->ub_poll_fd != -1) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = context->unbound_ctx;
+        if (epoll_ctl(context->ub_poll_fd, EPOLL_CTL_ADD,
+            ub_fd(context->unbound_ctx), &ev) != 0) {
+            return GETDNS_RETURN_GENERIC_ERROR;
+        }
+    }
+#endif
     set_ub_dnssec_allowed_skew(context,
         context->dnssec_allowed_skew);
     set_ub_edns_maximum_udp_payload_size(context,
         context->edns_maximum_udp_payload_size);
     set_ub_dns_transport(context,
         context->dns_transport);
+    if (context->limit_outstanding_queries)
+        set_ub_limit_outstanding_queries(context,
+            context->limit_outstanding_queries);
+    if (context->use_threads)
+        (void) ub_ctx_async(context->unbound_ctx, 1);
 
     /* Set default trust anchor */
     if (context->has_ta) {
@@ -644,6 +951,88 @@ rebuild_ub_ctx(struct getdns_context* context) {
     return GETDNS_RETURN_GOOD;
 }
 
+static getdns_return_t
+rebuild_ub_ctx(struct getdns_context* context) {
+    getdns_return_t r = GETDNS_RETURN_GOOD;
+
+    /* async requests in flight cannot be watched on the old one.  Not
+     * under the lock, the callbacks may do sync requests.
+     */
+    if (context->unbound_ctx != NULL && context->ub_poll_fd == -1)
+        cancel_outstanding_requests(context, 1);
+
+    /* sync requests in other threads use or prepare the unbound context */
+    (void) pthread_mutex_lock(&context->resolution_lock);
+    if (context->unbound_ctx != NULL) {
+        /* requests in flight finish on the old one */
+        r = retire_ub_ctx(context);
+        if (r == GETDNS_RETURN_GOOD)
+            context->unbound_ctx = NULL;
+    }
+    if (r == GETDNS_RETURN_GOOD)
+        r = setup_ub_ctx(context);
+    if (context->retired && !context->processing)
+        reap_retired_ub_ctxs(context);
+    (void) pthread_mutex_unlock(&context->resolution_lock);
+    return r;
+}
+
+/*
+ * Helper to make a changed setting take effect once the unbound context
+ * is set up, and can no longer be configured.  New requests go to a new
+ * unbound context.
+ */
+static getdns_return_t
+renew_ub_ctx(struct getdns_context* context) {
+    if (context->resolution_type_set == 0)
+        return GETDNS_RETURN_GOOD;
+    return rebuild_ub_ctx(context) == GETDNS_RETURN_GOOD
+         ? GETDNS_RETURN_GOOD : GETDNS_RETURN_CONTEXT_UPDATE_FAIL;
+}
+
+/*
+ * Take the settings read from changed system files by the watcher, for
+ * the requests that follow.  Only from the thread running the event loop,
+ * a new unbound context is set up and the updated callbacks are called.
+ */
+void
+getdns_context_apply_system_files(struct getdns_context* context) {
+    struct priv_getdns_sysfiles_update *update;
+
+    if (!context->watcher ||
+        !(update = priv_getdns_watcher_take(context->watcher))) {
+        return;
+    }
+    if (update->resolvconf) {
+        struct getdns_list *prev;
+        /* sync requests in other threads read the lists when preparing */
+        (void) pthread_mutex_lock(&context->resolution_lock);
+        /* without nameservers unbound keeps using the old ones */
+        if (update->upstreams) {
+            prev = context->upstream_list;
+            context->upstream_list = update->upstreams;
+            update->upstreams = prev;
+        }
+        prev = context->suffix;
+        context->suffix = update->suffix;
+        update->suffix = prev;
+        (void) filechg_check(context, context->fchg_resolvconf);
+        (void) pthread_mutex_unlock(&context->resolution_lock);
+    }
+    /* unbound reads the hosts file when it is set up again */
+    (void) renew_ub_ctx(context);
+    if (update->resolvconf) {
+        dispatch_updated(context,
+            GETDNS_CONTEXT_CODE_UPSTREAM_RECURSIVE_SERVERS);
+        dispatch_updated(context, GETDNS_CONTEXT_CODE_SUFFIX);
+    }
+    if (update->hosts) {
+        dispatch_updated(context, GETDNS_CONTEXT_CODE_NAMESPACES);
+    }
+    /* with the replaced lists */
+    priv_getdns_sysfiles_update_free(context, update);
+}
+
 /**
  * Helper to dispatch the updated callback
  */
@@ -667,11 +1056,13 @@ getdns_context_set_resolution_type(struct getdns_context *context,
     if (value != GETDNS_RESOLUTION_STUB && value != GETDNS_RESOLUTION_RECURSING) {
         return GETDNS_RETURN_CONTEXT_UPDATE_FAIL;
     }
-    if (context->resolution_type_set != 0) {
-        /* already setup */
-        return GETDNS_RETURN_CONTEXT_UPDATE_FAIL;
+    if (value != context->resolution_type) {
+        context->resolution_type = value;
+        /* in use already, set up on a new unbound context */
+        if (renew_ub_ctx(context) != GETDNS_RETURN_GOOD) {
+            return GETDNS_RETURN_CONTEXT_UPDATE_FAIL;
+        }
     }
-    context->resolution_type = value;
 
     dispatch_updated(context, GETDNS_CONTEXT_CODE_RESOLUTION_TYPE);
 
@@ -692,10 +1083,6 @@ getdns_context_set_namespaces(struct getdns_context *context,
     if (namespace_count == 0 || namespaces == NULL) {
         return GETDNS_RETURN_CONTEXT_UPDATE_FAIL;
     }
-    if (context->resolution_type_set != 0) {
-        return GETDNS_RETURN_CONTEXT_UPDATE_FAIL;
-    }
-
 	for(i=0; i<namespace_count; i++)
 	{
 		if( namespaces[i] != GETDNS_NAMESPACE_DNS
@@ -714,6 +1101,9 @@ getdns_context_set_namespaces(struct getdns_context *context,
     memcpy(context->namespaces, namespaces,
         namespace_count * sizeof(getdns_namespace_t));
 	context->namespace_count = namespace_count;
+    if (renew_ub_ctx(context) != GETDNS_RETURN_GOOD) {
+        return GETDNS_RETURN_CONTEXT_UPDATE_FAIL;
+    }
     dispatch_updated(context, GETDNS_CONTEXT_CODE_NAMESPACES);
 
     return GETDNS_RETURN_GOOD;
@@ -732,11 +1122,13 @@ set_ub_dns_transport(struct getdns_context* context,
             set_ub_string_opt(context, "do-tcp", "no");
             break;
         case GETDNS_TRANSPORT_TCP_ONLY:
+        /* the native stub keeps the connections open, unbound is left
+         * with what it cannot do, over TCP too */
+        case GETDNS_TRANSPORT_TCP_ONLY_KEEP_CONNECTIONS_OPEN:
             set_ub_string_opt(context, "do-udp", "no");
             set_ub_string_opt(context, "do-tcp", "yes");
             break;
         default:
-            /* TODO GETDNS_CONTEXT_TCP_ONLY_KEEP_CONNECTIONS_OPEN */
             return GETDNS_RETURN_CONTEXT_UPDATE_FAIL;
         }
     return GETDNS_RETURN_GOOD;
@@ -755,6 +1147,9 @@ getdns_context_set_dns_transport(struct getdns_context *context,
     }
     if (value != context->dns_transport) {
         context->dns_transport = value;
+        if (renew_ub_ctx(context) != GETDNS_RETURN_GOOD) {
+            return GETDNS_RETURN_CONTEXT_UPDATE_FAIL;
+        }
         dispatch_updated(context, GETDNS_CONTEXT_CODE_DNS_TRANSPORT);
     }
 
@@ -778,6 +1173,9 @@ getdns_context_set_limit_outstanding_queries(struct getdns_context *context,
     set_ub_limit_outstanding_queries(context, limit);
     if (limit != context->limit_outstanding_queries) {
         context->limit_outstanding_queries = limit;
+        if (renew_ub_ctx(context) != GETDNS_RETURN_GOOD) {
+            return GETDNS_RETURN_CONTEXT_UPDATE_FAIL;
+        }
         dispatch_updated(context,
             GETDNS_CONTEXT_CODE_LIMIT_OUTSTANDING_QUERIES);
     }
@@ -966,6 +1364,9 @@ getdns_context_set_dnssec_allowed_skew(struct getdns_context *context,
     set_ub_dnssec_allowed_skew(context, value);
     if (value != context->dnssec_allowed_skew) {
         context->dnssec_allowed_skew = value;
+        if (renew_ub_ctx(context) != GETDNS_RETURN_GOOD) {
+            return GETDNS_RETURN_CONTEXT_UPDATE_FAIL;
+        }
         dispatch_updated(context, GETDNS_CONTEXT_CODE_DNSSEC_ALLOWED_SKEW);
     }
 
@@ -988,10 +1389,6 @@ getdns_context_set_upstream_recursive_servers(struct getdns_context *context,
     if (count == 0 || r != GETDNS_RETURN_GOOD) {
         return GETDNS_RETURN_CONTEXT_UPDATE_FAIL;
     }
-    if (context->resolution_type_set != 0) {
-        /* already setup */
-        return GETDNS_RETURN_CONTEXT_UPDATE_FAIL;
-    }
     struct getdns_list *copy = NULL;
     if (getdns_list_copy(upstream_list, &copy) != GETDNS_RETURN_GOOD) {
         return GETDNS_RETURN_CONTEXT_UPDATE_FAIL;
@@ -1014,6 +1411,9 @@ getdns_context_set_upstream_recursive_servers(struct getdns_context *context,
 
     getdns_list_destroy(context->upstream_list);
     context->upstream_list = upstream_list;
+    if (renew_ub_ctx(context) != GETDNS_RETURN_GOOD) {
+        return GETDNS_RETURN_CONTEXT_UPDATE_FAIL;
+    }
 
     dispatch_updated(context,
         GETDNS_CONTEXT_CODE_UPSTREAM_RECURSIVE_SERVERS);
@@ -1044,6 +1444,9 @@ getdns_context_set_edns_maximum_udp_payload_size(struct getdns_context *context,
     set_ub_edns_maximum_udp_payload_size(context, value);
     if (value != context->edns_maximum_udp_payload_size) {
         context->edns_maximum_udp_payload_size = value;
+        if (renew_ub_ctx(context) != GETDNS_RETURN_GOOD) {
+            return GETDNS_RETURN_CONTEXT_UPDATE_FAIL;
+        }
         dispatch_updated(context,
             GETDNS_CONTEXT_CODE_EDNS_MAXIMUM_UDP_PAYLOAD_SIZE);
     }
@@ -1157,7 +1560,10 @@ cancel_dns_req(getdns_dns_req * req)
         if (netreq->state == NET_REQ_IN_FLIGHT) {
             /* for ev based ub, this should always prevent
              * the callback from firing */
-            ub_cancel(req->context->unbound_ctx, netreq->unbound_id);
+            if (netreq->stub)
+                priv_getdns_stub_cancel(netreq);
+            else
+                ub_cancel(req->unbound_ctx, netreq->unbound_id);
             netreq->state = NET_REQ_CANCELED;
         } else if (netreq->state == NET_REQ_NOT_SENT) {
             netreq->state = NET_REQ_CANCELED;
@@ -1182,6 +1588,8 @@ getdns_context_cancel_request(struct getdns_context *context,
         return GETDNS_RETURN_UNKNOWN_TRANSACTION;
     }
     req = (getdns_dns_req *) node->data;
+    release_ub_ctx(context, req);
+    priv_getdns_admission_done(req);
     /* do the cancel */
 
     cancel_dns_req(req);
@@ -1194,9 +1602,14 @@ getdns_context_cancel_request(struct getdns_context *context,
         user_pointer = req->user_pointer;
 
         /* fire callback */
-        cb(context,
-            GETDNS_CALLBACK_CANCEL,
-            NULL, user_pointer, transaction_id);
+        /* without one for the completion queue, which may be disabled */
+        if (getdns_context_defer_callback(context, cb, GETDNS_CALLBACK_CANCEL,
+            NULL, user_pointer, transaction_id) != GETDNS_RETURN_GOOD &&
+            cb) {
+            cb(context,
+                GETDNS_CALLBACK_CANCEL,
+                NULL, user_pointer, transaction_id);
+        }
     }
     /* clean up */
     GETDNS_FREE(context->my_mf, node);
@@ -1315,12 +1728,20 @@ ub_setup_stub(struct ub_ctx *ctx, struct getdns_list * upstreams)
 static getdns_return_t
 priv_getdns_ns_dns_setup(struct getdns_context *context)
 {
+	getdns_return_t r;
+
 	assert(context);
 
 	switch (context->resolution_type) {
 	case GETDNS_RESOLUTION_STUB:
-		return ub_setup_stub(context->unbound_ctx,
+		r = ub_setup_stub(context->unbound_ctx,
 		    context->upstream_list);
+		/* without it unbound resolves all requests */
+		if (r == GETDNS_RETURN_GOOD && (context->native_stub ||
+		    context->dns_transport ==
+		    GETDNS_TRANSPORT_TCP_ONLY_KEEP_CONNECTIONS_OPEN))
+			(void) priv_getdns_stub_setup(context);
+		return r;
 
 	case GETDNS_RESOLUTION_RECURSING:
 		/* TODO: use the root servers via root hints file */
@@ -1330,8 +1751,8 @@ priv_getdns_ns_dns_setup(struct getdns_context *context)
 	return GETDNS_RETURN_BAD_CONTEXT;
 }
 
-getdns_return_t
-getdns_context_prepare_for_resolution(struct getdns_context *context,
+static getdns_return_t
+prepare_for_resolution(struct getdns_context *context,
     int usenamespaces)
 {
 	int i;
@@ -1380,8 +1801,59 @@ getdns_context_prepare_for_resolution(struct getdns_context *context,
 	}
 	context->resolution_type_set = context->resolution_type;
 	return r;
+} /* prepare_for_resolution */
+
+getdns_return_t
+getdns_context_prepare_for_resolution(struct getdns_context *context,
+    int usenamespaces)
+{
+	getdns_return_t r;
+
+	RETURN_IF_NULL(context, GETDNS_RETURN_INVALID_PARAMETER);
+	(void) pthread_mutex_lock(&context->resolution_lock);
+	r = prepare_for_resolution(context, usenamespaces);
+	(void) pthread_mutex_unlock(&context->resolution_lock);
+	return r;
 } /* getdns_context_prepare_for_resolution */
 
+getdns_return_t
+getdns_context_prepare_sync(getdns_dns_req *req, int usenamespaces)
+{
+	struct getdns_context *context;
+	getdns_return_t r;
+
+	RETURN_IF_NULL(req, GETDNS_RETURN_INVALID_PARAMETER);
+	context = req->context;
+	/* prepared and counted at once, so it is not replaced in between */
+	(void) pthread_mutex_lock(&context->resolution_lock);
+	r = prepare_for_resolution(context, usenamespaces);
+	if (r == GETDNS_RETURN_GOOD) {
+		req->unbound_ctx = context->unbound_ctx;
+		context->sync_requests++;
+	}
+	(void) pthread_mutex_unlock(&context->resolution_lock);
+	return r;
+} /* getdns_context_prepare_sync */
+
+void
+getdns_context_release_sync(getdns_dns_req *req)
+{
+	struct getdns_context *context = req->context;
+	struct priv_getdns_ub_generation *gen;
+
+	(void) pthread_mutex_lock(&context->resolution_lock);
+	if (req->unbound_ctx == context->unbound_ctx)
+		context->sync_requests--;
+	else for (gen = context->retired; gen; gen = gen->next) {
+		/* deleted by the event loop thread when it was the last */
+		if (gen->unbound_ctx == req->unbound_ctx) {
+			gen->sync_outstanding--;
+			break;
+		}
+	}
+	(void) pthread_mutex_unlock(&context->resolution_lock);
+} /* getdns_context_release_sync */
+
 getdns_return_t
 getdns_context_track_outbound_request(getdns_dns_req * req)
 {
@@ -1389,6 +1861,16 @@ getdns_context_track_outbound_request(getdns_dns_req * req)
         return GETDNS_RETURN_GENERIC_ERROR;
     }
     struct getdns_context *context = req->context;
+    getdns_transaction_t tries;
+    /* the random 16 bit transaction id may be that of a request in flight,
+     * the next free one is taken then */
+    for (tries = 0; ldns_rbtree_search(context->outbound_requests,
+        &(req->trans_id)); tries++) {
+        if (tries == 0xffff) {
+            return GETDNS_RETURN_GENERIC_ERROR;
+        }
+        req->trans_id = (req->trans_id + 1) & 0xffff;
+    }
     ldns_rbnode_t *node = GETDNS_MALLOC(context->my_mf, ldns_rbnode_t);
     if (!node) {
         return GETDNS_RETURN_GENERIC_ERROR;
@@ -1417,6 +1899,8 @@ getdns_context_clear_outbound_request(getdns_dns_req * req)
     ldns_rbnode_t *node = ldns_rbtree_delete(context->outbound_requests,
         &(req->trans_id));
     if (node) {
+        release_ub_ctx(context, req);
+        priv_getdns_admission_done(req);
         GETDNS_FREE(context->my_mf, node);
     }
     return GETDNS_RETURN_GOOD;
@@ -1432,9 +1916,12 @@ getdns_context_request_timed_out(struct getdns_dns_req
 
     /* cancel the req - also clears it from outbound and cleans up*/
     getdns_context_cancel_request(context, trans_id, 0);
-    context->processing = 1;
-    cb(context, GETDNS_CALLBACK_TIMEOUT, NULL, user_arg, trans_id);
-    context->processing = 0;
+    if (getdns_context_defer_callback(context, cb, GETDNS_CALLBACK_TIMEOUT,
+        NULL, user_arg, trans_id) != GETDNS_RETURN_GOOD && cb) {
+        context->processing = 1;
+        cb(context, GETDNS_CALLBACK_TIMEOUT, NULL, user_arg, trans_id);
+        context->processing = 0;
+    }
     if (context->extension) {
         context->extension->request_count_changed(context,
             context->outbound_requests->count, context->extension_data);
@@ -1453,6 +1940,16 @@ getdns_strdup(const struct mem_funcs *mfs, const char *s)
         return NULL;
 }
 
+/*
+ * The data of a copied bindata is stored directly behind the header, so
+ * that a copy is a single allocation.  Most bindatas are small (addresses,
+ * type strings and names) which makes the extra allocation and the pointer
+ * chase when walking a response relatively expensive.
+ * A bindata of which the data is not stored inline is a reference to
+ * memory owned by someone else (see getdns_bindata_borrow).
+ */
+#define BINDATA_INLINE_DATA(b) ((uint8_t *)((struct getdns_bindata *)(b) + 1))
+
 struct getdns_bindata *
 getdns_bindata_copy(struct mem_funcs *mfs,
     const struct getdns_bindata *src)
@@ -1462,17 +1959,29 @@ getdns_bindata_copy(struct mem_funcs *mfs,
     if (!src)
         return NULL;
 
-    dst = GETDNS_MALLOC(*mfs, struct getdns_bindata);
+    dst = (struct getdns_bindata *)GETDNS_XMALLOC(*mfs, uint8_t,
+        sizeof(struct getdns_bindata) + src->size);
     if (!dst)
         return NULL;
 
     dst->size = src->size;
-    dst->data = GETDNS_XMALLOC(*mfs, uint8_t, src->size);
-    if (!dst->data) {
-        GETDNS_FREE(*mfs, dst);
+    dst->data = BINDATA_INLINE_DATA(dst);
+    if (src->size)
+        (void) memcpy(dst->data, src->data, src->size);
+    return dst;
+}
+
+struct getdns_bindata *
+getdns_bindata_borrow(struct mem_funcs *mfs, size_t size, uint8_t *data)
+{
+    struct getdns_bindata *dst;
+
+    dst = GETDNS_MALLOC(*mfs, struct getdns_bindata);
+    if (!dst)
         return NULL;
-    }
-    (void) memcpy(dst->data, src->data, src->size);
+
+    dst->size = size;
+    dst->data = data;
     return dst;
 }
 
@@ -1482,13 +1991,16 @@ getdns_bindata_destroy(struct mem_funcs *mfs,
 {
     if (!bindata)
         return;
-    GETDNS_FREE(*mfs, bindata->data);
+    /* the data is either inline or not ours */
     GETDNS_FREE(*mfs, bindata);
 }
 
 /* get the fd */
 int getdns_context_fd(struct getdns_context* context) {
     RETURN_IF_NULL(context, -1);
+    /* stays the same when the unbound context is renewed */
+    if (context->ub_poll_fd != -1)
+        return context->ub_poll_fd;
     return ub_fd(context->unbound_ctx);
 }
 
@@ -1497,7 +2009,14 @@ getdns_context_get_num_pending_requests(struct getdns_context* context,
     struct timeval* next_timeout) {
     RETURN_IF_NULL(context, GETDNS_RETURN_INVALID_PARAMETER);
     uint32_t r = context->outbound_requests->count;
-    if (r > 0) {
+    if (context->num_completions > 0) {
+        /* callbacks waiting to be delivered, or completions to be polled */
+        r += context->num_completions;
+        if (next_timeout && !context->completion_queue) {
+            next_timeout->tv_sec = 0;
+            next_timeout->tv_usec = 0;
+        }
+    } else if (r > 0) {
         if (!context->extension && next_timeout) {
             /* default is 1 second */
             next_timeout->tv_sec = 1;
@@ -1515,7 +2034,7 @@ getdns_context_get_num_pending_requests(struct getdns_context* context,
                         next_timeout->tv_sec = timeout_data->timeout_time.tv_sec - now.tv_sec;
                         if (timeout_data->timeout_time.tv_usec < now.tv_usec) {
                             /* we only enter this condition when timeout_data.tv_sec > now.tv_sec */
-                            next_timeout->tv_usec = (timeout_data->timeout_time.tv_usec + 100000) - now.tv_usec;
+                            next_timeout->tv_usec = (timeout_data->timeout_time.tv_usec + 1000000) - now.tv_usec;
                             next_timeout->tv_sec--;
                         } else {
                             next_timeout->tv_usec = timeout_data->timeout_time.tv_usec - now.tv_usec;
@@ -1532,56 +2051,286 @@ getdns_context_get_num_pending_requests(struct getdns_context* context,
     return r;
 }
 
-/* process async reqs */
-getdns_return_t getdns_context_process_async(struct getdns_context* context) {
-    RETURN_IF_NULL(context, GETDNS_RETURN_INVALID_PARAMETER);
-    context->processing = 1;
-    if (ub_poll(context->unbound_ctx)) {
-        if (ub_process(context->unbound_ctx) != 0) {
-            /* need an async return code? */
-            context->processing = 0;
-            return GETDNS_RETURN_GENERIC_ERROR;
-        }
+/* limits of a getdns_context_process_async_budget call */
+struct process_budget {
+    uint32_t max_callbacks;
+    uint32_t delivered;
+    uint32_t max_usecs;
+    struct timeval start;
+};
+
+static int
+budget_left(struct process_budget* budget) {
+    struct timeval now;
+    if (!budget) {
+        return 1;
     }
-    // reset the processing flag
-    context->processing = 0;
-    if (context->extension != NULL) {
-        /* no need to process timeouts since it is delegated
-         * to the extension */
-        return GETDNS_RETURN_GOOD;
+    if (budget->max_callbacks && budget->delivered >= budget->max_callbacks) {
+        return 0;
     }
-    getdns_timeout_data_t key;
-    /* set to 0 so it is the last timeout if we have
-     * two with the same time */
-    key.transaction_id = 0;
-    if (gettimeofday(&key.timeout_time, NULL) != 0) {
+    if (budget->max_usecs && gettimeofday(&now, NULL) == 0 &&
+        (now.tv_sec - budget->start.tv_sec) * 1000000LL +
+        (now.tv_usec - budget->start.tv_usec) >= budget->max_usecs) {
+        return 0;
+    }
+    return 1;
+}
+
+getdns_return_t
+getdns_context_defer_callback(struct getdns_context *context,
+    getdns_callback_t callback, getdns_callback_type_t callback_type,
+    struct getdns_dict *response, void *userarg,
+    getdns_transaction_t transaction_id) {
+    struct getdns_queued_completion* queued;
+    if (!context->defer_callbacks && !context->completion_queue) {
         return GETDNS_RETURN_GENERIC_ERROR;
     }
-    ldns_rbnode_t* next_timeout = ldns_rbtree_first(context->timeouts_by_time);
-    getdns_return_t r = GETDNS_RETURN_GOOD;
-    while (next_timeout && r == GETDNS_RETURN_GOOD) {
-        getdns_timeout_data_t* timeout_data = (getdns_timeout_data_t*) next_timeout->data;
-        if (timeout_cmp(timeout_data, &key) > 0) {
-            /* no more timeouts need to be fired. */
-            break;
+    if (callback == priv_getdns_submission_callback) {
+        /* only hands the completion to the submitting thread's queue */
+        return GETDNS_RETURN_GENERIC_ERROR;
+    }
+    if (context->num_completions == context->completions_alloc) {
+        /* grow the ring, unwrapping it into the new array */
+        uint32_t alloc = context->completions_alloc ?
+            context->completions_alloc * 2 : 16;
+        uint32_t i;
+        queued = GETDNS_XMALLOC(context->my_mf,
+            struct getdns_queued_completion, alloc);
+        if (!queued) {
+            return GETDNS_RETURN_MEMORY_ERROR;
         }
-        /* get the next_timeout */
-        next_timeout = ldns_rbtree_next(next_timeout);
-        /* delete the node */
-        /* timeout data and the timeouts_by_id node are freed in the clear_timeout */
-        ldns_rbnode_t* to_del = ldns_rbtree_delete(context->timeouts_by_time, timeout_data);
-        if (to_del) {
-            /* should always exist .. */
-            GETDNS_FREE(context->my_mf, to_del);
+        for (i = 0; i < context->num_completions; i++) {
+            queued[i] = context->completions[
+                (context->completions_head + i) % context->completions_alloc];
+        }
+        GETDNS_FREE(context->my_mf, context->completions);
+        context->completions = queued;
+        context->completions_head = 0;
+        context->completions_alloc = alloc;
+    }
+    queued = &context->completions[(context->completions_head +
+        context->num_completions) % context->completions_alloc];
+    queued->callback = callback;
+    queued->completion.transaction_id = transaction_id;
+    queued->completion.callback_type = callback_type;
+    queued->completion.response = response;
+    queued->completion.userarg = userarg;
+    context->num_completions++;
+    return GETDNS_RETURN_GOOD;
+}
+
+static int
+pop_completion(struct getdns_context* context,
+    struct getdns_queued_completion* queued) {
+    if (context->num_completions == 0) {
+        return 0;
+    }
+    *queued = context->completions[context->completions_head];
+    context->completions_head =
+        (context->completions_head + 1) % context->completions_alloc;
+    context->num_completions--;
+    return 1;
+}
+
+/* deliver the queued callbacks within the budget */
+static void
+deliver_completions(struct getdns_context* context,
+    struct process_budget* budget) {
+    struct getdns_queued_completion queued;
+    if (context->completion_queue) {
+        /* left for getdns_context_poll_completions */
+        return;
+    }
+    while (context->num_completions > 0 && budget_left(budget)) {
+        (void) pop_completion(context, &queued);
+        if (!queued.callback) {
+            /* queued before the completion queue was disabled */
+            getdns_dict_destroy(queued.completion.response);
+            continue;
         }
+        if (budget) {
+            budget->delivered++;
+        }
+        context->processing = 1;
+        queued.callback(context, queued.completion.callback_type,
+            queued.completion.response, queued.completion.userarg,
+            queued.completion.transaction_id);
+        context->processing = 0;
+    }
+}
 
-        /* fire the timeout */
-        r = timeout_data->callback(timeout_data->userarg);
+/* the queued callbacks are canceled when the context is destroyed */
+static void
+cancel_completions(struct getdns_context* context) {
+    struct getdns_queued_completion queued;
+    while (pop_completion(context, &queued)) {
+        getdns_dict_destroy(queued.completion.response);
+        if (queued.callback && !context->completion_queue) {
+            queued.callback(context, GETDNS_CALLBACK_CANCEL, NULL,
+                queued.completion.userarg,
+                queued.completion.transaction_id);
+        }
     }
+    GETDNS_FREE(context->my_mf, context->completions);
+    context->completions = NULL;
+    context->completions_alloc = 0;
+}
 
+getdns_return_t
+getdns_context_set_completion_queue(struct getdns_context* context,
+    int enabled) {
+    RETURN_IF_NULL(context, GETDNS_RETURN_INVALID_PARAMETER);
+    context->completion_queue = enabled ? 1 : 0;
+    return GETDNS_RETURN_GOOD;
+}
+
+getdns_return_t
+getdns_context_poll_completions(struct getdns_context* context,
+    getdns_completion_t* completions, size_t max, size_t* count) {
+    RETURN_IF_NULL(context, GETDNS_RETURN_INVALID_PARAMETER);
+    RETURN_IF_NULL(count, GETDNS_RETURN_INVALID_PARAMETER);
+    struct getdns_queued_completion queued;
+    if (max && !completions) {
+        return GETDNS_RETURN_INVALID_PARAMETER;
+    }
+    *count = 0;
+    while (*count < max && pop_completion(context, &queued)) {
+        completions[(*count)++] = queued.completion;
+    }
+    return GETDNS_RETURN_GOOD;
+}
+
+/* first timeout when it has expired, NULL otherwise */
+static getdns_timeout_data_t*
+expired_timeout(struct getdns_context* context, getdns_timeout_data_t* key) {
+    ldns_rbnode_t* first = ldns_rbtree_first(context->timeouts_by_time);
+    if (first == LDNS_RBTREE_NULL) {
+        return NULL;
+    }
+    getdns_timeout_data_t* timeout_data = (getdns_timeout_data_t*) first->data;
+    return timeout_cmp(timeout_data, key) > 0 ? NULL : timeout_data;
+}
+
+/* answers are waiting on the current or a retired unbound context */
+static int
+ub_ctxs_poll(struct getdns_context* context) {
+    struct priv_getdns_ub_generation *gen;
+
+    if (ub_poll(context->unbound_ctx))
+        return 1;
+    for (gen = context->retired; gen; gen = gen->next)
+        if (ub_poll(gen->unbound_ctx))
+            return 1;
+    return 0;
+}
+
+static int
+ub_ctxs_process(struct getdns_context* context) {
+    struct priv_getdns_ub_generation *gen;
+    int r = 0;
+
+    /* retired ones first, callbacks may retire the current one.  They are
+     * not deleted while in this loop, only added to the front.
+     */
+    for (gen = context->retired; gen; gen = gen->next)
+        if (ub_poll(gen->unbound_ctx) && ub_process(gen->unbound_ctx) != 0)
+            r = -1;
+    if (ub_poll(context->unbound_ctx) && ub_process(context->unbound_ctx) != 0)
+        r = -1;
     return r;
 }
 
+static getdns_return_t
+process_async(struct getdns_context* context, struct process_budget* budget,
+    int* work_remaining) {
+    getdns_timeout_data_t key;
+    getdns_timeout_data_t* timeout_data;
+    getdns_return_t r = GETDNS_RETURN_GOOD;
+
+    /* start the requests submitted from other threads */
+    priv_getdns_submissions_drain(context);
+    /* changed system files, only an atomic load when there are none */
+    getdns_context_apply_system_files(context);
+    /* callbacks left over from the previous call go first */
+    deliver_completions(context, budget);
+    if (budget_left(budget) && (context->stub || ub_ctxs_poll(context))) {
+        context->processing = 1;
+        context->defer_callbacks = budget != NULL;
+        /* answers to the native stub are read right away */
+        if (context->stub)
+            priv_getdns_stub_read(context->stub);
+        if (ub_ctxs_process(context) != 0) {
+            /* need an async return code? */
+            r = GETDNS_RETURN_GENERIC_ERROR;
+        }
+        context->defer_callbacks = 0;
+        // reset the processing flag
+        context->processing = 0;
+        deliver_completions(context, budget);
+    }
+    /* send the queries of the requests started meanwhile together */
+    if (context->stub) {
+        priv_getdns_stub_flush(context->stub);
+    }
+    if (context->retired && !context->processing) {
+        (void) pthread_mutex_lock(&context->resolution_lock);
+        reap_retired_ub_ctxs(context);
+        (void) pthread_mutex_unlock(&context->resolution_lock);
+    }
+    /* with an extension processing timeouts is delegated to it */
+    if (r == GETDNS_RETURN_GOOD && context->extension == NULL) {
+        /* set to 0 so it is the last timeout if we have
+         * two with the same time */
+        key.transaction_id = 0;
+        if (gettimeofday(&key.timeout_time, NULL) != 0) {
+            return GETDNS_RETURN_GENERIC_ERROR;
+        }
+        while (r == GETDNS_RETURN_GOOD && budget_left(budget) &&
+               (timeout_data = expired_timeout(context, &key))) {
+            /* delete the node */
+            /* timeout data and the timeouts_by_id node are freed in the clear_timeout */
+            ldns_rbnode_t* to_del = ldns_rbtree_delete(context->timeouts_by_time, timeout_data);
+            if (to_del) {
+                /* should always exist .. */
+                GETDNS_FREE(context->my_mf, to_del);
+            }
+            if (budget) {
+                budget->delivered++;
+            }
+            /* fire the timeout */
+            r = timeout_data->callback(timeout_data->userarg);
+        }
+    }
+    if (work_remaining) {
+        /* everything is done unless the budget ran out */
+        *work_remaining = r == GETDNS_RETURN_GOOD && !budget_left(budget) &&
+            ((!context->completion_queue && context->num_completions > 0) ||
+             ub_ctxs_poll(context) ||
+             (context->extension == NULL && expired_timeout(context, &key)));
+    }
+    return r;
+}
+
+/* process async reqs */
+getdns_return_t getdns_context_process_async(struct getdns_context* context) {
+    RETURN_IF_NULL(context, GETDNS_RETURN_INVALID_PARAMETER);
+    return process_async(context, NULL, NULL);
+}
+
+getdns_return_t
+getdns_context_process_async_budget(struct getdns_context* context,
+    uint32_t max_callbacks, uint32_t max_usecs, int* work_remaining) {
+    RETURN_IF_NULL(context, GETDNS_RETURN_INVALID_PARAMETER);
+    struct process_budget budget;
+    budget.max_callbacks = max_callbacks;
+    budget.delivered = 0;
+    budget.max_usecs = max_usecs;
+    if (max_usecs && gettimeofday(&budget.start, NULL) != 0) {
+        budget.max_usecs = 0;
+    }
+    return process_async(context, &budget, work_remaining);
+}
+
 typedef struct timeout_accumulator {
     getdns_transaction_t* ids;
     int idx;
@@ -1625,6 +2374,9 @@ getdns_extension_detach_eventloop(struct getdns_context* context)
 		context->processing = 1;
 		/* cancel all outstanding requests */
 		cancel_outstanding_requests(context, 1);
+		/* and clear the timeout that sends the stub queries */
+		if (context->stub)
+			priv_getdns_stub_flush(context->stub);
 		r = context->extension->cleanup_data(context,
 		    context->extension_data);
 		if (r == GETDNS_RETURN_GOOD) {
@@ -1648,6 +2400,12 @@ getdns_extension_set_eventloop(struct getdns_context* context,
     }
     context->extension = extension;
     context->extension_data = extension_data;
+    if (context->submissions) {
+        /* have the submission fd watched right away */
+        extension->request_count_changed(context,
+            getdns_context_get_num_pending_requests(context, NULL),
+            extension_data);
+    }
     return GETDNS_RETURN_GOOD;
 }
 
@@ -1788,7 +2546,8 @@ priv_get_context_settings(getdns_context* context) {
     if (context->namespace_count > 0) {
         /* create a namespace list */
         size_t i;
-        getdns_list* namespaces = getdns_list_create_with_context(context);
+        getdns_list* namespaces = getdns_list_create_with_capacity(context,
+            context->namespace_count);
         if (namespaces) {
             for (i = 0; i < context->namespace_count; ++i) {
                 r |= getdns_list_set_int(namespaces, i, context->namespaces[i]);
@@ -1808,6 +2567,7 @@ getdns_context_get_api_information(getdns_context* context) {
     getdns_return_t r = GETDNS_RETURN_GOOD;
     getdns_dict* result = getdns_dict_create_with_context(context);
     getdns_dict* settings;
+    getdns_list* upstream_stats;
     if (!result) {
         return NULL;
     }
@@ -1817,6 +2577,13 @@ getdns_context_get_api_information(getdns_context* context) {
     settings = priv_get_context_settings(context);
     r |= getdns_dict_set_dict(result, "all_context", settings);
     getdns_dict_destroy(settings);
+    /* of the upstreams the native stub selects from */
+    upstream_stats = priv_getdns_stub_upstream_stats(context);
+    if (upstream_stats) {
+        r |= getdns_dict_set_list(result, "upstream_stats", upstream_stats);
+        getdns_list_destroy(upstream_stats);
+    }
+    r |= priv_getdns_admission_stats(context, result);
     if (r != GETDNS_RETURN_GOOD) {
         getdns_dict_destroy(result);
         result = NULL;
@@ -1847,6 +2614,8 @@ getdns_context_set_use_threads(getdns_context* context, int use_threads) {
         r = ub_ctx_async(context->unbound_ctx, 1);
     else
         r = ub_ctx_async(context->unbound_ctx, 0);
+    if (r == 0)
+        context->use_threads = use_threads != 0;
     return r == 0 ? GETDNS_RETURN_GOOD : GETDNS_RETURN_CONTEXT_UPDATE_FAIL;
 }
 
@@ -37,6 +37,7 @@
 #ifndef _GETDNS_CONTEXT_H_
 #define _GETDNS_CONTEXT_H_
 
+#include <pthread.h>
 #include <getdns/getdns.h>
 #include <getdns/getdns_extra.h>
 #include "types-internal.h"
@@ -44,6 +45,10 @@
 struct getdns_dns_req;
 struct ldns_rbtree_t;
 struct ub_ctx;
+struct priv_getdns_submissions;
+struct priv_getdns_watcher;
+struct priv_getdns_stub;
+struct priv_getdns_admission;
 
 #define GETDNS_FN_RESOLVCONF "/etc/resolv.conf"
 #define GETDNS_FN_HOSTS      "/etc/hosts"
@@ -58,6 +63,12 @@ enum filechgs { GETDNS_FCHG_ERRORS = -1
 typedef void (*getdns_update_callback) (struct getdns_context *,
     getdns_context_code_t);
 
+/* a completed request of which the callback is not yet delivered */
+struct getdns_queued_completion {
+	getdns_callback_t   callback;
+	getdns_completion_t completion;
+};
+
 /* internal use only for detecting changes to system files */
 struct filechg {
 	char *fn;
@@ -66,6 +77,16 @@ struct filechg {
 	struct stat *prevstat;
 };
 
+/* an unbound context replaced after reconfiguration, deleted once the
+   requests started on it are done */
+struct priv_getdns_ub_generation {
+	struct priv_getdns_ub_generation *next;
+	struct ub_ctx *unbound_ctx;
+	size_t outstanding;
+	/* sync requests resolving on it, under the resolution_lock */
+	size_t sync_outstanding;
+};
+
 struct getdns_context {
 
 	/* Context values */
@@ -99,6 +120,42 @@ struct getdns_context {
 	/* The underlying unbound contexts that do
 	 * the real work */
 	struct ub_ctx *unbound_ctx;
+	/* previous unbound contexts with requests still in flight */
+	struct priv_getdns_ub_generation *retired;
+	/* sync requests on the current one, under the resolution_lock */
+	size_t sync_requests;
+	/* epoll fd on the fds of all of them, or -1 when unavailable */
+	int ub_poll_fd;
+	int use_threads;
+	/* stub resolution with the native stub, when it can, see stub.h */
+	int native_stub;
+	struct priv_getdns_stub *stub;
+	/* told when an upstream of the native stub goes down or comes back */
+	getdns_upstream_health_callback upstream_health_callback;
+	void *upstream_health_userarg;
+	/* hedged queries of the native stub, off when hedge_percentile is 0 */
+	uint8_t hedge_percentile;
+	uint16_t hedge_permille;
+	/* retry deadlines of the native stub at this many times the 99th
+	 * percentile round trip time, fixed when 0 */
+	uint8_t adaptive_timeout_factor;
+	/* UDP sockets per address family of the native stub, and how often
+	 * one of them is replaced (never when 0) */
+	uint16_t udp_pool_size;
+	uint16_t udp_rotate_ms;
+	/* the largest EDNS payload size the native stub negotiates with its
+	 * upstreams, edns_maximum_udp_payload_size is used when 0 */
+	uint16_t edns_negotiation_max;
+	/* admission control of the asynchronous requests, see admission.h,
+	 * and the limits of the native stub per upstream, off when 0 */
+	uint32_t request_qps;
+	uint32_t request_burst;
+	uint32_t request_max_in_flight;
+	uint32_t request_queue_size;
+	struct priv_getdns_admission *admission;
+	uint32_t upstream_qps;
+	uint32_t upstream_burst;
+	uint32_t upstream_max_in_flight;
 	int has_ta; /* No DNSSEC without trust anchor */
     int return_dnssec_status;
 
@@ -106,6 +163,8 @@ struct getdns_context {
 	 * 0 means nothing set
 	 */
 	getdns_resolution_t resolution_type_set;
+	/* the sync functions can be called from many threads at once */
+	pthread_mutex_t resolution_lock;
 
 	/*
 	 * outbound requests -> transaction to getdns_dns_req
@@ -132,6 +191,28 @@ struct getdns_context {
     struct ldns_rbtree_t *timeouts_by_id;
     struct ldns_rbtree_t *timeouts_by_time;
 
+    /*
+     * Completed requests, in order of completion, in a ring.  With the
+     * completion queue enabled they are left for
+     * getdns_context_poll_completions.  Otherwise callbacks are queued
+     * only while processing with a budget, and delivered within it.
+     */
+    int completion_queue;
+    int defer_callbacks;
+    struct getdns_queued_completion *completions;
+    uint32_t completions_head;
+    uint32_t num_completions;
+    uint32_t completions_alloc;
+
+    /* requests submitted from other threads, NULL when not enabled.
+       Published and retired atomically, producers read it while they
+       are counted in submission_producers */
+    struct priv_getdns_submissions *submissions;
+    int submission_producers;
+
+    /* follows the system files, NULL when not enabled */
+    struct priv_getdns_watcher *watcher;
+
 	/*
 	 * state data used to detect changes to the system config files
 	 */
@@ -151,6 +232,16 @@ struct getdns_context {
 getdns_return_t getdns_context_prepare_for_resolution(struct getdns_context *context,
  int usenamespaces);
 
+/* prepare for a sync request, and have it resolve on the unbound context
+   of the moment, which is kept until getdns_context_release_sync */
+getdns_return_t getdns_context_prepare_sync(struct getdns_dns_req *req,
+    int usenamespaces);
+void getdns_context_release_sync(struct getdns_dns_req *req);
+
+/* take the settings the watcher read from changed system files, from the
+   thread running the event loop only */
+void getdns_context_apply_system_files(struct getdns_context *context);
+
 /* track an outbound request */
 getdns_return_t getdns_context_track_outbound_request(struct getdns_dns_req
     *req);
@@ -161,6 +252,15 @@ getdns_return_t getdns_context_clear_outbound_request(struct getdns_dns_req
 getdns_return_t getdns_context_request_timed_out(struct getdns_dns_req
     *req);
 
+/* queue the callback of a completed request when callbacks are deferred or
+   the completion queue is enabled.
+   Returns GETDNS_RETURN_GOOD when queued, the caller has to deliver the
+   callback itself otherwise */
+getdns_return_t getdns_context_defer_callback(struct getdns_context *context,
+    getdns_callback_t callback, getdns_callback_type_t callback_type,
+    struct getdns_dict *response, void *userarg,
+    getdns_transaction_t transaction_id);
+
 /* cancel callback internal - flag to indicate if req should be freed and callback fired */
 getdns_return_t getdns_context_cancel_request(struct getdns_context *context,
     getdns_transaction_t transaction_id, int fire_callback);
@@ -171,11 +271,23 @@ struct getdns_bindata *getdns_bindata_copy(
     struct mem_funcs *mfs,
     const struct getdns_bindata *src);
 
+/* a bindata referring to data without copying it.  data must outlive
+   the bindata */
+struct getdns_bindata *getdns_bindata_borrow(
+    struct mem_funcs *mfs, size_t size, uint8_t *data);
+
 void getdns_bindata_destroy(
     struct mem_funcs *mfs,
     struct getdns_bindata *bindata);
 
 /* timeout scheduling */
+/* Timeouts are keyed by id.  Requests, and their local timeouts, use random
+ * 16 bit ids.  Other timeouts take ids above those from ranges of their
+ * own, so that none of them collide: admission one id, and the native
+ * stub ids counting up from GETDNS_TIMEOUT_ID_STUB */
+#define GETDNS_TIMEOUT_ID_ADMISSION ((getdns_transaction_t)1 << 62)
+#define GETDNS_TIMEOUT_ID_STUB      ((getdns_transaction_t)1 << 63)
+
 getdns_return_t getdns_context_schedule_timeout(struct getdns_context* context,
     getdns_transaction_t id, uint16_t timeout, getdns_timeout_callback callback,
     void* userarg);
@@ -185,4 +297,9 @@ getdns_return_t getdns_context_clear_timeout(struct getdns_context* context,
 
 int filechg_check(struct getdns_context *context, struct filechg *fchg);
 
+/* read the nameservers and search list from resolv.conf, each NULL when
+   there are none */
+getdns_return_t priv_getdns_read_resolvconf(struct getdns_context *context,
+    struct getdns_list **upstreams, struct getdns_list **suffix);
+
 #endif /* _GETDNS_CONTEXT_H_ */
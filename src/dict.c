@@ -90,9 +90,7 @@ getdns_dict_get_names(const struct getdns_dict * dict,
 	if (!dict || !answer)
 		return GETDNS_RETURN_INVALID_PARAMETER;
 
-	*answer = getdns_list_create_with_extended_memory_functions(
-		dict->mf.mf_arg, dict->mf.mf.ext.malloc,
-		dict->mf.mf.ext.realloc, dict->mf.mf.ext.free);
+	*answer = priv_getdns_list_create_with_mf(&dict->mf, dict->root.count);
 	if (!*answer)
 		return GETDNS_RETURN_NO_SUCH_DICT_NAME;
 
@@ -494,8 +492,8 @@ getdns_indent(size_t indent)
 	return spaces + 80 - (indent < 80 ? indent : 0);
 }				/* getdns_indent */
 
-static int
-priv_getdns_bindata_is_dname(struct getdns_bindata *bindata)
+int
+priv_getdns_bindata_is_dname(const struct getdns_bindata *bindata)
 {
 	size_t i = 0, n_labels = 0;
 	while (i < bindata->size) {
@@ -200,13 +200,13 @@ resolve(char* name, int rrtype, struct chain_response *response)
 
 	if (response->chain->sync_response) {
 		ub_res = NULL;
-		r = ub_resolve(response->chain->dns_req->context->unbound_ctx,
+		r = ub_resolve(response->chain->dns_req->unbound_ctx,
 		    name, rrtype, LDNS_RR_CLASS_IN, &ub_res);
 		ub_chain_response_callback(response, r, ub_res);
 		return r;
 	} else
 		return ub_resolve_async(
-		    response->chain->dns_req->context->unbound_ctx,
+		    response->chain->dns_req->unbound_ctx,
 		    name, rrtype, LDNS_RR_CLASS_IN, response,
 		    ub_chain_response_callback, &response->unbound_id);
 }
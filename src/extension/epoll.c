@@ -0,0 +1,339 @@
+/**
+ * \file
+ * \brief Built-in event loop extension on top of epoll.
+ *
+ * The timeouts of all contexts are pooled in the loop, so that a single
+ * epoll_wait with the time until the first timeout is enough per
+ * iteration.  One loop can drive many contexts.
+ */
+
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <getdns/getdns_ext_epoll.h>
+#include "config.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "extension/timeouts.h"
+
+#define RETURN_IF_NULL(ptr, code) if(ptr == NULL) return code;
+
+/* maximum number of events handled per epoll_wait */
+#define EPOLL_MAX_EVENTS 64
+
+/* callbacks delivered per context per iteration, so that one busy
+ * context does not starve the others */
+#define EPOLL_CALLBACK_BUDGET 64
+
+/* extension info, one per context */
+struct epoll_context {
+    struct getdns_epoll* loop;
+    /* NULL once the context is detached */
+    struct getdns_context* context;
+    int fd;
+    int polling;
+    /* the submission fd when watched, -1 otherwise */
+    int submission_fd;
+    /* has work left after its budget ran out */
+    int ready;
+    struct epoll_context* next_ready;
+    /* contexts detached while dispatching are freed afterwards */
+    struct epoll_context* next_detached;
+};
+
+struct getdns_epoll {
+    int epfd;
+    /* number of contexts with outstanding requests */
+    size_t num_polling;
+    /* the timeouts of all contexts */
+    struct priv_getdns_timeouts timeouts;
+    /* contexts to process without waiting for their fd */
+    struct epoll_context* ready;
+    int dispatching;
+    struct epoll_context* detached;
+};
+
+/* watch the submission fd while the context has the queue enabled */
+static void
+watch_submissions(struct epoll_context* ep_ctx) {
+    struct epoll_event ev;
+    int fd = ep_ctx->context ?
+        getdns_context_submission_fd(ep_ctx->context) : -1;
+    if (fd == ep_ctx->submission_fd) {
+        return;
+    }
+    if (ep_ctx->submission_fd != -1) {
+        (void) epoll_ctl(ep_ctx->loop->epfd, EPOLL_CTL_DEL,
+            ep_ctx->submission_fd, &ev);
+        ep_ctx->submission_fd = -1;
+        ep_ctx->loop->num_polling--;
+    }
+    if (fd != -1) {
+        ev.events = EPOLLIN;
+        ev.data.ptr = ep_ctx;
+        if (epoll_ctl(ep_ctx->loop->epfd, EPOLL_CTL_ADD, fd, &ev) == 0) {
+            ep_ctx->submission_fd = fd;
+            ep_ctx->loop->num_polling++;
+        }
+    }
+}
+
+static void
+request_count_changed(uint32_t request_count, struct epoll_context* ep_ctx) {
+    struct epoll_event ev;
+    watch_submissions(ep_ctx);
+    if (request_count > 0 && !ep_ctx->polling) {
+        /* the fd changes when the context rebuilds its resolver */
+        ep_ctx->fd = getdns_context_fd(ep_ctx->context);
+        ev.events = EPOLLIN;
+        ev.data.ptr = ep_ctx;
+        if (epoll_ctl(ep_ctx->loop->epfd, EPOLL_CTL_ADD, ep_ctx->fd, &ev) == 0) {
+            ep_ctx->polling = 1;
+            ep_ctx->loop->num_polling++;
+        }
+    } else if (request_count == 0 && ep_ctx->polling) {
+        (void) epoll_ctl(ep_ctx->loop->epfd, EPOLL_CTL_DEL, ep_ctx->fd, &ev);
+        ep_ctx->polling = 0;
+        ep_ctx->loop->num_polling--;
+    }
+}
+
+static void
+getdns_epoll_cb(struct epoll_context* ep_ctx) {
+    int more = 0;
+    if (!ep_ctx->context) {
+        /* detached by an earlier callback in this iteration */
+        return;
+    }
+    if (getdns_context_process_async_budget(ep_ctx->context,
+        EPOLL_CALLBACK_BUDGET, 0, &more) == GETDNS_RETURN_BAD_CONTEXT) {
+        // context destroyed
+        return;
+    }
+    if (!ep_ctx->context) {
+        return;
+    }
+    request_count_changed(
+        getdns_context_get_num_pending_requests(ep_ctx->context, NULL),
+        ep_ctx);
+    if (more && !ep_ctx->ready) {
+        ep_ctx->ready = 1;
+        ep_ctx->next_ready = ep_ctx->loop->ready;
+        ep_ctx->loop->ready = ep_ctx;
+    }
+}
+
+/* getdns extension functions */
+static getdns_return_t
+getdns_epoll_request_count_changed(struct getdns_context* context,
+    uint32_t request_count, void* eventloop_data) {
+    request_count_changed(request_count, (struct epoll_context*) eventloop_data);
+    return GETDNS_RETURN_GOOD;
+}
+
+static getdns_return_t
+getdns_epoll_cleanup(struct getdns_context* context, void* data) {
+    struct epoll_context* ep_ctx = (struct epoll_context*) data;
+    struct epoll_context** prev;
+    ep_ctx->context = NULL;
+    request_count_changed(0, ep_ctx);
+    for (prev = &ep_ctx->loop->ready; *prev; prev = &(*prev)->next_ready) {
+        if (*prev == ep_ctx) {
+            *prev = ep_ctx->next_ready;
+            break;
+        }
+    }
+    if (ep_ctx->loop->dispatching) {
+        /* there might be an event for this context still to be handled */
+        ep_ctx->next_detached = ep_ctx->loop->detached;
+        ep_ctx->loop->detached = ep_ctx;
+    } else {
+        free(ep_ctx);
+    }
+    return GETDNS_RETURN_GOOD;
+}
+
+static getdns_return_t
+getdns_epoll_schedule_timeout(struct getdns_context* context,
+    void* eventloop_data, uint16_t timeout,
+    getdns_timeout_data_t* timeout_data,
+    void** eventloop_timer) {
+    struct epoll_context* ep_ctx = (struct epoll_context*) eventloop_data;
+    return priv_getdns_timeouts_add(&ep_ctx->loop->timeouts, timeout_data, timeout);
+}
+
+static getdns_return_t
+getdns_epoll_clear_timeout(struct getdns_context* context,
+    void* eventloop_data, void* eventloop_timer) {
+    struct epoll_context* ep_ctx = (struct epoll_context*) eventloop_data;
+    priv_getdns_timeouts_remove(&ep_ctx->loop->timeouts, eventloop_timer);
+    return GETDNS_RETURN_GOOD;
+}
+
+
+static getdns_eventloop_extension EPOLL_EXT = {
+    getdns_epoll_cleanup,
+    getdns_epoll_schedule_timeout,
+    getdns_epoll_clear_timeout,
+    getdns_epoll_request_count_changed
+};
+
+/*
+ * getdns_epoll_create
+ *
+ */
+getdns_return_t
+getdns_epoll_create(struct getdns_epoll **loop)
+{
+    RETURN_IF_NULL(loop, GETDNS_RETURN_INVALID_PARAMETER);
+    struct getdns_epoll* result = (struct getdns_epoll*) calloc(1, sizeof(struct getdns_epoll));
+    if (!result) {
+        return GETDNS_RETURN_MEMORY_ERROR;
+    }
+    priv_getdns_timeouts_init(&result->timeouts);
+    result->epfd = epoll_create(EPOLL_MAX_EVENTS);
+    if (result->epfd == -1) {
+        free(result);
+        return GETDNS_RETURN_GENERIC_ERROR;
+    }
+    *loop = result;
+    return GETDNS_RETURN_GOOD;
+}               /* getdns_epoll_create */
+
+/*
+ * getdns_epoll_destroy
+ *
+ */
+void
+getdns_epoll_destroy(struct getdns_epoll *loop)
+{
+    if (!loop) {
+        return;
+    }
+    (void) close(loop->epfd);
+    priv_getdns_timeouts_cleanup(&loop->timeouts);
+    free(loop);
+}               /* getdns_epoll_destroy */
+
+/*
+ * getdns_extension_set_epoll
+ *
+ */
+getdns_return_t
+getdns_extension_set_epoll(struct getdns_context *context,
+    struct getdns_epoll *loop)
+{
+    RETURN_IF_NULL(context, GETDNS_RETURN_BAD_CONTEXT);
+    RETURN_IF_NULL(loop, GETDNS_RETURN_INVALID_PARAMETER);
+    getdns_return_t r = getdns_extension_detach_eventloop(context);
+    if (r != GETDNS_RETURN_GOOD) {
+        return r;
+    }
+    struct epoll_context* ep_ctx = (struct epoll_context*) calloc(1, sizeof(struct epoll_context));
+    if (!ep_ctx) {
+        return GETDNS_RETURN_MEMORY_ERROR;
+    }
+    ep_ctx->loop = loop;
+    ep_ctx->context = context;
+    ep_ctx->fd = -1;
+    ep_ctx->submission_fd = -1;
+    return getdns_extension_set_eventloop(context, &EPOLL_EXT, ep_ctx);
+}               /* getdns_extension_set_epoll */
+
+/*
+ * getdns_epoll_run_once
+ *
+ */
+getdns_return_t
+getdns_epoll_run_once(struct getdns_epoll *loop, int timeout)
+{
+    RETURN_IF_NULL(loop, GETDNS_RETURN_INVALID_PARAMETER);
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    struct epoll_context* ep_ctx;
+    struct epoll_context* ready;
+    struct timeval tv;
+    int i, n;
+
+    if (loop->ready) {
+        timeout = 0;
+    } else if (priv_getdns_timeouts_next(&loop->timeouts, &tv)) {
+        int wait = tv.tv_sec > 2000000 ? 2000000000 :
+            (int)(tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000);
+        if (timeout < 0 || wait < timeout) {
+            timeout = wait;
+        }
+    }
+    n = epoll_wait(loop->epfd, events, EPOLL_MAX_EVENTS, timeout);
+    if (n < 0) {
+        if (errno != EINTR) {
+            return GETDNS_RETURN_GENERIC_ERROR;
+        }
+        n = 0;
+    }
+
+    loop->dispatching = 1;
+    ready = loop->ready;
+    loop->ready = NULL;
+    for (i = 0; i < n; i++) {
+        ep_ctx = (struct epoll_context*) events[i].data.ptr;
+        if (!ep_ctx->ready) {
+            getdns_epoll_cb(ep_ctx);
+        }
+    }
+    /* the contexts that did not finish in the previous iteration */
+    while ((ep_ctx = ready)) {
+        ready = ep_ctx->next_ready;
+        ep_ctx->ready = 0;
+        getdns_epoll_cb(ep_ctx);
+    }
+    priv_getdns_timeouts_fire(&loop->timeouts);
+    loop->dispatching = 0;
+
+    while ((ep_ctx = loop->detached)) {
+        loop->detached = ep_ctx->next_detached;
+        free(ep_ctx);
+    }
+    return GETDNS_RETURN_GOOD;
+}               /* getdns_epoll_run_once */
+
+/*
+ * getdns_epoll_run
+ *
+ */
+getdns_return_t
+getdns_epoll_run(struct getdns_epoll *loop)
+{
+    RETURN_IF_NULL(loop, GETDNS_RETURN_INVALID_PARAMETER);
+    getdns_return_t r = GETDNS_RETURN_GOOD;
+    while (r == GETDNS_RETURN_GOOD &&
+           (loop->num_polling > 0 || loop->timeouts.count > 0 || loop->ready)) {
+        r = getdns_epoll_run_once(loop, -1);
+    }
+    return r;
+}               /* getdns_epoll_run */
@@ -37,17 +37,53 @@
 #include <sys/time.h>
 #include <stdio.h>
 #include <ev.h>
+#include "extension/timeouts.h"
 
 #define RETURN_IF_NULL(ptr, code) if(ptr == NULL) return code;
 
+/* callbacks delivered per wakeup, so other watchers get a turn */
+#define CALLBACK_BUDGET 64
+
 /* extension info */
 struct getdns_libev_data {
+    struct getdns_context* context;
     struct ev_loop* loop;
     struct ev_io* poll_handle;
+    /* on the submission fd, while the context has the queue enabled */
+    struct ev_io submissions;
+    /* armed for the first of the timeouts */
+    struct ev_timer timer;
+    struct priv_getdns_timeouts timeouts;
 };
 
+static void
+arm_timer(struct getdns_libev_data *ev_data) {
+    struct timeval tv;
+    ev_timer_stop(ev_data->loop, &ev_data->timer);
+    if (priv_getdns_timeouts_next(&ev_data->timeouts, &tv)) {
+        ev_timer_set(&ev_data->timer, tv.tv_sec + tv.tv_usec / 1000000.0, 0);
+        ev_timer_start(ev_data->loop, &ev_data->timer);
+    }
+}
+
+static void
+watch_submissions(struct getdns_libev_data *ev_data) {
+    int fd = getdns_context_submission_fd(ev_data->context);
+    if (ev_is_active(&ev_data->submissions)) {
+        if (ev_data->submissions.fd == fd) {
+            return;
+        }
+        ev_io_stop(ev_data->loop, &ev_data->submissions);
+    }
+    if (fd != -1) {
+        ev_io_set(&ev_data->submissions, fd, EV_READ);
+        ev_io_start(ev_data->loop, &ev_data->submissions);
+    }
+}
+
 static void
 request_count_changed(uint32_t request_count, struct getdns_libev_data *ev_data) {
+    watch_submissions(ev_data);
     if (request_count > 0) {
         ev_io_start(ev_data->loop, ev_data->poll_handle);
     } else {
@@ -59,7 +95,9 @@ request_count_changed(uint32_t request_count, struct getdns_libev_data *ev_data)
 static void
 getdns_libev_cb(struct ev_loop *loop, struct ev_io *handle, int revents) {
     struct getdns_context* context = (struct getdns_context*) handle->data;
-    if (getdns_context_process_async(context) == GETDNS_RETURN_BAD_CONTEXT) {
+    int more = 0;
+    if (getdns_context_process_async_budget(context, CALLBACK_BUDGET, 0,
+        &more) == GETDNS_RETURN_BAD_CONTEXT) {
         // context destroyed
         return;
     }
@@ -67,12 +105,17 @@ getdns_libev_cb(struct ev_loop *loop, struct ev_io *handle, int revents) {
     struct getdns_libev_data* ev_data =
         (struct getdns_libev_data*) getdns_context_get_extension_data(context);
     request_count_changed(rc, ev_data);
+    if (more) {
+        /* yield to the other watchers and continue in the next iteration */
+        ev_feed_event(loop, handle, EV_READ);
+    }
 }
 
 static void
 getdns_libev_timeout_cb(struct ev_loop *loop, struct ev_timer* handle, int status) {
-    getdns_timeout_data_t* timeout_data = (getdns_timeout_data_t*) handle->data;
-    timeout_data->callback(timeout_data->userarg);
+    struct getdns_libev_data* ev_data = (struct getdns_libev_data*) handle->data;
+    priv_getdns_timeouts_fire(&ev_data->timeouts);
+    arm_timer(ev_data);
 }
 
 /* getdns extension functions */
@@ -88,7 +131,10 @@ static getdns_return_t
 getdns_libev_cleanup(struct getdns_context* context, void* data) {
     struct getdns_libev_data *ev_data = (struct getdns_libev_data*) data;
     ev_io_stop(ev_data->loop, ev_data->poll_handle);
+    ev_io_stop(ev_data->loop, &ev_data->submissions);
+    ev_timer_stop(ev_data->loop, &ev_data->timer);
     free(ev_data->poll_handle);
+    priv_getdns_timeouts_cleanup(&ev_data->timeouts);
     free(ev_data);
     return GETDNS_RETURN_GOOD;
 }
@@ -99,26 +145,25 @@ getdns_libev_schedule_timeout(struct getdns_context* context,
     getdns_timeout_data_t* timeout_data,
     void** eventloop_timer) {
 
-    struct ev_timer *timer;
     struct getdns_libev_data* ev_data = (struct getdns_libev_data*) eventloop_data;
-    ev_tstamp to = timeout;
-    to /= 1000;
-    timer = (struct ev_timer*) malloc(sizeof(struct ev_timer));
-    ev_timer_init(timer, getdns_libev_timeout_cb, to, 0);
-    timer->data = timeout_data;
-    ev_timer_start(ev_data->loop, timer);
-
-    *eventloop_timer = timer;
-    return GETDNS_RETURN_GOOD;
+    getdns_return_t r = priv_getdns_timeouts_add(&ev_data->timeouts,
+        timeout_data, timeout);
+    if (r == GETDNS_RETURN_GOOD &&
+        priv_getdns_timeouts_first(&ev_data->timeouts) == timeout_data) {
+        arm_timer(ev_data);
+    }
+    return r;
 }
 
 static getdns_return_t
 getdns_libev_clear_timeout(struct getdns_context* context,
     void* eventloop_data, void* eventloop_timer) {
-    struct ev_timer* timer = (struct ev_timer*) eventloop_timer;
     struct getdns_libev_data* ev_data = (struct getdns_libev_data*) eventloop_data;
-    ev_timer_stop(ev_data->loop, timer);
-    free(timer);
+    priv_getdns_timeouts_remove(&ev_data->timeouts, eventloop_timer);
+    /* when the first one is cleared the timer just fires early */
+    if (ev_data->timeouts.count == 0) {
+        ev_timer_stop(ev_data->loop, &ev_data->timer);
+    }
     return GETDNS_RETURN_GOOD;
 }
 
@@ -152,7 +197,13 @@ getdns_extension_set_libev_loop(struct getdns_context *context,
     int fd = getdns_context_fd(context);
     ev_data->poll_handle = (struct ev_io*) malloc(sizeof(struct ev_io));
     ev_io_init(ev_data->poll_handle, getdns_libev_cb, fd, EV_READ);
+    ev_data->context = context;
     ev_data->loop = loop;
+    ev_io_init(&ev_data->submissions, getdns_libev_cb, -1, EV_READ);
+    ev_data->submissions.data = context;
+    ev_timer_init(&ev_data->timer, getdns_libev_timeout_cb, 0, 0);
+    ev_data->timer.data = ev_data;
+    priv_getdns_timeouts_init(&ev_data->timeouts);
 
     ev_data->poll_handle->data = context;
     return getdns_extension_set_eventloop(context, &LIBEV_EXT, ev_data);
@@ -36,6 +36,7 @@
 #include <getdns/getdns_ext_libevent.h>
 #include "config.h"
 #include <sys/time.h>
+#include "extension/timeouts.h"
 
 #ifdef HAVE_EVENT2_EVENT_H
 #  include <event2/event.h>
@@ -50,6 +51,9 @@
 #endif
 #define RETURN_IF_NULL(ptr, code) if(ptr == NULL) return code;
 
+/* callbacks delivered per wakeup, so other events get a turn */
+#define CALLBACK_BUDGET 64
+
 #ifndef HAVE_EVENT_BASE_FREE
 #define event_base_free(x) /* nop */
 #endif
@@ -71,12 +75,54 @@ event_new(struct event_base *b, evutil_socket_t fd, short ev, void* cb, void *ar
 
 /* extension info */
 struct event_data {
+    struct getdns_context* context;
     struct event* event;
+    /* on the submission fd, while the context has the queue enabled */
+    struct event* submissions;
+    int submission_fd;
+    /* armed for the first of the timeouts */
+    struct event* timer;
     struct event_base* event_base;
+    struct priv_getdns_timeouts timeouts;
 };
 
+static void
+arm_timer(struct event_data *ev_data) {
+    struct timeval tv;
+    if (priv_getdns_timeouts_next(&ev_data->timeouts, &tv)) {
+        evtimer_add(ev_data->timer, &tv);
+    } else {
+        event_del(ev_data->timer);
+    }
+}
+
+static void getdns_libevent_cb(evutil_socket_t fd, short what, void *userarg);
+
+static void
+watch_submissions(struct event_data *ev_data) {
+    int fd = getdns_context_submission_fd(ev_data->context);
+    if (fd == ev_data->submission_fd) {
+        return;
+    }
+    if (ev_data->submissions) {
+        event_del(ev_data->submissions);
+        event_free(ev_data->submissions);
+        ev_data->submissions = NULL;
+    }
+    ev_data->submission_fd = -1;
+    if (fd != -1) {
+        ev_data->submissions = event_new(ev_data->event_base, fd,
+            EV_READ | EV_PERSIST, getdns_libevent_cb, ev_data->context);
+        if (ev_data->submissions) {
+            event_add(ev_data->submissions, NULL);
+            ev_data->submission_fd = fd;
+        }
+    }
+}
+
 static void
 request_count_changed(uint32_t request_count, struct event_data *ev_data) {
+    watch_submissions(ev_data);
     if (request_count > 0) {
         event_add(ev_data->event, NULL);
     } else {
@@ -88,7 +134,9 @@ request_count_changed(uint32_t request_count, struct event_data *ev_data) {
 static void
 getdns_libevent_cb(evutil_socket_t fd, short what, void *userarg) {
     struct getdns_context* context = (struct getdns_context*) userarg;
-    if (getdns_context_process_async(context) == GETDNS_RETURN_BAD_CONTEXT) {
+    int more = 0;
+    if (getdns_context_process_async_budget(context, CALLBACK_BUDGET, 0,
+        &more) == GETDNS_RETURN_BAD_CONTEXT) {
         // context destroyed
         return;
     }
@@ -96,12 +144,17 @@ getdns_libevent_cb(evutil_socket_t fd, short what, void *userarg) {
     struct event_data* ev_data =
         (struct event_data*) getdns_context_get_extension_data(context);
     request_count_changed(rc, ev_data);
+    if (more) {
+        /* yield to the other events and continue in the next iteration */
+        event_active(ev_data->event, EV_READ, 1);
+    }
 }
 
 static void
 getdns_libevent_timeout_cb(evutil_socket_t fd, short what, void* userarg) {
-    getdns_timeout_data_t* timeout_data = (getdns_timeout_data_t*) userarg;
-    timeout_data->callback(timeout_data->userarg);
+    struct event_data* ev_data = (struct event_data*) userarg;
+    priv_getdns_timeouts_fire(&ev_data->timeouts);
+    arm_timer(ev_data);
 }
 
 /* getdns extension functions */
@@ -118,6 +171,13 @@ getdns_libevent_cleanup(struct getdns_context* context, void* data) {
     struct event_data *edata = (struct event_data*) data;
     event_del(edata->event);
     event_free(edata->event);
+    event_del(edata->timer);
+    event_free(edata->timer);
+    if (edata->submissions) {
+        event_del(edata->submissions);
+        event_free(edata->submissions);
+    }
+    priv_getdns_timeouts_cleanup(&edata->timeouts);
     free(edata);
     return GETDNS_RETURN_GOOD;
 }
@@ -128,26 +188,25 @@ getdns_libevent_schedule_timeout(struct getdns_context* context,
     getdns_timeout_data_t* timeout_data,
     void** eventloop_timer) {
 
-    struct timeval tv;
-    struct event* ev = NULL;
     struct event_data* ev_data = (struct event_data*) eventloop_data;
-
-    tv.tv_sec = timeout / 1000;
-    tv.tv_usec = (timeout % 1000) * 1000;
-
-    ev = evtimer_new(ev_data->event_base, getdns_libevent_timeout_cb, timeout_data);
-    evtimer_add(ev, &tv);
-
-    *eventloop_timer = ev;
-    return GETDNS_RETURN_GOOD;
+    getdns_return_t r = priv_getdns_timeouts_add(&ev_data->timeouts,
+        timeout_data, timeout);
+    if (r == GETDNS_RETURN_GOOD &&
+        priv_getdns_timeouts_first(&ev_data->timeouts) == timeout_data) {
+        arm_timer(ev_data);
+    }
+    return r;
 }
 
 static getdns_return_t
 getdns_libevent_clear_timeout(struct getdns_context* context,
     void* eventloop_data, void* eventloop_timer) {
-    struct event* ev = (struct event*) eventloop_timer;
-    event_del(ev);
-    event_free(ev);
+    struct event_data* ev_data = (struct event_data*) eventloop_data;
+    priv_getdns_timeouts_remove(&ev_data->timeouts, eventloop_timer);
+    /* when the first one is cleared the timer just fires early */
+    if (ev_data->timeouts.count == 0) {
+        event_del(ev_data->timer);
+    }
     return GETDNS_RETURN_GOOD;
 }
 
@@ -188,7 +247,17 @@ getdns_extension_set_libevent_base(struct getdns_context *context,
         event_free(getdns_event);
         return GETDNS_RETURN_GENERIC_ERROR;
     }
+    ev_data->timer = evtimer_new(this_event_base, getdns_libevent_timeout_cb, ev_data);
+    if (!ev_data->timer) {
+        event_free(getdns_event);
+        free(ev_data);
+        return GETDNS_RETURN_GENERIC_ERROR;
+    }
+    ev_data->context = context;
     ev_data->event = getdns_event;
+    ev_data->submissions = NULL;
+    ev_data->submission_fd = -1;
     ev_data->event_base = this_event_base;
+    priv_getdns_timeouts_init(&ev_data->timeouts);
     return getdns_extension_set_eventloop(context, &LIBEVENT_EXT, ev_data);
 }               /* getdns_extension_set_libevent_base */
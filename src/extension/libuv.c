@@ -37,13 +37,21 @@
 #include <sys/time.h>
 #include <stdio.h>
 #include <uv.h>
+#include "extension/timeouts.h"
 
 #define RETURN_IF_NULL(ptr, code) if(ptr == NULL) return code;
 
 /* extension info */
 struct getdns_libuv_data {
+    struct getdns_context* context;
     uv_loop_t* loop;
     uv_poll_t* poll_handle;
+    /* on the submission fd, while the context has the queue enabled */
+    uv_poll_t* submissions;
+    int submission_fd;
+    /* armed for the first of the timeouts */
+    uv_timer_t* timer;
+    struct priv_getdns_timeouts timeouts;
 };
 
 static void request_count_changed(uint32_t request_count, struct getdns_libuv_data *uv_data);
@@ -62,8 +70,34 @@ getdns_libuv_cb(uv_poll_t* handle, int status, int events) {
     request_count_changed(rc, uv_data);
 }
 
+static void getdns_libuv_close_cb(uv_handle_t* handle);
+
+static void
+watch_submissions(struct getdns_libuv_data *uv_data) {
+    int fd = getdns_context_submission_fd(uv_data->context);
+    if (fd == uv_data->submission_fd) {
+        return;
+    }
+    if (uv_data->submissions) {
+        uv_poll_stop(uv_data->submissions);
+        uv_close((uv_handle_t*) uv_data->submissions, getdns_libuv_close_cb);
+        uv_data->submissions = NULL;
+    }
+    uv_data->submission_fd = -1;
+    if (fd != -1) {
+        uv_data->submissions = (uv_poll_t*) malloc(sizeof(uv_poll_t));
+        if (uv_data->submissions) {
+            uv_poll_init(uv_data->loop, uv_data->submissions, fd);
+            uv_data->submissions->data = uv_data->context;
+            uv_poll_start(uv_data->submissions, UV_READABLE, getdns_libuv_cb);
+            uv_data->submission_fd = fd;
+        }
+    }
+}
+
 static void
 request_count_changed(uint32_t request_count, struct getdns_libuv_data *uv_data) {
+    watch_submissions(uv_data);
     if (request_count > 0 && !uv_is_active((uv_handle_t*) uv_data->poll_handle)) {
         uv_poll_start(uv_data->poll_handle, UV_READABLE, getdns_libuv_cb);
     } else if (request_count == 0 && uv_is_active((uv_handle_t*) uv_data->poll_handle)) {
@@ -71,10 +105,24 @@ request_count_changed(uint32_t request_count, struct getdns_libuv_data *uv_data)
     }
 }
 
+static void getdns_libuv_timeout_cb(uv_timer_t* handle, int status);
+
+static void
+arm_timer(struct getdns_libuv_data *uv_data) {
+    struct timeval tv;
+    if (priv_getdns_timeouts_next(&uv_data->timeouts, &tv)) {
+        uv_timer_start(uv_data->timer, getdns_libuv_timeout_cb,
+            (uint64_t) tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000, 0);
+    } else {
+        uv_timer_stop(uv_data->timer);
+    }
+}
+
 static void
 getdns_libuv_timeout_cb(uv_timer_t* handle, int status) {
-    getdns_timeout_data_t* timeout_data = (getdns_timeout_data_t*) handle->data;
-    timeout_data->callback(timeout_data->userarg);
+    struct getdns_libuv_data* uv_data = (struct getdns_libuv_data*) handle->data;
+    priv_getdns_timeouts_fire(&uv_data->timeouts);
+    arm_timer(uv_data);
 }
 
 static void
@@ -96,7 +144,14 @@ getdns_libuv_cleanup(struct getdns_context* context, void* data) {
     struct getdns_libuv_data *uv_data = (struct getdns_libuv_data*) data;
     uv_poll_stop(uv_data->poll_handle);
     uv_close((uv_handle_t*) uv_data->poll_handle, getdns_libuv_close_cb);
-    /* handle itself gets cleaned up in close_cb */
+    uv_timer_stop(uv_data->timer);
+    uv_close((uv_handle_t*) uv_data->timer, getdns_libuv_close_cb);
+    if (uv_data->submissions) {
+        uv_poll_stop(uv_data->submissions);
+        uv_close((uv_handle_t*) uv_data->submissions, getdns_libuv_close_cb);
+    }
+    /* handles themselves get cleaned up in close_cb */
+    priv_getdns_timeouts_cleanup(&uv_data->timeouts);
     free(uv_data);
     return GETDNS_RETURN_GOOD;
 }
@@ -107,24 +162,25 @@ getdns_libuv_schedule_timeout(struct getdns_context* context,
     getdns_timeout_data_t* timeout_data,
     void** eventloop_timer) {
 
-    uv_timer_t *timer;
     struct getdns_libuv_data* uv_data = (struct getdns_libuv_data*) eventloop_data;
-
-    timer = (uv_timer_t*) malloc(sizeof(uv_timer_t));
-    timer->data = timeout_data;
-    uv_timer_init(uv_data->loop, timer);
-    uv_timer_start(timer, getdns_libuv_timeout_cb, timeout, 0);
-
-    *eventloop_timer = timer;
-    return GETDNS_RETURN_GOOD;
+    getdns_return_t r = priv_getdns_timeouts_add(&uv_data->timeouts,
+        timeout_data, timeout);
+    if (r == GETDNS_RETURN_GOOD &&
+        priv_getdns_timeouts_first(&uv_data->timeouts) == timeout_data) {
+        arm_timer(uv_data);
+    }
+    return r;
 }
 
 static getdns_return_t
 getdns_libuv_clear_timeout(struct getdns_context* context,
     void* eventloop_data, void* eventloop_timer) {
-    uv_timer_t* timer = (uv_timer_t*) eventloop_timer;
-    uv_timer_stop(timer);
-    uv_close((uv_handle_t*) timer, getdns_libuv_close_cb);
+    struct getdns_libuv_data* uv_data = (struct getdns_libuv_data*) eventloop_data;
+    priv_getdns_timeouts_remove(&uv_data->timeouts, eventloop_timer);
+    /* when the first one is cleared the timer just fires early */
+    if (uv_data->timeouts.count == 0) {
+        uv_timer_stop(uv_data->timer);
+    }
     return GETDNS_RETURN_GOOD;
 }
 
@@ -161,8 +217,20 @@ getdns_extension_set_libuv_loop(struct getdns_context *context,
         free(uv_data);
         return GETDNS_RETURN_MEMORY_ERROR;
     }
+    uv_data->timer = (uv_timer_t*) malloc(sizeof(uv_timer_t));
+    if (!uv_data->timer) {
+        free(uv_data->poll_handle);
+        free(uv_data);
+        return GETDNS_RETURN_MEMORY_ERROR;
+    }
     uv_poll_init(uv_loop, uv_data->poll_handle, fd);
     uv_data->poll_handle->data = context;
+    uv_timer_init(uv_loop, uv_data->timer);
+    uv_data->timer->data = uv_data;
+    uv_data->context = context;
+    uv_data->submissions = NULL;
+    uv_data->submission_fd = -1;
     uv_data->loop = uv_loop;
+    priv_getdns_timeouts_init(&uv_data->timeouts);
     return getdns_extension_set_eventloop(context, &LIBUV_EXT, uv_data);
 }               /* getdns_extension_set_libuv_loop */
@@ -0,0 +1,195 @@
+/**
+ * \file
+ * \brief Pooled timeouts for the event loop extensions
+ */
+
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include "extension/timeouts.h"
+
+static void
+timeouts_now(struct timeval* now) {
+    struct timespec ts;
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    now->tv_sec = ts.tv_sec;
+    now->tv_usec = ts.tv_nsec / 1000;
+}
+
+static int
+timeouts_before(const getdns_timeout_data_t* t1, const getdns_timeout_data_t* t2) {
+    return t1->timeout_time.tv_sec < t2->timeout_time.tv_sec ||
+        (t1->timeout_time.tv_sec == t2->timeout_time.tv_sec &&
+         t1->timeout_time.tv_usec < t2->timeout_time.tv_usec);
+}
+
+static void
+timeouts_set(struct priv_getdns_timeouts* timeouts, size_t i,
+    getdns_timeout_data_t* timeout_data) {
+    timeouts->heap[i] = timeout_data;
+    /* offset by one, so NULL means not queued */
+    timeout_data->extension_timer = (void*)(uintptr_t)(i + 1);
+}
+
+static void
+timeouts_up(struct priv_getdns_timeouts* timeouts, size_t i) {
+    getdns_timeout_data_t* timeout_data = timeouts->heap[i];
+    while (i > 0 && timeouts_before(timeout_data, timeouts->heap[(i - 1) / 2])) {
+        timeouts_set(timeouts, i, timeouts->heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    timeouts_set(timeouts, i, timeout_data);
+}
+
+static void
+timeouts_down(struct priv_getdns_timeouts* timeouts, size_t i) {
+    getdns_timeout_data_t* timeout_data = timeouts->heap[i];
+    size_t child;
+    while ((child = 2 * i + 1) < timeouts->count) {
+        if (child + 1 < timeouts->count &&
+            timeouts_before(timeouts->heap[child + 1], timeouts->heap[child])) {
+            child++;
+        }
+        if (!timeouts_before(timeouts->heap[child], timeout_data)) {
+            break;
+        }
+        timeouts_set(timeouts, i, timeouts->heap[child]);
+        i = child;
+    }
+    timeouts_set(timeouts, i, timeout_data);
+}
+
+void
+priv_getdns_timeouts_init(struct priv_getdns_timeouts* timeouts) {
+    timeouts->heap = NULL;
+    timeouts->count = 0;
+    timeouts->alloc = 0;
+}
+
+void
+priv_getdns_timeouts_cleanup(struct priv_getdns_timeouts* timeouts) {
+    free(timeouts->heap);
+    priv_getdns_timeouts_init(timeouts);
+}
+
+getdns_return_t
+priv_getdns_timeouts_add(struct priv_getdns_timeouts* timeouts,
+    getdns_timeout_data_t* timeout_data, uint16_t timeout) {
+    if (timeouts->count == timeouts->alloc) {
+        size_t alloc = timeouts->alloc ? timeouts->alloc * 2 : 32;
+        getdns_timeout_data_t** heap = (getdns_timeout_data_t**)
+            realloc(timeouts->heap, alloc * sizeof(getdns_timeout_data_t*));
+        if (!heap) {
+            return GETDNS_RETURN_MEMORY_ERROR;
+        }
+        timeouts->heap = heap;
+        timeouts->alloc = alloc;
+    }
+    timeouts_now(&timeout_data->timeout_time);
+    timeout_data->timeout_time.tv_sec += timeout / 1000;
+    timeout_data->timeout_time.tv_usec += (timeout % 1000) * 1000;
+    if (timeout_data->timeout_time.tv_usec >= 1000000) {
+        timeout_data->timeout_time.tv_usec -= 1000000;
+        timeout_data->timeout_time.tv_sec++;
+    }
+    timeouts->heap[timeouts->count] = timeout_data;
+    timeouts_up(timeouts, timeouts->count++);
+    return GETDNS_RETURN_GOOD;
+}
+
+void
+priv_getdns_timeouts_remove(struct priv_getdns_timeouts* timeouts,
+    void* extension_timer) {
+    size_t i;
+    getdns_timeout_data_t* timeout_data;
+    getdns_timeout_data_t* last;
+    if (!extension_timer) {
+        /* already fired */
+        return;
+    }
+    i = (size_t)(uintptr_t)extension_timer - 1;
+    timeout_data = timeouts->heap[i];
+    timeout_data->extension_timer = NULL;
+    last = timeouts->heap[--timeouts->count];
+    if (last == timeout_data) {
+        return;
+    }
+    timeouts_set(timeouts, i, last);
+    if (i > 0 && timeouts_before(last, timeouts->heap[(i - 1) / 2])) {
+        timeouts_up(timeouts, i);
+    } else {
+        timeouts_down(timeouts, i);
+    }
+}
+
+getdns_timeout_data_t*
+priv_getdns_timeouts_first(struct priv_getdns_timeouts* timeouts) {
+    return timeouts->count > 0 ? timeouts->heap[0] : NULL;
+}
+
+int
+priv_getdns_timeouts_next(struct priv_getdns_timeouts* timeouts,
+    struct timeval* tv) {
+    struct timeval now;
+    getdns_timeout_data_t* first = priv_getdns_timeouts_first(timeouts);
+    if (!first) {
+        return 0;
+    }
+    timeouts_now(&now);
+    if (first->timeout_time.tv_sec < now.tv_sec ||
+        (first->timeout_time.tv_sec == now.tv_sec &&
+         first->timeout_time.tv_usec <= now.tv_usec)) {
+        tv->tv_sec = 0;
+        tv->tv_usec = 0;
+    } else if (first->timeout_time.tv_usec < now.tv_usec) {
+        tv->tv_sec = first->timeout_time.tv_sec - now.tv_sec - 1;
+        tv->tv_usec = first->timeout_time.tv_usec + 1000000 - now.tv_usec;
+    } else {
+        tv->tv_sec = first->timeout_time.tv_sec - now.tv_sec;
+        tv->tv_usec = first->timeout_time.tv_usec - now.tv_usec;
+    }
+    return 1;
+}
+
+void
+priv_getdns_timeouts_fire(struct priv_getdns_timeouts* timeouts) {
+    struct timeval now;
+    getdns_timeout_data_t* first;
+    timeouts_now(&now);
+    /* callbacks may clear other timeouts, so look at the top every time */
+    while ((first = priv_getdns_timeouts_first(timeouts)) &&
+           (first->timeout_time.tv_sec < now.tv_sec ||
+            (first->timeout_time.tv_sec == now.tv_sec &&
+             first->timeout_time.tv_usec <= now.tv_usec))) {
+        priv_getdns_timeouts_remove(timeouts, first->extension_timer);
+        first->callback(first->userarg);
+    }
+}
@@ -0,0 +1,84 @@
+/**
+ * \file
+ * \brief Pooled timeouts for the event loop extensions
+ *
+ * The extensions keep the timeouts of a context in a binary heap and arm
+ * a single timer of the event loop for the earliest one, instead of
+ * registering a timer with the event loop for every request.
+ */
+
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GETDNS_EXTENSION_TIMEOUTS_H
+#define GETDNS_EXTENSION_TIMEOUTS_H
+
+#include <sys/time.h>
+#include <getdns/getdns.h>
+#include <getdns/getdns_extra.h>
+
+/*
+ * Heap of getdns_timeout_data_t on timeout_time.  The entries are not
+ * copied, and while queued the position of an entry is kept in its
+ * extension_timer member, so scheduling a timeout does not allocate.
+ */
+struct priv_getdns_timeouts {
+    getdns_timeout_data_t** heap;
+    size_t count;
+    size_t alloc;
+};
+
+void priv_getdns_timeouts_init(struct priv_getdns_timeouts* timeouts);
+void priv_getdns_timeouts_cleanup(struct priv_getdns_timeouts* timeouts);
+
+/* queue timeout_data to expire timeout milliseconds from now */
+getdns_return_t priv_getdns_timeouts_add(struct priv_getdns_timeouts* timeouts,
+    getdns_timeout_data_t* timeout_data, uint16_t timeout);
+
+/*
+ * take a timeout off the heap, by the extension_timer its context passes
+ * to clear_timeout.  Does nothing when the timeout already fired
+ */
+void priv_getdns_timeouts_remove(struct priv_getdns_timeouts* timeouts,
+    void* extension_timer);
+
+/* the timeout that expires first, or NULL if there are none */
+getdns_timeout_data_t* priv_getdns_timeouts_first(
+    struct priv_getdns_timeouts* timeouts);
+
+/* time until the first timeout expires, returns 0 if there are none */
+int priv_getdns_timeouts_next(struct priv_getdns_timeouts* timeouts,
+    struct timeval* tv);
+
+/*
+ * Fire the callbacks of all expired timeouts.  The entries are taken off
+ * the heap before their callback is called, so the clear_timeout from
+ * the context that follows is a no-op.
+ */
+void priv_getdns_timeouts_fire(struct priv_getdns_timeouts* timeouts);
+
+#endif
@@ -43,6 +43,9 @@
 #include "types-internal.h"
 #include "util-internal.h"
 #include "dnssec.h"
+#include "general.h"
+#include "stub.h"
+#include "admission.h"
 #include <stdio.h>
 
 /* stuff to make it compile pedantically */
@@ -55,6 +58,7 @@ static getdns_return_t ub_local_resolve_timeout(void *arg);
 
 static void handle_network_request_error(getdns_network_req * netreq, int err);
 static void handle_dns_request_complete(getdns_dns_req * dns_req);
+static void handle_network_request_done(getdns_network_req * netreq);
 static int submit_network_request(getdns_network_req * netreq);
 
 typedef struct netreq_cb_data
@@ -102,13 +106,24 @@ void priv_getdns_call_user_callback(getdns_dns_req *dns_req,
 	getdns_callback_t cb = dns_req->user_callback;
 	void *user_arg = dns_req->user_pointer;
 
+	getdns_callback_type_t cb_type =
+	    response ? GETDNS_CALLBACK_COMPLETE : GETDNS_CALLBACK_ERROR;
+
 	/* clean up */
 	getdns_context_clear_outbound_request(dns_req);
 	dns_req_free(dns_req);
 
-	cb(context,
-	    (response ? GETDNS_CALLBACK_COMPLETE : GETDNS_CALLBACK_ERROR),
-	    response, user_arg, trans_id);
+	if (getdns_context_defer_callback(context, cb, cb_type, response,
+	    user_arg, trans_id) == GETDNS_RETURN_GOOD)
+		return;
+
+	/* made for the completion queue, which was disabled since, or could
+	 * not grow */
+	if (!cb) {
+		getdns_dict_destroy(response);
+		return;
+	}
+	cb(context, cb_type, response, user_arg, trans_id);
 }
 
 /* cleanup and send an error to the user callback */
@@ -129,11 +144,27 @@ handle_dns_request_complete(getdns_dns_req * dns_req)
 		    dns_req, create_getdns_response(dns_req));
 }
 
+/* the network request has its result, go on with the next one or finish */
+static void
+handle_network_request_done(getdns_network_req * netreq)
+{
+	/* is this the last request */
+	if (!netreq->next) {
+		/* finished */
+		handle_dns_request_complete(netreq->owner);
+	} else {
+		/* not finished - update to next request and ship it */
+		getdns_dns_req *dns_req = netreq->owner;
+		dns_req->current_req = netreq->next;
+		submit_network_request(netreq->next);
+	}
+}
+
 static int
-submit_network_request(getdns_network_req * netreq)
+submit_ub_request(getdns_network_req * netreq)
 {
 	getdns_dns_req *dns_req = netreq->owner;
-	int r = ub_resolve_async(dns_req->context->unbound_ctx,
+	int r = ub_resolve_async(dns_req->unbound_ctx,
 	    dns_req->name,
 	    netreq->request_type,
 	    netreq->request_class,
@@ -144,6 +175,15 @@ submit_network_request(getdns_network_req * netreq)
 	return r;
 }
 
+static int
+submit_network_request(getdns_network_req * netreq)
+{
+	if (netreq->owner->native_stub)
+		return priv_getdns_stub_submit(netreq) == GETDNS_RETURN_GOOD
+		    ? 0 : -1;
+	return submit_ub_request(netreq);
+}
+
 static void
 ub_resolve_callback(void* arg, int err, struct ub_result* ub_res)
 // ub_resolve_callback(void *arg, int err, ldns_buffer * result, int sec,
@@ -183,19 +223,35 @@ ub_resolve_callback(void* arg, int err, struct ub_result* ub_res)
     if (r != GETDNS_RETURN_GOOD) {
         handle_network_request_error(netreq, err);
     } else {
-		/* is this the last request */
-		if (!netreq->next) {
-			/* finished */
-			handle_dns_request_complete(netreq->owner);
-		} else {
-			/* not finished - update to next request and ship it */
-			getdns_dns_req *dns_req = netreq->owner;
-			dns_req->current_req = netreq->next;
-			submit_network_request(netreq->next);
-		}
+		handle_network_request_done(netreq);
 	}
 } /* ub_resolve_callback */
 
+void
+priv_getdns_stub_answered(getdns_network_req * netreq,
+    const uint8_t *wire, size_t len, int truncated)
+{
+	getdns_dns_req *dns_req = netreq->owner;
+
+	if (truncated && dns_req->context->dns_transport ==
+	    GETDNS_TRANSPORT_UDP_FIRST_AND_FALL_BACK_TO_TCP) {
+		/* unbound takes it from here, and falls back to TCP */
+		netreq->state = NET_REQ_NOT_SENT;
+		if (submit_ub_request(netreq) != 0)
+			handle_network_request_error(netreq, 0);
+		return;
+	}
+	netreq->state = NET_REQ_FINISHED;
+	if (ldns_wire2pkt(&(netreq->result), wire, len) != LDNS_STATUS_OK) {
+		handle_network_request_error(netreq, 0);
+		return;
+	}
+	/* not validated */
+	netreq->secure = 0;
+	netreq->bogus = 0;
+	handle_network_request_done(netreq);
+}
+
 getdns_return_t
 getdns_general_ub(struct getdns_context *context,
     const char *name,
@@ -207,12 +263,14 @@ getdns_general_ub(struct getdns_context *context,
 	int usenamespaces)
 {
 	getdns_return_t gr;
-	int r;
+	int r, admit;
 
 	if (!name) {
 		return GETDNS_RETURN_INVALID_PARAMETER;
 	}
 
+	/* changed system files, from this thread only, which runs the loop */
+	getdns_context_apply_system_files(context);
 	gr = getdns_context_prepare_for_resolution(context, usenamespaces);
 	if (gr != GETDNS_RETURN_GOOD) {
 		return gr;
@@ -229,20 +287,37 @@ getdns_general_ub(struct getdns_context *context,
 
 	req->user_pointer = userarg;
 	req->user_callback = callbackfn;
+	req->native_stub = priv_getdns_stub_eligible(context, req,
+	    usenamespaces);
+
+	/* first, so that it has a transaction id of its own */
+	if (getdns_context_track_outbound_request(req) != GETDNS_RETURN_GOOD) {
+		dns_req_free(req);
+		return GETDNS_RETURN_GENERIC_ERROR;
+	}
+
+	/* over the limits of the context and no room to wait */
+	admit = priv_getdns_admit(req);
+	if (admit == PRIV_GETDNS_ADMIT_REJECT) {
+		getdns_context_clear_outbound_request(req);
+		dns_req_free(req);
+		return GETDNS_RETURN_GENERIC_ERROR;
+	}
 
 	if (transaction_id) {
 		*transaction_id = req->trans_id;
 	}
 
-	getdns_context_track_outbound_request(req);
-
 	/* assign a timeout */
 	// req->ev_base = ev_base;
 	// req->timeout = evtimer_new(ev_base, ub_resolve_timeout, req);
-    /* schedule the timeout */
+    /* schedule the timeout, which covers the wait for admission too */
     getdns_context_schedule_timeout(context, req->trans_id,
         context->timeout, ub_resolve_timeout, req);
 
+	if (admit == PRIV_GETDNS_ADMIT_QUEUED)
+		return GETDNS_RETURN_GOOD;
+
 	/* issue the first network req */
 
 	r = submit_network_request(req->first_req);
@@ -256,6 +331,13 @@ getdns_general_ub(struct getdns_context *context,
 	return GETDNS_RETURN_GOOD;
 }				/* getdns_general_ub */
 
+void
+priv_getdns_start_request(getdns_dns_req *req)
+{
+	if (submit_network_request(req->first_req) != 0)
+		priv_getdns_call_user_callback(req, NULL);
+}
+
 /**
  * getdns_general
  */
@@ -276,8 +358,8 @@ getdns_general(struct getdns_context *context,
 		return GETDNS_RETURN_INVALID_PARAMETER;
 	}
 
-    /* ensure callback is not NULL */
-    if (!callback || !name) {
+    /* ensure callback is not NULL, unless completions are polled */
+    if ((!callback && !context->completion_queue) || !name) {
          return GETDNS_RETURN_INVALID_PARAMETER;
     }
 
@@ -312,7 +394,7 @@ getdns_address(struct getdns_context *context,
 
 	if (!context)
 		return GETDNS_RETURN_INVALID_PARAMETER;
-    if (!callback || !name)
+    if ((!callback && !context->completion_queue) || !name)
          return GETDNS_RETURN_INVALID_PARAMETER;
 
     extcheck = validate_dname(name);
@@ -53,4 +53,13 @@ getdns_general_ub(struct getdns_context *context,
 
 void priv_getdns_call_user_callback(getdns_dns_req *, struct getdns_dict *);
 
+/* issue the first network request of req, which waited to be admitted, or
+   deliver an error to its callback when that fails */
+void priv_getdns_start_request(getdns_dns_req *req);
+
+/* an answer for netreq from the native stub, truncated when the TC bit
+   was set or it did not fit the buffer */
+void priv_getdns_stub_answered(getdns_network_req *netreq,
+    const uint8_t *wire, size_t len, int truncated);
+
 #endif
@@ -0,0 +1,76 @@
+/**
+ * \file
+ * \brief Public interfaces to getdns, include in your application to use getdns API.
+ *
+ * This source was taken from the original pseudo-implementation by
+ * Paul Hoffman.
+ */
+
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GETDNS_EXT_EPOLL_H
+#define GETDNS_EXT_EPOLL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <getdns/getdns.h>
+#include <getdns/getdns_extra.h>
+
+/* A built-in event loop on top of epoll.  One loop can drive any number
+   of contexts from a single thread. */
+struct getdns_epoll;
+
+/* create a new, empty loop */
+getdns_return_t
+getdns_epoll_create(struct getdns_epoll **loop);
+
+/* destroy a loop.  Contexts still using the loop must be destroyed (or
+   detached with getdns_extension_detach_eventloop) first */
+void
+getdns_epoll_destroy(struct getdns_epoll *loop);
+
+/* let loop drive the asynchronous requests of context */
+getdns_return_t
+getdns_extension_set_epoll(struct getdns_context *context,
+    struct getdns_epoll *loop);
+
+/* handle the events and timeouts that are due, waiting at most timeout
+   milliseconds (-1 to wait for the first event or timeout) */
+getdns_return_t
+getdns_epoll_run_once(struct getdns_epoll *loop, int timeout);
+
+/* run loop until none of its contexts have outstanding requests */
+getdns_return_t
+getdns_epoll_run(struct getdns_epoll *loop);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
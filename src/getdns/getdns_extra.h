@@ -50,6 +50,92 @@ getdns_return_t getdns_dict_util_set_string(struct getdns_dict * dict, char *nam
 getdns_return_t getdns_dict_util_get_string(struct getdns_dict * dict, char *name,
     char **result);
 
+/* list util */
+/* create a list with room for capacity items before it needs to grow.
+   Memory functions are taken from context, or the libc ones if NULL */
+struct getdns_list *getdns_list_create_with_capacity(getdns_context *context,
+    size_t capacity);
+
+/* path queries */
+/* A path is a JSON pointer like expression, for example
+   "/replies_tree/" "*" "/answer/" "*" "/rdata/ipv4_address".  Each '/'
+   prefixed segment selects a dict member by name or a list item by index,
+   a segment of just '*' selects every member or item.  Like with JSON
+   pointers, "~1" encodes a '/' and "~0" a '~' in a segment name. */
+typedef struct getdns_path getdns_path;
+
+typedef struct getdns_path_match {
+    getdns_data_type dtype;
+    union {
+        struct getdns_dict *dict;
+        struct getdns_list *list;
+        struct getdns_bindata *bindata;
+        uint32_t n;
+    } data;
+} getdns_path_match;
+
+/* parse expression into a path that can be reused for any number of
+   extractions.  Memory functions are taken from context, or the libc
+   ones if NULL.  Returns GETDNS_RETURN_INVALID_PARAMETER when expression
+   is malformed, or has an index that does not fit a size_t.  The path must
+   be freed with getdns_path_destroy */
+getdns_return_t getdns_path_compile(getdns_context *context,
+    const char *expression, getdns_path **path);
+
+void getdns_path_destroy(getdns_path *path);
+
+/* store the items in dict matching path in matches, in order, without
+   copying them.  At most max matches are stored, count is set to the
+   total number of matches (which may exceed max).  The matched items are
+   owned by dict */
+getdns_return_t getdns_path_extract(const getdns_path *path,
+    struct getdns_dict *dict, getdns_path_match *matches, size_t max,
+    size_t *count);
+
+/* binary serialization */
+/* Serialize dict in a compact, versioned binary format into buf.
+   *buf_len is the size of buf on input and is set to the size of the
+   serialization on output.  When buf is NULL only the size is returned.
+   Returns GETDNS_RETURN_MEMORY_ERROR when buf is too small, and
+   GETDNS_RETURN_INVALID_PARAMETER when a bindata, name, list or dict in
+   dict is larger than the format allows (2^32 - 1 octets or items) */
+getdns_return_t getdns_dict_serialize(const struct getdns_dict *dict,
+    uint8_t *buf, size_t *buf_len);
+
+/* Reconstruct a dict serialized with getdns_dict_serialize.  Memory
+   functions are taken from context, or the libc ones if NULL.  With
+   in_place, the bindatas in the result refer to buf instead of holding a
+   copy, so buf must outlive the dict (copies made with the getdns_dict_set_*
+   and getdns_list_set_* functions do not refer to buf).  Returns
+   GETDNS_RETURN_INVALID_PARAMETER when buf is malformed, or when its
+   reserved header octet is not zero */
+getdns_return_t getdns_dict_deserialize(getdns_context *context,
+    const uint8_t *buf, size_t buf_len, int in_place,
+    struct getdns_dict **dict);
+
+/* JSON output */
+/* flag for the JSON functions: write bindata that has no text form (not
+   an address, string or domain name) in base64 instead of hex (0x...) */
+#define GETDNS_JSON_BASE64 1
+
+/* called with consecutive chunks of JSON output, return non zero to
+   abort the output */
+typedef int (*getdns_json_write_t)(void *userarg, const char *data,
+    size_t len);
+
+/* Stream dict as JSON to write, in chunks, without building the whole
+   string in memory.  Returns GETDNS_RETURN_GENERIC_ERROR when write
+   aborted the output */
+getdns_return_t getdns_write_json_dict(const struct getdns_dict *dict,
+    int flags, getdns_json_write_t write, void *userarg);
+
+/* Write dict as a zero terminated JSON string into buf.  *buf_len is the
+   size of buf on input and is set to the length of the JSON (without the
+   terminating zero) on output.  When buf is NULL only the length is
+   returned.  Returns GETDNS_RETURN_MEMORY_ERROR when buf is too small */
+getdns_return_t getdns_print_json_dict(const struct getdns_dict *dict,
+    int flags, char *buf, size_t *buf_len);
+
 /* Async support */
 uint32_t getdns_context_get_num_pending_requests(getdns_context* context, struct timeval* next_timeout);
 
@@ -59,6 +145,264 @@ int getdns_context_fd(getdns_context* context);
 /* process async reqs */
 getdns_return_t getdns_context_process_async(getdns_context* context);
 
+/* process async reqs, but deliver at most max_callbacks callbacks and stop
+   after max_usecs microseconds (0 means no limit).  *work_remaining is set
+   to 1 when there is more to be done right away, in which case the caller
+   should call again without waiting for the fd.  Completed requests stay
+   counted in getdns_context_get_num_pending_requests until their callback
+   is delivered */
+getdns_return_t getdns_context_process_async_budget(getdns_context* context,
+    uint32_t max_callbacks, uint32_t max_usecs, int *work_remaining);
+
+/* completion queue */
+typedef struct getdns_completion {
+    getdns_transaction_t transaction_id;
+    /* GETDNS_CALLBACK_COMPLETE, _CANCEL, _TIMEOUT or _ERROR */
+    getdns_callback_type_t callback_type;
+    /* the response, to be destroyed by the caller, or NULL */
+    struct getdns_dict *response;
+    void *userarg;
+} getdns_completion_t;
+
+/* With the completion queue enabled no callbacks are called.  Answers,
+   timeouts and cancels are queued instead, to be collected with
+   getdns_context_poll_completions, and the callback given to the async
+   functions may be NULL.  Queued completions count as pending requests.
+   Requests made without a callback complete silently when the queue is
+   disabled before they are done, or when it cannot grow */
+getdns_return_t getdns_context_set_completion_queue(getdns_context* context,
+    int enabled);
+
+/* Move up to max completions, oldest first, into completions.  *count is
+   set to the number of completions returned */
+getdns_return_t getdns_context_poll_completions(getdns_context* context,
+    getdns_completion_t *completions, size_t max, size_t *count);
+
+/* thread-safe submission */
+/* A context is used from a single thread, the loop thread.  With the
+   submission queue enabled, other threads can hand requests to it with
+   getdns_submit_general.  The loop thread is woken through the fd from
+   getdns_context_submission_fd, which the event loop extensions watch,
+   and starts the submitted requests when it processes the context.  Their
+   completions go to the completion queue given with the submission, to be
+   polled by the submitting thread.  The memory functions of the context
+   have to be thread-safe */
+typedef struct getdns_completion_queue getdns_completion_queue;
+
+getdns_return_t getdns_completion_queue_create(getdns_completion_queue **queue);
+
+/* a queue may not be destroyed while it has submissions in flight.
+   The responses of completions not polled are destroyed with it */
+void getdns_completion_queue_destroy(getdns_completion_queue *queue);
+
+/* readable while the queue has completions */
+int getdns_completion_queue_fd(getdns_completion_queue *queue);
+
+/* Move up to max completions, oldest first, into completions.  *count is
+   set to the number of completions returned */
+getdns_return_t getdns_completion_queue_poll(getdns_completion_queue *queue,
+    getdns_completion_t *completions, size_t max, size_t *count);
+
+/* To be called from the loop thread.  Disabling may be done while other
+   threads submit: it waits for the submissions in progress to be queued,
+   and completes all those not yet started with GETDNS_CALLBACK_CANCEL.
+   Submissions made after that return GETDNS_RETURN_BAD_CONTEXT.  The
+   context itself may not be destroyed while other threads submit */
+getdns_return_t getdns_context_set_submission_queue(getdns_context *context,
+    int enabled);
+
+/* the fd to watch for submissions, -1 when the queue is not enabled */
+int getdns_context_submission_fd(getdns_context *context);
+
+/* Submit a getdns_general request, from any thread.  The transaction id
+   is assigned when the loop thread starts the request, and reported with
+   its completion */
+getdns_return_t getdns_submit_general(getdns_context *context,
+    getdns_completion_queue *queue, const char *name, uint16_t request_type,
+    struct getdns_dict *extensions, void *userarg);
+
+/* resolver pool */
+/* A pool of worker threads, each with a context (and so an unbound
+   instance) of its own, that share the requests submitted to the pool.
+   Requests are spread over the workers, and a worker that runs out of
+   work steals from the one with the longest queue.  setup is called
+   with each worker context, right after it is created, to configure it */
+typedef struct getdns_pool getdns_pool;
+
+typedef getdns_return_t (*getdns_pool_setup_t)(getdns_context *context,
+    void *userarg);
+
+getdns_return_t getdns_pool_create(getdns_pool **pool, size_t num_workers,
+    int set_from_os, getdns_pool_setup_t setup, void *userarg);
+
+/* stops the workers, outstanding requests are completed with
+   GETDNS_CALLBACK_CANCEL */
+void getdns_pool_destroy(getdns_pool *pool);
+
+/* the completion queue for requests submitted without one */
+getdns_completion_queue *getdns_pool_get_completion_queue(getdns_pool *pool);
+
+/* Submit a getdns_general request to the pool, from any thread.  Its
+   completion goes to queue, or to the queue of the pool when NULL */
+getdns_return_t getdns_pool_submit_general(getdns_pool *pool,
+    getdns_completion_queue *queue, const char *name, uint16_t request_type,
+    struct getdns_dict *extensions, void *userarg);
+
+/* concurrent sync requests */
+/* The sync functions (getdns_general_sync and friends) may be called from
+   many threads at once on the same context, also while another thread runs
+   its async requests.  Every call resolves with an unbound worker of its
+   own, so they run in parallel.  The context may not be reconfigured
+   meanwhile, and its memory functions have to be thread-safe */
+
+/* reconfiguration */
+/* Changing the resolution type, namespaces, upstream recursive servers,
+   transport, DNSSEC allowed skew, EDNS maximum UDP payload size or the
+   limit on outstanding queries of a context that is in use sets up a new
+   unbound context for the requests that follow.  Requests in flight are
+   not canceled but finish on the old one, which is deleted after its last
+   request, and getdns_context_fd stays the same.  Where epoll is not
+   available the async requests in flight are canceled instead.  Sync
+   requests in other threads always finish on the old one */
+
+/* system files */
+/* Follow changes to resolv.conf and the hosts file, for a context created
+   with set_from_os.  A thread of the context waits for them with inotify,
+   and reads the changed files.  The new nameservers and search list, and
+   the new hosts, are taken with the next async request or
+   getdns_context_process_async call (see reconfiguration), in the thread
+   running the event loop and not by the sync functions, and the update
+   callback is called with GETDNS_CONTEXT_CODE_UPSTREAM_RECURSIVE_SERVERS
+   and GETDNS_CONTEXT_CODE_SUFFIX, or GETDNS_CONTEXT_CODE_NAMESPACES for
+   the hosts file.  Nothing is taken while the context is idle, so a
+   process that makes no requests and does not call
+   getdns_context_process_async never gets the update callback.
+   The thread allocates the lists it reads with the memory functions of the
+   context, while the event loop runs, so custom memory functions given to
+   getdns_context_create_with_memory_functions or
+   getdns_context_create_with_extended_memory_functions have to be
+   thread-safe to enable this.
+   GETDNS_RETURN_GENERIC_ERROR where inotify is not available */
+getdns_return_t getdns_context_set_follow_system_files(getdns_context *context,
+    int enable);
+
+/* native stub */
+/* Resolve in stub mode without unbound.  Queries are sent to the upstream
+   recursive servers by getdns itself, over UDP from a few sockets, and the
+   queries of requests made in the same event loop iteration are sent
+   together with one system call (sendmmsg), as are the answers read
+   (recvmmsg).  A query that is not answered is sent again to the next
+   upstream, until the request times out.  Truncated answers are retried
+   by unbound over TCP, unless the transport is UDP only.  Requests for
+   DNSSEC validation, over TCP, or with the hosts file in the namespaces
+   (getdns_address, getdns_hostname) and the sync functions stay with
+   unbound.  GETDNS_RETURN_GENERIC_ERROR where epoll or sendmmsg is not
+   available.
+   Queries go to the upstream with the lowest smoothed round trip time
+   plus four times its variance, and to one of the others with a small
+   chance that decays with the number of queries, to notice when they get
+   faster.  getdns_context_get_api_information has these per upstream in
+   the "upstream_stats" list: the address, "port", "srtt" and "rttvar" in
+   microseconds, "queries_sent" and "answers" (to first tries, from which
+   the round trip times are measured).
+   With GETDNS_TRANSPORT_TCP_ONLY_KEEP_CONNECTIONS_OPEN the native stub is
+   used in stub mode also when not enabled, for the same requests: their
+   queries are pipelined on one TCP connection per upstream, kept open
+   until idle for 10 seconds, and answered in any order.  Queries not
+   answered when a connection closes are written to a new one, and those
+   not answered in time to the connection to the next upstream, with the
+   deadlines of UDP doubled once for setting up the connection */
+getdns_return_t getdns_context_set_native_stub(getdns_context *context,
+    int enable);
+
+/* An upstream of the native stub that times out or answers SERVFAIL 3
+   times in a row is taken out of rotation for a second, doubling with
+   every time it is taken out again up to a minute.  After that one query
+   is sent to it as a probe, and when that is answered it is back.  A query
+   answered with SERVFAIL is sent to the next upstream when there is one.
+   The "upstream_stats" have "healthy", "failures" (timeouts and SERVFAILs),
+   "consecutive_failures" and "outages" (times taken out) as well.
+   callback is called when an upstream is taken out (healthy is 0) and when
+   it is back (1), with upstream like the entries of "upstream_stats" and
+   only valid during the call */
+typedef void (*getdns_upstream_health_callback)(getdns_context *context,
+    struct getdns_dict *upstream, int healthy, void *userarg);
+
+getdns_return_t getdns_context_set_upstream_health_callback(
+    getdns_context *context, getdns_upstream_health_callback callback,
+    void *userarg);
+
+/* Hedged queries: a query of the native stub over UDP that is not answered
+   within the given percentile (1 to 99) of the round trip times seen lately
+   is sent to another upstream as well, and the first answer is used.  At
+   most max_permille hedges are sent per 1000 queries, in bursts of up to
+   10.  The round trip times of hedged queries are not measured, and the
+   "upstream_stats" have the "hedges" sent to each upstream.  Off with a
+   percentile of 0, which is the default */
+getdns_return_t getdns_context_set_hedged_queries(getdns_context *context,
+    uint8_t percentile, uint16_t max_permille);
+
+/* Adaptive timeouts: a query of the native stub over UDP is sent again (to
+   the next upstream) after factor times the 99th percentile of the round
+   trip times seen lately, instead of after 400 ms, doubling with every try
+   and never later than the timeout of the context.  Each reply of the
+   native stub has the "retry_deadlines" in milliseconds that were
+   scheduled for it.  Off with a factor of 0, which is the default */
+getdns_return_t getdns_context_set_adaptive_timeouts(getdns_context *context,
+    uint8_t factor);
+
+/* The native stub sends its UDP queries from a pool of pool_size (1 to 64,
+   4 by default) sockets per address family, bound to random ports.  Every
+   rotate_ms milliseconds (10000 by default, never with 0) one socket of
+   each pool is replaced by one on a new random port, checked when sending.
+   Answers are only taken from the socket their query was sent from */
+getdns_return_t getdns_context_set_udp_socket_pool(getdns_context *context,
+    uint16_t pool_size, uint16_t rotate_ms);
+
+/* EDNS size negotiation: the native stub learns per upstream the largest
+   payload size (512, 1232, 1452 or 4096, up to max_size) that it can
+   advertise without answers getting lost.  It starts at 1232, goes one size
+   down after 2 timeouts in a row, and one size up when an answer is
+   truncated after 8 answers in a row, doubled every time it went down.
+   The "upstream_stats" have the "edns_size" advertised, and the "truncated"
+   answers and "tcp_fallbacks".  With a max_size of 0, the default,
+   edns_maximum_udp_payload_size is advertised to all */
+getdns_return_t getdns_context_set_edns_size_negotiation(
+    getdns_context *context, uint16_t max_size);
+
+/* The native stub sends at most qps queries per second, with bursts of up
+   to burst at once, to each upstream, and waits for the answers to at most
+   max_in_flight queries of each at a time.  A query goes to the next
+   upstream with room when its own has none, and is held until there is one
+   otherwise.  The "upstream_stats" have the queries "in_flight".  No limit
+   where 0, the default */
+getdns_return_t getdns_context_set_upstream_limits(getdns_context *context,
+    uint32_t qps, uint32_t burst, uint32_t max_in_flight);
+
+/* admission control */
+/* The asynchronous requests of the context start at most qps per second,
+   with bursts of up to burst at once, and no more than max_in_flight of them
+   are outstanding at a time.  The others wait, at most queue_size of them,
+   until there is room, and are started in the order they were made.  The
+   timeout of a request includes this wait.  When the queue is full, or a
+   request would time out before its turn, getdns_general and the like fail
+   right away with GETDNS_RETURN_GENERIC_ERROR.  getdns_context_get_api_-
+   information has the "requests_in_flight", "requests_queued" and
+   "requests_rejected".  No limit where 0, the default.  The sync functions
+   are not limited; limit_outstanding_queries limits unbound only */
+getdns_return_t getdns_context_set_request_limits(getdns_context *context,
+    uint32_t qps, uint32_t burst, uint32_t max_in_flight, uint32_t queue_size);
+
+/* context cloning */
+/* Create a context with the settings of src (upstreams, suffixes, namespaces,
+   timeouts, transport, EDNS and DNSSEC options), without reading resolv.conf
+   or parsing the trust anchor file again.  The unbound context of the clone
+   is its own, and reads the trust anchor file on its first resolution like
+   that of any context.  The clone uses the memory functions src was created
+   with, and has no event loop, requests or queues of src */
+getdns_return_t getdns_context_clone(getdns_context *src,
+    getdns_context **dst);
+
 /* tells underlying unbound to use background threads or fork */
 getdns_return_t getdns_context_set_use_threads(getdns_context* context, int use_threads);
 
@@ -0,0 +1,509 @@
+/**
+ *
+ * /brief getdns JSON output of dicts
+ *
+ * The JSON is streamed through a small staging buffer into a caller
+ * supplied buffer or write callback, without building the whole string
+ * in memory and without allocations.
+ *
+ */
+
+/*
+ * Copyright (c) 2013, NLnet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <ctype.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "types-internal.h"
+#include "util-internal.h"
+#include "list.h"
+#include "dict.h"
+
+/* size of the staging buffer used with a write callback */
+#define JSON_STAGE_LEN 512
+
+struct json_out
+{
+	char *buf;		/* staging buffer or the caller's buffer */
+	size_t len;		/* capacity of buf */
+	size_t pos;		/* number of octets in buf */
+	size_t total;		/* number of octets produced */
+	getdns_json_write_t write;
+	void *userarg;
+	int error;
+	int flags;
+};
+
+static const char json_hex[] = "0123456789abcdef";
+
+static const char json_base64[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/*
+ * How characters are written inside a JSON string:  0 as is, 'u' as a
+ * \u00XX escape, or as a backslash followed by the given character.
+ */
+static const char json_escape[256] = {
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',	/* 0x00 */
+	'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',	/* 0x10 */
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	 0,   0,  '"',  0,   0,   0,   0,   0,	/* 0x20 */
+	 0,   0,   0,   0,   0,   0,   0,   0,
+	 0,   0,   0,   0,   0,   0,   0,   0,	/* 0x30 */
+	 0,   0,   0,   0,   0,   0,   0,   0,
+	 0,   0,   0,   0,   0,   0,   0,   0,	/* 0x40 */
+	 0,   0,   0,   0,   0,   0,   0,   0,
+	 0,   0,   0,   0,   0,   0,   0,   0,	/* 0x50 */
+	 0,   0,   0,   0, '\\',  0,   0,   0,
+	 0,   0,   0,   0,   0,   0,   0,   0,	/* 0x60 */
+	 0,   0,   0,   0,   0,   0,   0,   0,
+	 0,   0,   0,   0,   0,   0,   0,   0,	/* 0x70 */
+	 0,   0,   0,   0,   0,   0,   0, 'u',
+	/* 0x80 - 0xff as is within valid UTF-8 sequences (see utf8_len) */
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u'
+};
+
+/*
+ * Characters in a label that need a backslash in the presentation format
+ * of a domain name.  Non printable characters are written as \DDD.
+ */
+static const char dname_special[] = ".;()\\\"$@";
+
+/*---------------------------------------- utf8_len */
+/**
+  * @return the length of the valid UTF-8 sequence that starts at s and
+  *         ends before end, 1 for ASCII, or 0 when there is none.
+  *         Overlong forms, surrogates and code points beyond U+10FFFF are
+  *         not valid.
+  */
+static size_t
+utf8_len(const uint8_t *s, const uint8_t *end)
+{
+	uint32_t cp;
+	size_t len, i;
+
+	if (*s < 0x80)
+		return 1;
+	else if (*s >= 0xc2 && *s <= 0xdf) {
+		len = 2;
+		cp = *s & 0x1f;
+	} else if ((*s & 0xf0) == 0xe0) {
+		len = 3;
+		cp = *s & 0x0f;
+	} else if (*s >= 0xf0 && *s <= 0xf4) {
+		len = 4;
+		cp = *s & 0x07;
+	} else
+		return 0;
+
+	if ((size_t)(end - s) < len)
+		return 0;
+	for (i = 1; i < len; i++) {
+		if ((s[i] & 0xc0) != 0x80)
+			return 0;
+		cp = cp << 6 | (s[i] & 0x3f);
+	}
+	if ((len == 3 && (cp < 0x800 || (cp >= 0xd800 && cp <= 0xdfff))) ||
+	    (len == 4 && (cp < 0x10000 || cp > 0x10ffff)))
+		return 0;
+	return len;
+}				/* utf8_len */
+
+/*---------------------------------------- json_put */
+/**
+  * appends len octets from s to the output
+  * with a write callback, the staging buffer is flushed when full
+  * with a caller supplied buffer, octets that do not fit are only counted
+  */
+static void
+json_put(struct json_out *out, const char *s, size_t len)
+{
+	size_t n;
+
+	while (len && !out->error) {
+		if (out->pos == out->len) {
+			if (!out->write) {
+				out->total += len;
+				return;
+			}
+			if (out->write(out->userarg, out->buf, out->pos))
+				out->error = 1;
+			out->pos = 0;
+			continue;
+		}
+		n = out->len - out->pos < len ? out->len - out->pos : len;
+		(void) memcpy(out->buf + out->pos, s, n);
+		out->pos += n;
+		out->total += n;
+		s += n;
+		len -= n;
+	}
+}				/* json_put */
+
+#define json_puts(out, s) json_put((out), (s), sizeof(s) - 1)
+
+/*---------------------------------------- json_put_escaped */
+/**
+  * appends len characters from s to the output, escaped for use within
+  * a JSON string.  Valid UTF-8 is written as is, other octets above 0x7f
+  * as \u00XX.
+  */
+static void
+json_put_escaped(struct json_out *out, const uint8_t *s, size_t len)
+{
+	const uint8_t *run = s, *end = s + len;
+	char esc[6] = { '\\', 'u', '0', '0' };
+	size_t n;
+
+	for (; s < end; s++) {
+		if (!json_escape[*s])
+			continue;
+		if (*s >= 0x80 && (n = utf8_len(s, end))) {
+			s += n - 1;
+			continue;
+		}
+
+		json_put(out, (const char *)run, s - run);
+		run = s + 1;
+		if (json_escape[*s] == 'u') {
+			esc[1] = 'u';
+			esc[4] = json_hex[*s >> 4];
+			esc[5] = json_hex[*s & 0xF];
+			json_put(out, esc, 6);
+		} else {
+			esc[1] = json_escape[*s];
+			json_put(out, esc, 2);
+		}
+	}
+	json_put(out, (const char *)run, end - run);
+}				/* json_put_escaped */
+
+/*---------------------------------------- json_put_int */
+static void
+json_put_int(struct json_out *out, uint32_t n)
+{
+	char digits[10];
+	char *p = digits + sizeof(digits);
+
+	do {
+		*--p = '0' + n % 10;
+		n /= 10;
+	} while (n);
+	json_put(out, p, digits + sizeof(digits) - p);
+}				/* json_put_int */
+
+/*---------------------------------------- json_put_dname */
+/**
+  * appends the presentation format of a wire format domain name, escaped
+  * for use within a JSON string, label by label
+  */
+static void
+json_put_dname(struct json_out *out, const struct getdns_bindata *dname)
+{
+	/* a label of (at most) 255 characters, each at most \DDD, and a dot */
+	uint8_t label[255 * 4 + 1];
+	uint8_t *l;
+	const uint8_t *p = dname->data, *end = dname->data + dname->size;
+	size_t i;
+
+	for (; p < end && *p && p + *p < end; p += *p + 1) {
+		l = label;
+		for (i = 1; i <= *p; i++) {
+			if (p[i] < 0x21 || p[i] > 0x7e) {
+				*l++ = '\\';
+				*l++ = '0' + p[i] / 100;
+				*l++ = '0' + p[i] / 10 % 10;
+				*l++ = '0' + p[i] % 10;
+				continue;
+			}
+			if (strchr(dname_special, p[i]))
+				*l++ = '\\';
+			*l++ = p[i];
+		}
+		*l++ = '.';
+		json_put_escaped(out, label, l - label);
+	}
+}				/* json_put_dname */
+
+/*---------------------------------------- json_put_hex */
+static void
+json_put_hex(struct json_out *out, const struct getdns_bindata *bindata)
+{
+	char chunk[64];
+	size_t i, n = 0;
+
+	for (i = 0; i < bindata->size; i++) {
+		chunk[n++] = json_hex[bindata->data[i] >> 4];
+		chunk[n++] = json_hex[bindata->data[i] & 0xF];
+		if (n == sizeof(chunk)) {
+			json_put(out, chunk, n);
+			n = 0;
+		}
+	}
+	json_put(out, chunk, n);
+}				/* json_put_hex */
+
+/*---------------------------------------- json_put_base64 */
+static void
+json_put_base64(struct json_out *out, const struct getdns_bindata *bindata)
+{
+	char chunk[64];
+	const uint8_t *d = bindata->data;
+	size_t i, n = 0, rest = bindata->size % 3;
+
+	for (i = 0; i + 3 <= bindata->size; i += 3) {
+		chunk[n++] = json_base64[d[i] >> 2];
+		chunk[n++] = json_base64[((d[i] & 0x03) << 4) | (d[i + 1] >> 4)];
+		chunk[n++] = json_base64[((d[i + 1] & 0x0F) << 2) | (d[i + 2] >> 6)];
+		chunk[n++] = json_base64[d[i + 2] & 0x3F];
+		if (n == sizeof(chunk)) {
+			json_put(out, chunk, n);
+			n = 0;
+		}
+	}
+	if (rest) {
+		chunk[n++] = json_base64[d[i] >> 2];
+		if (rest == 1) {
+			chunk[n++] = json_base64[(d[i] & 0x03) << 4];
+			chunk[n++] = '=';
+		} else {
+			chunk[n++] = json_base64[((d[i] & 0x03) << 4) | (d[i + 1] >> 4)];
+			chunk[n++] = json_base64[(d[i + 1] & 0x0F) << 2];
+		}
+		chunk[n++] = '=';
+	}
+	json_put(out, chunk, n);
+}				/* json_put_base64 */
+
+/*---------------------------------------- json_put_bindata */
+/**
+  * appends bindata as a JSON string.  IP addresses (when name says the
+  * bindata holds one), strings of printable ASCII and valid UTF-8, and
+  * domain names are written in their text form, anything else in hex
+  * (prefixed with 0x) or base64.
+  * @param name the dict name of the bindata, or NULL for list items
+  */
+static void
+json_put_bindata(struct json_out *out, const char *name,
+	const struct getdns_bindata *bindata)
+{
+	char addr[INET6_ADDRSTRLEN];
+	size_t i, n;
+
+	json_puts(out, "\"");
+
+	if (name && (bindata->size == 4 || bindata->size == 16) &&
+	    (strcmp(name, "ipv4_address") == 0 ||
+	     strcmp(name, "ipv6_address") == 0 ||
+	     strcmp(name, GETDNS_STR_ADDRESS_DATA) == 0) &&
+	    inet_ntop(bindata->size == 4 ? AF_INET : AF_INET6,
+		bindata->data, addr, sizeof(addr))) {
+		json_put(out, addr, strlen(addr));
+		json_puts(out, "\"");
+		return;
+	}
+	/* Walk through all printable characters */
+	i = 0;
+	if (bindata->size && bindata->data[bindata->size - 1] == 0)
+		while (i < bindata->size - 1 &&
+		    (n = utf8_len(bindata->data + i,
+		    bindata->data + bindata->size - 1)) &&
+		    (n > 1 || isprint(bindata->data[i])))
+			i += n;
+
+	if (bindata->size > 1 && i >= bindata->size - 1)
+		json_put_escaped(out, bindata->data, bindata->size - 1);
+
+	else if (bindata->size == 1 && *bindata->data == 0)
+		json_puts(out, ".");
+
+	else if (priv_getdns_bindata_is_dname(bindata))
+		json_put_dname(out, bindata);
+
+	else if (out->flags & GETDNS_JSON_BASE64)
+		json_put_base64(out, bindata);
+	else {
+		json_puts(out, "0x");
+		json_put_hex(out, bindata);
+	}
+	json_puts(out, "\"");
+}				/* json_put_bindata */
+
+static void json_put_dict(struct json_out *out,
+	const struct getdns_dict *dict);
+
+/*---------------------------------------- json_put_list */
+static void
+json_put_list(struct json_out *out, const struct getdns_list *list)
+{
+	struct getdns_list_item *item;
+	size_t i;
+
+	json_puts(out, "[");
+	for (i = 0; i < list->numinuse && !out->error; i++) {
+		if (i)
+			json_puts(out, ",");
+		item = &list->items[i];
+		switch (item->dtype) {
+		case t_int:
+			json_put_int(out, (uint32_t)item->data.n);
+			break;
+		case t_bindata:
+			json_put_bindata(out, NULL, item->data.bindata);
+			break;
+		case t_list:
+			json_put_list(out, item->data.list);
+			break;
+		case t_dict:
+			json_put_dict(out, item->data.dict);
+			break;
+		default:
+			json_puts(out, "null");
+			break;
+		}
+	}
+	json_puts(out, "]");
+}				/* json_put_list */
+
+/*---------------------------------------- json_put_dict */
+static void
+json_put_dict(struct json_out *out, const struct getdns_dict *dict)
+{
+	struct getdns_dict_item *item;
+	const char *name;
+	int first = 1;
+
+	json_puts(out, "{");
+	LDNS_RBTREE_FOR(item, struct getdns_dict_item *,
+	    (ldns_rbtree_t *)&dict->root) {
+		if (out->error)
+			break;
+		if (!first)
+			json_puts(out, ",");
+		first = 0;
+
+		name = (const char *)item->node.key;
+		json_puts(out, "\"");
+		json_put_escaped(out, (const uint8_t *)name, strlen(name));
+		json_puts(out, "\":");
+
+		switch (item->dtype) {
+		case t_int:
+			json_put_int(out, item->data.n);
+			break;
+		case t_bindata:
+			json_put_bindata(out, name, item->data.bindata);
+			break;
+		case t_list:
+			json_put_list(out, item->data.list);
+			break;
+		case t_dict:
+			json_put_dict(out, item->data.dict);
+			break;
+		default:
+			json_puts(out, "null");
+			break;
+		}
+	}
+	json_puts(out, "}");
+}				/* json_put_dict */
+
+/*---------------------------------------- getdns_write_json_dict */
+getdns_return_t
+getdns_write_json_dict(const struct getdns_dict *dict, int flags,
+	getdns_json_write_t write, void *userarg)
+{
+	char stage[JSON_STAGE_LEN];
+	struct json_out out;
+
+	if (!dict || !write)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	out.buf = stage;
+	out.len = sizeof(stage);
+	out.pos = 0;
+	out.total = 0;
+	out.write = write;
+	out.userarg = userarg;
+	out.error = 0;
+	out.flags = flags;
+
+	json_put_dict(&out, dict);
+	if (!out.error && out.pos && write(userarg, stage, out.pos))
+		out.error = 1;
+
+	return out.error ? GETDNS_RETURN_GENERIC_ERROR : GETDNS_RETURN_GOOD;
+}				/* getdns_write_json_dict */
+
+/*---------------------------------------- getdns_print_json_dict */
+getdns_return_t
+getdns_print_json_dict(const struct getdns_dict *dict, int flags,
+	char *buf, size_t *buf_len)
+{
+	struct json_out out;
+
+	if (!dict || !buf_len)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	out.buf = buf;
+	out.len = buf ? *buf_len : 0;
+	out.pos = 0;
+	out.total = 0;
+	out.write = NULL;
+	out.userarg = NULL;
+	out.error = 0;
+	out.flags = flags;
+
+	json_put_dict(&out, dict);
+	*buf_len = out.total;
+	if (!buf)
+		return GETDNS_RETURN_GOOD;
+	if (out.total >= out.len)
+		return GETDNS_RETURN_MEMORY_ERROR;
+
+	buf[out.total] = 0;
+	return GETDNS_RETURN_GOOD;
+}				/* getdns_print_json_dict */
+
+/* json.c */
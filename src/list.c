@@ -138,31 +138,54 @@ getdns_list_get_int(const struct getdns_list * list, size_t index,
 	return GETDNS_RETURN_GOOD;
 }				/* getdns_list_get_int */
 
-/*---------------------------------------- getdns_list_realloc */
+/*---------------------------------------- priv_getdns_list_reserve */
 /**
   * private function (API users should not be calling this)
-  * allocates a block of items, should be called when a list needs to grow
+  * makes sure the list has room for at least size items
   * preserves the existing items
-  * in case of an error the list should be considered unusable
+  * in case of an error the list is left untouched
   * @return GETDNS_RETURN_GOOD on success, GETDNS_RETURN_GENERIC_ERROR if out of memory
   */
 getdns_return_t
-getdns_list_realloc(struct getdns_list *list)
+priv_getdns_list_reserve(struct getdns_list *list, size_t size)
 {
 	struct getdns_list_item *newlist;
 
 	if (!list)
 		return GETDNS_RETURN_INVALID_PARAMETER;
 
+	if (size <= list->numalloc)
+		return GETDNS_RETURN_GOOD;
+
 	newlist = GETDNS_XREALLOC(list->mf, list->items,
-		struct getdns_list_item,
-		list->numalloc + GETDNS_LIST_BLOCKSZ);
+		struct getdns_list_item, size);
 	if (!newlist)
 		return GETDNS_RETURN_GENERIC_ERROR;
 
 	list->items = newlist;
-	list->numalloc += GETDNS_LIST_BLOCKSZ;
+	list->numalloc = size;
 	return GETDNS_RETURN_GOOD;
+}				/* priv_getdns_list_reserve */
+
+/*---------------------------------------- getdns_list_realloc */
+/**
+  * private function (API users should not be calling this)
+  * grows the list, should be called when a list needs to grow
+  * the number of allocated items is doubled (but is at least
+  * GETDNS_LIST_BLOCKSZ) so that appending N items costs O(N) copies
+  * preserves the existing items
+  * in case of an error the list should be considered unusable
+  * @return GETDNS_RETURN_GOOD on success, GETDNS_RETURN_GENERIC_ERROR if out of memory
+  */
+getdns_return_t
+getdns_list_realloc(struct getdns_list *list)
+{
+	if (!list)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	return priv_getdns_list_reserve(list,
+		list->numalloc < GETDNS_LIST_BLOCKSZ
+		? GETDNS_LIST_BLOCKSZ : list->numalloc * 2);
 }				/* getdns_list_realloc */
 
 /*---------------------------------------- getdns_list_copy */
@@ -181,13 +204,9 @@ getdns_list_copy(const struct getdns_list * srclist,
 		*dstlist = NULL;
 		return GETDNS_RETURN_GOOD;
 	}
-	*dstlist = getdns_list_create_with_extended_memory_functions(
-		srclist->mf.mf_arg,
-		srclist->mf.mf.ext.malloc,
-		srclist->mf.mf.ext.realloc,
-		srclist->mf.mf.ext.free
-	);
-	if (!dstlist)
+	*dstlist = priv_getdns_list_create_with_mf(&srclist->mf,
+		srclist->numinuse);
+	if (!*dstlist)
 		return GETDNS_RETURN_GENERIC_ERROR;
 
 	for (i = 0; i < srclist->numinuse; i++) {
@@ -227,41 +246,57 @@ getdns_list_copy(const struct getdns_list * srclist,
 	return GETDNS_RETURN_GOOD;
 }				/* getdns_list_copy */
 
+/*---------------------------------------- priv_getdns_list_create_with_mf */
+/**
+  * private function (API users should not be calling this)
+  * creates an empty list using the memory functions in mf, with room
+  * for capacity items before the list needs to grow
+  * @param mf memory functions to use for the list and its items
+  * @param capacity number of items to preallocate, 0 for the default
+  * @return pointer to an allocated list, NULL if insufficient memory
+  */
 struct getdns_list *
-getdns_list_create_with_extended_memory_functions(
-	void *userarg,
-	void *(*malloc)(void *userarg, size_t),
-	void *(*realloc)(void *userarg, void *, size_t),
-	void (*free)(void *userarg, void *))
+priv_getdns_list_create_with_mf(const struct mem_funcs *mf, size_t capacity)
 {
 	struct getdns_list *list;
-	mf_union mf;
 
-	if (!malloc || !realloc || !free)
+	if (!mf)
 		return NULL;
 
-	mf.ext.malloc = malloc;
-	list = userarg == MF_PLAIN
-		 ? (struct getdns_list *)(*mf.pln.malloc)(
-			   sizeof(struct getdns_list))
-		 : (struct getdns_list *)(*mf.ext.malloc)(userarg,
-			   sizeof(struct getdns_list));
+	list = GETDNS_MALLOC(*mf, struct getdns_list);
 	if (!list)
 		return NULL;
 
-	list->mf.mf_arg         = userarg;
-	list->mf.mf.ext.malloc  = malloc;
-	list->mf.mf.ext.realloc = realloc;
-	list->mf.mf.ext.free    = free;
-
+	list->mf = *mf;
 	list->numalloc = 0;
 	list->numinuse = 0;
 	list->items = NULL;
-	if (getdns_list_realloc(list) != GETDNS_RETURN_GOOD) {
+	if (priv_getdns_list_reserve(list, capacity
+		? capacity : GETDNS_LIST_BLOCKSZ) != GETDNS_RETURN_GOOD) {
 		getdns_list_destroy(list);
 		return NULL;
 	}
 	return list;
+}				/* priv_getdns_list_create_with_mf */
+
+struct getdns_list *
+getdns_list_create_with_extended_memory_functions(
+	void *userarg,
+	void *(*malloc)(void *userarg, size_t),
+	void *(*realloc)(void *userarg, void *, size_t),
+	void (*free)(void *userarg, void *))
+{
+	struct mem_funcs mf;
+
+	if (!malloc || !realloc || !free)
+		return NULL;
+
+	mf.mf_arg         = userarg;
+	mf.mf.ext.malloc  = malloc;
+	mf.mf.ext.realloc = realloc;
+	mf.mf.ext.free    = free;
+
+	return priv_getdns_list_create_with_mf(&mf, 0);
 }
 
 struct getdns_list *
@@ -293,6 +328,23 @@ getdns_list_create_with_context(struct getdns_context *context)
 			realloc, free);
 }			/* getdns_list_create_with_context */
 
+/*-------------------------- getdns_list_create_with_capacity */
+struct getdns_list *
+getdns_list_create_with_capacity(struct getdns_context *context,
+	size_t capacity)
+{
+	struct mem_funcs mf;
+
+	if (context)
+		return priv_getdns_list_create_with_mf(&context->mf, capacity);
+
+	mf.mf_arg         = MF_PLAIN;
+	mf.mf.pln.malloc  = malloc;
+	mf.mf.pln.realloc = realloc;
+	mf.mf.pln.free    = free;
+	return priv_getdns_list_create_with_mf(&mf, capacity);
+}			/* getdns_list_create_with_capacity */
+
 /*---------------------------------------- getdns_list_create */
 struct getdns_list *
 getdns_list_create()
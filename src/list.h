@@ -40,6 +40,7 @@
 #include <getdns/getdns.h>
 #include "types-internal.h"
 
+/* minimum number of items allocated for a list, lists grow geometrically */
 #define GETDNS_LIST_BLOCKSZ 10
 
 /**
@@ -63,6 +64,8 @@ struct getdns_list_item
  * lists are implemented as arrays internally since the helper functions
  * like to reference indexes in the list.  Elements are allocated in blocks
  * and then marked valid as they are used and invalid as they are not used
+ * The block doubles in size every time the list runs out of room.  When the
+ * final size is known upfront, create the list with a capacity hint instead.
  * The use cases do not justify working too hard at shrinking the structures.
  * Indexes are 0 based.
  */
@@ -0,0 +1,267 @@
+/**
+ *
+ * /brief getdns compiled path queries
+ *
+ * A path expression, like "/replies_tree/<star>/answer/<star>/rdata/ipv4_address"
+ * with <star> written as '*', is parsed once into a getdns_path.  The path
+ * can then be used to extract all matching items from any number of
+ * response dicts, each with a single traversal.
+ *
+ */
+
+/*
+ * Copyright (c) 2013, NLnet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include "types-internal.h"
+#include "util-internal.h"
+#include "list.h"
+#include "dict.h"
+
+typedef enum path_seg_type {
+	PATH_SEG_NAME,		/* dict member; also a list index if numeric */
+	PATH_SEG_WILDCARD	/* every list item or dict member */
+} path_seg_type;
+
+struct path_seg
+{
+	path_seg_type type;
+	const char *name;
+	int is_index;
+	size_t index;
+};
+
+/**
+ * A compiled path.  The segments and the (unescaped) segment names are
+ * stored in the same allocation, directly behind the header.
+ */
+struct getdns_path
+{
+	struct mem_funcs mf;
+	size_t nsegs;
+	struct path_seg *segs;
+};
+
+struct path_extract_state
+{
+	getdns_path_match *matches;
+	size_t max;
+	size_t count;
+};
+
+/*---------------------------------------- getdns_path_compile */
+getdns_return_t
+getdns_path_compile(struct getdns_context *context, const char *expression,
+	struct getdns_path **path)
+{
+	struct mem_funcs mf;
+	const char *s;
+	size_t nsegs, len, i;
+	struct getdns_path *p;
+	char *names, *d;
+	const char *n;
+
+	if (!expression || !path)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	/* like a JSON pointer the expression is either empty (the whole
+	 * dict) or a sequence of '/' prefixed segments */
+	if (*expression && *expression != '/')
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	for (nsegs = 0, s = expression; *s; s++)
+		if (*s == '/')
+			nsegs++;
+	len = s - expression;
+
+	if (context)
+		mf = context->mf;
+	else {
+		mf.mf_arg         = MF_PLAIN;
+		mf.mf.pln.malloc  = malloc;
+		mf.mf.pln.realloc = realloc;
+		mf.mf.pln.free    = free;
+	}
+	p = (struct getdns_path *)GETDNS_XMALLOC(mf, uint8_t,
+		sizeof(struct getdns_path) + nsegs * sizeof(struct path_seg)
+		+ len + 1);
+	if (!p)
+		return GETDNS_RETURN_MEMORY_ERROR;
+
+	p->mf = mf;
+	p->nsegs = nsegs;
+	p->segs = (struct path_seg *)(p + 1);
+	names = (char *)(p->segs + nsegs);
+
+	for (i = 0, s = expression, d = names; i < nsegs; i++) {
+		struct path_seg *seg = &p->segs[i];
+
+		seg->name = d;
+		for (s++; *s && *s != '/'; s++) {
+			if (*s != '~')
+				*d++ = *s;
+			else if (s[1] == '0')
+				*d++ = '~', s++;
+			else if (s[1] == '1')
+				*d++ = '/', s++;
+			else {
+				GETDNS_FREE(mf, p);
+				return GETDNS_RETURN_INVALID_PARAMETER;
+			}
+		}
+		*d++ = 0;
+
+		if (strcmp(seg->name, "*") == 0) {
+			seg->type = PATH_SEG_WILDCARD;
+			continue;
+		}
+		seg->type = PATH_SEG_NAME;
+		seg->index = 0;
+		/* no leading zeros, like JSON pointer array indices */
+		seg->is_index = isdigit((unsigned char)seg->name[0]) &&
+			(seg->name[0] != '0' || seg->name[1] == 0);
+		for (n = seg->name; seg->is_index && *n; n++)
+			if (!isdigit((unsigned char)*n))
+				seg->is_index = 0;
+		for (n = seg->name; seg->is_index && *n; n++) {
+			/* an index that does not fit would wrap around */
+			if (seg->index > (SIZE_MAX - (*n - '0')) / 10) {
+				GETDNS_FREE(mf, p);
+				return GETDNS_RETURN_INVALID_PARAMETER;
+			}
+			seg->index = seg->index * 10 + (*n - '0');
+		}
+	}
+	*path = p;
+	return GETDNS_RETURN_GOOD;
+}				/* getdns_path_compile */
+
+/*---------------------------------------- getdns_path_destroy */
+void
+getdns_path_destroy(struct getdns_path *path)
+{
+	if (path)
+		GETDNS_FREE(path->mf, path);
+}				/* getdns_path_destroy */
+
+/*---------------------------------------- path_walk */
+/**
+  * matches the segments of path from seg onwards against item
+  * @param path the compiled path
+  * @param seg index of the segment to match against item
+  * @param dtype data type of item
+  * @param item the item to match
+  * @param state where to store the matches
+  */
+static void
+path_walk(const struct getdns_path *path, size_t seg,
+	getdns_data_type dtype, union getdns_item item,
+	struct path_extract_state *state)
+{
+	const struct path_seg *s;
+	struct getdns_dict_item *dict_item;
+	struct getdns_list_item *list_item;
+	union getdns_item child;
+	size_t i;
+
+	if (seg == path->nsegs) {
+		if (state->count < state->max) {
+			getdns_path_match *m = &state->matches[state->count];
+
+			m->dtype = dtype;
+			switch (dtype) {
+			case t_dict:	m->data.dict    = item.dict;    break;
+			case t_list:	m->data.list    = item.list;    break;
+			case t_int:	m->data.n       = item.n;       break;
+			case t_bindata:	m->data.bindata = item.bindata; break;
+			default:	break;
+			}
+		}
+		state->count++;
+		return;
+	}
+	s = &path->segs[seg];
+
+	if (dtype == t_dict) {
+		if (s->type == PATH_SEG_WILDCARD) {
+			LDNS_RBTREE_FOR(dict_item, struct getdns_dict_item *,
+			    &item.dict->root)
+				path_walk(path, seg + 1, dict_item->dtype,
+				    dict_item->data, state);
+
+		} else if ((dict_item = (struct getdns_dict_item *)
+		    ldns_rbtree_search(&item.dict->root, s->name)))
+			path_walk(path, seg + 1, dict_item->dtype,
+			    dict_item->data, state);
+
+	} else if (dtype == t_list) {
+		for (i = 0; i < item.list->numinuse; i++) {
+			if (s->type != PATH_SEG_WILDCARD) {
+				if (!s->is_index || s->index >= item.list->numinuse)
+					return;
+				i = s->index;
+			}
+			list_item = &item.list->items[i];
+			switch (list_item->dtype) {
+			case t_dict:	child.dict    = list_item->data.dict;    break;
+			case t_list:	child.list    = list_item->data.list;    break;
+			case t_int:	child.n       = list_item->data.n;       break;
+			case t_bindata:	child.bindata = list_item->data.bindata; break;
+			default:	continue;
+			}
+			path_walk(path, seg + 1, list_item->dtype, child, state);
+			if (s->type != PATH_SEG_WILDCARD)
+				return;
+		}
+	}
+}				/* path_walk */
+
+/*---------------------------------------- getdns_path_extract */
+getdns_return_t
+getdns_path_extract(const struct getdns_path *path,
+	struct getdns_dict *dict, getdns_path_match *matches, size_t max,
+	size_t *count)
+{
+	struct path_extract_state state;
+	union getdns_item root;
+
+	if (!path || !dict || !count || (max && !matches))
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	state.matches = matches;
+	state.max = max;
+	state.count = 0;
+	root.dict = dict;
+	path_walk(path, 0, t_dict, root, &state);
+
+	*count = state.count;
+	return GETDNS_RETURN_GOOD;
+}				/* getdns_path_extract */
+
+/* path.c */
@@ -0,0 +1,455 @@
+/**
+ *
+ * /brief getdns resolver pool
+ *
+ * Worker threads, each with a context of its own, that share the
+ * requests submitted to the pool by stealing from each other.
+ *
+ */
+
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include "types-internal.h"
+#include "util-internal.h"
+#include "context.h"
+#include "submission.h"
+
+/* requests a worker has outstanding before it leaves the rest of its
+ * queue to be stolen by others
+ */
+#define POOL_WORKER_MAX_INFLIGHT 256
+
+struct pool_worker;
+
+/* a request submitted to the pool */
+struct pool_request {
+	/* the worker that started it */
+	struct pool_worker *worker;
+	getdns_completion_queue *queue;
+	char *name;
+	uint16_t request_type;
+	struct getdns_dict *extensions;
+	void *userarg;
+};
+
+struct pool_worker {
+	struct getdns_pool *pool;
+	struct getdns_context *context;
+	pthread_t thread;
+	int started;
+
+	/* Deque of requests not yet started.  The worker takes from the
+	 * head, in order of submission, other workers steal from the tail.
+	 */
+	pthread_mutex_t lock;
+	struct pool_request **deque;
+	size_t head;
+	size_t count;
+	size_t alloc;
+
+	/* signaled on submission, and for idle workers, on work to steal */
+	int fd[2];
+	int signaled;
+	int idle;
+	uint32_t inflight;
+};
+
+struct getdns_pool {
+	struct pool_worker *workers;
+	size_t num_workers;
+	/* for requests submitted without a completion queue */
+	getdns_completion_queue *completions;
+	/* the next worker to submit to */
+	size_t next;
+	int stopping;
+};
+
+/*---------------------------------------- requests */
+static void
+request_destroy(struct pool_request *req)
+{
+	free(req->name);
+	getdns_dict_destroy(req->extensions);
+	free(req);
+}
+
+static void
+request_complete(struct pool_request *req,
+    getdns_callback_type_t callback_type, struct getdns_dict *response,
+    getdns_transaction_t transaction_id)
+{
+	getdns_completion_t completion;
+
+	completion.transaction_id = transaction_id;
+	completion.callback_type = callback_type;
+	completion.response = response;
+	completion.userarg = req->userarg;
+	if (priv_getdns_completion_queue_push(req->queue, &completion))
+		getdns_dict_destroy(response);
+	request_destroy(req);
+}
+
+static void
+pool_callback(struct getdns_context *context,
+    getdns_callback_type_t callback_type, struct getdns_dict *response,
+    void *userarg, getdns_transaction_t transaction_id)
+{
+	struct pool_request *req = (struct pool_request *)userarg;
+
+	__atomic_sub_fetch(&req->worker->inflight, 1, __ATOMIC_RELAXED);
+	request_complete(req, callback_type, response, transaction_id);
+}
+
+/*---------------------------------------- deques */
+static getdns_return_t
+deque_push(struct pool_worker *w, struct pool_request *req)
+{
+	struct pool_request **deque;
+	size_t alloc, i;
+
+	(void) pthread_mutex_lock(&w->lock);
+	if (w->count == w->alloc) {
+		alloc = w->alloc ? w->alloc * 2 : 64;
+		deque = malloc(alloc * sizeof(struct pool_request *));
+		if (!deque) {
+			(void) pthread_mutex_unlock(&w->lock);
+			return GETDNS_RETURN_MEMORY_ERROR;
+		}
+		for (i = 0; i < w->count; i++)
+			deque[i] = w->deque[(w->head + i) % w->alloc];
+		free(w->deque);
+		w->deque = deque;
+		w->head = 0;
+		w->alloc = alloc;
+	}
+	w->deque[(w->head + w->count) % w->alloc] = req;
+	__atomic_store_n(&w->count, w->count + 1, __ATOMIC_RELAXED);
+	(void) pthread_mutex_unlock(&w->lock);
+	return GETDNS_RETURN_GOOD;
+}
+
+/* the oldest request of w, or by a thief the newest */
+static struct pool_request *
+deque_pop(struct pool_worker *w, int steal)
+{
+	struct pool_request *req = NULL;
+
+	(void) pthread_mutex_lock(&w->lock);
+	if (w->count > 0) {
+		if (steal)
+			req = w->deque[(w->head + w->count - 1) % w->alloc];
+		else {
+			req = w->deque[w->head];
+			w->head = (w->head + 1) % w->alloc;
+		}
+		__atomic_store_n(&w->count, w->count - 1, __ATOMIC_RELAXED);
+	}
+	(void) pthread_mutex_unlock(&w->lock);
+	return req;
+}
+
+/* take a request from the worker with the longest queue */
+static struct pool_request *
+steal(struct pool_worker *w)
+{
+	struct getdns_pool *pool = w->pool;
+	struct pool_worker *victim = NULL;
+	size_t i, count, most = 0;
+
+	for (i = 0; i < pool->num_workers; i++) {
+		if (&pool->workers[i] == w)
+			continue;
+		count = __atomic_load_n(&pool->workers[i].count, __ATOMIC_RELAXED);
+		if (count > most) {
+			most = count;
+			victim = &pool->workers[i];
+		}
+	}
+	return victim ? deque_pop(victim, 1) : NULL;
+}
+
+/*---------------------------------------- workers */
+static void
+worker_wake(struct pool_worker *w)
+{
+	/* only the first since the worker last woke up writes to the fd */
+	if (!__atomic_exchange_n(&w->signaled, 1, __ATOMIC_ACQ_REL))
+		priv_getdns_wakeup_signal(w->fd);
+}
+
+static void
+worker_start(struct pool_worker *w, struct pool_request *req)
+{
+	getdns_transaction_t transaction_id = 0;
+
+	req->worker = w;
+	__atomic_add_fetch(&w->inflight, 1, __ATOMIC_RELAXED);
+	if (getdns_general(w->context, req->name, req->request_type,
+	    req->extensions, req, &transaction_id, pool_callback)) {
+		__atomic_sub_fetch(&w->inflight, 1, __ATOMIC_RELAXED);
+		request_complete(req, GETDNS_CALLBACK_ERROR, NULL,
+		    transaction_id);
+	}
+}
+
+/* start requests from the own queue, or stolen ones, up to the maximum
+ * Returns whether anything was started.
+ */
+static int
+worker_take(struct pool_worker *w)
+{
+	struct pool_request *req;
+	int started = 0;
+
+	while (__atomic_load_n(&w->inflight, __ATOMIC_RELAXED) <
+	    POOL_WORKER_MAX_INFLIGHT &&
+	    ((req = deque_pop(w, 0)) || (req = steal(w)))) {
+		worker_start(w, req);
+		started = 1;
+	}
+	return started;
+}
+
+static void *
+worker_run(void *arg)
+{
+	struct pool_worker *w = (struct pool_worker *)arg;
+	struct pollfd fds[2];
+	struct timeval tv;
+	int timeout;
+
+	fds[0].events = POLLIN;
+	fds[1].fd = w->fd[0];
+	fds[1].events = POLLIN;
+	while (!__atomic_load_n(&w->pool->stopping, __ATOMIC_ACQUIRE)) {
+		(void) worker_take(w);
+
+		/* not every pending state sets a timeout */
+		tv.tv_sec = 1;
+		tv.tv_usec = 0;
+		if (getdns_context_get_num_pending_requests(w->context, &tv)) {
+			timeout = tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000;
+			if (timeout < 0)
+				timeout = 0;
+		} else {
+			/* Announce being idle before looking for work once
+			 * more, so that a submitter either sees the flag or
+			 * its request is found.
+			 */
+			__atomic_store_n(&w->idle, 1, __ATOMIC_SEQ_CST);
+			if (worker_take(w)) {
+				__atomic_store_n(&w->idle, 0, __ATOMIC_SEQ_CST);
+				continue;
+			}
+			timeout = -1;
+		}
+		fds[0].fd = getdns_context_fd(w->context);
+		if (poll(fds, 2, timeout) == -1 && errno != EINTR)
+			break;
+
+		__atomic_store_n(&w->idle, 0, __ATOMIC_SEQ_CST);
+		if (fds[1].revents) {
+			/* cleared before taking work, as in the submission
+			 * queue, so a wake that is not written is not needed
+			 */
+			priv_getdns_wakeup_clear(w->fd);
+			(void) __atomic_exchange_n(&w->signaled, 0,
+			    __ATOMIC_ACQ_REL);
+		}
+		(void) getdns_context_process_async(w->context);
+	}
+	return NULL;
+}
+
+/* wake an idle worker, if any, to steal from one that has enough to do */
+static void
+wake_idle(struct getdns_pool *pool)
+{
+	size_t i;
+
+	for (i = 0; i < pool->num_workers; i++) {
+		if (__atomic_exchange_n(&pool->workers[i].idle, 0,
+		    __ATOMIC_SEQ_CST)) {
+			worker_wake(&pool->workers[i]);
+			return;
+		}
+	}
+}
+
+static void
+worker_cleanup(struct pool_worker *w)
+{
+	struct pool_request *req;
+
+	/* cancels the outstanding requests through pool_callback */
+	getdns_context_destroy(w->context);
+	while ((req = deque_pop(w, 0)))
+		request_complete(req, GETDNS_CALLBACK_CANCEL, NULL, 0);
+	free(w->deque);
+	priv_getdns_wakeup_close(w->fd);
+	(void) pthread_mutex_destroy(&w->lock);
+}
+
+/*---------------------------------------- getdns_pool_create */
+getdns_return_t
+getdns_pool_create(getdns_pool **pool, size_t num_workers, int set_from_os,
+    getdns_pool_setup_t setup, void *userarg)
+{
+	struct getdns_pool *p;
+	struct pool_worker *w;
+	getdns_return_t r;
+	size_t i;
+
+	if (!pool || !num_workers)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	if (!(p = malloc(sizeof(struct getdns_pool))))
+		return GETDNS_RETURN_MEMORY_ERROR;
+
+	(void) memset(p, 0, sizeof(struct getdns_pool));
+	if (!(p->workers = calloc(num_workers, sizeof(struct pool_worker)))) {
+		free(p);
+		return GETDNS_RETURN_MEMORY_ERROR;
+	}
+	if ((r = getdns_completion_queue_create(&p->completions))) {
+		free(p->workers);
+		free(p);
+		return r;
+	}
+	/* The contexts are created and set up here, so failures are
+	 * reported to the caller.  Each is only used by its worker after.
+	 */
+	for (i = 0; i < num_workers; i++, p->num_workers++) {
+		w = &p->workers[i];
+		w->pool = p;
+		if ((r = getdns_context_create(&w->context, set_from_os)))
+			break;
+		if (setup && (r = setup(w->context, userarg))) {
+			getdns_context_destroy(w->context);
+			break;
+		}
+		if (priv_getdns_wakeup_open(w->fd) == -1) {
+			getdns_context_destroy(w->context);
+			r = GETDNS_RETURN_GENERIC_ERROR;
+			break;
+		}
+		(void) pthread_mutex_init(&w->lock, NULL);
+	}
+	for (i = 0; r == GETDNS_RETURN_GOOD && i < num_workers; i++) {
+		w = &p->workers[i];
+		if (pthread_create(&w->thread, NULL, worker_run, w) != 0)
+			r = GETDNS_RETURN_GENERIC_ERROR;
+		else
+			w->started = 1;
+	}
+	if (r != GETDNS_RETURN_GOOD) {
+		getdns_pool_destroy(p);
+		return r;
+	}
+	*pool = p;
+	return GETDNS_RETURN_GOOD;
+}				/* getdns_pool_create */
+
+/*---------------------------------------- getdns_pool_destroy */
+void
+getdns_pool_destroy(getdns_pool *pool)
+{
+	size_t i;
+
+	if (!pool)
+		return;
+
+	__atomic_store_n(&pool->stopping, 1, __ATOMIC_RELEASE);
+	for (i = 0; i < pool->num_workers; i++)
+		worker_wake(&pool->workers[i]);
+	for (i = 0; i < pool->num_workers; i++)
+		if (pool->workers[i].started)
+			(void) pthread_join(pool->workers[i].thread, NULL);
+
+	for (i = 0; i < pool->num_workers; i++)
+		worker_cleanup(&pool->workers[i]);
+
+	getdns_completion_queue_destroy(pool->completions);
+	free(pool->workers);
+	free(pool);
+}				/* getdns_pool_destroy */
+
+getdns_completion_queue *
+getdns_pool_get_completion_queue(getdns_pool *pool)
+{
+	return pool ? pool->completions : NULL;
+}
+
+/*---------------------------------------- getdns_pool_submit_general */
+getdns_return_t
+getdns_pool_submit_general(getdns_pool *pool, getdns_completion_queue *queue,
+    const char *name, uint16_t request_type,
+    struct getdns_dict *extensions, void *userarg)
+{
+	struct pool_request *req;
+	struct pool_worker *w;
+	getdns_return_t r;
+
+	if (!pool || !name)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	if (!(req = malloc(sizeof(struct pool_request))))
+		return GETDNS_RETURN_MEMORY_ERROR;
+
+	req->worker = NULL;
+	req->queue = queue ? queue : pool->completions;
+	req->request_type = request_type;
+	req->extensions = NULL;
+	req->userarg = userarg;
+	if (!(req->name = strdup(name)) ||
+	    (extensions && getdns_dict_copy(extensions, &req->extensions))) {
+		request_destroy(req);
+		return GETDNS_RETURN_MEMORY_ERROR;
+	}
+	w = &pool->workers[__atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)
+	    % pool->num_workers];
+	if ((r = deque_push(w, req))) {
+		request_destroy(req);
+		return r;
+	}
+	worker_wake(w);
+	if (__atomic_load_n(&w->inflight, __ATOMIC_RELAXED) >=
+	    POOL_WORKER_MAX_INFLIGHT)
+		/* w has its hands full, have someone else take it */
+		wake_idle(pool);
+
+	return GETDNS_RETURN_GOOD;
+}				/* getdns_pool_submit_general */
+
+/* pool.c */
@@ -46,6 +46,9 @@ network_req_free(getdns_network_req * net_req)
 	if (net_req->result) {
 		ldns_pkt_free(net_req->result);
 	}
+	if (net_req->wire) {
+		GETDNS_FREE(net_req->owner->my_mf, net_req->wire);
+	}
 	GETDNS_FREE(net_req->owner->my_mf, net_req);
 }
 
@@ -69,6 +72,28 @@ network_req_new(getdns_dns_req * owner,
 	net_req->state = NET_REQ_NOT_SENT;
 	net_req->owner = owner;
 
+	net_req->stub = 0;
+	net_req->query_id = 0;
+	net_req->wire = NULL;
+	net_req->wire_len = 0;
+	net_req->upstreams = NULL;
+	net_req->upstream = 0;
+	net_req->tries = 0;
+	net_req->retry_id = 0;
+	net_req->hash_next = NULL;
+	net_req->hash = 0;
+	net_req->sockets[0] = net_req->sockets[1] = NULL;
+	net_req->pending_next = NULL;
+	net_req->pending_pprev = NULL;
+	net_req->tcp = 0;
+	net_req->conn = NULL;
+	net_req->sent_usec = 0;
+	net_req->edns_size = 0;
+	net_req->hedging = 0;
+	net_req->charged = NULL;
+	net_req->held = 0;
+	net_req->n_deadlines = 0;
+
 	/* TODO: records and other extensions */
 
 	return net_req;
@@ -94,12 +119,16 @@ dns_req_free(getdns_dns_req * req)
 		net_req = next;
 	}
 
-    if (req->local_timeout_id != 0) {
-        getdns_context_clear_timeout(context, req->local_timeout_id);
+    /* the sync functions may run in parallel with the thread that
+     * owns the timeouts, so they stay away from them
+     */
+    if (!req->sync) {
+        if (req->local_timeout_id != 0) {
+            getdns_context_clear_timeout(context, req->local_timeout_id);
+        }
+        getdns_context_clear_timeout(context, req->trans_id);
     }
 
-    getdns_context_clear_timeout(context, req->trans_id);
-
 	/* free strduped name */
 	GETDNS_FREE(req->my_mf, req->name);
 
@@ -122,6 +151,7 @@ dns_req_new(struct getdns_context *context,
     result->my_mf = context->mf;
 	result->name = getdns_strdup(&(result->my_mf), name);
 	result->context = context;
+	result->unbound_ctx = context->unbound_ctx;
 	result->canceled = 0;
 	result->current_req = NULL;
 	result->first_req = NULL;
@@ -129,6 +159,11 @@ dns_req_new(struct getdns_context *context,
 
 	getdns_dict_copy(extensions, &result->extensions);
     result->return_dnssec_status = context->return_dnssec_status;
+    result->sync = 0;
+    result->native_stub = 0;
+    result->admitted = 0;
+    result->admission_next = NULL;
+    result->admission_pprev = NULL;
 
 	/* will be set by caller */
 	result->user_pointer = NULL;
@@ -584,7 +584,8 @@ priv_getdns_equip_dict_with_txt_rdfs(struct getdns_dict* rdata, ldns_rr* rr,
     struct getdns_bindata bindata;
     uint8_t buffer[LDNS_MAX_RDFLEN];
     getdns_return_t r = GETDNS_RETURN_GOOD;
-    struct getdns_list* records = getdns_list_create_with_context(context);
+    struct getdns_list* records = getdns_list_create_with_capacity(context,
+        ldns_rr_rd_count(rr));
     if (!records) {
         return GETDNS_RETURN_MEMORY_ERROR;
     }
@@ -667,7 +668,8 @@ priv_getdns_equip_dict_with_hip_rdfs(struct getdns_dict* rdata, ldns_rr* rr,
         /* servers */
         size_t i;
         struct getdns_bindata server_data;
-        struct getdns_list* servers = getdns_list_create_with_context(context);
+        struct getdns_list* servers = getdns_list_create_with_capacity(context,
+            ldns_rr_rd_count(rr) - 1);
         if (!servers) {
             return GETDNS_RETURN_MEMORY_ERROR;
         }
@@ -757,7 +759,8 @@ priv_getdns_equip_dict_with_apl_rdfs(struct getdns_dict* rdata, ldns_rr* rr,
                                      struct getdns_context* context) {
     size_t i;
     getdns_return_t r = GETDNS_RETURN_GOOD;
-    struct getdns_list* records = getdns_list_create_with_context(context);
+    struct getdns_list* records = getdns_list_create_with_capacity(context,
+        ldns_rr_rd_count(rr));
     if (!records) {
         return GETDNS_RETURN_MEMORY_ERROR;
     }
@@ -0,0 +1,500 @@
+/**
+ *
+ * /brief getdns binary serialization of dicts and lists
+ *
+ * A compact, versioned encoding of getdns_dict trees, for shipping
+ * responses between processes and storing them in caches.
+ *
+ */
+
+/*
+ * Copyright (c) 2013, NLnet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "types-internal.h"
+#include "util-internal.h"
+#include "context.h"
+#include "list.h"
+#include "dict.h"
+
+/*
+ * A serialized dict consists of an 8 octet header followed by the body.
+ * The header has the magic "GD", a version octet, a reserved octet that
+ * must be zero, and the length of the body as a 32 bit unsigned integer in network
+ * order.  The body is the encoding of the dict, using a subset of CBOR
+ * (RFC 7049):
+ *
+ *   t_int      major type 0, unsigned integer (at most 32 bits)
+ *   t_bindata  major type 2, byte string
+ *   dict names major type 3, text string (without terminating zero)
+ *   t_list     major type 4, array
+ *   t_dict     major type 5, map with text string keys
+ *
+ * Integers and lengths are encoded in the shortest possible form.
+ * Dict members are written in the (sorted) order of the dict.
+ */
+#define SERIALIZE_MAGIC_0	'G'
+#define SERIALIZE_MAGIC_1	'D'
+#define SERIALIZE_VERSION	1
+#define SERIALIZE_HEADER_LEN	8
+
+/* deeper nesting than this is rejected by the decoder */
+#define SERIALIZE_MAX_DEPTH	64
+
+/* returned by the encoders for data with a length that does not fit in
+   32 bits, and passed on by those that follow */
+#define SERIALIZE_OVERSIZED	((size_t)-1)
+
+#define MAJOR_UINT	0
+#define MAJOR_BYTES	2
+#define MAJOR_TEXT	3
+#define MAJOR_ARRAY	4
+#define MAJOR_MAP	5
+
+/*---------------------------------------- serialize_head */
+/**
+  * writes a CBOR head at pos, if it fits in buf
+  * @return the position after the head
+  */
+static size_t
+serialize_head(uint8_t *buf, size_t len, size_t pos, int major,
+	uint32_t value)
+{
+	uint8_t head[5];
+	size_t head_len;
+
+	if (pos == SERIALIZE_OVERSIZED)
+		return pos;
+	if (value < 24) {
+		head[0] = (major << 5) | value;
+		head_len = 1;
+	} else if (value <= 0xFF) {
+		head[0] = (major << 5) | 24;
+		head[1] = value;
+		head_len = 2;
+	} else if (value <= 0xFFFF) {
+		head[0] = (major << 5) | 25;
+		head[1] = value >> 8;
+		head[2] = value;
+		head_len = 3;
+	} else {
+		head[0] = (major << 5) | 26;
+		head[1] = value >> 24;
+		head[2] = value >> 16;
+		head[3] = value >> 8;
+		head[4] = value;
+		head_len = 5;
+	}
+	if (pos + head_len <= len)
+		(void) memcpy(buf + pos, head, head_len);
+	return pos + head_len;
+}				/* serialize_head */
+
+/*---------------------------------------- serialize_data */
+static size_t
+serialize_data(uint8_t *buf, size_t len, size_t pos, int major,
+	const void *data, size_t data_len)
+{
+	if (data_len > 0xFFFFFFFF)
+		return SERIALIZE_OVERSIZED;
+	pos = serialize_head(buf, len, pos, major, data_len);
+	if (pos == SERIALIZE_OVERSIZED)
+		return pos;
+	if (pos + data_len <= len && data_len)
+		(void) memcpy(buf + pos, data, data_len);
+	return pos + data_len;
+}				/* serialize_data */
+
+static size_t serialize_dict(uint8_t *buf, size_t len, size_t pos,
+	const struct getdns_dict *dict);
+
+/*---------------------------------------- serialize_list */
+static size_t
+serialize_list(uint8_t *buf, size_t len, size_t pos,
+	const struct getdns_list *list)
+{
+	struct getdns_list_item *item;
+	size_t i;
+
+	if (list->numinuse > 0xFFFFFFFF)
+		return SERIALIZE_OVERSIZED;
+	pos = serialize_head(buf, len, pos, MAJOR_ARRAY, list->numinuse);
+	for (i = 0; i < list->numinuse; i++) {
+		item = &list->items[i];
+		switch (item->dtype) {
+		case t_dict:
+			pos = serialize_dict(buf, len, pos, item->data.dict);
+			break;
+		case t_list:
+			pos = serialize_list(buf, len, pos, item->data.list);
+			break;
+		case t_int:
+			pos = serialize_head(buf, len, pos, MAJOR_UINT,
+				(uint32_t)item->data.n);
+			break;
+		case t_bindata:
+			pos = serialize_data(buf, len, pos, MAJOR_BYTES,
+				item->data.bindata->data,
+				item->data.bindata->size);
+			break;
+		default:
+			break;
+		}
+	}
+	return pos;
+}				/* serialize_list */
+
+/*---------------------------------------- serialize_dict */
+static size_t
+serialize_dict(uint8_t *buf, size_t len, size_t pos,
+	const struct getdns_dict *dict)
+{
+	struct getdns_dict_item *item;
+
+	if (dict->root.count > 0xFFFFFFFF)
+		return SERIALIZE_OVERSIZED;
+	pos = serialize_head(buf, len, pos, MAJOR_MAP, dict->root.count);
+	LDNS_RBTREE_FOR(item, struct getdns_dict_item *,
+	    (ldns_rbtree_t *)&dict->root) {
+		pos = serialize_data(buf, len, pos, MAJOR_TEXT,
+			item->node.key, strlen((const char *)item->node.key));
+		switch (item->dtype) {
+		case t_dict:
+			pos = serialize_dict(buf, len, pos, item->data.dict);
+			break;
+		case t_list:
+			pos = serialize_list(buf, len, pos, item->data.list);
+			break;
+		case t_int:
+			pos = serialize_head(buf, len, pos, MAJOR_UINT,
+				item->data.n);
+			break;
+		case t_bindata:
+			pos = serialize_data(buf, len, pos, MAJOR_BYTES,
+				item->data.bindata->data,
+				item->data.bindata->size);
+			break;
+		default:
+			break;
+		}
+	}
+	return pos;
+}				/* serialize_dict */
+
+/*---------------------------------------- getdns_dict_serialize */
+getdns_return_t
+getdns_dict_serialize(const struct getdns_dict *dict, uint8_t *buf,
+	size_t *buf_len)
+{
+	size_t len, body_len;
+
+	if (!dict || !buf_len)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	len = buf ? *buf_len : 0;
+	if ((*buf_len = serialize_dict(buf, len, SERIALIZE_HEADER_LEN, dict))
+	    == SERIALIZE_OVERSIZED) {
+		*buf_len = 0;
+		return GETDNS_RETURN_INVALID_PARAMETER;
+	}
+	if (!buf)
+		return GETDNS_RETURN_GOOD;
+	if (*buf_len > len)
+		return GETDNS_RETURN_MEMORY_ERROR;
+
+	body_len = *buf_len - SERIALIZE_HEADER_LEN;
+	if (body_len > 0xFFFFFFFF)
+		return GETDNS_RETURN_GENERIC_ERROR;
+
+	buf[0] = SERIALIZE_MAGIC_0;
+	buf[1] = SERIALIZE_MAGIC_1;
+	buf[2] = SERIALIZE_VERSION;
+	buf[3] = 0;
+	buf[4] = body_len >> 24;
+	buf[5] = body_len >> 16;
+	buf[6] = body_len >> 8;
+	buf[7] = body_len;
+	return GETDNS_RETURN_GOOD;
+}				/* getdns_dict_serialize */
+
+/* decoder state */
+struct deserialize_state
+{
+	struct mem_funcs *mf;
+	const uint8_t *pos;
+	const uint8_t *end;
+	int in_place;
+};
+
+/*---------------------------------------- deserialize_head */
+/**
+  * reads a CBOR head
+  * @return GETDNS_RETURN_GOOD on success
+  * @return GETDNS_RETURN_INVALID_PARAMETER when the input is malformed
+  */
+static getdns_return_t
+deserialize_head(struct deserialize_state *st, int *major, uint32_t *value)
+{
+	uint8_t info;
+	size_t n;
+
+	if (st->pos >= st->end)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	*major = *st->pos >> 5;
+	info = *st->pos++ & 0x1F;
+	if (info < 24) {
+		*value = info;
+		return GETDNS_RETURN_GOOD;
+	}
+	/* 64 bit values and indefinite lengths are not used */
+	if (info > 26)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	n = (size_t)1 << (info - 24);
+	if ((size_t)(st->end - st->pos) < n)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	for (*value = 0; n > 0; n--)
+		*value = (*value << 8) | *st->pos++;
+	return GETDNS_RETURN_GOOD;
+}				/* deserialize_head */
+
+static getdns_return_t deserialize_item(struct deserialize_state *st,
+	int depth, getdns_data_type *dtype, union getdns_item *item);
+
+/*---------------------------------------- deserialize_dict */
+static getdns_return_t
+deserialize_dict(struct deserialize_state *st, int depth, uint32_t count,
+	struct getdns_dict **dict)
+{
+	struct getdns_dict_item *item;
+	getdns_return_t r;
+	uint32_t key_len;
+	char *key;
+	int major;
+
+	/* every member takes at least two octets */
+	if (count > (size_t)(st->end - st->pos) / 2)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	*dict = getdns_dict_create_with_extended_memory_functions(
+		st->mf->mf_arg, st->mf->mf.ext.malloc,
+		st->mf->mf.ext.realloc, st->mf->mf.ext.free);
+	if (!*dict)
+		return GETDNS_RETURN_MEMORY_ERROR;
+
+	for (; count > 0; count--) {
+		if ((r = deserialize_head(st, &major, &key_len)))
+			goto error;
+		if (major != MAJOR_TEXT ||
+		    key_len > (size_t)(st->end - st->pos)) {
+			r = GETDNS_RETURN_INVALID_PARAMETER;
+			goto error;
+		}
+		item = GETDNS_MALLOC(*st->mf, struct getdns_dict_item);
+		key = GETDNS_XMALLOC(*st->mf, char, key_len + 1);
+		if (!item || !key) {
+			GETDNS_FREE(*st->mf, item);
+			GETDNS_FREE(*st->mf, key);
+			r = GETDNS_RETURN_MEMORY_ERROR;
+			goto error;
+		}
+		(void) memcpy(key, st->pos, key_len);
+		key[key_len] = 0;
+		st->pos += key_len;
+
+		item->node.key = key;
+		item->dtype = t_int;
+		item->data.n = 0;
+		if (!ldns_rbtree_insert(&(*dict)->root, &item->node)) {
+			/* duplicate name */
+			GETDNS_FREE(*st->mf, item);
+			GETDNS_FREE(*st->mf, key);
+			r = GETDNS_RETURN_INVALID_PARAMETER;
+			goto error;
+		}
+		if ((r = deserialize_item(st, depth, &item->dtype, &item->data))) {
+			item->dtype = t_int;
+			goto error;
+		}
+	}
+	return GETDNS_RETURN_GOOD;
+error:
+	getdns_dict_destroy(*dict);
+	*dict = NULL;
+	return r;
+}				/* deserialize_dict */
+
+/*---------------------------------------- deserialize_list */
+static getdns_return_t
+deserialize_list(struct deserialize_state *st, int depth, uint32_t count,
+	struct getdns_list **list)
+{
+	getdns_return_t r;
+	getdns_data_type dtype;
+	union getdns_item item;
+
+	/* every item takes at least one octet */
+	if (count > (size_t)(st->end - st->pos))
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	if (!(*list = priv_getdns_list_create_with_mf(st->mf, count)))
+		return GETDNS_RETURN_MEMORY_ERROR;
+
+	for (; count > 0; count--) {
+		if ((r = deserialize_item(st, depth, &dtype, &item))) {
+			getdns_list_destroy(*list);
+			*list = NULL;
+			return r;
+		}
+		/* room was reserved upfront */
+		(*list)->items[(*list)->numinuse].dtype = dtype;
+		switch (dtype) {
+		case t_dict:
+			(*list)->items[(*list)->numinuse].data.dict = item.dict;
+			break;
+		case t_list:
+			(*list)->items[(*list)->numinuse].data.list = item.list;
+			break;
+		case t_int:
+			(*list)->items[(*list)->numinuse].data.n = item.n;
+			break;
+		case t_bindata:
+			(*list)->items[(*list)->numinuse].data.bindata =
+				item.bindata;
+			break;
+		default:
+			break;
+		}
+		(*list)->numinuse++;
+	}
+	return GETDNS_RETURN_GOOD;
+}				/* deserialize_list */
+
+/*---------------------------------------- deserialize_item */
+static getdns_return_t
+deserialize_item(struct deserialize_state *st, int depth,
+	getdns_data_type *dtype, union getdns_item *item)
+{
+	getdns_return_t r;
+	struct getdns_bindata bindata;
+	uint32_t value;
+	int major;
+
+	if ((r = deserialize_head(st, &major, &value)))
+		return r;
+
+	switch (major) {
+	case MAJOR_UINT:
+		*dtype = t_int;
+		item->n = value;
+		return GETDNS_RETURN_GOOD;
+
+	case MAJOR_BYTES:
+		if (value > (size_t)(st->end - st->pos))
+			return GETDNS_RETURN_INVALID_PARAMETER;
+		*dtype = t_bindata;
+		bindata.size = value;
+		bindata.data = (uint8_t *)st->pos;
+		item->bindata = st->in_place
+			? getdns_bindata_borrow(st->mf, bindata.size, bindata.data)
+			: getdns_bindata_copy(st->mf, &bindata);
+		if (!item->bindata)
+			return GETDNS_RETURN_MEMORY_ERROR;
+		st->pos += value;
+		return GETDNS_RETURN_GOOD;
+
+	case MAJOR_ARRAY:
+		if (depth >= SERIALIZE_MAX_DEPTH)
+			return GETDNS_RETURN_INVALID_PARAMETER;
+		*dtype = t_list;
+		return deserialize_list(st, depth + 1, value, &item->list);
+
+	case MAJOR_MAP:
+		if (depth >= SERIALIZE_MAX_DEPTH)
+			return GETDNS_RETURN_INVALID_PARAMETER;
+		*dtype = t_dict;
+		return deserialize_dict(st, depth + 1, value, &item->dict);
+
+	default:
+		return GETDNS_RETURN_INVALID_PARAMETER;
+	}
+}				/* deserialize_item */
+
+/*---------------------------------------- getdns_dict_deserialize */
+getdns_return_t
+getdns_dict_deserialize(struct getdns_context *context, const uint8_t *buf,
+	size_t buf_len, int in_place, struct getdns_dict **dict)
+{
+	struct mem_funcs mf;
+	struct deserialize_state st;
+	getdns_return_t r;
+	uint32_t body_len, count;
+	int major;
+
+	if (!buf || !dict)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	if (buf_len < SERIALIZE_HEADER_LEN ||
+	    buf[0] != SERIALIZE_MAGIC_0 || buf[1] != SERIALIZE_MAGIC_1 ||
+	    buf[2] != SERIALIZE_VERSION || buf[3] != 0)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	body_len = ((uint32_t)buf[4] << 24) | ((uint32_t)buf[5] << 16) |
+		((uint32_t)buf[6] << 8) | buf[7];
+	if (body_len > buf_len - SERIALIZE_HEADER_LEN)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	if (context)
+		mf = context->mf;
+	else {
+		mf.mf_arg         = MF_PLAIN;
+		mf.mf.pln.malloc  = malloc;
+		mf.mf.pln.realloc = realloc;
+		mf.mf.pln.free    = free;
+	}
+	st.mf = &mf;
+	st.pos = buf + SERIALIZE_HEADER_LEN;
+	st.end = st.pos + body_len;
+	st.in_place = in_place;
+
+	if ((r = deserialize_head(&st, &major, &count)))
+		return r;
+	if (major != MAJOR_MAP)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+	if ((r = deserialize_dict(&st, 1, count, dict)))
+		return r;
+	if (st.pos != st.end) {
+		getdns_dict_destroy(*dict);
+		*dict = NULL;
+		return GETDNS_RETURN_INVALID_PARAMETER;
+	}
+	return GETDNS_RETURN_GOOD;
+}				/* getdns_dict_deserialize */
+
+/* serialize.c */
@@ -35,6 +35,7 @@
  */
 
 #include <getdns/getdns.h>
+#include "context.h"
 #include "general.h"
 #include "util-internal.h"
 
@@ -54,7 +55,7 @@ getdns_service(struct getdns_context *context,
 
 	if (!context)
 		return GETDNS_RETURN_INVALID_PARAMETER;
-    if (!callback || !name)
+    if ((!callback && !context->completion_queue) || !name)
          return GETDNS_RETURN_INVALID_PARAMETER;
 
     parmcheck = validate_dname(name);
@@ -0,0 +1,1979 @@
+/**
+ *
+ * /brief getdns native stub resolution
+ *
+ * Queries to the upstream recursive servers are sent and answered over
+ * UDP by getdns itself, in batches, instead of through unbound.
+ *
+ */
+
+
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* sendmmsg and recvmmsg */
+#endif
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+#include <ldns/ldns.h>
+#include "types-internal.h"
+#include "util-internal.h"
+#include "context.h"
+#include "general.h"
+#include "stub.h"
+#include "admission.h"
+
+/* the sockets are watched with the epoll fd of the context */
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SENDMMSG) && defined(HAVE_RECVMMSG)
+#define HAVE_NATIVE_STUB 1
+#endif
+
+/* a query is sent again, to the next upstream, when not answered after
+ * STUB_RETRY_MS, doubling with every try up to STUB_RETRY_DOUBLINGS times,
+ * until the request times out.  Over TCP it starts doubled once, for the
+ * connection to be set up, and is written to the connection to the next
+ * upstream */
+#define STUB_RETRY_MS        400
+#define STUB_RETRY_DOUBLINGS 3
+
+/* queries go to the upstream with the lowest srtt + 4 * rttvar, and to
+ * another one with a chance of STUB_EXPLORE_PERMILLE per mille, which
+ * halves after STUB_EXPLORE_DECAY queries, thirds after twice as many
+ * and so on, down to STUB_EXPLORE_MIN_PERMILLE */
+#define STUB_EXPLORE_PERMILLE     100
+#define STUB_EXPLORE_MIN_PERMILLE 5
+#define STUB_EXPLORE_DECAY        1000
+
+/* an upstream with STUB_FAILURES_DOWN timeouts or SERVFAILs in a row is
+ * out of rotation for STUB_DOWN_MS, doubling each time it is taken out
+ * again up to STUB_DOWN_DOUBLINGS times, and then gets a single probe */
+#define STUB_FAILURES_DOWN  3
+#define STUB_DOWN_MS        1000
+#define STUB_DOWN_DOUBLINGS 6
+
+/* the round trip times in the histogram are halved after this many, and
+ * no percentile is taken from fewer than STUB_RTT_MIN_SAMPLES */
+#define STUB_RTT_WINDOW      1024
+#define STUB_RTT_MIN_SAMPLES 32
+
+/* adaptive retry deadlines are never shorter than this */
+#define STUB_ADAPTIVE_MIN_MS 10
+
+/* a hedge costs 1000 credits, and the credit is capped at this many */
+#define STUB_HEDGE_BURST 10
+
+/* with EDNS size negotiation, the payload sizes advertised to an upstream
+ * start at the one that is not fragmented on any path with an MTU of 1280
+ * or more.  One size down after STUB_EDNS_TIMEOUTS timeouts in a row, and
+ * one up when an answer is truncated after STUB_EDNS_GROW answers in a row,
+ * doubled for every time it went down, up to STUB_EDNS_GROW_DOUBLINGS */
+static const uint16_t edns_sizes[] = { 512, 1232, 1452, 4096 };
+#define STUB_EDNS_START    1
+#define STUB_EDNS_LEVELS   (sizeof(edns_sizes) / sizeof(edns_sizes[0]))
+#define STUB_EDNS_TIMEOUTS 2
+#define STUB_EDNS_GROW     8
+#define STUB_EDNS_GROW_DOUBLINGS 10
+
+/* IPv4 or IPv6 sockets and queue */
+#define FAMILY_INDEX(family) ((family) == AF_INET6)
+/* queue of the queries to be written to a TCP connection */
+#define TCP_QUEUE 2
+/* queue of the queries held until an upstream has room for them */
+#define HELD_QUEUE 3
+
+/* when its connection fails a query is written to the connection to the
+ * next upstream, until each was tried this many times */
+#define STUB_TCP_TRIES 2
+/* a length prefixed message of the maximum size */
+#define TCP_IN_SIZE (2 + 65535)
+
+/* random ports tried for a socket before the system picks one */
+#define STUB_BIND_TRIES 8
+
+/* buckets of the hash of queries in flight, doubled when all are used */
+#define STUB_QUERIES_MIN 256
+/* IDs tried for a query before giving up, with this many for its
+ * question in flight */
+#define STUB_ID_TRIES 16
+
+/* question, and the OPT record, of a query */
+#define QUESTION_FIXED_SIZE 4
+#define OPT_RR_SIZE 11
+
+#ifdef HAVE_NATIVE_STUB
+/*---------------------------------------- upstreams */
+static void
+release_upstreams(struct priv_getdns_stub *stub,
+    struct priv_getdns_upstreams *upstreams)
+{
+	if (upstreams && --upstreams->referenced == 0)
+		GETDNS_FREE(stub->context->my_mf, upstreams);
+}
+
+static struct priv_getdns_upstream *
+netreq_upstream(getdns_network_req *netreq)
+{
+	return &netreq->upstreams->upstreams[netreq->upstream];
+}
+
+static int
+same_address(const struct sockaddr_storage *a, const struct sockaddr_storage *b)
+{
+	const struct sockaddr_in *a4, *b4;
+	const struct sockaddr_in6 *a6, *b6;
+
+	if (a->ss_family != b->ss_family)
+		return 0;
+	if (a->ss_family == AF_INET) {
+		a4 = (const struct sockaddr_in *) a;
+		b4 = (const struct sockaddr_in *) b;
+		return a4->sin_port == b4->sin_port &&
+		    a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+	}
+	a6 = (const struct sockaddr_in6 *) a;
+	b6 = (const struct sockaddr_in6 *) b;
+	return a6->sin6_port == b6->sin6_port &&
+	    memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(a6->sin6_addr)) == 0;
+}
+
+static uint64_t
+now_usec(void)
+{
+	struct timeval tv;
+
+	(void) gettimeofday(&tv, NULL);
+	return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* a round trip time sample, or the time waited for an answer in vain */
+static void
+update_rtt(struct priv_getdns_upstream *upstream, uint64_t usec)
+{
+	uint32_t rtt = usec > UINT32_MAX / 8 ? UINT32_MAX / 8 : (uint32_t) usec;
+
+	if (upstream->srtt == 0 && upstream->rttvar == 0) {
+		upstream->srtt = rtt;
+		upstream->rttvar = rtt / 2;
+		return;
+	}
+	upstream->rttvar = (3 * upstream->rttvar + (upstream->srtt > rtt
+	    ? upstream->srtt - rtt : rtt - upstream->srtt)) / 4;
+	upstream->srtt = (7 * upstream->srtt + rtt) / 8;
+}
+
+/* 0 to 3 in the first buckets, then 4 per power of 2 */
+static size_t
+rtt_bucket(uint32_t usec)
+{
+	unsigned int p = 0;
+	uint32_t v = usec;
+
+	if (usec < 4)
+		return usec;
+	while (v >>= 1)
+		p++;
+	return 4 * (p - 1) + ((usec >> (p - 2)) & 3);
+}
+
+static void
+add_rtt_sample(struct priv_getdns_stub *stub, uint64_t usec)
+{
+	size_t i;
+
+	stub->rtt_buckets[rtt_bucket(usec > UINT32_MAX ? UINT32_MAX
+	    : (uint32_t) usec)]++;
+	if (++stub->rtt_samples < STUB_RTT_WINDOW)
+		return;
+	stub->rtt_samples = 0;
+	for (i = 0; i < STUB_RTT_BUCKETS; i++)
+		stub->rtt_samples += (stub->rtt_buckets[i] /= 2);
+}
+
+/* the round trip time below which permille of the samples are, rounded up
+ * to the end of its bucket.  0 with too few samples */
+static uint64_t
+rtt_percentile(struct priv_getdns_stub *stub, unsigned int permille)
+{
+	uint64_t below = 0, want;
+	size_t i;
+
+	if (stub->rtt_samples < STUB_RTT_MIN_SAMPLES)
+		return 0;
+	want = ((uint64_t) stub->rtt_samples * permille + 999) / 1000;
+	for (i = 0; i < STUB_RTT_BUCKETS - 1; i++)
+		if ((below += stub->rtt_buckets[i]) >= want)
+			break;
+	if (i < 4)
+		return i + 1;
+	return (uint64_t) (5 + i % 4) << (i / 4 - 1);
+}
+
+/* the lower the better, the ones not measured yet are tried first */
+static uint64_t
+upstream_score(const struct priv_getdns_upstream *upstream)
+{
+	return (uint64_t) upstream->srtt + 4 * (uint64_t) upstream->rttvar;
+}
+
+static struct priv_getdns_upstream *
+find_upstream(struct priv_getdns_upstreams *upstreams,
+    const struct sockaddr_storage *addr)
+{
+	size_t i;
+
+	for (i = 0; upstreams && i < upstreams->count; i++)
+		if (same_address(&upstreams->upstreams[i].addr, addr))
+			return &upstreams->upstreams[i];
+	return NULL;
+}
+
+/* in rotation, or out of it long enough to be probed */
+static int
+upstream_available(const struct priv_getdns_upstream *upstream, uint64_t now)
+{
+	return upstream->down_until <= now;
+}
+
+/* when u is out of rotation, the query sent to it now is its probe, until
+ * which is known it is out again for as long as a query is waited for */
+static size_t
+take_upstream(struct priv_getdns_upstreams *upstreams, size_t u, uint64_t now)
+{
+	struct priv_getdns_upstream *upstream = &upstreams->upstreams[u];
+
+	if (upstream->down_until) {
+		upstream->probing = 1;
+		upstream->down_until = now + STUB_RETRY_MS * 1000;
+	}
+	return u;
+}
+
+static size_t
+select_upstream(struct priv_getdns_stub *stub)
+{
+	struct priv_getdns_upstreams *upstreams = stub->upstreams;
+	struct priv_getdns_upstream *upstream;
+	uint64_t now = now_usec(), permille;
+	size_t best, i, u, n;
+
+	/* with all out of rotation the one back first is used */
+	best = u = stub->next_upstream++ % upstreams->count;
+	for (i = 0, n = 0; i < upstreams->count;
+	    i++, u = (u + 1) % upstreams->count) {
+		upstream = &upstreams->upstreams[u];
+		if (!upstream_available(upstream, now)) {
+			if (n == 0 && upstream->down_until <
+			    upstreams->upstreams[best].down_until)
+				best = u;
+			continue;
+		}
+		/* probes go first */
+		if (upstream->down_until)
+			return take_upstream(upstreams, u, now);
+		if (n++ == 0 || upstream_score(upstream) <
+		    upstream_score(&upstreams->upstreams[best]))
+			best = u;
+	}
+	permille = STUB_EXPLORE_PERMILLE * STUB_EXPLORE_DECAY /
+	    (STUB_EXPLORE_DECAY + stub->selections++);
+	if (permille < STUB_EXPLORE_MIN_PERMILLE)
+		permille = STUB_EXPLORE_MIN_PERMILLE;
+	if (n > 1 && ldns_get_random() % 1000 < permille) {
+		u = (best + 1 + ldns_get_random() % (upstreams->count - 1)) %
+		    upstreams->count;
+		if (upstream_available(&upstreams->upstreams[u], now))
+			best = u;
+	}
+	return take_upstream(upstreams, best, now);
+}
+
+/* the upstream to send a query to again, after the one tried last */
+static size_t
+next_upstream(getdns_network_req *netreq)
+{
+	struct priv_getdns_upstreams *upstreams = netreq->upstreams;
+	uint64_t now = now_usec();
+	size_t i, u;
+
+	for (i = 1; i < upstreams->count; i++) {
+		u = (netreq->upstream + i) % upstreams->count;
+		if (upstream_available(&upstreams->upstreams[u], now))
+			return take_upstream(upstreams, u, now);
+	}
+	return (netreq->upstream + 1) % upstreams->count;
+}
+
+/* an answer to a retried query may come from any of the upstreams */
+static int
+from_upstream(const struct priv_getdns_upstreams *upstreams,
+    const struct sockaddr_storage *from)
+{
+	size_t i;
+
+	for (i = 0; i < upstreams->count; i++)
+		if (same_address(&upstreams->upstreams[i].addr, from))
+			return 1;
+	return 0;
+}
+
+/* upstream as given to getdns_context_set_upstream_recursive_servers, and
+ * its stats */
+static uint16_t edns_size(struct getdns_context *,
+    struct priv_getdns_upstream *);
+
+static getdns_return_t
+upstream_dict(struct getdns_context *context,
+    struct priv_getdns_upstream *upstream, struct getdns_dict **dict)
+{
+	getdns_return_t r;
+
+	if ((r = sockaddr_to_dict(context, &upstream->addr, dict)))
+		return r;
+	r = getdns_dict_set_int(*dict, GETDNS_STR_PORT, ntohs(
+	    upstream->addr.ss_family == AF_INET
+	    ? ((struct sockaddr_in *) &upstream->addr)->sin_port
+	    : ((struct sockaddr_in6 *) &upstream->addr)->sin6_port));
+	r |= getdns_dict_set_int(*dict, "srtt", upstream->srtt);
+	r |= getdns_dict_set_int(*dict, "rttvar", upstream->rttvar);
+	r |= getdns_dict_set_int(*dict, "queries_sent",
+	    (uint32_t) upstream->sent);
+	r |= getdns_dict_set_int(*dict, "answers",
+	    (uint32_t) upstream->answered);
+	r |= getdns_dict_set_int(*dict, "hedges", (uint32_t) upstream->hedges);
+	r |= getdns_dict_set_int(*dict, "healthy", upstream->down_until == 0);
+	r |= getdns_dict_set_int(*dict, "failures",
+	    (uint32_t) upstream->failures);
+	r |= getdns_dict_set_int(*dict, "consecutive_failures",
+	    upstream->consecutive_failures);
+	r |= getdns_dict_set_int(*dict, "outages",
+	    (uint32_t) upstream->outages);
+	r |= getdns_dict_set_int(*dict, "edns_size",
+	    edns_size(context, upstream));
+	r |= getdns_dict_set_int(*dict, "truncated",
+	    (uint32_t) upstream->truncated);
+	r |= getdns_dict_set_int(*dict, "tcp_fallbacks",
+	    (uint32_t) upstream->tcp_fallbacks);
+	r |= getdns_dict_set_int(*dict, "in_flight",
+	    (uint32_t) upstream->in_flight);
+	if (r != GETDNS_RETURN_GOOD) {
+		getdns_dict_destroy(*dict);
+		*dict = NULL;
+	}
+	return r;
+}
+
+static void
+report_health(struct priv_getdns_stub *stub,
+    struct priv_getdns_upstream *upstream, int healthy)
+{
+	struct getdns_context *context = stub->context;
+	struct getdns_dict *dict;
+
+	if (!context->upstream_health_callback ||
+	    upstream_dict(context, upstream, &dict) != GETDNS_RETURN_GOOD)
+		return;
+	context->upstream_health_callback(context, dict, healthy,
+	    context->upstream_health_userarg);
+	getdns_dict_destroy(dict);
+}
+
+/* a timeout or SERVFAIL of upstream */
+static void
+upstream_failed(struct priv_getdns_stub *stub,
+    struct priv_getdns_upstream *upstream)
+{
+	unsigned int doublings;
+
+	if (!upstream)
+		return;
+	upstream->failures++;
+	/* of the queries sent before it was taken out */
+	if (upstream->down_until && !upstream->probing)
+		return;
+	if (++upstream->consecutive_failures < STUB_FAILURES_DOWN &&
+	    !upstream->probing)
+		return;
+	doublings = upstream->downs < STUB_DOWN_DOUBLINGS
+	    ? upstream->downs : STUB_DOWN_DOUBLINGS;
+	upstream->probing = 0;
+	upstream->down_until = now_usec() +
+	    ((uint64_t) STUB_DOWN_MS << doublings) * 1000;
+	if (upstream->downs++ == 0) {
+		upstream->outages++;
+		report_health(stub, upstream, 0);
+	}
+}
+
+static void
+upstream_answered(struct priv_getdns_stub *stub,
+    struct priv_getdns_upstream *upstream)
+{
+	if (!upstream)
+		return;
+	upstream->consecutive_failures = 0;
+	if (upstream->down_until) {
+		upstream->down_until = 0;
+		upstream->probing = 0;
+		upstream->downs = 0;
+		report_health(stub, upstream, 1);
+	}
+}
+
+/*---------------------------------------- sockets */
+static void
+close_socket(struct priv_getdns_stub *stub,
+    struct priv_getdns_udp_socket *sock)
+{
+	/* closing takes it out of the epoll set */
+	(void) close(sock->fd);
+	GETDNS_FREE(stub->context->my_mf, sock);
+}
+
+/* take sock out of its pool, it is closed when the queries sent from it
+ * are done */
+static void
+retire_socket(struct priv_getdns_stub *stub,
+    struct priv_getdns_udp_socket *sock)
+{
+	if (!sock->referenced) {
+		close_socket(stub, sock);
+		return;
+	}
+	sock->retired = 1;
+	sock->next = stub->retired;
+	stub->retired = sock;
+}
+
+static void
+release_socket(struct priv_getdns_stub *stub,
+    struct priv_getdns_udp_socket *sock)
+{
+	struct priv_getdns_udp_socket **sock_p = &stub->retired;
+
+	if (--sock->referenced || !sock->retired)
+		return;
+	while (*sock_p != sock)
+		sock_p = &(*sock_p)->next;
+	*sock_p = sock->next;
+	close_socket(stub, sock);
+}
+
+/* a random port above 1023, or one the system picks when the ones tried
+ * are in use */
+static int
+bind_random_port(int fd, int family)
+{
+	struct sockaddr_storage addr;
+	socklen_t addr_len;
+	in_port_t *port;
+	uint32_t r;
+	int i;
+
+	(void) memset(&addr, 0, sizeof(addr));
+	addr.ss_family = family;
+	if (family == AF_INET) {
+		port = &((struct sockaddr_in *) &addr)->sin_port;
+		addr_len = sizeof(struct sockaddr_in);
+	} else {
+		port = &((struct sockaddr_in6 *) &addr)->sin6_port;
+		addr_len = sizeof(struct sockaddr_in6);
+	}
+	for (i = 0; i < STUB_BIND_TRIES; i++) {
+		r = (uint32_t) ldns_get_random() << 16 | ldns_get_random();
+		*port = htons(1024 + r % (65536 - 1024));
+		if (bind(fd, (struct sockaddr *) &addr, addr_len) == 0)
+			return 0;
+		if (errno != EADDRINUSE)
+			break;
+	}
+	*port = 0;
+	return bind(fd, (struct sockaddr *) &addr, addr_len);
+}
+
+static struct priv_getdns_udp_socket *
+open_socket(struct priv_getdns_stub *stub, int family)
+{
+	struct priv_getdns_udp_socket *sock;
+	struct epoll_event ev;
+
+	sock = GETDNS_MALLOC(stub->context->my_mf,
+	    struct priv_getdns_udp_socket);
+	if (!sock)
+		return NULL;
+	(void) memset(sock, 0, sizeof(struct priv_getdns_udp_socket));
+	sock->fd = socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+	    IPPROTO_UDP);
+	ev.events = EPOLLIN;
+	ev.data.ptr = stub;
+	if (sock->fd == -1 || bind_random_port(sock->fd, family) != 0 ||
+	    epoll_ctl(stub->context->ub_poll_fd, EPOLL_CTL_ADD, sock->fd,
+	    &ev) != 0) {
+		if (sock->fd != -1)
+			(void) close(sock->fd);
+		GETDNS_FREE(stub->context->my_mf, sock);
+		return NULL;
+	}
+	return sock;
+}
+
+static void
+close_pool(struct priv_getdns_stub *stub, int f)
+{
+	size_t i;
+
+	for (i = 0; i < stub->pool_size[f]; i++)
+		retire_socket(stub, stub->pool[f][i]);
+	if (stub->pool[f])
+		GETDNS_FREE(stub->context->my_mf, stub->pool[f]);
+	stub->pool[f] = NULL;
+	stub->pool_size[f] = 0;
+}
+
+/* (re)open the pool of family with the size set in the context, the
+ * previous one is kept when that fails */
+static int
+open_pool(struct priv_getdns_stub *stub, int family)
+{
+	int f = FAMILY_INDEX(family);
+	size_t size = stub->context->udp_pool_size, i;
+	struct priv_getdns_udp_socket **pool;
+
+	if (stub->pool[f] && stub->pool_size[f] == size)
+		return 0;
+	pool = GETDNS_XMALLOC(stub->context->my_mf,
+	    struct priv_getdns_udp_socket *, size);
+	if (!pool)
+		return -1;
+	for (i = 0; i < size; i++) {
+		if (!(pool[i] = open_socket(stub, family))) {
+			while (i--)
+				close_socket(stub, pool[i]);
+			GETDNS_FREE(stub->context->my_mf, pool);
+			return -1;
+		}
+	}
+	close_pool(stub, f);
+	stub->pool[f] = pool;
+	stub->pool_size[f] = size;
+	stub->next_socket[f] = stub->next_rotate[f] = 0;
+	stub->rotated_usec = now_usec();
+	return 0;
+}
+
+/* replace one socket of each pool every udp_rotate_ms.  Checked when
+ * sending, so that no timeout keeps the event loop busy */
+static void
+rotate_pools(struct priv_getdns_stub *stub, uint64_t now)
+{
+	struct priv_getdns_udp_socket *sock;
+	size_t i;
+	int f;
+
+	if (!stub->context->udp_rotate_ms || now - stub->rotated_usec <
+	    (uint64_t) stub->context->udp_rotate_ms * 1000)
+		return;
+	stub->rotated_usec = now;
+	for (f = 0; f < 2; f++) {
+		if (!stub->pool[f] ||
+		    !(sock = open_socket(stub, f ? AF_INET6 : AF_INET)))
+			continue;
+		i = stub->next_rotate[f]++ % stub->pool_size[f];
+		retire_socket(stub, stub->pool[f][i]);
+		stub->pool[f][i] = sock;
+	}
+}
+
+/*---------------------------------------- queries */
+/* the length of the uncompressed question name of wire, 0 when there is
+ * none */
+static size_t
+question_name_len(const uint8_t *wire, size_t len)
+{
+	size_t pos = LDNS_HEADER_SIZE;
+
+	while (pos < len && wire[pos]) {
+		if (wire[pos] & 0xc0)
+			return 0;
+		pos += wire[pos] + 1;
+	}
+	return pos < len ? pos + 1 - LDNS_HEADER_SIZE : 0;
+}
+
+/* FNV-1a of the ID and the question name, ignoring case */
+static uint32_t
+query_hash(uint32_t seed, const uint8_t *wire, size_t name_len)
+{
+	uint32_t h = 2166136261u ^ seed;
+	size_t i;
+
+	h = (h ^ wire[0]) * 16777619u;
+	h = (h ^ wire[1]) * 16777619u;
+	for (i = LDNS_HEADER_SIZE; i < LDNS_HEADER_SIZE + name_len; i++)
+		h = (h ^ (uint8_t) tolower(wire[i])) * 16777619u;
+	return h;
+}
+
+static int same_question(const getdns_network_req *, const uint8_t *,
+    size_t);
+
+/* the query in flight with the ID and question of wire */
+static getdns_network_req *
+find_query(struct priv_getdns_stub *stub, const uint8_t *wire, size_t len)
+{
+	getdns_network_req *netreq;
+	size_t name_len;
+	uint32_t h;
+
+	if (!stub->queries || !(name_len = question_name_len(wire, len)))
+		return NULL;
+	h = query_hash(stub->hash_seed, wire, name_len);
+	for ( netreq = stub->queries[h & (stub->queries_size - 1)]
+	    ; netreq
+	    ; netreq = netreq->hash_next)
+		if (netreq->hash == h &&
+		    netreq->query_id == LDNS_ID_WIRE(wire) &&
+		    same_question(netreq, wire, len))
+			return netreq;
+	return NULL;
+}
+
+/* the buckets are doubled when all are used, or not when that fails */
+static int
+insert_query(struct priv_getdns_stub *stub, getdns_network_req *netreq)
+{
+	getdns_network_req **queries, *moved, *next;
+	size_t size = stub->queries_size ? 2 * stub->queries_size
+	    : STUB_QUERIES_MIN, i;
+
+	if (stub->queries_count >= stub->queries_size && (queries =
+	    GETDNS_XMALLOC(stub->context->my_mf, getdns_network_req *, size))) {
+		(void) memset(queries, 0, size * sizeof(getdns_network_req *));
+		for (i = 0; i < stub->queries_size; i++) {
+			for (moved = stub->queries[i]; moved; moved = next) {
+				next = moved->hash_next;
+				moved->hash_next = queries[moved->hash &
+				    (size - 1)];
+				queries[moved->hash & (size - 1)] = moved;
+			}
+		}
+		if (stub->queries)
+			GETDNS_FREE(stub->context->my_mf, stub->queries);
+		stub->queries = queries;
+		stub->queries_size = size;
+	}
+	if (!stub->queries)
+		return -1;
+	netreq->hash_next = stub->queries[netreq->hash &
+	    (stub->queries_size - 1)];
+	stub->queries[netreq->hash & (stub->queries_size - 1)] = netreq;
+	stub->queries_count++;
+	return 0;
+}
+
+static void
+remove_query(struct priv_getdns_stub *stub, getdns_network_req *netreq)
+{
+	getdns_network_req **netreq_p;
+
+	if (!stub->queries)
+		return;
+	for ( netreq_p = &stub->queries[netreq->hash &
+	      (stub->queries_size - 1)]
+	    ; *netreq_p
+	    ; netreq_p = &(*netreq_p)->hash_next)
+		if (*netreq_p == netreq) {
+			*netreq_p = netreq->hash_next;
+			stub->queries_count--;
+			break;
+		}
+	netreq->hash_next = NULL;
+}
+
+/* the wire format query of netreq, with a zero ID */
+static getdns_return_t
+build_query(getdns_network_req *netreq)
+{
+	getdns_dns_req *dns_req = netreq->owner;
+	struct getdns_context *context = dns_req->context;
+	ldns_rdf *qname;
+	size_t name_len;
+	uint8_t *wire;
+
+	if (ldns_str2rdf_dname(&qname, dns_req->name) != LDNS_STATUS_OK)
+		return GETDNS_RETURN_BAD_DOMAIN_NAME;
+	name_len = ldns_rdf_size(qname);
+	netreq->wire_len = LDNS_HEADER_SIZE + name_len + QUESTION_FIXED_SIZE +
+	    OPT_RR_SIZE;
+	netreq->wire = GETDNS_XMALLOC(dns_req->my_mf, uint8_t, netreq->wire_len);
+	if (!netreq->wire) {
+		ldns_rdf_deep_free(qname);
+		return GETDNS_RETURN_MEMORY_ERROR;
+	}
+	wire = netreq->wire;
+	(void) memset(wire, 0, LDNS_HEADER_SIZE);
+	LDNS_RD_SET(wire);
+	ldns_write_uint16(wire + 4, 1);  /* QDCOUNT */
+	ldns_write_uint16(wire + 10, 1); /* ARCOUNT, for the OPT record */
+	(void) memcpy(wire + LDNS_HEADER_SIZE, ldns_rdf_data(qname), name_len);
+	ldns_rdf_deep_free(qname);
+
+	wire += LDNS_HEADER_SIZE + name_len;
+	ldns_write_uint16(wire, netreq->request_type);
+	ldns_write_uint16(wire + 2, netreq->request_class);
+	/* OPT record: root owner, the payload size as class and the extended
+	 * rcode, version and DO bit as TTL, without options */
+	wire[4] = 0;
+	ldns_write_uint16(wire + 5, LDNS_RR_TYPE_OPT);
+	ldns_write_uint16(wire + 7, context->edns_maximum_udp_payload_size);
+	wire[9] = context->edns_extended_rcode;
+	wire[10] = context->edns_version;
+	wire[11] = context->edns_do_bit ? 0x80 : 0;
+	wire[12] = 0;
+	ldns_write_uint16(wire + 13, 0);
+	return GETDNS_RETURN_GOOD;
+}
+
+/* whether answer is for the question of query, ignoring case */
+static int
+same_question(const getdns_network_req *netreq, const uint8_t *answer,
+    size_t len)
+{
+	const uint8_t *query = netreq->wire;
+	size_t pos = LDNS_HEADER_SIZE, end;
+
+	/* the query is ours, so its name is well formed */
+	while (query[pos])
+		pos += query[pos] + 1;
+	end = pos + 1 + QUESTION_FIXED_SIZE;
+	if (len < end || LDNS_QDCOUNT(answer) != 1)
+		return 0;
+	/* label lengths are below 64, so not changed by tolower */
+	for (pos = LDNS_HEADER_SIZE; pos < end - QUESTION_FIXED_SIZE; pos++)
+		if (tolower(query[pos]) != tolower(answer[pos]))
+			return 0;
+	return memcmp(query + pos, answer + pos, QUESTION_FIXED_SIZE) == 0;
+}
+
+/*---------------------------------------- EDNS payload sizes */
+static uint16_t
+edns_size(struct getdns_context *context, struct priv_getdns_upstream *upstream)
+{
+	uint16_t max = context->edns_negotiation_max;
+
+	if (!max)
+		return context->edns_maximum_udp_payload_size;
+	return edns_sizes[upstream->edns_level] < max
+	    ? edns_sizes[upstream->edns_level] : max;
+}
+
+/* with the payload size advertised to upstream in the wire of netreq */
+static void
+set_edns_size(struct getdns_context *context, getdns_network_req *netreq,
+    struct priv_getdns_upstream *upstream)
+{
+	/* skipping the question and the root owner and type of the OPT
+	 * record, to its class */
+	size_t pos = LDNS_HEADER_SIZE + question_name_len(netreq->wire,
+	    netreq->wire_len) + QUESTION_FIXED_SIZE + 3;
+
+	netreq->edns_size = edns_size(context, upstream);
+	ldns_write_uint16(netreq->wire + pos, netreq->edns_size);
+}
+
+/* an answer from upstream to netreq over UDP */
+static void
+edns_answered(struct getdns_context *context,
+    struct priv_getdns_upstream *upstream, getdns_network_req *netreq,
+    int truncated)
+{
+	if (truncated) {
+		upstream->truncated++;
+		if (context->dns_transport ==
+		    GETDNS_TRANSPORT_UDP_FIRST_AND_FALL_BACK_TO_TCP)
+			upstream->tcp_fallbacks++;
+	}
+	if (!context->edns_negotiation_max ||
+	    upstream != netreq_upstream(netreq) ||
+	    netreq->edns_size != edns_size(context, upstream))
+		return;
+	upstream->edns_timeouts = 0;
+	upstream->edns_answers++;
+	if (truncated && upstream->edns_answers >= STUB_EDNS_GROW <<
+	    (upstream->edns_downs < STUB_EDNS_GROW_DOUBLINGS
+	    ? upstream->edns_downs : STUB_EDNS_GROW_DOUBLINGS) &&
+	    upstream->edns_level + 1 < STUB_EDNS_LEVELS &&
+	    edns_sizes[upstream->edns_level] < context->edns_negotiation_max) {
+		upstream->edns_level++;
+		upstream->edns_answers = 0;
+	}
+}
+
+/* large answers may be lost when fragmented, so smaller ones are asked
+ * for after a few timeouts */
+static void
+edns_timed_out(struct getdns_context *context,
+    struct priv_getdns_upstream *upstream, getdns_network_req *netreq)
+{
+	if (!context->edns_negotiation_max ||
+	    netreq->edns_size != edns_size(context, upstream) ||
+	    upstream->edns_level == 0)
+		return;
+	upstream->edns_answers = 0;
+	if (++upstream->edns_timeouts >= STUB_EDNS_TIMEOUTS) {
+		upstream->edns_level--;
+		upstream->edns_downs++;
+		upstream->edns_timeouts = 0;
+	}
+}
+
+/*---------------------------------------- sending */
+static getdns_return_t
+flush_timeout(void *arg)
+{
+	priv_getdns_stub_flush((struct priv_getdns_stub *) arg);
+	return GETDNS_RETURN_GOOD;
+}
+
+/*
+ * Have the queued queries sent right after the current event loop
+ * iteration, so that the requests made within it go out together.  The
+ * context flushes them when it is processed as well.
+ */
+static void
+schedule_flush(struct priv_getdns_stub *stub)
+{
+	if (stub->flush_id)
+		return;
+	stub->flush_id = stub->next_timeout_id++;
+	if (getdns_context_schedule_timeout(stub->context, stub->flush_id, 0,
+	    flush_timeout, stub) != GETDNS_RETURN_GOOD) {
+		stub->flush_id = 0;
+		priv_getdns_stub_flush(stub);
+	}
+}
+
+static int
+queue_index(getdns_network_req *netreq)
+{
+	return netreq->held ? HELD_QUEUE : netreq->tcp ? TCP_QUEUE
+	    : FAMILY_INDEX(netreq_upstream(netreq)->addr.ss_family);
+}
+
+static void
+link_query(struct priv_getdns_stub *stub, getdns_network_req *netreq)
+{
+	int f = queue_index(netreq);
+
+	netreq->pending_next = NULL;
+	netreq->pending_pprev = stub->pending_tail[f];
+	*stub->pending_tail[f] = netreq;
+	stub->pending_tail[f] = &netreq->pending_next;
+}
+
+static void
+unqueue_query(struct priv_getdns_stub *stub, getdns_network_req *netreq)
+{
+	int f = queue_index(netreq);
+
+	if (!netreq->pending_pprev)
+		return;
+	*netreq->pending_pprev = netreq->pending_next;
+	if (netreq->pending_next)
+		netreq->pending_next->pending_pprev = netreq->pending_pprev;
+	else
+		stub->pending_tail[f] = netreq->pending_pprev;
+	netreq->pending_pprev = NULL;
+	netreq->held = 0;
+}
+
+/* room for one more query to upstream now, which is then taken */
+static int
+upstream_admit(struct getdns_context *context,
+    struct priv_getdns_upstream *upstream, uint64_t now)
+{
+	if (context->upstream_max_in_flight &&
+	    upstream->in_flight >= context->upstream_max_in_flight)
+		return 0;
+	if (context->upstream_qps && priv_getdns_take_token(
+	    &upstream->bucket_usec, context->upstream_qps,
+	    context->upstream_burst, now))
+		return 0;
+	upstream->in_flight++;
+	return 1;
+}
+
+/*
+ * With limits per upstream, count netreq in the queries in flight of its
+ * upstream, or of the next available one with room when that has none.
+ * Returns 0 when none has, and the query is to be held.
+ */
+static int
+charge_query(struct priv_getdns_stub *stub, getdns_network_req *netreq)
+{
+	struct priv_getdns_upstreams *upstreams = netreq->upstreams;
+	struct priv_getdns_upstream *upstream;
+	uint64_t now;
+	size_t i, u;
+
+	if (!stub->context->upstream_qps &&
+	    !stub->context->upstream_max_in_flight)
+		return 1;
+	now = now_usec();
+	for (i = 0; i < upstreams->count; i++) {
+		u = (netreq->upstream + i) % upstreams->count;
+		upstream = &upstreams->upstreams[u];
+		if (i && !upstream_available(upstream, now))
+			continue;
+		if (upstream_admit(stub->context, upstream, now)) {
+			if (i)
+				netreq->upstream = take_upstream(upstreams, u,
+				    now);
+			netreq->charged = upstream;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* netreq is no longer waited for at the upstream it was counted with, the
+ * held queries may have room now */
+static void
+release_query(struct priv_getdns_stub *stub, getdns_network_req *netreq)
+{
+	if (!netreq->charged)
+		return;
+	netreq->charged->in_flight--;
+	netreq->charged = NULL;
+	if (stub->pending[HELD_QUEUE])
+		schedule_flush(stub);
+}
+
+static getdns_return_t
+admit_timeout(void *arg)
+{
+	struct priv_getdns_stub *stub = (struct priv_getdns_stub *) arg;
+
+	(void) getdns_context_clear_timeout(stub->context, stub->admit_id);
+	stub->admit_id = 0;
+	priv_getdns_stub_flush(stub);
+	return GETDNS_RETURN_GOOD;
+}
+
+/* held queries wait for a query in flight to be done, which flushes, or
+ * for the next token when limited to a rate */
+static void
+schedule_admit(struct priv_getdns_stub *stub)
+{
+	uint32_t qps = stub->context->upstream_qps;
+
+	if (stub->admit_id || !qps)
+		return;
+	stub->admit_id = stub->next_timeout_id++;
+	if (getdns_context_schedule_timeout(stub->context, stub->admit_id,
+	    qps >= 1000 ? 1 : 1000 / qps, admit_timeout, stub) !=
+	    GETDNS_RETURN_GOOD)
+		stub->admit_id = 0;
+}
+
+/* queue the held queries there is room for now, the oldest first */
+static void
+admit_held(struct priv_getdns_stub *stub)
+{
+	getdns_network_req *netreq;
+
+	while ((netreq = stub->pending[HELD_QUEUE]) &&
+	    charge_query(stub, netreq)) {
+		unqueue_query(stub, netreq);
+		link_query(stub, netreq);
+	}
+	if (stub->pending[HELD_QUEUE])
+		schedule_admit(stub);
+}
+
+/* a query sent again is waited for at its new upstream only, and held
+ * behind the others when none has room */
+static void
+queue_query(struct priv_getdns_stub *stub, getdns_network_req *netreq)
+{
+	release_query(stub, netreq);
+	netreq->held = stub->pending[HELD_QUEUE] != NULL ||
+	    !charge_query(stub, netreq);
+	link_query(stub, netreq);
+	if (netreq->held)
+		schedule_admit(stub);
+	schedule_flush(stub);
+}
+
+static void schedule_retry(struct priv_getdns_stub *, getdns_network_req *,
+    int);
+static void release_conn(struct priv_getdns_stub *, getdns_network_req *);
+
+static getdns_return_t
+retry_timeout(void *arg)
+{
+	getdns_network_req *netreq = (getdns_network_req *) arg;
+	struct priv_getdns_stub *stub = netreq->owner->context->stub;
+
+	(void) getdns_context_clear_timeout(stub->context, netreq->retry_id);
+	netreq->retry_id = 0;
+	/* the first upstream is not failing (yet), just slow */
+	if (netreq->hedging) {
+		netreq->hedging = 0;
+		if (!netreq->pending_pprev && stub->hedge_credit >= 1000) {
+			stub->hedge_credit -= 1000;
+			netreq->upstream = next_upstream(netreq);
+			netreq_upstream(netreq)->hedges++;
+			netreq->tries++;
+			queue_query(stub, netreq);
+		}
+		schedule_retry(stub, netreq, 0);
+		return GETDNS_RETURN_GOOD;
+	}
+	/* not even sent when still queued */
+	if (!netreq->pending_pprev) {
+		update_rtt(netreq_upstream(netreq),
+		    now_usec() - netreq->sent_usec);
+		/* a late answer on the old connection is not taken */
+		if (netreq->tcp)
+			release_conn(stub, netreq);
+		else
+			edns_timed_out(stub->context, netreq_upstream(netreq),
+			    netreq);
+		upstream_failed(stub, netreq_upstream(netreq));
+		netreq->upstream = next_upstream(netreq);
+		queue_query(stub, netreq);
+	}
+	netreq->tries++;
+	schedule_retry(stub, netreq, 0);
+	return GETDNS_RETURN_GOOD;
+}
+
+/* with may_hedge, the first retry may be a hedge that is due earlier */
+static void
+schedule_retry(struct priv_getdns_stub *stub, getdns_network_req *netreq,
+    int may_hedge)
+{
+	unsigned int tries = netreq->tries + (netreq->tcp ? 1 : 0);
+	unsigned int doublings = tries < STUB_RETRY_DOUBLINGS
+	    ? tries : STUB_RETRY_DOUBLINGS;
+	uint16_t ms = STUB_RETRY_MS << doublings;
+	uint64_t hedge_usec, adaptive_ms, max_ms = stub->context->timeout;
+
+	/* the user's timeout fails the request anyway */
+	if (stub->context->adaptive_timeout_factor &&
+	    (adaptive_ms = rtt_percentile(stub, 990))) {
+		adaptive_ms = ((adaptive_ms *
+		    stub->context->adaptive_timeout_factor + 999) / 1000)
+		    << doublings;
+		if (max_ms > 0xffff)
+			max_ms = 0xffff;
+		ms = adaptive_ms < STUB_ADAPTIVE_MIN_MS ? STUB_ADAPTIVE_MIN_MS
+		    : adaptive_ms > max_ms ? max_ms : adaptive_ms;
+	}
+	if (may_hedge && stub->context->hedge_percentile &&
+	    netreq->upstreams->count > 1 && (hedge_usec = rtt_percentile(stub,
+	    stub->context->hedge_percentile * 10)) &&
+	    hedge_usec < (uint64_t) ms * 1000) {
+		ms = (hedge_usec + 999) / 1000;
+		netreq->hedging = 1;
+	}
+	if (netreq->n_deadlines < NETREQ_DEADLINES)
+		netreq->deadlines[netreq->n_deadlines++] = ms;
+	netreq->retry_id = stub->next_timeout_id++;
+	if (getdns_context_schedule_timeout(stub->context, netreq->retry_id,
+	    ms, retry_timeout, netreq) != GETDNS_RETURN_GOOD)
+		netreq->retry_id = 0;
+}
+
+/*---------------------------------------- connections */
+static void
+destroy_conn(struct priv_getdns_stub *stub, struct priv_getdns_tcp_conn *conn)
+{
+	if (conn->idle_id)
+		(void) getdns_context_clear_timeout(stub->context,
+		    conn->idle_id);
+	if (conn->fd != -1)
+		(void) close(conn->fd);
+	if (conn->out)
+		GETDNS_FREE(stub->context->my_mf, conn->out);
+	if (conn->in)
+		GETDNS_FREE(stub->context->my_mf, conn->in);
+	GETDNS_FREE(stub->context->my_mf, conn);
+}
+
+/* closing takes it out of the epoll set, it is freed when reaped */
+static void
+fail_conn(struct priv_getdns_tcp_conn *conn)
+{
+	if (conn->fd != -1)
+		(void) close(conn->fd);
+	conn->fd = -1;
+}
+
+/* a query written to conn, which failed */
+static void
+requeue_query(struct priv_getdns_stub *stub, struct priv_getdns_tcp_conn *conn,
+    getdns_network_req *netreq)
+{
+	netreq->conn = NULL;
+	conn->outstanding--;
+	/* upstreams close connections after a number of queries, those not
+	 * answered go on a new one */
+	if (conn->answered)
+		queue_query(stub, netreq);
+	/* otherwise it waits for the request to time out */
+	else if (++netreq->tries < STUB_TCP_TRIES * netreq->upstreams->count) {
+		netreq->upstream = next_upstream(netreq);
+		queue_query(stub, netreq);
+	}
+}
+
+/*
+ * Free the failed connections, and write the queries that were not
+ * answered on them to the connection to the next upstream.  Not while
+ * reading, the callbacks of which could get a connection failed that
+ * is still being read.
+ */
+static void
+reap_conns(struct priv_getdns_stub *stub)
+{
+	struct priv_getdns_tcp_conn **conn_p = &stub->conns, *conn;
+	getdns_network_req *netreq;
+	size_t i;
+
+	if (stub->reading)
+		return;
+	while ((conn = *conn_p)) {
+		if (conn->fd != -1) {
+			conn_p = &conn->next;
+			continue;
+		}
+		if (conn->outstanding && !conn->answered)
+			upstream_failed(stub, find_upstream(stub->upstreams,
+			    &conn->upstream.addr));
+		for (i = 0; conn->outstanding && i < stub->queries_size; i++)
+			for ( netreq = stub->queries[i]
+			    ; netreq
+			    ; netreq = netreq->hash_next)
+				if (netreq->conn == conn)
+					requeue_query(stub, conn, netreq);
+		*conn_p = conn->next;
+		destroy_conn(stub, conn);
+	}
+}
+
+static getdns_return_t
+idle_timeout(void *arg)
+{
+	struct priv_getdns_tcp_conn *conn = (struct priv_getdns_tcp_conn *) arg;
+	struct priv_getdns_stub *stub = conn->stub;
+
+	(void) getdns_context_clear_timeout(stub->context, conn->idle_id);
+	conn->idle_id = 0;
+	fail_conn(conn);
+	reap_conns(stub);
+	return GETDNS_RETURN_GOOD;
+}
+
+static void
+watch_writing(struct priv_getdns_stub *stub, struct priv_getdns_tcp_conn *conn,
+    int writing)
+{
+	struct epoll_event ev;
+
+	if (conn->writing == writing)
+		return;
+	ev.events = writing ? EPOLLIN | EPOLLOUT : EPOLLIN;
+	ev.data.ptr = stub;
+	if (epoll_ctl(stub->context->ub_poll_fd, EPOLL_CTL_MOD, conn->fd,
+	    &ev) != 0)
+		fail_conn(conn);
+	else
+		conn->writing = writing;
+}
+
+/* the connection is established while the first queries wait to be
+ * written, with EPOLLOUT watched until then */
+static struct priv_getdns_tcp_conn *
+open_conn(struct priv_getdns_stub *stub, struct priv_getdns_upstream *upstream)
+{
+	struct priv_getdns_tcp_conn *conn;
+	struct epoll_event ev;
+	int on = 1;
+
+	conn = GETDNS_MALLOC(stub->context->my_mf, struct priv_getdns_tcp_conn);
+	if (!conn)
+		return NULL;
+	(void) memset(conn, 0, sizeof(struct priv_getdns_tcp_conn));
+	conn->stub = stub;
+	conn->upstream = *upstream;
+	conn->in = GETDNS_XMALLOC(stub->context->my_mf, uint8_t, TCP_IN_SIZE);
+	conn->fd = socket(upstream->addr.ss_family,
+	    SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+	ev.events = EPOLLIN | EPOLLOUT;
+	ev.data.ptr = stub;
+	if (!conn->in || conn->fd == -1 ||
+	    (connect(conn->fd, (struct sockaddr *) &upstream->addr,
+	    upstream->addr_len) != 0 && errno != EINPROGRESS) ||
+	    epoll_ctl(stub->context->ub_poll_fd, EPOLL_CTL_ADD, conn->fd,
+	    &ev) != 0) {
+		destroy_conn(stub, conn);
+		return NULL;
+	}
+	/* the queries are small and written as soon as they are made */
+	(void) setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	conn->writing = 1;
+	conn->next = stub->conns;
+	stub->conns = conn;
+	return conn;
+}
+
+/* queue netreq with its length to be written to the connection to its
+ * upstream, which is opened when there is none */
+static int
+write_query(struct priv_getdns_stub *stub, getdns_network_req *netreq)
+{
+	struct priv_getdns_upstream *upstream = netreq_upstream(netreq);
+	struct priv_getdns_tcp_conn *conn;
+	size_t size;
+	uint8_t *out;
+
+	for (conn = stub->conns; conn; conn = conn->next)
+		if (conn->fd != -1 && same_address(&conn->upstream.addr,
+		    &upstream->addr))
+			break;
+	if (!conn && !(conn = open_conn(stub, upstream)))
+		return -1;
+
+	if (conn->out_pos > 0) {
+		(void) memmove(conn->out, conn->out + conn->out_pos,
+		    conn->out_len - conn->out_pos);
+		conn->out_len -= conn->out_pos;
+		conn->out_pos = 0;
+	}
+	if (conn->out_len + 2 + netreq->wire_len > conn->out_size) {
+		for (size = conn->out_size ? conn->out_size : 4096
+		    ; size < conn->out_len + 2 + netreq->wire_len
+		    ; size *= 2)
+			; /* pass */
+		out = GETDNS_XREALLOC(stub->context->my_mf, conn->out,
+		    uint8_t, size);
+		if (!out)
+			return -1;
+		conn->out = out;
+		conn->out_size = size;
+	}
+	ldns_write_uint16(conn->out + conn->out_len, netreq->wire_len);
+	(void) memcpy(conn->out + conn->out_len + 2, netreq->wire,
+	    netreq->wire_len);
+	conn->out_len += 2 + netreq->wire_len;
+
+	netreq->conn = conn;
+	netreq->sent_usec = now_usec();
+	upstream->sent++;
+	conn->outstanding++;
+	if (conn->idle_id) {
+		(void) getdns_context_clear_timeout(stub->context,
+		    conn->idle_id);
+		conn->idle_id = 0;
+	}
+	return 0;
+}
+
+/* write what fits in the send buffer, or is possible while connecting */
+static void
+write_conn(struct priv_getdns_stub *stub, struct priv_getdns_tcp_conn *conn)
+{
+	ssize_t n;
+
+	while (conn->out_pos < conn->out_len) {
+		n = send(conn->fd, conn->out + conn->out_pos,
+		    conn->out_len - conn->out_pos, MSG_NOSIGNAL);
+		if (n > 0)
+			conn->out_pos += n;
+		else if (n == -1 && errno == EINTR)
+			continue;
+		else if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			watch_writing(stub, conn, 1);
+			return;
+		} else {
+			fail_conn(conn);
+			return;
+		}
+	}
+	watch_writing(stub, conn, 0);
+}
+
+/* netreq is no longer waited for on its connection */
+static void
+release_conn(struct priv_getdns_stub *stub, getdns_network_req *netreq)
+{
+	struct priv_getdns_tcp_conn *conn = netreq->conn;
+
+	if (!conn)
+		return;
+	netreq->conn = NULL;
+	if (--conn->outstanding == 0 && conn->fd != -1) {
+		conn->idle_id = stub->next_timeout_id++;
+		if (getdns_context_schedule_timeout(stub->context,
+		    conn->idle_id, STUB_TCP_IDLE_MS, idle_timeout,
+		    conn) != GETDNS_RETURN_GOOD)
+			conn->idle_id = 0;
+	}
+}
+
+static void
+clear_retry(struct priv_getdns_stub *stub, getdns_network_req *netreq)
+{
+	netreq->hedging = 0;
+	if (netreq->retry_id) {
+		(void) getdns_context_clear_timeout(stub->context,
+		    netreq->retry_id);
+		netreq->retry_id = 0;
+	}
+}
+
+/* take netreq out of the stub, when answered or canceled */
+static void
+stop_query(struct priv_getdns_stub *stub, getdns_network_req *netreq)
+{
+	int f;
+
+	remove_query(stub, netreq);
+	for (f = 0; f < 2; f++) {
+		if (netreq->sockets[f])
+			release_socket(stub, netreq->sockets[f]);
+		netreq->sockets[f] = NULL;
+	}
+	unqueue_query(stub, netreq);
+	release_query(stub, netreq);
+	release_conn(stub, netreq);
+	clear_retry(stub, netreq);
+	release_upstreams(stub, netreq->upstreams);
+	netreq->upstreams = NULL;
+	netreq->stub = 0;
+}
+
+/*---------------------------------------- receiving */
+/* an answer from conn, or from the address from on sock over UDP */
+static void
+handle_answer(struct priv_getdns_stub *stub, struct priv_getdns_tcp_conn *conn,
+    struct priv_getdns_udp_socket *sock, uint8_t *wire, size_t len,
+    int truncated, const struct sockaddr_storage *from)
+{
+	struct priv_getdns_upstream *upstream;
+	getdns_network_req *netreq;
+
+	if (len < LDNS_HEADER_SIZE || !LDNS_QR_WIRE(wire) ||
+	    !(netreq = find_query(stub, wire, len)))
+		return;
+	if (conn ? netreq->conn != conn
+	    : netreq->tcp ||
+	    netreq->sockets[FAMILY_INDEX(from->ss_family)] != sock ||
+	    !from_upstream(netreq->upstreams, from))
+		return;
+
+	if (conn)
+		conn->answered++;
+	upstream = conn ? find_upstream(netreq->upstreams, &conn->upstream.addr)
+	    : find_upstream(netreq->upstreams, from);
+	if (!conn)
+		edns_answered(stub->context, upstream, netreq,
+		    truncated || LDNS_TC_WIRE(wire));
+	if (LDNS_RCODE_WIRE(wire) == LDNS_RCODE_SERVFAIL) {
+		upstream_failed(stub, upstream);
+		/* already to be sent again, after a retry timed out */
+		if (netreq->pending_pprev)
+			return;
+		/* another upstream may know better */
+		if (netreq->tries + 1 < netreq->upstreams->count) {
+			release_conn(stub, netreq);
+			clear_retry(stub, netreq);
+			netreq->upstream = next_upstream(netreq);
+			netreq->tries++;
+			queue_query(stub, netreq);
+			schedule_retry(stub, netreq, 0);
+			return;
+		}
+	} else
+		upstream_answered(stub, upstream);
+	/* which try was answered is only known of the first */
+	if (netreq->tries == 0 && (conn || same_address(from,
+	    &netreq_upstream(netreq)->addr))) {
+		update_rtt(netreq_upstream(netreq),
+		    now_usec() - netreq->sent_usec);
+		add_rtt_sample(stub, now_usec() - netreq->sent_usec);
+		netreq_upstream(netreq)->answered++;
+	}
+	stop_query(stub, netreq);
+	priv_getdns_stub_answered(netreq, wire, len,
+	    truncated || LDNS_TC_WIRE(wire));
+}
+
+/* read the answers that arrived on conn, until it would block */
+static void
+read_conn(struct priv_getdns_stub *stub, struct priv_getdns_tcp_conn *conn)
+{
+	size_t pos, len;
+	ssize_t n;
+
+	for (;;) {
+		n = read(conn->fd, conn->in + conn->in_len,
+		    TCP_IN_SIZE - conn->in_len);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return;
+		if (n <= 0) {
+			/* also when closed by the upstream for being idle */
+			fail_conn(conn);
+			return;
+		}
+		conn->in_len += n;
+		for ( pos = 0
+		    ; conn->in_len - pos >= 2 && conn->in_len - pos >=
+		      2 + (len = ldns_read_uint16(conn->in + pos))
+		    ; pos += 2 + len)
+			handle_answer(stub, conn, NULL, conn->in + pos + 2, len, 0,
+			    NULL);
+		(void) memmove(conn->in, conn->in + pos, conn->in_len - pos);
+		conn->in_len -= pos;
+	}
+}
+
+/* read the answers that arrived on sock, until it would block */
+static void
+read_socket(struct priv_getdns_stub *stub, struct priv_getdns_udp_socket *sock)
+{
+	struct mmsghdr msgs[STUB_BATCH];
+	struct iovec iov[STUB_BATCH];
+	struct sockaddr_storage from[STUB_BATCH];
+	size_t size = stub->buf_size;
+	int i, n;
+
+	do {
+		(void) memset(msgs, 0, sizeof(msgs));
+		for (i = 0; i < STUB_BATCH; i++) {
+			iov[i].iov_base = stub->buf + i * size;
+			iov[i].iov_len = size;
+			msgs[i].msg_hdr.msg_name = &from[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		n = recvmmsg(sock->fd, msgs, STUB_BATCH, MSG_DONTWAIT, NULL);
+		for (i = 0; i < n; i++)
+			handle_answer(stub, NULL, sock, iov[i].iov_base,
+			    msgs[i].msg_len,
+			    (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0,
+			    &from[i]);
+	} while (n == STUB_BATCH);
+}
+#endif
+
+/*---------------------------------------- engine */
+getdns_return_t
+priv_getdns_stub_setup(struct getdns_context *context)
+{
+#ifdef HAVE_NATIVE_STUB
+	struct priv_getdns_stub *stub = context->stub;
+	struct priv_getdns_upstreams *upstreams;
+	struct priv_getdns_upstream *upstream;
+	struct getdns_dict *dict;
+	size_t count, i, j;
+
+	if (getdns_list_get_length(context->upstream_list, &count) !=
+	    GETDNS_RETURN_GOOD || count == 0)
+		return GETDNS_RETURN_BAD_CONTEXT;
+	if (!stub) {
+		stub = GETDNS_MALLOC(context->my_mf, struct priv_getdns_stub);
+		if (!stub)
+			return GETDNS_RETURN_MEMORY_ERROR;
+		(void) memset(stub, 0, sizeof(struct priv_getdns_stub));
+		stub->context = context;
+		stub->hash_seed = (uint32_t) ldns_get_random() << 16 |
+		    ldns_get_random();
+		stub->pending_tail[0] = &stub->pending[0];
+		stub->pending_tail[1] = &stub->pending[1];
+		stub->pending_tail[TCP_QUEUE] = &stub->pending[TCP_QUEUE];
+		stub->pending_tail[HELD_QUEUE] = &stub->pending[HELD_QUEUE];
+		stub->next_timeout_id = GETDNS_TIMEOUT_ID_STUB;
+		context->stub = stub;
+	}
+	upstreams = (struct priv_getdns_upstreams *) GETDNS_XMALLOC(
+	    context->my_mf, uint8_t, sizeof(struct priv_getdns_upstreams) +
+	    count * sizeof(struct priv_getdns_upstream));
+	if (!upstreams)
+		return GETDNS_RETURN_MEMORY_ERROR;
+	upstreams->referenced = 1;
+	upstreams->count = 0;
+	for (i = 0; i < count; i++) {
+		upstream = &upstreams->upstreams[upstreams->count];
+		(void) memset(upstream, 0, sizeof(struct priv_getdns_upstream));
+		upstream->edns_level = STUB_EDNS_START;
+		if (getdns_list_get_dict(context->upstream_list, i, &dict) !=
+		    GETDNS_RETURN_GOOD ||
+		    dict_to_sockaddr(dict, &upstream->addr) != GETDNS_RETURN_GOOD ||
+		    open_pool(stub, upstream->addr.ss_family) != 0)
+			continue;
+		upstream->addr_len = upstream->addr.ss_family == AF_INET
+		    ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+		/* what was measured stays with the upstreams kept */
+		for (j = 0; stub->upstreams && j < stub->upstreams->count; j++)
+			if (same_address(&stub->upstreams->upstreams[j].addr,
+			    &upstream->addr)) {
+				*upstream = stub->upstreams->upstreams[j];
+				/* those in flight count with the previous */
+				upstream->in_flight = 0;
+			}
+		upstreams->count++;
+	}
+	/* the queries in flight keep the previous ones */
+	release_upstreams(stub, stub->upstreams);
+	stub->upstreams = NULL;
+	if (upstreams->count == 0) {
+		GETDNS_FREE(context->my_mf, upstreams);
+		return GETDNS_RETURN_GENERIC_ERROR;
+	}
+	stub->upstreams = upstreams;
+	stub->next_upstream = 0;
+	return GETDNS_RETURN_GOOD;
+#else
+	return GETDNS_RETURN_GENERIC_ERROR;
+#endif
+}
+
+void
+priv_getdns_stub_destroy(struct getdns_context *context)
+{
+#ifdef HAVE_NATIVE_STUB
+	struct priv_getdns_stub *stub = context->stub;
+	struct priv_getdns_udp_socket *sock;
+	struct priv_getdns_tcp_conn *conn;
+
+	if (!stub)
+		return;
+	/* the requests are canceled, only the flush and the admission of
+	 * held queries can be scheduled */
+	priv_getdns_stub_flush(stub);
+	if (stub->admit_id)
+		(void) getdns_context_clear_timeout(context, stub->admit_id);
+	while (stub->conns) {
+		conn = stub->conns;
+		stub->conns = conn->next;
+		destroy_conn(stub, conn);
+	}
+	close_pool(stub, 0);
+	close_pool(stub, 1);
+	while ((sock = stub->retired)) {
+		stub->retired = sock->next;
+		close_socket(stub, sock);
+	}
+	release_upstreams(stub, stub->upstreams);
+	if (stub->queries)
+		GETDNS_FREE(context->my_mf, stub->queries);
+	if (stub->buf)
+		GETDNS_FREE(context->my_mf, stub->buf);
+	GETDNS_FREE(context->my_mf, stub);
+	context->stub = NULL;
+#endif
+}
+
+int
+priv_getdns_stub_eligible(struct getdns_context *context,
+    getdns_dns_req *req, int usenamespaces)
+{
+	int i;
+
+	if (!context->stub || !context->stub->upstreams ||
+	    context->resolution_type != GETDNS_RESOLUTION_STUB)
+		return 0;
+	/* unbound cannot keep connections open, so the native stub is used
+	 * for that transport whenever it can be */
+	if (context->dns_transport !=
+	    GETDNS_TRANSPORT_TCP_ONLY_KEEP_CONNECTIONS_OPEN &&
+	    !(context->native_stub &&
+	    (context->dns_transport == GETDNS_TRANSPORT_UDP_ONLY ||
+	     context->dns_transport ==
+	     GETDNS_TRANSPORT_UDP_FIRST_AND_FALL_BACK_TO_TCP)))
+		return 0;
+	/* answers are not validated */
+	if (req->return_dnssec_status == GETDNS_EXTENSION_TRUE ||
+	    is_extension_set(req->extensions, "dnssec_return_status") ||
+	    is_extension_set(req->extensions, "dnssec_return_only_secure") ||
+	    is_extension_set(req->extensions,
+	    "dnssec_return_validation_chain"))
+		return 0;
+	if (usenamespaces)
+		for (i = 0; i < context->namespace_count; i++)
+			if (context->namespaces[i] ==
+			    GETDNS_NAMESPACE_LOCALNAMES)
+				return 0;
+	return 1;
+}
+
+getdns_return_t
+priv_getdns_stub_submit(getdns_network_req *netreq)
+{
+#ifdef HAVE_NATIVE_STUB
+	struct priv_getdns_stub *stub = netreq->owner->context->stub;
+	getdns_return_t r;
+	int tries = 0;
+
+	if (!stub->upstreams)
+		return GETDNS_RETURN_GENERIC_ERROR;
+	if (!netreq->wire && (r = build_query(netreq)) != GETDNS_RETURN_GOOD)
+		return r;
+
+	/* the ID needs to be unique for the question only */
+	do {
+		if (tries++ == STUB_ID_TRIES)
+			return GETDNS_RETURN_GENERIC_ERROR;
+		netreq->query_id = ldns_get_random();
+		ldns_write_uint16(netreq->wire, netreq->query_id);
+	} while (find_query(stub, netreq->wire, netreq->wire_len));
+	netreq->hash = query_hash(stub->hash_seed, netreq->wire,
+	    question_name_len(netreq->wire, netreq->wire_len));
+	if (insert_query(stub, netreq) != 0)
+		return GETDNS_RETURN_MEMORY_ERROR;
+
+	netreq->upstreams = stub->upstreams;
+	netreq->upstreams->referenced++;
+	netreq->upstream = select_upstream(stub);
+	netreq->tries = 0;
+	netreq->n_deadlines = 0;
+	netreq->tcp = stub->context->dns_transport ==
+	    GETDNS_TRANSPORT_TCP_ONLY_KEEP_CONNECTIONS_OPEN;
+	netreq->stub = 1;
+	netreq->state = NET_REQ_IN_FLIGHT;
+	queue_query(stub, netreq);
+	/* over TCP not hedged, the answer is not lost but may be late */
+	if (!netreq->tcp) {
+		stub->hedge_credit += stub->context->hedge_permille;
+		if (stub->hedge_credit > STUB_HEDGE_BURST * 1000)
+			stub->hedge_credit = STUB_HEDGE_BURST * 1000;
+	}
+	schedule_retry(stub, netreq, !netreq->tcp);
+	return GETDNS_RETURN_GOOD;
+#else
+	return GETDNS_RETURN_GENERIC_ERROR;
+#endif
+}
+
+void
+priv_getdns_stub_cancel(getdns_network_req *netreq)
+{
+#ifdef HAVE_NATIVE_STUB
+	if (netreq->stub)
+		stop_query(netreq->owner->context->stub, netreq);
+#endif
+}
+
+void
+priv_getdns_stub_flush(struct priv_getdns_stub *stub)
+{
+#ifdef HAVE_NATIVE_STUB
+	struct mmsghdr msgs[STUB_BATCH];
+	struct iovec iov[STUB_BATCH];
+	struct priv_getdns_upstream *upstream;
+	struct priv_getdns_udp_socket *sock;
+	struct priv_getdns_tcp_conn *conn;
+	getdns_network_req *netreq;
+	unsigned int n, sent;
+	uint64_t now;
+	int f, r;
+
+	if (stub->flush_id) {
+		(void) getdns_context_clear_timeout(stub->context,
+		    stub->flush_id);
+		stub->flush_id = 0;
+	}
+	admit_held(stub);
+	while ((netreq = stub->pending[TCP_QUEUE])) {
+		unqueue_query(stub, netreq);
+		if (write_query(stub, netreq) != 0 && ++netreq->tries <
+		    STUB_TCP_TRIES * netreq->upstreams->count) {
+			netreq->upstream = next_upstream(netreq);
+			queue_query(stub, netreq);
+		}
+	}
+	for (conn = stub->conns; conn; conn = conn->next)
+		if (conn->fd != -1 && (conn->writing ||
+		    conn->out_pos < conn->out_len))
+			write_conn(stub, conn);
+	reap_conns(stub);
+	if (!stub->pending[0] && !stub->pending[1])
+		return;
+	now = now_usec();
+	rotate_pools(stub, now);
+	for (f = 0; f < 2; f++) {
+		/* lost when there are no sockets, and sent again when their
+		 * retry is due */
+		if (stub->pending[f] && open_pool(stub, f ? AF_INET6 : AF_INET)
+		    != 0 && !stub->pool[f])
+			while (stub->pending[f])
+				unqueue_query(stub, stub->pending[f]);
+		while (stub->pending[f]) {
+			/* a query is sent from the same socket every try, so
+			 * that the answer to an earlier one is still taken */
+			if (!(sock = stub->pending[f]->sockets[f]))
+				sock = stub->pool[f][stub->next_socket[f]++ %
+				    stub->pool_size[f]];
+			(void) memset(msgs, 0, sizeof(msgs));
+			for ( n = 0, netreq = stub->pending[f]
+			    ; n < STUB_BATCH && netreq
+			    ; n++, netreq = netreq->pending_next) {
+				if (!netreq->sockets[f]) {
+					netreq->sockets[f] = sock;
+					sock->referenced++;
+				} else if (netreq->sockets[f] != sock)
+					break;
+				upstream = netreq_upstream(netreq);
+				upstream->sent++;
+				netreq->sent_usec = now;
+				set_edns_size(stub->context, netreq, upstream);
+				iov[n].iov_base = netreq->wire;
+				iov[n].iov_len = netreq->wire_len;
+				msgs[n].msg_hdr.msg_name = &upstream->addr;
+				msgs[n].msg_hdr.msg_namelen = upstream->addr_len;
+				msgs[n].msg_hdr.msg_iov = &iov[n];
+				msgs[n].msg_hdr.msg_iovlen = 1;
+			}
+			/* a query that could not be sent counts as lost, and
+			 * is sent again when its retry is due */
+			for (sent = 0; sent < n; sent += r) {
+				r = sendmmsg(sock->fd, msgs + sent, n - sent, 0);
+				if (r == -1 && errno == EINTR)
+					r = 0;
+				else if (r == -1 && (errno == EAGAIN ||
+				    errno == EWOULDBLOCK))
+					break;
+				else if (r == -1)
+					r = 1; /* skip the one that failed */
+			}
+			while (n--)
+				unqueue_query(stub, stub->pending[f]);
+		}
+	}
+#endif
+}
+
+void
+priv_getdns_stub_read(struct priv_getdns_stub *stub)
+{
+#ifdef HAVE_NATIVE_STUB
+	size_t size = stub->context->edns_maximum_udp_payload_size, s;
+	struct priv_getdns_udp_socket *sock, *next;
+	struct priv_getdns_tcp_conn *conn;
+	int f;
+
+	/* connections are created by the callbacks, but not freed */
+	stub->reading = 1;
+	for (conn = stub->conns; conn; conn = conn->next)
+		if (conn->fd != -1)
+			read_conn(stub, conn);
+	stub->reading = 0;
+	reap_conns(stub);
+
+	/* answers larger than the payload size we offer are truncated */
+	if (size < 512)
+		size = 512;
+	if (size < stub->context->edns_negotiation_max)
+		size = stub->context->edns_negotiation_max <
+		    edns_sizes[STUB_EDNS_LEVELS - 1]
+		    ? stub->context->edns_negotiation_max
+		    : edns_sizes[STUB_EDNS_LEVELS - 1];
+	if (stub->buf_size < size) {
+		if (stub->buf)
+			GETDNS_FREE(stub->context->my_mf, stub->buf);
+		stub->buf_size = 0;
+		stub->buf = GETDNS_XMALLOC(stub->context->my_mf, uint8_t,
+		    STUB_BATCH * size);
+		if (!stub->buf)
+			return;
+		stub->buf_size = size;
+	}
+	/* the sockets are referenced while read, as the callbacks of the
+	 * answers could have them rotated out and closed */
+	for (f = 0; f < 2; f++) {
+		for (s = 0; s < stub->pool_size[f]; s++) {
+			sock = stub->pool[f][s];
+			sock->referenced++;
+			read_socket(stub, sock);
+			release_socket(stub, sock);
+		}
+	}
+	if ((sock = stub->retired))
+		sock->referenced++;
+	while (sock) {
+		read_socket(stub, sock);
+		if ((next = sock->next))
+			next->referenced++;
+		release_socket(stub, sock);
+		sock = next;
+	}
+#endif
+}
+
+struct getdns_list *
+priv_getdns_stub_upstream_stats(struct getdns_context *context)
+{
+#ifdef HAVE_NATIVE_STUB
+	struct priv_getdns_upstreams *upstreams;
+	struct getdns_list *stats;
+	struct getdns_dict *dict;
+	getdns_return_t r = GETDNS_RETURN_GOOD;
+	size_t i;
+
+	if (!context->stub || !(upstreams = context->stub->upstreams) ||
+	    !(stats = getdns_list_create_with_context(context)))
+		return NULL;
+	for (i = 0; r == GETDNS_RETURN_GOOD && i < upstreams->count; i++) {
+		if ((r = upstream_dict(context, &upstreams->upstreams[i],
+		    &dict)))
+			break;
+		r = getdns_list_set_dict(stats, i, dict);
+		getdns_dict_destroy(dict);
+	}
+	if (r != GETDNS_RETURN_GOOD) {
+		getdns_list_destroy(stats);
+		return NULL;
+	}
+	return stats;
+#else
+	return NULL;
+#endif
+}
+
+/*---------------------------------------- public */
+getdns_return_t
+getdns_context_set_native_stub(getdns_context *context, int enable)
+{
+	if (!context)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+#ifdef HAVE_NATIVE_STUB
+	if (enable && context->ub_poll_fd == -1)
+		return GETDNS_RETURN_GENERIC_ERROR;
+#else
+	if (enable)
+		return GETDNS_RETURN_GENERIC_ERROR;
+#endif
+	context->native_stub = enable != 0;
+	/* otherwise set up with the next request */
+	if (context->native_stub &&
+	    context->resolution_type_set == GETDNS_RESOLUTION_STUB)
+		(void) priv_getdns_stub_setup(context);
+	return GETDNS_RETURN_GOOD;
+}
+
+getdns_return_t
+getdns_context_set_upstream_health_callback(getdns_context *context,
+    getdns_upstream_health_callback callback, void *userarg)
+{
+	if (!context)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+	context->upstream_health_callback = callback;
+	context->upstream_health_userarg = userarg;
+	return GETDNS_RETURN_GOOD;
+}
+
+getdns_return_t
+getdns_context_set_hedged_queries(getdns_context *context, uint8_t percentile,
+    uint16_t max_permille)
+{
+	if (!context)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+	if (percentile > 99 || max_permille > 1000)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+	context->hedge_percentile = percentile;
+	context->hedge_permille = max_permille;
+	return GETDNS_RETURN_GOOD;
+}
+
+getdns_return_t
+getdns_context_set_adaptive_timeouts(getdns_context *context, uint8_t factor)
+{
+	if (!context)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+	context->adaptive_timeout_factor = factor;
+	return GETDNS_RETURN_GOOD;
+}
+
+/* pools of another size are reopened when the next query is sent */
+getdns_return_t
+getdns_context_set_udp_socket_pool(getdns_context *context,
+    uint16_t pool_size, uint16_t rotate_ms)
+{
+	if (!context || pool_size < 1 || pool_size > STUB_MAX_SOCKETS)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+	context->udp_pool_size = pool_size;
+	context->udp_rotate_ms = rotate_ms;
+	return GETDNS_RETURN_GOOD;
+}
+
+getdns_return_t
+getdns_context_set_edns_size_negotiation(getdns_context *context,
+    uint16_t max_size)
+{
+	if (!context)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+	if (max_size && max_size < 512)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+	context->edns_negotiation_max = max_size;
+	return GETDNS_RETURN_GOOD;
+}
+
+getdns_return_t
+getdns_context_set_upstream_limits(getdns_context *context, uint32_t qps,
+    uint32_t burst, uint32_t max_in_flight)
+{
+	if (!context || (qps && !burst))
+		return GETDNS_RETURN_INVALID_PARAMETER;
+	context->upstream_qps = qps;
+	context->upstream_burst = burst;
+	context->upstream_max_in_flight = max_in_flight;
+#ifdef HAVE_NATIVE_STUB
+	/* held queries may fit the new limits */
+	if (context->stub && context->stub->pending[HELD_QUEUE])
+		schedule_flush(context->stub);
+#endif
+	return GETDNS_RETURN_GOOD;
+}
+
+/* stub.c */
@@ -0,0 +1,230 @@
+/**
+ * \file
+ * \brief Native stub resolution over UDP
+ */
+
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _GETDNS_STUB_H_
+#define _GETDNS_STUB_H_
+
+#include <sys/socket.h>
+#include <getdns/getdns.h>
+#include "types-internal.h"
+
+/* sockets per address family the queries are spread over, by default,
+ * and at most */
+#define STUB_SOCKETS 4
+#define STUB_MAX_SOCKETS 64
+/* one socket of each pool is replaced this often, by default */
+#define STUB_ROTATE_MS 10000
+/* queries sent, and answers read, with one system call */
+#define STUB_BATCH 32
+/* TCP connections without queries are closed after this */
+#define STUB_TCP_IDLE_MS 10000
+/* of the round trip time histogram, 4 per power of 2 microseconds */
+#define STUB_RTT_BUCKETS 128
+
+struct priv_getdns_upstream {
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    /* smoothed round trip time and its variance in microseconds, as for
+     * TCP (RFC 6298), both 0 until measured */
+    uint32_t srtt;
+    uint32_t rttvar;
+    /* queries sent to it, and answers to the first try of one */
+    uint64_t sent;
+    uint64_t answered;
+    /* queries sent to it because another upstream was slow to answer */
+    uint64_t hedges;
+    /* timeouts and SERVFAILs, in a row and in total */
+    unsigned int consecutive_failures;
+    uint64_t failures;
+    /* out of rotation until then (see now_usec), 0 while healthy */
+    uint64_t down_until;
+    /* times taken out since it was last healthy, and outages in total */
+    unsigned int downs;
+    uint64_t outages;
+    /* a probe was sent to it, after which it is out of rotation again */
+    int probing;
+    /* with EDNS size negotiation, the payload size advertised to it (see
+     * stub.c), the answers and timeouts in a row at that size, and the
+     * times it went down */
+    unsigned int edns_level;
+    unsigned int edns_answers;
+    unsigned int edns_timeouts;
+    unsigned int edns_downs;
+    /* truncated answers over UDP, and those retried over TCP */
+    uint64_t truncated;
+    uint64_t tcp_fallbacks;
+    /* with limits per upstream, the token bucket (see admission.h) and
+     * the queries waited for */
+    uint64_t bucket_usec;
+    size_t in_flight;
+};
+
+/*
+ * The upstreams of the context, referenced by the queries sent to them,
+ * so they stay around when the upstreams are replaced while those are
+ * still in flight.
+ */
+struct priv_getdns_upstreams {
+    size_t referenced;
+    size_t count;
+    struct priv_getdns_upstream upstreams[];
+};
+
+/*
+ * A UDP socket of the pool, bound to a random port.  When rotated out of
+ * the pool it is still read, until the queries sent from it are done.
+ */
+struct priv_getdns_udp_socket {
+    /* in the list of retired sockets */
+    struct priv_getdns_udp_socket *next;
+    int fd;
+    /* queries sent from it that are still in flight */
+    size_t referenced;
+    int retired;
+};
+
+/*
+ * A TCP connection to an upstream, kept open for the queries to it until
+ * idle for STUB_TCP_IDLE_MS.  Queries are pipelined on it, and the answers
+ * matched by ID in whatever order they come (RFC 7766).
+ */
+struct priv_getdns_tcp_conn {
+    struct priv_getdns_tcp_conn *next;
+    struct priv_getdns_stub *stub;
+    struct priv_getdns_upstream upstream;
+    /* -1 when failed, and to be reaped */
+    int fd;
+    /* whether EPOLLOUT is watched, for connecting or a full send buffer */
+    int writing;
+    /* queries sent, or to be sent, on the connection and not answered */
+    size_t outstanding;
+    /* queries answered on the connection */
+    size_t answered;
+    /* of the timeout that closes it when idle, 0 when not scheduled */
+    getdns_transaction_t idle_id;
+    /* length prefixed queries not yet written */
+    uint8_t *out;
+    size_t out_pos, out_len, out_size;
+    /* of one length prefixed answer at least */
+    uint8_t *in;
+    size_t in_len;
+};
+
+/*
+ * Stub resolution without unbound.  Queries are queued and sent together
+ * with sendmmsg from a pool of UDP sockets on random ports, when the
+ * context is processed or from a timeout right after the request was made.
+ * Answers are read with recvmmsg when the context is processed, and
+ * matched to their query by socket, ID, upstream and question.  The
+ * sockets are watched through the epoll fd of the unbound contexts, so
+ * getdns_context_fd covers them too.  With the
+ * GETDNS_TRANSPORT_TCP_ONLY_KEEP_CONNECTIONS_OPEN transport queries are
+ * written to the connections to the upstreams instead.
+ */
+struct priv_getdns_stub {
+    struct getdns_context *context;
+    /* NULL when the upstreams could not be set up */
+    struct priv_getdns_upstreams *upstreams;
+    /* to rotate among upstreams with the same score */
+    size_t next_upstream;
+    /* upstreams picked, the chance to explore decays with it */
+    uint64_t selections;
+    /* round trip times of all upstreams, halved every STUB_RTT_WINDOW
+     * samples so that the older ones count less */
+    uint32_t rtt_buckets[STUB_RTT_BUCKETS];
+    uint32_t rtt_samples;
+    /* hedges that may be sent, in thousandths */
+    uint32_t hedge_credit;
+    /* IPv4 and IPv6 sockets, pool_size[i] of them, NULL when not open */
+    struct priv_getdns_udp_socket **pool[2];
+    size_t pool_size[2];
+    size_t next_socket[2];
+    /* the next of each pool to be replaced, and when the last one was */
+    size_t next_rotate[2];
+    uint64_t rotated_usec;
+    /* rotated out of the pools, closed when no longer referenced */
+    struct priv_getdns_udp_socket *retired;
+    /* of the timeout that rotates the pools, 0 when not scheduled */
+    getdns_transaction_t rotate_id;
+    /* the queries in flight, hashed on ID and question name with a
+     * random seed, and chained by hash_next */
+    getdns_network_req **queries;
+    size_t queries_size;
+    size_t queries_count;
+    uint32_t hash_seed;
+    /* queries to be sent with the next flush, per address family for
+     * UDP, the ones for TCP, and those held until an upstream has room */
+    getdns_network_req *pending[4];
+    getdns_network_req **pending_tail[4];
+    /* the TCP connections to the upstreams, reaped when failed */
+    struct priv_getdns_tcp_conn *conns;
+    /* set while reading, when the connections may not be reaped */
+    int reading;
+    /* of the timeout that flushes, 0 when not scheduled */
+    getdns_transaction_t flush_id;
+    /* of the timeout that admits held queries when there is a token */
+    getdns_transaction_t admit_id;
+    /* ids for the timeouts of the stub, out of the range of transactions */
+    getdns_transaction_t next_timeout_id;
+    /* STUB_BATCH buffers of buf_size for reading */
+    uint8_t *buf;
+    size_t buf_size;
+};
+
+/* set up the native stub of context for its current upstreams */
+getdns_return_t priv_getdns_stub_setup(struct getdns_context *context);
+void priv_getdns_stub_destroy(struct getdns_context *context);
+
+/* whether req can be resolved with the native stub.  Requests for DNSSEC,
+   that look at the hosts file, or over TCP without keeping connections
+   open are left to unbound */
+int priv_getdns_stub_eligible(struct getdns_context *context,
+    getdns_dns_req *req, int usenamespaces);
+
+/* queue netreq to be sent to an upstream, and retried until answered */
+getdns_return_t priv_getdns_stub_submit(getdns_network_req *netreq);
+
+/* stop waiting for an answer to netreq, does nothing when not in flight */
+void priv_getdns_stub_cancel(getdns_network_req *netreq);
+
+/* send the queued queries, and clear the timeout scheduled to do so */
+void priv_getdns_stub_flush(struct priv_getdns_stub *stub);
+
+/* read the answers that arrived and complete their network requests */
+void priv_getdns_stub_read(struct priv_getdns_stub *stub);
+
+/* the round trip times and counts of the upstreams of the native stub, for
+   getdns_context_get_api_information.  NULL when it is not set up */
+struct getdns_list *priv_getdns_stub_upstream_stats(
+    struct getdns_context *context);
+
+#endif
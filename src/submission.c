@@ -0,0 +1,464 @@
+/**
+ *
+ * /brief getdns thread-safe submission of requests
+ *
+ * Requests submitted from other threads are queued lock-free for the
+ * thread that runs the context, and their completions are routed back to
+ * a completion queue of the submitting thread.
+ *
+ */
+
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+#include "types-internal.h"
+#include "util-internal.h"
+#include "context.h"
+#include "submission.h"
+
+struct getdns_completion_queue {
+    pthread_mutex_t lock;
+    /* ring of completions */
+    getdns_completion_t *completions;
+    size_t head;
+    size_t count;
+    size_t alloc;
+    /* readable while count > 0 */
+    int fd[2];
+};
+
+/*---------------------------------------- wakeup fds */
+int
+priv_getdns_wakeup_open(int fd[2])
+{
+#ifdef HAVE_SYS_EVENTFD_H
+	fd[0] = fd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	return fd[0] == -1 ? -1 : 0;
+#else
+	if (pipe(fd) == -1)
+		return -1;
+	(void) fcntl(fd[0], F_SETFL, O_NONBLOCK);
+	(void) fcntl(fd[1], F_SETFL, O_NONBLOCK);
+	(void) fcntl(fd[0], F_SETFD, FD_CLOEXEC);
+	(void) fcntl(fd[1], F_SETFD, FD_CLOEXEC);
+	return 0;
+#endif
+}
+
+void
+priv_getdns_wakeup_close(int fd[2])
+{
+	(void) close(fd[0]);
+	if (fd[1] != fd[0])
+		(void) close(fd[1]);
+}
+
+void
+priv_getdns_wakeup_signal(int fd[2])
+{
+	/* an eventfd takes 8 octets, a pipe anything */
+	uint64_t one = 1;
+	ssize_t r;
+
+	do r = write(fd[1], &one, sizeof(one));
+	while (r == -1 && errno == EINTR);
+}
+
+void
+priv_getdns_wakeup_clear(int fd[2])
+{
+	uint64_t buf[16];
+	ssize_t r;
+
+	do r = read(fd[0], buf, sizeof(buf));
+	while (r > 0 || (r == -1 && errno == EINTR));
+}
+
+/*---------------------------------------- completion queues */
+getdns_return_t
+getdns_completion_queue_create(getdns_completion_queue **queue)
+{
+	struct getdns_completion_queue *q;
+
+	if (!queue)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	q = malloc(sizeof(struct getdns_completion_queue));
+	if (!q)
+		return GETDNS_RETURN_MEMORY_ERROR;
+
+	(void) memset(q, 0, sizeof(struct getdns_completion_queue));
+	if (priv_getdns_wakeup_open(q->fd) == -1) {
+		free(q);
+		return GETDNS_RETURN_GENERIC_ERROR;
+	}
+	if (pthread_mutex_init(&q->lock, NULL) != 0) {
+		priv_getdns_wakeup_close(q->fd);
+		free(q);
+		return GETDNS_RETURN_GENERIC_ERROR;
+	}
+	*queue = q;
+	return GETDNS_RETURN_GOOD;
+}
+
+void
+getdns_completion_queue_destroy(getdns_completion_queue *queue)
+{
+	if (!queue)
+		return;
+
+	/* responses not polled are destroyed with the memory functions
+	 * each one carries, so they may outlive the context that made them
+	 */
+	for (; queue->count; queue->count--) {
+		getdns_dict_destroy(queue->completions[queue->head].response);
+		queue->head = (queue->head + 1) % queue->alloc;
+	}
+	(void) pthread_mutex_destroy(&queue->lock);
+	priv_getdns_wakeup_close(queue->fd);
+	free(queue->completions);
+	free(queue);
+}
+
+int
+getdns_completion_queue_fd(getdns_completion_queue *queue)
+{
+	return queue ? queue->fd[0] : -1;
+}
+
+getdns_return_t
+priv_getdns_completion_queue_push(struct getdns_completion_queue *q,
+    getdns_completion_t *completion)
+{
+	getdns_completion_t *completions;
+	size_t alloc, i;
+
+	(void) pthread_mutex_lock(&q->lock);
+	if (q->count == q->alloc) {
+		/* grow the ring, unwrapping it into the new array */
+		alloc = q->alloc ? q->alloc * 2 : 16;
+		completions = malloc(alloc * sizeof(getdns_completion_t));
+		if (!completions) {
+			(void) pthread_mutex_unlock(&q->lock);
+			return GETDNS_RETURN_MEMORY_ERROR;
+		}
+		for (i = 0; i < q->count; i++)
+			completions[i] = q->completions[(q->head + i) % q->alloc];
+		free(q->completions);
+		q->completions = completions;
+		q->head = 0;
+		q->alloc = alloc;
+	}
+	q->completions[(q->head + q->count) % q->alloc] = *completion;
+	if (q->count++ == 0)
+		priv_getdns_wakeup_signal(q->fd);
+	(void) pthread_mutex_unlock(&q->lock);
+	return GETDNS_RETURN_GOOD;
+}
+
+getdns_return_t
+getdns_completion_queue_poll(getdns_completion_queue *queue,
+    getdns_completion_t *completions, size_t max, size_t *count)
+{
+	if (!queue || !count || (max && !completions))
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	*count = 0;
+	(void) pthread_mutex_lock(&queue->lock);
+	while (*count < max && queue->count > 0) {
+		completions[(*count)++] = queue->completions[queue->head];
+		queue->head = (queue->head + 1) % queue->alloc;
+		queue->count--;
+	}
+	if (queue->count == 0)
+		priv_getdns_wakeup_clear(queue->fd);
+	(void) pthread_mutex_unlock(&queue->lock);
+	return GETDNS_RETURN_GOOD;
+}
+
+/*---------------------------------------- submission queue */
+static void
+submissions_push(struct priv_getdns_submissions *q,
+    struct priv_getdns_submission *s)
+{
+	struct priv_getdns_submission *prev;
+
+	s->next = NULL;
+	prev = __atomic_exchange_n(&q->head, s, __ATOMIC_ACQ_REL);
+	/* until this store, the consumer sees the queue end at prev */
+	__atomic_store_n(&prev->next, s, __ATOMIC_RELEASE);
+}
+
+/* NULL when empty, or when a push is still in progress; the pushing
+ * thread signals the wakeup fd after it is done in that case
+ */
+static struct priv_getdns_submission *
+submissions_pop(struct priv_getdns_submissions *q)
+{
+	struct priv_getdns_submission *tail = q->tail;
+	struct priv_getdns_submission *next =
+	    __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+	if (tail == &q->stub) {
+		if (!next)
+			return NULL;
+		q->tail = tail = next;
+		next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	}
+	if (next) {
+		q->tail = next;
+		return tail;
+	}
+	if (tail != __atomic_load_n(&q->head, __ATOMIC_ACQUIRE))
+		return NULL;
+
+	/* tail is the last one, put the stub behind it to take it off */
+	submissions_push(q, &q->stub);
+	next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (next) {
+		q->tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+static void
+submission_destroy(struct getdns_context *context,
+    struct priv_getdns_submission *s)
+{
+	GETDNS_FREE(context->my_mf, s->name);
+	getdns_dict_destroy(s->extensions);
+	GETDNS_FREE(context->my_mf, s);
+}
+
+static void
+submission_complete(struct getdns_context *context,
+    struct priv_getdns_submission *s, getdns_callback_type_t callback_type,
+    struct getdns_dict *response, getdns_transaction_t transaction_id)
+{
+	getdns_completion_t completion;
+
+	completion.transaction_id = transaction_id;
+	completion.callback_type = callback_type;
+	completion.response = response;
+	completion.userarg = s->userarg;
+	if (priv_getdns_completion_queue_push(s->queue, &completion))
+		getdns_dict_destroy(response);
+	submission_destroy(context, s);
+}
+
+void
+priv_getdns_submission_callback(struct getdns_context *context,
+    getdns_callback_type_t callback_type, struct getdns_dict *response,
+    void *userarg, getdns_transaction_t transaction_id)
+{
+	submission_complete(context, (struct priv_getdns_submission *)userarg,
+	    callback_type, response, transaction_id);
+}
+
+void
+priv_getdns_submissions_drain(struct getdns_context *context)
+{
+	struct priv_getdns_submissions *q = context->submissions;
+	struct priv_getdns_submission *s;
+	getdns_transaction_t transaction_id;
+
+	if (!q)
+		return;
+
+	/* Clear before popping, so that a producer that sees signaled
+	 * reset does its push and signal after our clear.
+	 */
+	priv_getdns_wakeup_clear(q->fd);
+	(void) __atomic_exchange_n(&q->signaled, 0, __ATOMIC_ACQ_REL);
+
+	while ((s = submissions_pop(q))) {
+		transaction_id = 0;
+		if (getdns_general(context, s->name, s->request_type,
+		    s->extensions, s, &transaction_id,
+		    priv_getdns_submission_callback) != GETDNS_RETURN_GOOD)
+			submission_complete(context, s, GETDNS_CALLBACK_ERROR,
+			    NULL, transaction_id);
+	}
+}
+
+/* Unpublish the queue and wait until no producer can still push to it.
+ * A producer is counted before it reads context->submissions, so after
+ * the counter is seen at zero every later producer reads NULL.
+ */
+static struct priv_getdns_submissions *
+submissions_retire(struct getdns_context *context)
+{
+	struct priv_getdns_submissions *q = context->submissions;
+
+	if (!q)
+		return NULL;
+
+	__atomic_store_n(&context->submissions, NULL, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&context->submission_producers,
+	    __ATOMIC_SEQ_CST))
+		(void) sched_yield();
+	return q;
+}
+
+static void
+submissions_free(struct getdns_context *context,
+    struct priv_getdns_submissions *q)
+{
+	struct priv_getdns_submission *s;
+
+	while ((s = submissions_pop(q)))
+		submission_complete(context, s, GETDNS_CALLBACK_CANCEL, NULL, 0);
+
+	priv_getdns_wakeup_close(q->fd);
+	GETDNS_FREE(context->my_mf, q);
+}
+
+void
+priv_getdns_submissions_destroy(struct getdns_context *context)
+{
+	struct priv_getdns_submissions *q = submissions_retire(context);
+
+	if (q)
+		submissions_free(context, q);
+}
+
+/* let the extension (un)watch the submission fd */
+static void
+submissions_changed(struct getdns_context *context)
+{
+	if (context->extension)
+		context->extension->request_count_changed(context,
+		    getdns_context_get_num_pending_requests(context, NULL),
+		    context->extension_data);
+}
+
+getdns_return_t
+getdns_context_set_submission_queue(struct getdns_context *context,
+    int enabled)
+{
+	struct priv_getdns_submissions *q;
+
+	if (!context)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	if (!enabled) {
+		if (!(q = submissions_retire(context)))
+			return GETDNS_RETURN_GOOD;
+
+		/* unwatched before the fd is closed */
+		submissions_changed(context);
+		submissions_free(context, q);
+		return GETDNS_RETURN_GOOD;
+	}
+	if (context->submissions)
+		return GETDNS_RETURN_GOOD;
+
+	q = GETDNS_MALLOC(context->my_mf, struct priv_getdns_submissions);
+	if (!q)
+		return GETDNS_RETURN_MEMORY_ERROR;
+
+	if (priv_getdns_wakeup_open(q->fd) == -1) {
+		GETDNS_FREE(context->my_mf, q);
+		return GETDNS_RETURN_GENERIC_ERROR;
+	}
+	q->stub.next = NULL;
+	q->head = q->tail = &q->stub;
+	q->signaled = 0;
+	__atomic_store_n(&context->submissions, q, __ATOMIC_SEQ_CST);
+	submissions_changed(context);
+	return GETDNS_RETURN_GOOD;
+}
+
+int
+getdns_context_submission_fd(struct getdns_context *context)
+{
+	struct priv_getdns_submissions *q;
+
+	if (!context ||
+	    !(q = __atomic_load_n(&context->submissions, __ATOMIC_ACQUIRE)))
+		return -1;
+	return q->fd[0];
+}
+
+getdns_return_t
+getdns_submit_general(struct getdns_context *context,
+    getdns_completion_queue *queue, const char *name, uint16_t request_type,
+    struct getdns_dict *extensions, void *userarg)
+{
+	struct priv_getdns_submissions *q;
+	struct priv_getdns_submission *s;
+	getdns_return_t r = GETDNS_RETURN_GOOD;
+
+	if (!context || !queue || !name)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	/* the queue is not freed while we are counted (see
+	 * submissions_retire)
+	 */
+	(void) __atomic_add_fetch(&context->submission_producers, 1,
+	    __ATOMIC_SEQ_CST);
+	if (!(q = __atomic_load_n(&context->submissions, __ATOMIC_SEQ_CST)))
+		r = GETDNS_RETURN_BAD_CONTEXT;
+
+	else if (!(s = GETDNS_MALLOC(context->my_mf,
+	    struct priv_getdns_submission)))
+		r = GETDNS_RETURN_MEMORY_ERROR;
+	else {
+		s->queue = queue;
+		s->request_type = request_type;
+		s->extensions = NULL;
+		s->userarg = userarg;
+		if (!(s->name = getdns_strdup(&context->my_mf, name)) ||
+		    (extensions &&
+		    getdns_dict_copy(extensions, &s->extensions))) {
+			submission_destroy(context, s);
+			r = GETDNS_RETURN_MEMORY_ERROR;
+		} else {
+			submissions_push(q, s);
+			if (!__atomic_exchange_n(&q->signaled, 1,
+			    __ATOMIC_ACQ_REL))
+				priv_getdns_wakeup_signal(q->fd);
+		}
+	}
+	(void) __atomic_sub_fetch(&context->submission_producers, 1,
+	    __ATOMIC_SEQ_CST);
+	return r;
+}
+
+/* submission.c */
@@ -0,0 +1,91 @@
+/**
+ * \file
+ * \brief Thread-safe submission of requests to a context
+ */
+
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _GETDNS_SUBMISSION_H_
+#define _GETDNS_SUBMISSION_H_
+
+#include <getdns/getdns.h>
+#include <getdns/getdns_extra.h>
+
+/* a request queued by getdns_submit_general */
+struct priv_getdns_submission {
+    struct priv_getdns_submission *next;
+    struct getdns_completion_queue *queue;
+    char *name;
+    uint16_t request_type;
+    struct getdns_dict *extensions;
+    void *userarg;
+};
+
+/*
+ * Lock-free multi-producer, single-consumer queue of submissions, with
+ * a stub node so that pushing never has to touch the consumer end.
+ * Producers signal the wakeup fd, which the loop thread watches.
+ */
+struct priv_getdns_submissions {
+    /* producers append here */
+    struct priv_getdns_submission *head;
+    /* the loop thread takes from here */
+    struct priv_getdns_submission *tail;
+    struct priv_getdns_submission stub;
+    /* set when the wakeup fd is signaled, and not yet cleared */
+    int signaled;
+    /* eventfd (both the same), or the read and write end of a pipe */
+    int fd[2];
+};
+
+/* Wakeup fds: an eventfd (both fds the same), or the read and write end
+   of a pipe.  Nonblocking, and readable after a signal until cleared */
+int priv_getdns_wakeup_open(int fd[2]);
+void priv_getdns_wakeup_close(int fd[2]);
+void priv_getdns_wakeup_signal(int fd[2]);
+void priv_getdns_wakeup_clear(int fd[2]);
+
+/* hand a completion to the thread polling queue, from any thread */
+getdns_return_t priv_getdns_completion_queue_push(
+    struct getdns_completion_queue *queue, getdns_completion_t *completion);
+
+/* start the requests submitted since the last call, from the loop thread */
+void priv_getdns_submissions_drain(struct getdns_context *context);
+
+/* take the queue off the context, wait for the producers still pushing
+   to it, complete all submissions not yet started with
+   GETDNS_CALLBACK_CANCEL and free the queue */
+void priv_getdns_submissions_destroy(struct getdns_context *context);
+
+/* the callback of the requests started for submissions, routing their
+   completion back to the queue of the submitting thread */
+void priv_getdns_submission_callback(struct getdns_context *context,
+    getdns_callback_type_t callback_type, struct getdns_dict *response,
+    void *userarg, getdns_transaction_t transaction_id);
+
+#endif
@@ -52,7 +52,7 @@ getdns_return_t submit_request_sync(getdns_dns_req* req) {
     getdns_return_t gr = GETDNS_RETURN_GOOD;
     getdns_network_req *netreq = req->first_req;
     while (netreq) {
-        int r = ub_resolve(req->context->unbound_ctx,
+        int r = ub_resolve(req->unbound_ctx,
             req->name,
             netreq->request_type,
             netreq->request_class,
@@ -93,16 +93,21 @@ getdns_general_sync(struct getdns_context *context,
 	if (response_status != GETDNS_RETURN_GOOD)
 		return response_status;
 
-       	/* general, so without dns lookup (no namespaces) */;
-	response_status = getdns_context_prepare_for_resolution(context, 0);
-	if (response_status != GETDNS_RETURN_GOOD)
-		return response_status;
-
 	/* for each netreq we call ub_ctx_resolve */
 	    /* request state */
 	req = dns_req_new(context, name, request_type, extensions);
 	if (!req)
 		return GETDNS_RETURN_MEMORY_ERROR;
+	req->sync = 1;
+
+       	/* general, so without dns lookup (no namespaces).  The changed
+	 * system files are left to the thread running the event loop.
+	 */
+	response_status = getdns_context_prepare_sync(req, 0);
+	if (response_status != GETDNS_RETURN_GOOD) {
+		dns_req_free(req);
+		return response_status;
+	}
 
 	response_status = submit_request_sync(req);
 	if (response_status == GETDNS_RETURN_GOOD) {
@@ -113,6 +118,8 @@ getdns_general_sync(struct getdns_context *context,
 			*response = create_getdns_response(req);
 	}
 
+	/* the unbound context it resolved on may be deleted now */
+	getdns_context_release_sync(req);
 	dns_req_free(req);
 	return response_status;
 }
@@ -0,0 +1,93 @@
+/**
+ * \file
+ * benchmark of getdns_context_clone, run with "make bench".  The time to
+ * create BENCH_CONTEXTS contexts with the settings of the OS is compared
+ * with the time to clone them from one such context.  Neither includes
+ * the trust anchor file that unbound reads on the first resolution.
+ */
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <getdns/getdns.h>
+#include <getdns/getdns_extra.h>
+
+#define BENCH_CONTEXTS 200
+
+/*---------------------------------------- bench_create */
+/**
+ * create and destroy BENCH_CONTEXTS contexts, cloned from src when set
+ * Returns the microseconds per context, or -1 on error.
+ */
+static double
+bench_create(struct getdns_context *src)
+{
+	struct getdns_context *context;
+	struct timeval start, end;
+	getdns_return_t r;
+	int i;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < BENCH_CONTEXTS; i++) {
+		r = src ? getdns_context_clone(src, &context)
+		    : getdns_context_create(&context, 1);
+		if (r)
+			return -1;
+		getdns_context_destroy(context);
+	}
+	gettimeofday(&end, NULL);
+
+	return ((end.tv_sec - start.tv_sec) * 1000000.0 +
+	    (end.tv_usec - start.tv_usec)) / BENCH_CONTEXTS;
+}				/* bench_create */
+
+int
+main(void)
+{
+	struct getdns_context *src;
+	double created, cloned;
+
+	if (getdns_context_create(&src, 1)) {
+		fprintf(stderr, "could not create the context\n");
+		return EXIT_FAILURE;
+	}
+	created = bench_create(NULL);
+	cloned = bench_create(src);
+	getdns_context_destroy(src);
+	if (created < 0 || cloned < 0) {
+		fprintf(stderr, "could not create the contexts\n");
+		return EXIT_FAILURE;
+	}
+	printf("           us/context\n");
+	printf("create     %10.1f\n", created);
+	printf("clone      %10.1f\n", cloned);
+	printf("saved      %10.1f\n", created - cloned);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,358 @@
+/**
+ * \file
+ * benchmark of EDNS size negotiation in the native stub, run with "make
+ * bench".  An upstream in the benchmark itself answers with the sizes of
+ * signed answers (a few hundred to some two thousand octets), truncated to
+ * the payload size offered and in full over TCP.  Answers that would be
+ * fragmented on a path with an MTU of 1500 are lost.  The same queries
+ * are resolved with the default payload size of 512, and with the size
+ * negotiated per upstream, counting the truncated answers and fallbacks to
+ * TCP in the "upstream_stats".
+ */
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <getdns/getdns.h>
+#include <getdns/getdns_extra.h>
+
+#define BENCH_QUERIES 4000
+/* queries outstanding at a time */
+#define BENCH_WINDOW 100
+/* the largest UDP answer that is not fragmented with an MTU of 1500 */
+#define BENCH_PATH_MAX (1500 - 20 - 8)
+
+/* sizes of signed answers: A, MX, DNSKEY, and DNSKEY during a rollover */
+static const size_t answer_sizes[] = { 700, 1100, 1400, 1900 };
+#define ANSWER_SIZES (sizeof(answer_sizes) / sizeof(answer_sizes[0]))
+
+static int upstream_fd = -1;
+static int upstream_tcp_fd = -1;
+static uint16_t upstream_port;
+static long bench_answered;
+static long bench_completed;
+
+/*---------------------------------------- answer */
+/**
+ * Turn the query in buf, of len octets, into an answer with one TXT
+ * record that fills it up to the size for its name, "q<n>.bench.", in
+ * buf of 2048 octets.  Returns the size of the answer, or 0 when the
+ * query is malformed.  *offered is the EDNS payload size of the query,
+ * and *question the size of the query without its OPT record.
+ */
+static size_t
+answer(uint8_t *buf, size_t len, size_t *offered, size_t *question)
+{
+	size_t pos, size, rdlen, chunk;
+	unsigned long n = 0;
+
+	if (len < 12 || buf[4] != 0 || buf[5] != 1)
+		return 0;
+	for (pos = 12; pos < len && buf[pos]; pos += buf[pos] + 1)
+		if (buf[pos] & 0xc0)
+			return 0;
+	if (pos + 5 > len || buf[12] < 2)
+		return 0;
+	(void) sscanf((char *)buf + 14, "%lu", &n);
+	size = answer_sizes[n % ANSWER_SIZES];
+	*question = pos += 5;
+	/* the payload size is the class of the OPT record */
+	*offered = buf[11] == 1 && pos + 11 <= len ? buf[pos + 3] << 8 |
+	    buf[pos + 4] : 512;
+
+	buf[2] = 0x84 | (buf[2] & 0x01); /* QR, AA and RD */
+	buf[3] = 0x80;                   /* RA, NOERROR */
+	buf[6] = buf[8] = buf[9] = buf[10] = buf[11] = 0;
+	buf[7] = 1;
+	(void) memcpy(buf + pos, "\xc0\x0c\x00\x10\x00\x01\x00\x00\x0e\x10", 10);
+	rdlen = size - pos - 12;
+	buf[pos + 10] = rdlen >> 8;
+	buf[pos + 11] = rdlen & 0xff;
+	for (pos += 12; rdlen; rdlen -= chunk + 1, pos += chunk + 1) {
+		chunk = rdlen - 1 < 255 ? rdlen - 1 : 255;
+		buf[pos] = chunk;
+		(void) memset(buf + pos + 1, 'x', chunk);
+	}
+	return size;
+}				/* answer */
+
+/*---------------------------------------- upstream_run */
+static void *
+upstream_run(void *arg)
+{
+	uint8_t buf[2048];
+	struct sockaddr_storage from;
+	socklen_t from_len;
+	ssize_t len;
+	size_t size, offered, question;
+
+	for (;;) {
+		from_len = sizeof(from);
+		len = recvfrom(upstream_fd, buf, 512, 0,
+		    (struct sockaddr *)&from, &from_len);
+		if (len <= 0 || !(size = answer(buf, len, &offered, &question)))
+			continue;
+		if (size > offered) {
+			/* just the question, with TC */
+			size = question;
+			buf[2] |= 0x02;
+			buf[7] = 0;
+		} else if (size > BENCH_PATH_MAX)
+			continue; /* a fragment got lost */
+		(void) sendto(upstream_fd, buf, size, 0,
+		    (struct sockaddr *)&from, from_len);
+	}
+	return NULL;
+}				/* upstream_run */
+
+/*---------------------------------------- upstream_tcp_conn */
+static void *
+upstream_tcp_conn(void *arg)
+{
+	int fd = (int)(intptr_t)arg;
+	uint8_t buf[2 + 2048];
+	size_t len, size, offered, question, have = 0;
+	ssize_t n;
+
+	for (;;) {
+		if ((n = read(fd, buf + have, sizeof(buf) - have)) <= 0)
+			break;
+		have += n;
+		if (have < 2 || have < 2 + (len = buf[0] << 8 | buf[1]))
+			continue;
+		if (!(size = answer(buf + 2, len, &offered, &question)))
+			break;
+		buf[0] = size >> 8;
+		buf[1] = size & 0xff;
+		if (write(fd, buf, 2 + size) != (ssize_t)(2 + size))
+			break;
+		have = 0;
+	}
+	(void) close(fd);
+	return NULL;
+}				/* upstream_tcp_conn */
+
+/*---------------------------------------- upstream_tcp_run */
+static void *
+upstream_tcp_run(void *arg)
+{
+	pthread_t thread;
+	int fd;
+
+	while ((fd = accept(upstream_tcp_fd, NULL, NULL)) != -1) {
+		if (pthread_create(&thread, NULL, upstream_tcp_conn,
+		    (void *)(intptr_t)fd) != 0)
+			(void) close(fd);
+		else
+			(void) pthread_detach(thread);
+	}
+	return NULL;
+}				/* upstream_tcp_run */
+
+/*---------------------------------------- upstream_start */
+static int
+upstream_start(void)
+{
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	pthread_t thread;
+
+	(void) memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((upstream_fd = socket(AF_INET, SOCK_DGRAM, 0)) == -1 ||
+	    bind(upstream_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+	    getsockname(upstream_fd, (struct sockaddr *)&addr, &addr_len) == -1)
+		return -1;
+	upstream_port = ntohs(addr.sin_port);
+	/* on the same port for the fallbacks */
+	if ((upstream_tcp_fd = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
+	    bind(upstream_tcp_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+	    listen(upstream_tcp_fd, 64) == -1)
+		return -1;
+
+	if (pthread_create(&thread, NULL, upstream_run, NULL) != 0)
+		return -1;
+	(void) pthread_detach(thread);
+	if (pthread_create(&thread, NULL, upstream_tcp_run, NULL) != 0)
+		return -1;
+	(void) pthread_detach(thread);
+	return 0;
+}				/* upstream_start */
+
+/*---------------------------------------- bench_callback */
+static void
+bench_callback(struct getdns_context *context,
+    getdns_callback_type_t callback_type,
+    struct getdns_dict *response, void *userarg,
+    getdns_transaction_t transaction_id)
+{
+	if (callback_type == GETDNS_CALLBACK_COMPLETE)
+		bench_answered++;
+	bench_completed++;
+	getdns_dict_destroy(response);
+}				/* bench_callback */
+
+/*---------------------------------------- bench_context */
+static struct getdns_context *
+bench_context(uint16_t negotiation_max)
+{
+	uint8_t localhost[4] = { 127, 0, 0, 1 };
+	struct getdns_bindata address_data = { 4, localhost };
+	struct getdns_context *context = NULL;
+	struct getdns_list *upstreams = getdns_list_create();
+	struct getdns_dict *upstream = getdns_dict_create();
+
+	if (getdns_context_create(&context, 1) ||
+	    getdns_context_set_resolution_type(context, GETDNS_RESOLUTION_STUB) ||
+	    getdns_dict_util_set_string(upstream, "address_type", "IPv4") ||
+	    getdns_dict_set_bindata(upstream, "address_data", &address_data) ||
+	    getdns_dict_set_int(upstream, "port", upstream_port) ||
+	    getdns_list_set_dict(upstreams, 0, upstream) ||
+	    getdns_context_set_upstream_recursive_servers(context, upstreams) ||
+	    getdns_context_set_dns_transport(context,
+	    GETDNS_TRANSPORT_UDP_FIRST_AND_FALL_BACK_TO_TCP) ||
+	    getdns_context_set_timeout(context, 5000) ||
+	    getdns_context_set_edns_size_negotiation(context, negotiation_max) ||
+	    getdns_context_set_native_stub(context, 1)) {
+		getdns_context_destroy(context);
+		context = NULL;
+	}
+	getdns_dict_destroy(upstream);
+	getdns_list_destroy(upstreams);
+	return context;
+}				/* bench_context */
+
+/*---------------------------------------- upstream_stat */
+static uint32_t
+upstream_stat(struct getdns_context *context, const char *name)
+{
+	struct getdns_dict *info = getdns_context_get_api_information(context);
+	struct getdns_list *stats;
+	struct getdns_dict *stat;
+	uint32_t value = 0;
+
+	if (!getdns_dict_get_list(info, "upstream_stats", &stats) &&
+	    !getdns_list_get_dict(stats, 0, &stat))
+		(void) getdns_dict_get_int(stat, name, &value);
+	getdns_dict_destroy(info);
+	return value;
+}				/* upstream_stat */
+
+/*---------------------------------------- bench_edns */
+/**
+ * Resolve BENCH_QUERIES names with negotiation up to negotiation_max (0
+ * for none), and have the truncated answers, fallbacks to TCP, and the
+ * payload size at the end, in stats.  Returns the number answered, or -1
+ * when the native stub is not available.
+ */
+static long
+bench_edns(uint16_t negotiation_max, uint32_t stats[3], double *secs)
+{
+	struct getdns_context *context = bench_context(negotiation_max);
+	struct timeval start, end, tv;
+	long submitted = 0;
+	fd_set read_fds;
+	char name[64];
+	int fd;
+
+	if (!context)
+		return -1;
+	bench_answered = bench_completed = 0;
+	gettimeofday(&start, NULL);
+	while (bench_completed < BENCH_QUERIES) {
+		while (submitted < BENCH_QUERIES &&
+		    submitted - bench_completed < BENCH_WINDOW) {
+			(void) snprintf(name, sizeof(name),
+			    "q%ld.bench.example.", submitted);
+			if (getdns_general(context, name, GETDNS_RRTYPE_TXT,
+			    NULL, NULL, NULL, bench_callback)) {
+				getdns_context_destroy(context);
+				return -1;
+			}
+			submitted++;
+		}
+		(void) getdns_context_get_num_pending_requests(context, &tv);
+		fd = getdns_context_fd(context);
+		FD_ZERO(&read_fds);
+		FD_SET(fd, &read_fds);
+		(void) select(fd + 1, &read_fds, NULL, NULL, &tv);
+		if (getdns_context_process_async(context))
+			break;
+	}
+	gettimeofday(&end, NULL);
+	stats[0] = upstream_stat(context, "truncated");
+	stats[1] = upstream_stat(context, "tcp_fallbacks");
+	stats[2] = upstream_stat(context, "edns_size");
+	getdns_context_destroy(context);
+
+	*secs = (end.tv_sec - start.tv_sec) +
+	    (end.tv_usec - start.tv_usec) / 1000000.0;
+	return bench_answered;
+}				/* bench_edns */
+
+int
+main(void)
+{
+	static const char *names[] = { "fixed 512", "negotiated" };
+	static const uint16_t maxima[] = { 0, 4096 };
+	uint32_t stats[3];
+	double secs;
+	long answered;
+	int i;
+	int result = EXIT_SUCCESS;
+
+	if (upstream_start() == -1) {
+		perror("could not start the upstream");
+		return EXIT_FAILURE;
+	}
+	printf("payload     answered   TC rate  TCP rate  edns_size      secs\n");
+	for (i = 0; i < 2; i++) {
+		if ((answered = bench_edns(maxima[i], stats, &secs)) < 0) {
+			/* the native stub needs epoll and sendmmsg */
+			fprintf(stderr, "could not resolve with the native stub\n");
+			return EXIT_FAILURE;
+		}
+		printf("%-10s  %8ld  %7.1f%%  %7.1f%%  %9u  %8.3f\n", names[i],
+		    answered, 100.0 * stats[0] / BENCH_QUERIES,
+		    100.0 * stats[1] / BENCH_QUERIES, stats[2], secs);
+		if (answered != BENCH_QUERIES)
+			result = EXIT_FAILURE;
+	}
+	return result;
+}
@@ -0,0 +1,128 @@
+/**
+ * \file
+ * benchmark of the event loop extensions.  Linked once for every event
+ * loop implementation (see check_getdns_eventloop.h), and run with
+ * "make bench".  Queries are sent to a local port without a listener,
+ * so the numbers reflect the cost of the loop and not of the network.
+ */
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <getdns/getdns.h>
+#include <getdns/getdns_extra.h>
+#include "check_getdns_eventloop.h"
+
+#define BENCH_ROUNDS 20
+#define BENCH_QUERIES 500
+
+static size_t bench_answered = 0;
+
+/*---------------------------------------- bench_callback */
+static void
+bench_callback(struct getdns_context *context,
+    getdns_callback_type_t callback_type,
+    struct getdns_dict *response, void *userarg,
+    getdns_transaction_t transaction_id)
+{
+	bench_answered++;
+	getdns_dict_destroy(response);
+}				/* bench_callback */
+
+/*---------------------------------------- bench_context */
+/**
+ * create a stub resolving context that sends its queries to 127.0.0.1
+ */
+static struct getdns_context *
+bench_context(void)
+{
+	uint8_t localhost[4] = { 127, 0, 0, 1 };
+	struct getdns_bindata address_data = { 4, localhost };
+	struct getdns_context *context = NULL;
+	struct getdns_list *upstreams = getdns_list_create();
+	struct getdns_dict *upstream = getdns_dict_create();
+
+	if (getdns_context_create(&context, 1) ||
+	    getdns_context_set_resolution_type(context, GETDNS_RESOLUTION_STUB) ||
+	    getdns_dict_util_set_string(upstream, "address_type", "IPv4") ||
+	    getdns_dict_set_bindata(upstream, "address_data", &address_data) ||
+	    getdns_list_set_dict(upstreams, 0, upstream) ||
+	    getdns_context_set_upstream_recursive_servers(context, upstreams) ||
+	    getdns_context_set_timeout(context, 1000)) {
+		getdns_context_destroy(context);
+		context = NULL;
+	}
+	getdns_dict_destroy(upstream);
+	getdns_list_destroy(upstreams);
+	return context;
+}				/* bench_context */
+
+int
+main(void)
+{
+	struct getdns_context *context;
+	getdns_transaction_t transaction_id;
+	struct timeval start, end;
+	struct rusage usage;
+	void *eventloop;
+	double secs, cpu;
+	int i, j;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		if (!(context = bench_context())) {
+			fprintf(stderr, "could not create context\n");
+			return EXIT_FAILURE;
+		}
+		eventloop = create_eventloop_impl(context);
+		for (j = 0; j < BENCH_QUERIES; j++) {
+			if (getdns_address(context, "www.example.com", NULL,
+			    NULL, &transaction_id, bench_callback)) {
+				fprintf(stderr, "getdns_address failed\n");
+				return EXIT_FAILURE;
+			}
+		}
+		run_event_loop_impl(context, eventloop);
+		getdns_context_destroy(context);
+	}
+	gettimeofday(&end, NULL);
+	getrusage(RUSAGE_SELF, &usage);
+
+	secs = (end.tv_sec - start.tv_sec) +
+	    (end.tv_usec - start.tv_usec) / 1000000.0;
+	cpu = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+	    (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+	printf("%zu/%d callbacks in %.3f s, %.3f s cpu, %.1f us cpu/query\n",
+	    bench_answered, BENCH_ROUNDS * BENCH_QUERIES, secs, cpu,
+	    cpu * 1000000.0 / (BENCH_ROUNDS * BENCH_QUERIES));
+	return bench_answered == BENCH_ROUNDS * BENCH_QUERIES
+	    ? EXIT_SUCCESS : EXIT_FAILURE;
+}
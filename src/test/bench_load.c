@@ -0,0 +1,282 @@
+/**
+ * \file
+ * end to end load generator, linked once for every event loop
+ * implementation (see check_getdns_eventloop.h) and run with "make bench".
+ * Queries for names that do not repeat go to the mock upstream of
+ * check_getdns_upstream.h, with a fixed number in flight, or at a fixed
+ * rate.  At a fixed rate the latency counts from when a query was due, so a
+ * loop that falls behind shows in the percentiles.
+ *
+ * usage: bench_load [-z zone file] [-l latency ms] [-p loss permille]
+ *                   [-t truncate permille] [-n queries]
+ *                   [-w in flight | -q queries per second] [-s]
+ *
+ * -s resolves with the native stub instead of unbound.  Names are
+ * q<n>.bench., for which the zone file needs a wildcard.  Allocations
+ * are the calls to malloc and realloc through the memory functions of
+ * the context, so they leave out those of unbound and ldns.
+ */
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <getdns/getdns.h>
+#include <getdns/getdns_extra.h>
+#include "check_getdns_eventloop.h"
+#include "check_getdns_upstream.h"
+
+#define BENCH_QUERIES 20000
+#define BENCH_WINDOW 100
+/* waiting in the loop at most, in milliseconds */
+#define BENCH_WAIT 100
+
+static uint16_t upstream_port;
+static size_t bench_allocs;
+static uint64_t *bench_start;
+static uint64_t *bench_latency;
+static long bench_answered;
+static long bench_completed;
+
+/*---------------------------------------- now_usec */
+static uint64_t
+now_usec(void)
+{
+	struct timeval tv;
+
+	(void) gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}				/* now_usec */
+
+/*---------------------------------------- bench_malloc */
+static void *
+bench_malloc(size_t size)
+{
+	bench_allocs++;
+	return malloc(size);
+}				/* bench_malloc */
+
+/*---------------------------------------- bench_realloc */
+static void *
+bench_realloc(void *ptr, size_t size)
+{
+	bench_allocs++;
+	return realloc(ptr, size);
+}				/* bench_realloc */
+
+/*---------------------------------------- bench_callback */
+/**
+ * userarg is the number of the query
+ */
+static void
+bench_callback(struct getdns_context *context,
+    getdns_callback_type_t callback_type,
+    struct getdns_dict *response, void *userarg,
+    getdns_transaction_t transaction_id)
+{
+	intptr_t i = (intptr_t)userarg;
+
+	if (callback_type == GETDNS_CALLBACK_COMPLETE)
+		bench_latency[bench_answered++] = now_usec() - bench_start[i];
+	bench_completed++;
+	getdns_dict_destroy(response);
+}				/* bench_callback */
+
+/*---------------------------------------- bench_context */
+static struct getdns_context *
+bench_context(int native)
+{
+	uint8_t localhost[4] = { 127, 0, 0, 1 };
+	struct getdns_bindata address_data = { 4, localhost };
+	struct getdns_context *context = NULL;
+	struct getdns_list *upstreams = getdns_list_create();
+	struct getdns_dict *upstream = getdns_dict_create();
+
+	if (getdns_context_create_with_memory_functions(&context, 1,
+	    bench_malloc, bench_realloc, free) ||
+	    getdns_context_set_resolution_type(context, GETDNS_RESOLUTION_STUB) ||
+	    getdns_dict_util_set_string(upstream, "address_type", "IPv4") ||
+	    getdns_dict_set_bindata(upstream, "address_data", &address_data) ||
+	    getdns_dict_set_int(upstream, "port", upstream_port) ||
+	    getdns_list_set_dict(upstreams, 0, upstream) ||
+	    getdns_context_set_upstream_recursive_servers(context, upstreams) ||
+	    getdns_context_set_dns_transport(context,
+	    GETDNS_TRANSPORT_UDP_FIRST_AND_FALL_BACK_TO_TCP) ||
+	    getdns_context_set_timeout(context, 2000) ||
+	    (native && getdns_context_set_native_stub(context, 1))) {
+		getdns_context_destroy(context);
+		context = NULL;
+	}
+	getdns_dict_destroy(upstream);
+	getdns_list_destroy(upstreams);
+	return context;
+}				/* bench_context */
+
+/*---------------------------------------- compare_latency */
+static int
+compare_latency(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}				/* compare_latency */
+
+/*---------------------------------------- percentile */
+/**
+ * of the sorted latencies of the answered queries, in milliseconds
+ */
+static double
+percentile(unsigned int permille)
+{
+	if (!bench_answered)
+		return 0;
+	return bench_latency[(bench_answered - 1) * permille / 1000] / 1000.0;
+}				/* percentile */
+
+/*---------------------------------------- bench_load */
+/**
+ * Resolve num_queries names, window at a time, or at qps per second when
+ * it is not 0.  Returns 0, or -1 when the queries could not be made.
+ */
+static int
+bench_load(struct getdns_context *context, void *eventloop,
+    long num_queries, long window, long qps)
+{
+	uint64_t start = now_usec(), due, now;
+	long submitted = 0;
+	char name[64];
+	int timeout;
+
+	while (bench_completed < num_queries) {
+		now = now_usec();
+		while (submitted < num_queries && (qps
+		    ? (due = start + submitted * 1000000 / qps) <= now
+		    : submitted - bench_completed < window)) {
+
+			bench_start[submitted] = qps ? due : now;
+			(void) snprintf(name, sizeof(name), "q%ld.bench.",
+			    submitted);
+			if (getdns_general(context, name, GETDNS_RRTYPE_A, NULL,
+			    (void *)(intptr_t)submitted, NULL, bench_callback))
+				return -1;
+			submitted++;
+		}
+		timeout = BENCH_WAIT;
+		if (qps && submitted < num_queries) {
+			due = start + submitted * 1000000 / qps;
+			timeout = due <= now ? 0 : (int)((due - now) / 1000);
+			if (timeout > BENCH_WAIT)
+				timeout = BENCH_WAIT;
+		}
+		/* the loops return at once without anything to wait for */
+		if (submitted == bench_completed)
+			(void) usleep(timeout * 1000);
+		else
+			run_event_loop_once_impl(context, eventloop, timeout);
+	}
+	return 0;
+}				/* bench_load */
+
+int
+main(int argc, char **argv)
+{
+	struct mock_upstream_config upstream = { 0 };
+	struct getdns_context *context;
+	void *eventloop;
+	long num_queries = BENCH_QUERIES, window = BENCH_WINDOW, qps = 0;
+	uint64_t start, end;
+	size_t allocs;
+	double secs;
+	int native = 0;
+	int c;
+
+	while ((c = getopt(argc, argv, "z:l:p:t:n:w:q:s")) != -1) {
+		switch (c) {
+		case 'z': upstream.zone_file = optarg; break;
+		case 'l': upstream.latency_ms = atoi(optarg); break;
+		case 'p': upstream.loss_permille = atoi(optarg); break;
+		case 't': upstream.truncate_permille = atoi(optarg); break;
+		case 'n': num_queries = atol(optarg); break;
+		case 'w': window = atol(optarg); break;
+		case 'q': qps = atol(optarg); break;
+		case 's': native = 1; break;
+		default:
+			fprintf(stderr, "usage: %s [-z zone file] [-l latency ms] "
+			    "[-p loss permille] [-t truncate permille] "
+			    "[-n queries] [-w in flight | -q queries per second] "
+			    "[-s]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (num_queries <= 0 || window <= 0 || qps < 0) {
+		fprintf(stderr, "%s: queries, in flight and queries per second "
+		    "must be positive\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (mock_upstream_start(&upstream, &upstream_port) == -1) {
+		perror("could not start the upstream");
+		return EXIT_FAILURE;
+	}
+	if (!(bench_start = calloc(num_queries, sizeof(uint64_t))) ||
+	    !(bench_latency = calloc(num_queries, sizeof(uint64_t))) ||
+	    !(context = bench_context(native))) {
+		fprintf(stderr, "could not create context\n");
+		return EXIT_FAILURE;
+	}
+	eventloop = create_eventloop_impl(context);
+
+	allocs = bench_allocs;
+	start = now_usec();
+	if (bench_load(context, eventloop, num_queries, window, qps)) {
+		fprintf(stderr, "getdns_general failed\n");
+		return EXIT_FAILURE;
+	}
+	end = now_usec();
+	allocs = bench_allocs - allocs;
+	getdns_context_destroy(context);
+
+	qsort(bench_latency, bench_answered, sizeof(uint64_t),
+	    compare_latency);
+	secs = (end - start) / 1000000.0;
+	if (qps)
+		printf("%s, %ld queries per second", argv[0], qps);
+	else
+		printf("%s, %ld in flight", argv[0], window);
+	printf(", %s stub\n", native ? "native" : "unbound");
+	printf("answered    failed        q/s   p50 ms   p99 ms  p999 ms"
+	    "  allocs/q\n");
+	printf("%8ld  %8ld  %9.0f  %7.2f  %7.2f  %7.2f  %8.1f\n",
+	    bench_answered, bench_completed - bench_answered,
+	    bench_completed / secs, percentile(500), percentile(990),
+	    percentile(999), (double)allocs / num_queries);
+	return EXIT_SUCCESS;
+}
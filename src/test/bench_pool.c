@@ -0,0 +1,175 @@
+/**
+ * \file
+ * benchmark of the resolver pool, run with "make bench".  A stub upstream
+ * (see check_getdns_upstream.h) answers every A query with 127.0.0.1,
+ * and the same number of queries is resolved with 1 up to
+ * BENCH_MAX_WORKERS workers, to show how throughput scales with the
+ * number of cores.
+ */
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <getdns/getdns.h>
+#include <getdns/getdns_extra.h>
+#include "check_getdns_upstream.h"
+
+#define BENCH_MAX_WORKERS 16
+#define BENCH_QUERIES 20000
+/* queries outstanding at a time */
+#define BENCH_WINDOW 2000
+#define BENCH_UPSTREAM_THREADS 2
+
+static uint16_t upstream_port;
+
+/*---------------------------------------- bench_setup */
+/**
+ * have a worker context send its queries to the stub upstream
+ */
+static getdns_return_t
+bench_setup(struct getdns_context *context, void *userarg)
+{
+	uint8_t localhost[4] = { 127, 0, 0, 1 };
+	struct getdns_bindata address_data = { 4, localhost };
+	struct getdns_list *upstreams = getdns_list_create();
+	struct getdns_dict *upstream = getdns_dict_create();
+	getdns_return_t r;
+
+	r = getdns_dict_util_set_string(upstream, "address_type", "IPv4");
+	if (!r)
+		r = getdns_dict_set_bindata(upstream, "address_data",
+		    &address_data);
+	if (!r)
+		r = getdns_dict_set_int(upstream, "port", upstream_port);
+	if (!r)
+		r = getdns_list_set_dict(upstreams, 0, upstream);
+	if (!r)
+		r = getdns_context_set_resolution_type(context,
+		    GETDNS_RESOLUTION_STUB);
+	if (!r)
+		r = getdns_context_set_upstream_recursive_servers(context,
+		    upstreams);
+	if (!r)
+		r = getdns_context_set_timeout(context, 2000);
+
+	getdns_dict_destroy(upstream);
+	getdns_list_destroy(upstreams);
+	return r;
+}				/* bench_setup */
+
+/*---------------------------------------- bench_pool */
+/**
+ * resolve BENCH_QUERIES names with a pool of num_workers
+ * Returns the number of answered queries, or -1 on error.
+ */
+static long
+bench_pool(size_t num_workers, double *secs)
+{
+	getdns_completion_t completions[256];
+	getdns_completion_queue *queue;
+	struct timeval start, end;
+	struct pollfd pfd;
+	getdns_pool *pool;
+	long submitted = 0, completed = 0, answered = 0;
+	char name[64];
+	size_t count, i;
+
+	if (getdns_pool_create(&pool, num_workers, 1, bench_setup, NULL))
+		return -1;
+
+	queue = getdns_pool_get_completion_queue(pool);
+	pfd.fd = getdns_completion_queue_fd(queue);
+	pfd.events = POLLIN;
+	gettimeofday(&start, NULL);
+	while (completed < BENCH_QUERIES) {
+		while (submitted < BENCH_QUERIES &&
+		    submitted - completed < BENCH_WINDOW) {
+			/* names are unique, so no answer comes from cache */
+			(void) snprintf(name, sizeof(name),
+			    "q%ld.w%zu.bench.example.", submitted, num_workers);
+			if (getdns_pool_submit_general(pool, NULL, name,
+			    GETDNS_RRTYPE_A, NULL, NULL)) {
+				getdns_pool_destroy(pool);
+				return -1;
+			}
+			submitted++;
+		}
+		(void) poll(&pfd, 1, 1000);
+		(void) getdns_completion_queue_poll(queue, completions,
+		    sizeof(completions) / sizeof(completions[0]), &count);
+		for (i = 0; i < count; i++) {
+			if (completions[i].callback_type ==
+			    GETDNS_CALLBACK_COMPLETE)
+				answered++;
+			getdns_dict_destroy(completions[i].response);
+		}
+		completed += count;
+	}
+	gettimeofday(&end, NULL);
+	getdns_pool_destroy(pool);
+
+	*secs = (end.tv_sec - start.tv_sec) +
+	    (end.tv_usec - start.tv_usec) / 1000000.0;
+	return answered;
+}				/* bench_pool */
+
+int
+main(void)
+{
+	double secs, base_qps = 0, qps;
+	size_t num_workers;
+	long answered;
+	int result = EXIT_SUCCESS;
+	struct mock_upstream_config upstream = {
+		.threads = BENCH_UPSTREAM_THREADS };
+
+	if (mock_upstream_start(&upstream, &upstream_port) == -1) {
+		perror("could not start the stub upstream");
+		return EXIT_FAILURE;
+	}
+	printf("workers  answered       secs        q/s  speedup\n");
+	for (num_workers = 1; num_workers <= BENCH_MAX_WORKERS;
+	    num_workers *= 2) {
+		if ((answered = bench_pool(num_workers, &secs)) < 0) {
+			fprintf(stderr, "could not run the pool\n");
+			return EXIT_FAILURE;
+		}
+		qps = answered / secs;
+		if (num_workers == 1)
+			base_qps = qps;
+		printf("%7zu  %8ld  %9.3f  %9.0f  %7.2f\n", num_workers,
+		    answered, secs, qps, base_qps ? qps / base_qps : 0.0);
+		if (answered != BENCH_QUERIES)
+			result = EXIT_FAILURE;
+	}
+	return result;
+}
@@ -0,0 +1,195 @@
+/**
+ * \file
+ * throughput benchmark of the binary serialization of dicts, compared
+ * with the pretty printer.  Not part of the regression tests, build and
+ * run with "make bench"
+ */
+
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <getdns/getdns.h>
+#include <getdns/getdns_extra.h>
+
+#define BENCH_ITERATIONS 20000
+#define BENCH_ANSWERS 8
+#define BENCH_BUF_LEN 65536
+
+/*---------------------------------------- bench_response */
+/**
+ * build a dict shaped like a response for an A query with BENCH_ANSWERS
+ * addresses
+ */
+static struct getdns_dict *
+bench_response(void)
+{
+	static uint8_t name_wire[] = "\x03www\x07""example\x03""com";
+	struct getdns_bindata name = { sizeof(name_wire), name_wire };
+	uint8_t address[4] = { 192, 0, 2, 0 };
+	struct getdns_bindata ipv4 = { 4, address };
+	struct getdns_dict *response = getdns_dict_create();
+	struct getdns_dict *reply = getdns_dict_create();
+	struct getdns_dict *header = getdns_dict_create();
+	struct getdns_dict *question = getdns_dict_create();
+	struct getdns_list *replies_tree = getdns_list_create();
+	struct getdns_list *answer = getdns_list_create();
+	struct getdns_list *addresses = getdns_list_create();
+	struct getdns_dict *rr, *rdata, *addr;
+	size_t i;
+
+	getdns_dict_set_int(header, "id", 4711);
+	getdns_dict_set_int(header, "qr", 1);
+	getdns_dict_set_int(header, "rd", 1);
+	getdns_dict_set_int(header, "ra", 1);
+	getdns_dict_set_int(header, "ancount", BENCH_ANSWERS);
+	getdns_dict_set_dict(reply, "header", header);
+
+	getdns_dict_set_bindata(question, "qname", &name);
+	getdns_dict_set_int(question, "qtype", GETDNS_RRTYPE_A);
+	getdns_dict_set_int(question, "qclass", GETDNS_RRCLASS_IN);
+	getdns_dict_set_dict(reply, "question", question);
+
+	for (i = 0; i < BENCH_ANSWERS; i++) {
+		address[3] = i + 1;
+
+		rr = getdns_dict_create();
+		rdata = getdns_dict_create();
+		getdns_dict_set_bindata(rdata, "ipv4_address", &ipv4);
+		getdns_dict_set_bindata(rdata, "rdata_raw", &ipv4);
+		getdns_dict_set_dict(rr, "rdata", rdata);
+		getdns_dict_set_bindata(rr, "name", &name);
+		getdns_dict_set_int(rr, "type", GETDNS_RRTYPE_A);
+		getdns_dict_set_int(rr, "class", GETDNS_RRCLASS_IN);
+		getdns_dict_set_int(rr, "ttl", 3600);
+		getdns_list_set_dict(answer, i, rr);
+		getdns_dict_destroy(rdata);
+		getdns_dict_destroy(rr);
+
+		addr = getdns_dict_create();
+		getdns_dict_util_set_string(addr, "address_type", "IPv4");
+		getdns_dict_set_bindata(addr, "address_data", &ipv4);
+		getdns_list_set_dict(addresses, i, addr);
+		getdns_dict_destroy(addr);
+	}
+	getdns_dict_set_list(reply, "answer", answer);
+	getdns_dict_set_int(reply, "dnssec_status", GETDNS_DNSSEC_INSECURE);
+	getdns_dict_set_bindata(reply, "canonical_name", &name);
+	getdns_list_set_dict(replies_tree, 0, reply);
+
+	getdns_dict_set_list(response, "replies_tree", replies_tree);
+	getdns_dict_set_list(response, "just_address_answers", addresses);
+	getdns_dict_set_bindata(response, "canonical_name", &name);
+	getdns_dict_set_int(response, "answer_type", GETDNS_NAMETYPE_DNS);
+	getdns_dict_set_int(response, "status", GETDNS_RESPSTATUS_GOOD);
+
+	getdns_dict_destroy(header);
+	getdns_dict_destroy(question);
+	getdns_dict_destroy(reply);
+	getdns_list_destroy(replies_tree);
+	getdns_list_destroy(answer);
+	getdns_list_destroy(addresses);
+	return response;
+}				/* bench_response */
+
+/*---------------------------------------- bench_report */
+static void
+bench_report(const char *what, struct timeval *start, size_t bytes)
+{
+	struct timeval end;
+	double secs;
+
+	gettimeofday(&end, NULL);
+	secs = (end.tv_sec - start->tv_sec) +
+	    (end.tv_usec - start->tv_usec) / 1000000.0;
+	printf("%-36s %10.0f ops/s %8.1f MB/s (%zu bytes)\n", what,
+	    BENCH_ITERATIONS / secs,
+	    BENCH_ITERATIONS * (double)bytes / secs / 1000000.0, bytes);
+	gettimeofday(start, NULL);
+}				/* bench_report */
+
+int
+main(void)
+{
+	struct getdns_dict *response = bench_response();
+	struct getdns_dict *result;
+	struct timeval start;
+	uint8_t *buf = malloc(BENCH_BUF_LEN);
+	size_t buf_len = 0;
+	size_t pp_len = 0;
+	char *pp;
+	int i;
+
+	if (!response || !buf) {
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < BENCH_ITERATIONS; i++) {
+		pp = getdns_pretty_print_dict(response);
+		pp_len = strlen(pp);
+		free(pp);
+	}
+	bench_report("getdns_pretty_print_dict", &start, pp_len);
+
+	for (i = 0; i < BENCH_ITERATIONS; i++) {
+		buf_len = BENCH_BUF_LEN;
+		if (getdns_dict_serialize(response, buf, &buf_len)) {
+			fprintf(stderr, "getdns_dict_serialize failed\n");
+			return EXIT_FAILURE;
+		}
+	}
+	bench_report("getdns_dict_serialize", &start, buf_len);
+
+	for (i = 0; i < BENCH_ITERATIONS; i++) {
+		if (getdns_dict_deserialize(NULL, buf, buf_len, 0, &result)) {
+			fprintf(stderr, "getdns_dict_deserialize failed\n");
+			return EXIT_FAILURE;
+		}
+		getdns_dict_destroy(result);
+	}
+	bench_report("getdns_dict_deserialize", &start, buf_len);
+
+	for (i = 0; i < BENCH_ITERATIONS; i++) {
+		if (getdns_dict_deserialize(NULL, buf, buf_len, 1, &result)) {
+			fprintf(stderr, "getdns_dict_deserialize failed\n");
+			return EXIT_FAILURE;
+		}
+		getdns_dict_destroy(result);
+	}
+	bench_report("getdns_dict_deserialize (in place)", &start, buf_len);
+
+	free(buf);
+	getdns_dict_destroy(response);
+	return EXIT_SUCCESS;
+}
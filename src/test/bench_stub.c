@@ -0,0 +1,179 @@
+/**
+ * \file
+ * benchmark of the native stub, run with "make bench".  A stub upstream
+ * (see check_getdns_upstream.h) answers every A query with 127.0.0.1,
+ * and the same number of queries is resolved by one context in stub
+ * mode, with unbound and with the native stub, keeping BENCH_WINDOW in
+ * flight.
+ */
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <getdns/getdns.h>
+#include <getdns/getdns_extra.h>
+#include "check_getdns_upstream.h"
+
+#define BENCH_QUERIES 50000
+/* queries outstanding at a time */
+#define BENCH_WINDOW 1000
+/* threads answering queries in the stub upstream */
+#define BENCH_UPSTREAM_THREADS 2
+
+static uint16_t upstream_port;
+static long bench_answered;
+static long bench_completed;
+
+/*---------------------------------------- bench_callback */
+static void
+bench_callback(struct getdns_context *context,
+    getdns_callback_type_t callback_type,
+    struct getdns_dict *response, void *userarg,
+    getdns_transaction_t transaction_id)
+{
+	if (callback_type == GETDNS_CALLBACK_COMPLETE)
+		bench_answered++;
+	bench_completed++;
+	getdns_dict_destroy(response);
+}				/* bench_callback */
+
+/*---------------------------------------- bench_context */
+/**
+ * create a context that sends its queries to the stub upstream
+ */
+static struct getdns_context *
+bench_context(int native)
+{
+	uint8_t localhost[4] = { 127, 0, 0, 1 };
+	struct getdns_bindata address_data = { 4, localhost };
+	struct getdns_context *context = NULL;
+	struct getdns_list *upstreams = getdns_list_create();
+	struct getdns_dict *upstream = getdns_dict_create();
+
+	if (getdns_context_create(&context, 1) ||
+	    getdns_context_set_resolution_type(context, GETDNS_RESOLUTION_STUB) ||
+	    getdns_dict_util_set_string(upstream, "address_type", "IPv4") ||
+	    getdns_dict_set_bindata(upstream, "address_data", &address_data) ||
+	    getdns_dict_set_int(upstream, "port", upstream_port) ||
+	    getdns_list_set_dict(upstreams, 0, upstream) ||
+	    getdns_context_set_upstream_recursive_servers(context, upstreams) ||
+	    getdns_context_set_timeout(context, 2000) ||
+	    getdns_context_set_native_stub(context, native)) {
+		getdns_context_destroy(context);
+		context = NULL;
+	}
+	getdns_dict_destroy(upstream);
+	getdns_list_destroy(upstreams);
+	return context;
+}				/* bench_context */
+
+/*---------------------------------------- bench_stub */
+/**
+ * resolve BENCH_QUERIES names with a select loop on the fd of the context
+ * Returns the number of answered queries, or -1 on error.
+ */
+static long
+bench_stub(int native, double *secs)
+{
+	struct getdns_context *context = bench_context(native);
+	struct timeval start, end, tv;
+	long submitted = 0;
+	fd_set read_fds;
+	char name[64];
+	int fd;
+
+	if (!context)
+		return -1;
+	bench_answered = bench_completed = 0;
+	gettimeofday(&start, NULL);
+	while (bench_completed < BENCH_QUERIES) {
+		while (submitted < BENCH_QUERIES &&
+		    submitted - bench_completed < BENCH_WINDOW) {
+			/* names are unique, so no answer comes from cache */
+			(void) snprintf(name, sizeof(name),
+			    "q%ld.n%d.bench.example.", submitted, native);
+			if (getdns_general(context, name, GETDNS_RRTYPE_A,
+			    NULL, NULL, NULL, bench_callback)) {
+				getdns_context_destroy(context);
+				return -1;
+			}
+			submitted++;
+		}
+		(void) getdns_context_get_num_pending_requests(context, &tv);
+		fd = getdns_context_fd(context);
+		FD_ZERO(&read_fds);
+		FD_SET(fd, &read_fds);
+		(void) select(fd + 1, &read_fds, NULL, NULL, &tv);
+		if (getdns_context_process_async(context))
+			break;
+	}
+	gettimeofday(&end, NULL);
+	getdns_context_destroy(context);
+
+	*secs = (end.tv_sec - start.tv_sec) +
+	    (end.tv_usec - start.tv_usec) / 1000000.0;
+	return bench_answered;
+}				/* bench_stub */
+
+int
+main(void)
+{
+	static const char *names[] = { "unbound", "native" };
+	double secs, base_qps = 0, qps;
+	long answered;
+	int native;
+	int result = EXIT_SUCCESS;
+	struct mock_upstream_config upstream = {
+		.threads = BENCH_UPSTREAM_THREADS };
+
+	if (mock_upstream_start(&upstream, &upstream_port) == -1) {
+		perror("could not start the stub upstream");
+		return EXIT_FAILURE;
+	}
+	printf("stub     answered       secs        q/s  speedup\n");
+	for (native = 0; native <= 1; native++) {
+		if ((answered = bench_stub(native, &secs)) < 0) {
+			/* the native stub needs epoll and sendmmsg */
+			fprintf(stderr, "could not resolve with the %s stub\n",
+			    names[native]);
+			return native ? result : EXIT_FAILURE;
+		}
+		qps = answered / secs;
+		if (!native)
+			base_qps = qps;
+		printf("%-7s  %8ld  %9.3f  %9.0f  %7.2f\n", names[native],
+		    answered, secs, qps, base_qps ? qps / base_qps : 0.0);
+		if (answered != BENCH_QUERIES)
+			result = EXIT_FAILURE;
+	}
+	return result;
+}
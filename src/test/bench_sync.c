@@ -0,0 +1,203 @@
+/**
+ * \file
+ * benchmark of concurrent sync requests, run with "make bench".  A stub
+ * upstream (see check_getdns_upstream.h) answers every A query with
+ * 127.0.0.1, and the same number of queries is resolved with
+ * getdns_general_sync by 1 up to BENCH_MAX_THREADS threads sharing one
+ * context, to show how throughput scales with the number of threads.
+ */
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <getdns/getdns.h>
+#include <getdns/getdns_extra.h>
+#include "check_getdns_upstream.h"
+
+#define BENCH_MAX_THREADS 16
+#define BENCH_QUERIES 8000
+#define BENCH_UPSTREAM_THREADS 4
+
+struct bench_thread {
+	pthread_t thread;
+	struct getdns_context *context;
+	size_t num_threads;
+	size_t index;
+	long answered;
+};
+
+/*---------------------------------------- bench_context */
+/**
+ * create a context that sends its queries to the stub upstream on port
+ */
+static struct getdns_context *
+bench_context(uint16_t port)
+{
+	uint8_t localhost[4] = { 127, 0, 0, 1 };
+	struct getdns_bindata address_data = { 4, localhost };
+	struct getdns_context *context = NULL;
+	struct getdns_list *upstreams = getdns_list_create();
+	struct getdns_dict *upstream = getdns_dict_create();
+	getdns_return_t r;
+
+	r = getdns_context_create(&context, 1);
+	if (!r)
+		r = getdns_dict_util_set_string(upstream, "address_type",
+		    "IPv4");
+	if (!r)
+		r = getdns_dict_set_bindata(upstream, "address_data",
+		    &address_data);
+	if (!r)
+		r = getdns_dict_set_int(upstream, "port", port);
+	if (!r)
+		r = getdns_list_set_dict(upstreams, 0, upstream);
+	if (!r)
+		r = getdns_context_set_resolution_type(context,
+		    GETDNS_RESOLUTION_STUB);
+	if (!r)
+		r = getdns_context_set_upstream_recursive_servers(context,
+		    upstreams);
+	if (!r)
+		r = getdns_context_set_timeout(context, 2000);
+
+	getdns_dict_destroy(upstream);
+	getdns_list_destroy(upstreams);
+	if (r) {
+		getdns_context_destroy(context);
+		return NULL;
+	}
+	return context;
+}				/* bench_context */
+
+/*---------------------------------------- bench_thread_run */
+/**
+ * resolve a share of BENCH_QUERIES names, one getdns_general_sync at a time
+ */
+static void *
+bench_thread_run(void *arg)
+{
+	struct bench_thread *t = (struct bench_thread *)arg;
+	struct getdns_dict *response;
+	uint32_t status;
+	char name[64];
+	long i;
+
+	for (i = t->index; i < BENCH_QUERIES; i += t->num_threads) {
+		/* names are unique, so no answer comes from cache */
+		(void) snprintf(name, sizeof(name), "q%ld.t%zu.bench.example.",
+		    i, t->num_threads);
+		response = NULL;
+		if (getdns_general_sync(t->context, name, GETDNS_RRTYPE_A,
+		    NULL, &response) == GETDNS_RETURN_GOOD &&
+		    getdns_dict_get_int(response, "status", &status) ==
+		    GETDNS_RETURN_GOOD && status == GETDNS_RESPSTATUS_GOOD)
+			t->answered++;
+		getdns_dict_destroy(response);
+	}
+	return NULL;
+}				/* bench_thread_run */
+
+/*---------------------------------------- bench_sync */
+/**
+ * resolve BENCH_QUERIES names with num_threads threads on context
+ * Returns the number of answered queries, or -1 on error.
+ */
+static long
+bench_sync(struct getdns_context *context, size_t num_threads, double *secs)
+{
+	struct bench_thread threads[BENCH_MAX_THREADS];
+	struct timeval start, end;
+	long answered = 0;
+	size_t i, started;
+
+	gettimeofday(&start, NULL);
+	for (started = 0; started < num_threads; started++) {
+		threads[started].context = context;
+		threads[started].num_threads = num_threads;
+		threads[started].index = started;
+		threads[started].answered = 0;
+		if (pthread_create(&threads[started].thread, NULL,
+		    bench_thread_run, &threads[started]) != 0)
+			break;
+	}
+	for (i = 0; i < started; i++) {
+		(void) pthread_join(threads[i].thread, NULL);
+		answered += threads[i].answered;
+	}
+	gettimeofday(&end, NULL);
+	if (started < num_threads)
+		return -1;
+
+	*secs = (end.tv_sec - start.tv_sec) +
+	    (end.tv_usec - start.tv_usec) / 1000000.0;
+	return answered;
+}				/* bench_sync */
+
+int
+main(void)
+{
+	struct getdns_context *context;
+	double secs, base_qps = 0, qps;
+	size_t num_threads;
+	uint16_t port;
+	long answered;
+	int result = EXIT_SUCCESS;
+	struct mock_upstream_config upstream = {
+		.threads = BENCH_UPSTREAM_THREADS };
+
+	if (mock_upstream_start(&upstream, &port) == -1) {
+		perror("could not start the stub upstream");
+		return EXIT_FAILURE;
+	}
+	if (!(context = bench_context(port))) {
+		fprintf(stderr, "could not create the context\n");
+		return EXIT_FAILURE;
+	}
+	printf("threads  answered       secs        q/s  speedup\n");
+	for (num_threads = 1; num_threads <= BENCH_MAX_THREADS;
+	    num_threads *= 2) {
+		if ((answered = bench_sync(context, num_threads, &secs)) < 0) {
+			fprintf(stderr, "could not start the threads\n");
+			getdns_context_destroy(context);
+			return EXIT_FAILURE;
+		}
+		qps = answered / secs;
+		if (num_threads == 1)
+			base_qps = qps;
+		printf("%7zu  %8ld  %9.3f  %9.0f  %7.2f\n", num_threads,
+		    answered, secs, qps, base_qps ? qps / base_qps : 0.0);
+		if (answered != BENCH_QUERIES)
+			result = EXIT_FAILURE;
+	}
+	getdns_context_destroy(context);
+	return result;
+}
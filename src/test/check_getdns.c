@@ -32,7 +32,9 @@
 #include <unistd.h>
 #include <check.h>
 #include <getdns/getdns.h>
+#include <getdns/getdns_extra.h>
 #include "check_getdns_common.h"
+#include "check_getdns_upstream.h"
 #include "check_getdns_general.h"
 #include "check_getdns_general_sync.h"
 #include "check_getdns_address.h"
@@ -48,6 +50,10 @@
 #include "check_getdns_list_get_list.h"
 #include "check_getdns_list_get_int.h"
 #include "check_getdns_list_get_bindata.h"
+#include "check_getdns_list_create_with_capacity.h"
+#include "check_getdns_path.h"
+#include "check_getdns_dict_serialize.h"
+#include "check_getdns_print_json_dict.h"
 #include "check_getdns_dict_get_names.h"
 #include "check_getdns_dict_get_data_type.h"
 #include "check_getdns_dict_get_dict.h"
@@ -65,6 +71,19 @@
 #include "check_getdns_display_ip_address.h"
 #include "check_getdns_context_set_context_update_callback.h"
 #include "check_getdns_context_set_timeout.h"
+#include "check_getdns_context_process_async_budget.h"
+#include "check_getdns_context_poll_completions.h"
+#include "check_getdns_submit_general.h"
+#include "check_getdns_pool.h"
+#include "check_getdns_context_clone.h"
+#include "check_getdns_context_set_follow_system_files.h"
+#include "check_getdns_context_set_native_stub.h"
+#include "check_getdns_context_set_upstream_health_callback.h"
+#include "check_getdns_context_set_hedged_queries.h"
+#include "check_getdns_context_set_adaptive_timeouts.h"
+#include "check_getdns_context_set_udp_socket_pool.h"
+#include "check_getdns_context_set_edns_size_negotiation.h"
+#include "check_getdns_context_set_request_limits.h"
 #include "check_getdns_context_set_upstream_recursive_servers.h"
 #include "check_getdns_service.h"
 #include "check_getdns_service_sync.h"
@@ -91,6 +110,10 @@ main (int argc, char** argv)
   Suite *getdns_list_get_int_suite(void);
   Suite *getdns_list_get_data_type_suite(void);
   Suite *getdns_list_get_bindata_suite(void);
+  Suite *getdns_list_create_with_capacity_suite(void);
+  Suite *getdns_path_suite(void);
+  Suite *getdns_dict_serialize_suite(void);
+  Suite *getdns_print_json_dict_suite(void);
   Suite *getdns_dict_get_names_suite(void);
   Suite *getdns_dict_get_data_type_suite(void);
   Suite *getdns_dict_get_dict_suite(void);
@@ -112,6 +135,19 @@ main (int argc, char** argv)
   Suite *getdns_service_suite(void);
   Suite *getdns_service_sync_suite(void);
   Suite *getdns_context_set_timeout_suite(void);
+  Suite *getdns_context_process_async_budget_suite(void);
+  Suite *getdns_context_poll_completions_suite(void);
+  Suite *getdns_submit_general_suite(void);
+  Suite *getdns_pool_suite(void);
+  Suite *getdns_context_clone_suite(void);
+  Suite *getdns_context_set_follow_system_files_suite(void);
+  Suite *getdns_context_set_native_stub_suite(void);
+  Suite *getdns_context_set_upstream_health_callback_suite(void);
+  Suite *getdns_context_set_hedged_queries_suite(void);
+  Suite *getdns_context_set_adaptive_timeouts_suite(void);
+  Suite *getdns_context_set_udp_socket_pool_suite(void);
+  Suite *getdns_context_set_edns_size_negotiation_suite(void);
+  Suite *getdns_context_set_request_limits_suite(void);
 
   sr = srunner_create(getdns_general_suite());
   srunner_add_suite(sr, getdns_general_sync_suite());
@@ -128,6 +164,10 @@ main (int argc, char** argv)
   srunner_add_suite(sr, getdns_list_get_list_suite());
   srunner_add_suite(sr, getdns_list_get_int_suite());
   srunner_add_suite(sr, getdns_list_get_bindata_suite());
+  srunner_add_suite(sr, getdns_list_create_with_capacity_suite());
+  srunner_add_suite(sr, getdns_path_suite());
+  srunner_add_suite(sr, getdns_dict_serialize_suite());
+  srunner_add_suite(sr, getdns_print_json_dict_suite());
   srunner_add_suite(sr, getdns_dict_get_names_suite());
   srunner_add_suite(sr, getdns_dict_get_data_type_suite());
   srunner_add_suite(sr, getdns_dict_get_dict_suite());
@@ -145,6 +185,19 @@ main (int argc, char** argv)
   srunner_add_suite(sr,getdns_display_ip_address_suite());
   srunner_add_suite(sr,getdns_context_set_context_update_callback_suite());
   srunner_add_suite(sr,getdns_context_set_timeout_suite());
+  srunner_add_suite(sr,getdns_context_process_async_budget_suite());
+  srunner_add_suite(sr,getdns_context_poll_completions_suite());
+  srunner_add_suite(sr,getdns_submit_general_suite());
+  srunner_add_suite(sr,getdns_pool_suite());
+  srunner_add_suite(sr,getdns_context_clone_suite());
+  srunner_add_suite(sr,getdns_context_set_follow_system_files_suite());
+  srunner_add_suite(sr,getdns_context_set_native_stub_suite());
+  srunner_add_suite(sr,getdns_context_set_upstream_health_callback_suite());
+  srunner_add_suite(sr,getdns_context_set_hedged_queries_suite());
+  srunner_add_suite(sr,getdns_context_set_adaptive_timeouts_suite());
+  srunner_add_suite(sr,getdns_context_set_udp_socket_pool_suite());
+  srunner_add_suite(sr,getdns_context_set_edns_size_negotiation_suite());
+  srunner_add_suite(sr,getdns_context_set_request_limits_suite());
   srunner_add_suite(sr,getdns_context_set_upstream_recursive_servers_suite());
   srunner_add_suite(sr,getdns_service_suite());
   srunner_add_suite(sr,getdns_service_sync_suite());
@@ -31,6 +31,7 @@
 #include <inttypes.h>
 #include <check.h>
 #include <getdns/getdns.h>
+#include <getdns/getdns_extra.h>
 #include "config.h"
 #include "check_getdns_common.h"
 #include "check_getdns_eventloop.h"
@@ -328,6 +329,87 @@ void update_callbackfn(struct getdns_context *context,
     changed_item, expected_changed_item);
 }
 
+void count_callbackfn(struct getdns_context *context,
+                getdns_callback_type_t callback_type,
+                struct getdns_dict *response,
+                void *userarg,
+                getdns_transaction_t transaction_id)
+{
+  (*(int *) userarg)++;
+  getdns_dict_destroy(response);
+}
+
+struct getdns_context *stub_context_create(const uint16_t *ports, size_t count)
+{
+  uint8_t localhost[4] = { 127, 0, 0, 1 };
+  struct getdns_bindata address_data = { 4, localhost };
+  struct getdns_context *context = NULL;
+  struct getdns_list *upstreams;
+  struct getdns_dict *upstream;
+  size_t i;
+
+  ASSERT_RC(getdns_context_create(&context, FALSE), GETDNS_RETURN_GOOD,
+    "Return code from getdns_context_create()");
+  ASSERT_RC(getdns_context_set_resolution_type(context,
+    GETDNS_RESOLUTION_STUB), GETDNS_RETURN_GOOD,
+    "Return code from getdns_context_set_resolution_type()");
+  LIST_CREATE(upstreams);
+  for (i = 0; i < count; i++) {
+    DICT_CREATE(upstream);
+    ASSERT_RC(getdns_dict_util_set_string(upstream, "address_type", "IPv4"),
+      GETDNS_RETURN_GOOD, "Return code from getdns_dict_util_set_string()");
+    ASSERT_RC(getdns_dict_set_bindata(upstream, "address_data",
+      &address_data), GETDNS_RETURN_GOOD,
+      "Return code from getdns_dict_set_bindata()");
+    ASSERT_RC(getdns_dict_set_int(upstream, "port", ports[i]),
+      GETDNS_RETURN_GOOD, "Return code from getdns_dict_set_int()");
+    ASSERT_RC(getdns_list_set_dict(upstreams, i, upstream),
+      GETDNS_RETURN_GOOD, "Return code from getdns_list_set_dict()");
+    DICT_DESTROY(upstream);
+  }
+  ASSERT_RC(getdns_context_set_upstream_recursive_servers(context, upstreams),
+    GETDNS_RETURN_GOOD,
+    "Return code from getdns_context_set_upstream_recursive_servers()");
+  LIST_DESTROY(upstreams);
+  ASSERT_RC(getdns_context_set_dns_transport(context,
+    GETDNS_TRANSPORT_UDP_FIRST_AND_FALL_BACK_TO_TCP), GETDNS_RETURN_GOOD,
+    "Return code from getdns_context_set_dns_transport()");
+  if (getdns_context_set_native_stub(context, 1) != GETDNS_RETURN_GOOD) {
+    getdns_context_destroy(context);
+    return NULL;
+  }
+  return context;
+}
+
+uint32_t upstream_stat(struct getdns_context *context, uint16_t port,
+                const char *name)
+{
+  struct getdns_dict *info = getdns_context_get_api_information(context);
+  struct getdns_list *stats;
+  struct getdns_dict *upstream;
+  uint32_t upstream_port, value = 0;
+  size_t i, count = 0;
+
+  ck_assert_msg(info != NULL, "No api information");
+  ASSERT_RC(getdns_dict_get_list(info, "upstream_stats", &stats),
+    GETDNS_RETURN_GOOD, "Return code from getdns_dict_get_list()");
+  ASSERT_RC(getdns_list_get_length(stats, &count), GETDNS_RETURN_GOOD,
+    "Return code from getdns_list_get_length()");
+  for (i = 0; i < count; i++) {
+    ASSERT_RC(getdns_list_get_dict(stats, i, &upstream), GETDNS_RETURN_GOOD,
+      "Return code from getdns_list_get_dict()");
+    ASSERT_RC(getdns_dict_get_int(upstream, "port", &upstream_port),
+      GETDNS_RETURN_GOOD, "Return code from getdns_dict_get_int()");
+    if (upstream_port == port)
+      break;
+  }
+  ck_assert_msg(i < count, "No upstream_stats for port %d", (int) port);
+  ASSERT_RC(getdns_dict_get_int(upstream, name, &value), GETDNS_RETURN_GOOD,
+    "Return code from getdns_dict_get_int()");
+  getdns_dict_destroy(info);
+  return value;
+}
+
 void run_event_loop(struct getdns_context* context, void* eventloop) {
     run_event_loop_impl(context, eventloop);
 }
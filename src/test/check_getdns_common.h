@@ -212,6 +212,33 @@
      void update_callbackfn(struct getdns_context *context,
                      getdns_context_code_t changed_item);
 
+     /*
+      *    count_callbackfn counts the calls for the requests it was
+      *    given to in the int userarg points to, of any callback type.
+      */
+     void count_callbackfn(struct getdns_context *context,
+                     getdns_callback_type_t callback_type,
+                     struct getdns_dict *response,
+                     void *userarg,
+                     getdns_transaction_t transaction_id);
+
+     /*
+      *    stub_context_create creates a context resolving in stub
+      *    mode with the native stub, over UDP with a fallback to TCP,
+      *    with an upstream on 127.0.0.1 for each of the count ports.
+      *    Returns NULL where the native stub is not available.
+      */
+     struct getdns_context *stub_context_create(const uint16_t *ports,
+                     size_t count);
+
+     /*
+      *    upstream_stat asserts that the upstream on port is in the
+      *    "upstream_stats" of the api information of context, and
+      *    returns the value of name in it.
+      */
+     uint32_t upstream_stat(struct getdns_context *context, uint16_t port,
+                     const char *name);
+
      /* run the event loop */
      void run_event_loop(struct getdns_context *context, void* eventloop);
 
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _check_getdns_context_clone_h_
+#define _check_getdns_context_clone_h_
+
+    /*
+     **************************************************************************
+     *                                                                        *
+     *  T E S T S  F O R  G E T D N S _ C O N T E X T _ C L O N E            *
+     *                                                                        *
+     **************************************************************************
+    */
+
+     START_TEST (getdns_context_clone_1)
+     {
+      /*
+       *  src = NULL
+       *  expect:  GETDNS_RETURN_INVALID_PARAMETER
+       */
+       struct getdns_context *clone = NULL;
+
+       ASSERT_RC(getdns_context_clone(NULL, &clone),
+         GETDNS_RETURN_INVALID_PARAMETER, "Return code from getdns_context_clone()");
+     }
+     END_TEST
+
+     START_TEST (getdns_context_clone_2)
+     {
+      /*
+       *  dst = NULL
+       *  expect:  GETDNS_RETURN_INVALID_PARAMETER
+       */
+       struct getdns_context *context = NULL;
+
+       CONTEXT_CREATE(TRUE);
+       ASSERT_RC(getdns_context_clone(context, NULL),
+         GETDNS_RETURN_INVALID_PARAMETER, "Return code from getdns_context_clone()");
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     START_TEST (getdns_context_clone_3)
+     {
+      /*
+       *  clone a context with a changed timeout, EDNS payload size and
+       *  transport
+       *  expect:  the settings of the clone in its api information equal
+       *           those of the source
+       */
+       struct getdns_context *context = NULL;
+       struct getdns_context *clone = NULL;
+       struct getdns_dict *src_info = NULL, *dst_info = NULL;
+       struct getdns_dict *src_settings, *dst_settings;
+       struct getdns_list *src_upstreams, *dst_upstreams;
+       size_t src_len, dst_len, i;
+       uint32_t src_value, dst_value;
+       const char *keys[] = { "timeout", "dns_transport",
+         "edns_maximum_udp_payload_size", "edns_do_bit", "append_name" };
+
+       CONTEXT_CREATE(TRUE);
+       ASSERT_RC(getdns_context_set_timeout(context, 1234),
+         GETDNS_RETURN_GOOD, "Return code from getdns_context_set_timeout()");
+       ASSERT_RC(getdns_context_set_edns_maximum_udp_payload_size(context, 1400),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_edns_maximum_udp_payload_size()");
+       ASSERT_RC(getdns_context_set_dns_transport(context,
+         GETDNS_TRANSPORT_TCP_ONLY), GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_dns_transport()");
+
+       ASSERT_RC(getdns_context_clone(context, &clone),
+         GETDNS_RETURN_GOOD, "Return code from getdns_context_clone()");
+       ck_assert_msg(clone != NULL && clone != context,
+         "Expected a new context from getdns_context_clone()");
+
+       src_info = getdns_context_get_api_information(context);
+       dst_info = getdns_context_get_api_information(clone);
+       ASSERT_RC(getdns_dict_get_dict(src_info, "all_context", &src_settings),
+         GETDNS_RETURN_GOOD, "Return code from getdns_dict_get_dict()");
+       ASSERT_RC(getdns_dict_get_dict(dst_info, "all_context", &dst_settings),
+         GETDNS_RETURN_GOOD, "Return code from getdns_dict_get_dict()");
+
+       for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+         ASSERT_RC(getdns_dict_get_int(src_settings, keys[i], &src_value),
+           GETDNS_RETURN_GOOD, "Return code from getdns_dict_get_int()");
+         ASSERT_RC(getdns_dict_get_int(dst_settings, keys[i], &dst_value),
+           GETDNS_RETURN_GOOD, "Return code from getdns_dict_get_int()");
+         ck_assert_msg(src_value == dst_value,
+           "Expected %s %d in the clone, got %d", keys[i], src_value, dst_value);
+       }
+       ASSERT_RC(getdns_dict_get_int(dst_settings, "timeout", &dst_value),
+         GETDNS_RETURN_GOOD, "Return code from getdns_dict_get_int()");
+       ck_assert_msg(dst_value == 1234, "Expected timeout 1234, got %d", dst_value);
+
+       if (getdns_dict_get_list(src_settings, "upstream_recursive_servers",
+         &src_upstreams) == GETDNS_RETURN_GOOD) {
+         ASSERT_RC(getdns_dict_get_list(dst_settings, "upstream_recursive_servers",
+           &dst_upstreams), GETDNS_RETURN_GOOD,
+           "Return code from getdns_dict_get_list()");
+         ASSERT_RC(getdns_list_get_length(src_upstreams, &src_len),
+           GETDNS_RETURN_GOOD, "Return code from getdns_list_get_length()");
+         ASSERT_RC(getdns_list_get_length(dst_upstreams, &dst_len),
+           GETDNS_RETURN_GOOD, "Return code from getdns_list_get_length()");
+         ck_assert_msg(src_len == dst_len,
+           "Expected %d upstreams in the clone, got %d", (int) src_len, (int) dst_len);
+       }
+
+       getdns_dict_destroy(src_info);
+       getdns_dict_destroy(dst_info);
+       getdns_context_destroy(clone);
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     START_TEST (getdns_context_clone_4)
+     {
+      /*
+       *  resolve "localhost" with a clone, after its source is destroyed
+       *  expect:  GETDNS_RETURN_GOOD and a response
+       */
+       struct getdns_context *context = NULL;
+       struct getdns_context *clone = NULL;
+       struct getdns_dict *response = NULL;
+
+       CONTEXT_CREATE(TRUE);
+       ASSERT_RC(getdns_context_clone(context, &clone),
+         GETDNS_RETURN_GOOD, "Return code from getdns_context_clone()");
+       CONTEXT_DESTROY;
+
+       ASSERT_RC(getdns_address_sync(clone, "localhost", NULL, &response),
+         GETDNS_RETURN_GOOD, "Return code from getdns_address_sync()");
+       ck_assert_msg(response != NULL, "Expected a response from the clone");
+       getdns_dict_destroy(response);
+       getdns_context_destroy(clone);
+     }
+     END_TEST
+
+     Suite *
+     getdns_context_clone_suite (void)
+     {
+       Suite *s = suite_create ("getdns_context_clone()");
+
+       /* Negative test caseis */
+       TCase *tc_neg = tcase_create("Negative");
+       tcase_add_test(tc_neg, getdns_context_clone_1);
+       tcase_add_test(tc_neg, getdns_context_clone_2);
+       suite_add_tcase(s, tc_neg);
+
+       /* Positive test cases */
+       TCase *tc_pos = tcase_create("Positive");
+       tcase_add_test(tc_pos, getdns_context_clone_3);
+       tcase_add_test(tc_pos, getdns_context_clone_4);
+       suite_add_tcase(s, tc_pos);
+
+       return s;
+     }
+
+#endif
@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _check_getdns_context_poll_completions_h_
+#define _check_getdns_context_poll_completions_h_
+
+#include <sys/select.h>
+
+    /*
+     **************************************************************************
+     *                                                                        *
+     *  T E S T S  F O R  G E T D N S _ C O N T E X T _ P O L L _            *
+     *  C O M P L E T I O N S                                                 *
+     *                                                                        *
+     **************************************************************************
+    */
+
+     START_TEST (getdns_context_poll_completions_1)
+     {
+      /*
+       *  context = NULL
+       *  expect:  GETDNS_RETURN_INVALID_PARAMETER
+       */
+       getdns_completion_t completions[1];
+       size_t count;
+
+       ASSERT_RC(getdns_context_poll_completions(NULL, completions, 1, &count),
+         GETDNS_RETURN_INVALID_PARAMETER,
+         "Return code from getdns_context_poll_completions()");
+     }
+     END_TEST
+
+     START_TEST (getdns_context_poll_completions_2)
+     {
+      /*
+       *  count = NULL
+       *  expect:  GETDNS_RETURN_INVALID_PARAMETER
+       */
+       struct getdns_context *context = NULL;
+       getdns_completion_t completions[1];
+
+       CONTEXT_CREATE(TRUE);
+       ASSERT_RC(getdns_context_poll_completions(context, completions, 1, NULL),
+         GETDNS_RETURN_INVALID_PARAMETER,
+         "Return code from getdns_context_poll_completions()");
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     START_TEST (getdns_context_poll_completions_3)
+     {
+      /*
+       *  three lookups of "localhost" without a callback, with the
+       *  completion queue enabled
+       *  expect:  three COMPLETE completions with their userarg and a
+       *           response
+       */
+       struct getdns_context *context = NULL;
+       getdns_transaction_t transaction_id = 0;
+       getdns_completion_t completions[2];
+       int userargs[3] = { 0, 0, 0 };
+       struct timeval tv;
+       fd_set read_fds;
+       size_t count, i;
+       int completed = 0, fd;
+
+       CONTEXT_CREATE(TRUE);
+       ASSERT_RC(getdns_context_set_completion_queue(context, 1),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_completion_queue()");
+       for (i = 0; i < 3; i++) {
+         ASSERT_RC(getdns_address(context, "localhost", NULL,
+           &userargs[i], &transaction_id, NULL),
+           GETDNS_RETURN_GOOD, "Return code from getdns_address()");
+       }
+       while (getdns_context_get_num_pending_requests(context, &tv) > 0) {
+         ASSERT_RC(getdns_context_poll_completions(context, completions, 2, &count),
+           GETDNS_RETURN_GOOD,
+           "Return code from getdns_context_poll_completions()");
+         for (i = 0; i < count; i++) {
+           ck_assert_msg(completions[i].callback_type == GETDNS_CALLBACK_COMPLETE,
+             "Expected a COMPLETE completion, got %d", completions[i].callback_type);
+           ck_assert_msg(completions[i].response != NULL,
+             "Expected a response with the completion");
+           (*(int *) completions[i].userarg)++;
+           getdns_dict_destroy(completions[i].response);
+           completed++;
+         }
+         if (count > 0)
+           continue;
+
+         fd = getdns_context_fd(context);
+         FD_ZERO(&read_fds);
+         FD_SET(fd, &read_fds);
+         select(fd + 1, &read_fds, NULL, NULL, &tv);
+         ASSERT_RC(getdns_context_process_async(context), GETDNS_RETURN_GOOD,
+           "Return code from getdns_context_process_async()");
+       }
+       ck_assert_msg(completed == 3, "Expected 3 completions, got %d", completed);
+       for (i = 0; i < 3; i++) {
+         ck_assert_msg(userargs[i] == 1,
+           "Expected one completion for request %d, got %d", (int) i, userargs[i]);
+       }
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     START_TEST (getdns_context_poll_completions_4)
+     {
+      /*
+       *  cancel a request with the completion queue enabled
+       *  expect:  one CANCEL completion with the transaction id
+       */
+       struct getdns_context *context = NULL;
+       getdns_transaction_t transaction_id = 0;
+       getdns_completion_t completions[2];
+       size_t count;
+
+       CONTEXT_CREATE(TRUE);
+       ASSERT_RC(getdns_context_set_completion_queue(context, 1),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_completion_queue()");
+       ASSERT_RC(getdns_address(context, "www.google.com", NULL,
+         NULL, &transaction_id, NULL),
+         GETDNS_RETURN_GOOD, "Return code from getdns_address()");
+       ASSERT_RC(getdns_cancel_callback(context, transaction_id),
+         GETDNS_RETURN_GOOD, "Return code from getdns_cancel_callback()");
+
+       ASSERT_RC(getdns_context_poll_completions(context, completions, 2, &count),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_poll_completions()");
+       ck_assert_msg(count == 1, "Expected 1 completion, got %d", (int) count);
+       ck_assert_msg(completions[0].callback_type == GETDNS_CALLBACK_CANCEL,
+         "Expected a CANCEL completion, got %d", completions[0].callback_type);
+       ck_assert_msg(completions[0].transaction_id == transaction_id,
+         "Expected the transaction id of the canceled request");
+       ck_assert_msg(completions[0].response == NULL,
+         "Expected no response with a CANCEL completion");
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     START_TEST (getdns_context_poll_completions_5)
+     {
+      /*
+       *  disable the completion queue while a lookup of "localhost" and
+       *  one that is canceled are outstanding without a callback
+       *  expect:  both complete without one, and no completions
+       */
+       struct getdns_context *context = NULL;
+       getdns_transaction_t transaction_id = 0;
+       getdns_completion_t completions[2];
+       struct timeval tv;
+       fd_set read_fds;
+       size_t count;
+       int fd;
+
+       CONTEXT_CREATE(TRUE);
+       ASSERT_RC(getdns_context_set_completion_queue(context, 1),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_completion_queue()");
+       ASSERT_RC(getdns_address(context, "localhost", NULL,
+         NULL, &transaction_id, NULL),
+         GETDNS_RETURN_GOOD, "Return code from getdns_address()");
+       ASSERT_RC(getdns_address(context, "www.google.com", NULL,
+         NULL, &transaction_id, NULL),
+         GETDNS_RETURN_GOOD, "Return code from getdns_address()");
+       ASSERT_RC(getdns_context_set_completion_queue(context, 0),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_completion_queue()");
+
+       ASSERT_RC(getdns_cancel_callback(context, transaction_id),
+         GETDNS_RETURN_GOOD, "Return code from getdns_cancel_callback()");
+       while (getdns_context_get_num_pending_requests(context, &tv) > 0) {
+         fd = getdns_context_fd(context);
+         FD_ZERO(&read_fds);
+         FD_SET(fd, &read_fds);
+         select(fd + 1, &read_fds, NULL, NULL, &tv);
+         ASSERT_RC(getdns_context_process_async(context), GETDNS_RETURN_GOOD,
+           "Return code from getdns_context_process_async()");
+       }
+       ASSERT_RC(getdns_context_poll_completions(context, completions, 2, &count),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_poll_completions()");
+       ck_assert_msg(count == 0, "Expected no completions, got %d", (int) count);
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     /* memory functions that fail while *userarg is set */
+     static void *
+     poll_completions_malloc(void *userarg, size_t size)
+     {
+       return *(int *) userarg ? NULL : malloc(size);
+     }
+
+     static void *
+     poll_completions_realloc(void *userarg, void *ptr, size_t size)
+     {
+       return *(int *) userarg ? NULL : realloc(ptr, size);
+     }
+
+     static void
+     poll_completions_free(void *userarg, void *ptr)
+     {
+       free(ptr);
+     }
+
+     START_TEST (getdns_context_poll_completions_6)
+     {
+      /*
+       *  cancel a request without a callback when the completion queue
+       *  cannot grow
+       *  expect:  the cancel is dropped, and no completions
+       */
+       struct getdns_context *context = NULL;
+       getdns_transaction_t transaction_id = 0;
+       getdns_completion_t completions[2];
+       size_t count;
+       int fail = 0;
+
+       ASSERT_RC(getdns_context_create_with_extended_memory_functions(
+         &context, TRUE, &fail, poll_completions_malloc,
+         poll_completions_realloc, poll_completions_free),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_create_with_extended_memory_functions()");
+       ASSERT_RC(getdns_context_set_completion_queue(context, 1),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_completion_queue()");
+       ASSERT_RC(getdns_address(context, "www.google.com", NULL,
+         NULL, &transaction_id, NULL),
+         GETDNS_RETURN_GOOD, "Return code from getdns_address()");
+
+       fail = 1;
+       ASSERT_RC(getdns_cancel_callback(context, transaction_id),
+         GETDNS_RETURN_GOOD, "Return code from getdns_cancel_callback()");
+       fail = 0;
+
+       ASSERT_RC(getdns_context_poll_completions(context, completions, 2, &count),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_poll_completions()");
+       ck_assert_msg(count == 0, "Expected no completions, got %d", (int) count);
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     Suite *
+     getdns_context_poll_completions_suite (void)
+     {
+       Suite *s = suite_create ("getdns_context_poll_completions()");
+
+       /* Negative test caseis */
+       TCase *tc_neg = tcase_create("Negative");
+       tcase_add_test(tc_neg, getdns_context_poll_completions_1);
+       tcase_add_test(tc_neg, getdns_context_poll_completions_2);
+       suite_add_tcase(s, tc_neg);
+
+       /* Positive test cases */
+       TCase *tc_pos = tcase_create("Positive");
+       tcase_add_test(tc_pos, getdns_context_poll_completions_3);
+       tcase_add_test(tc_pos, getdns_context_poll_completions_4);
+       tcase_add_test(tc_pos, getdns_context_poll_completions_5);
+       tcase_add_test(tc_pos, getdns_context_poll_completions_6);
+       suite_add_tcase(s, tc_pos);
+
+       return s;
+     }
+
+#endif
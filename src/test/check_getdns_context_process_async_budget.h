@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _check_getdns_context_process_async_budget_h_
+#define _check_getdns_context_process_async_budget_h_
+
+#include <sys/select.h>
+
+    /*
+     **************************************************************************
+     *                                                                        *
+     *  T E S T S  F O R  G E T D N S _ C O N T E X T _ P R O C E S S _      *
+     *  A S Y N C _ B U D G E T                                               *
+     *                                                                        *
+     **************************************************************************
+    */
+
+     /*
+      *  budget_callbackfn counts the callbacks in callback_called
+      */
+     static void
+     budget_callbackfn(struct getdns_context *context,
+                       getdns_callback_type_t callback_type,
+                       struct getdns_dict *response,
+                       void *userarg,
+                       getdns_transaction_t transaction_id)
+     {
+       callback_called++;
+       getdns_dict_destroy(response);
+     }
+
+     START_TEST (getdns_context_process_async_budget_1)
+     {
+      /*
+       *  context = NULL
+       *  expect:  GETDNS_RETURN_INVALID_PARAMETER
+       */
+       int more = 0;
+
+       ASSERT_RC(getdns_context_process_async_budget(NULL, 1, 0, &more),
+         GETDNS_RETURN_INVALID_PARAMETER,
+         "Return code from getdns_context_process_async_budget()");
+     }
+     END_TEST
+
+     START_TEST (getdns_context_process_async_budget_2)
+     {
+      /*
+       *  no outstanding requests
+       *  expect:  GETDNS_RETURN_GOOD and no work remaining
+       */
+       struct getdns_context *context = NULL;
+       int more = 1;
+
+       CONTEXT_CREATE(TRUE);
+       ASSERT_RC(getdns_context_process_async_budget(context, 1, 0, &more),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_process_async_budget()");
+       ck_assert_msg(more == 0, "Expected no work remaining");
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     START_TEST (getdns_context_process_async_budget_3)
+     {
+      /*
+       *  three lookups of "localhost" processed with a budget of one
+       *  callback, without an event loop extension
+       *  expect:  at most one callback per call and all three delivered
+       */
+       struct getdns_context *context = NULL;
+       getdns_transaction_t transaction_id = 0;
+       struct timeval tv;
+       fd_set read_fds;
+       int before, more = 0, fd, i;
+
+       callback_called = 0;
+       CONTEXT_CREATE(TRUE);
+       for (i = 0; i < 3; i++) {
+         ASSERT_RC(getdns_address(context, "localhost", NULL,
+           NULL, &transaction_id, budget_callbackfn),
+           GETDNS_RETURN_GOOD, "Return code from getdns_address()");
+       }
+       while (getdns_context_get_num_pending_requests(context, &tv) > 0) {
+         if (!more) {
+           fd = getdns_context_fd(context);
+           FD_ZERO(&read_fds);
+           FD_SET(fd, &read_fds);
+           select(fd + 1, &read_fds, NULL, NULL, &tv);
+         }
+         before = callback_called;
+         ASSERT_RC(getdns_context_process_async_budget(context, 1, 0, &more),
+           GETDNS_RETURN_GOOD,
+           "Return code from getdns_context_process_async_budget()");
+         ck_assert_msg(callback_called - before <= 1,
+           "Expected at most one callback, got %d", callback_called - before);
+       }
+       ck_assert_msg(callback_called == 3,
+         "callback_called should == 3, got %d", callback_called);
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     Suite *
+     getdns_context_process_async_budget_suite (void)
+     {
+       Suite *s = suite_create ("getdns_context_process_async_budget()");
+
+       /* Negative test caseis */
+       TCase *tc_neg = tcase_create("Negative");
+       tcase_add_test(tc_neg, getdns_context_process_async_budget_1);
+       suite_add_tcase(s, tc_neg);
+
+       /* Positive test cases */
+       TCase *tc_pos = tcase_create("Positive");
+       tcase_add_test(tc_pos, getdns_context_process_async_budget_2);
+       tcase_add_test(tc_pos, getdns_context_process_async_budget_3);
+       suite_add_tcase(s, tc_pos);
+
+       return s;
+     }
+
+#endif
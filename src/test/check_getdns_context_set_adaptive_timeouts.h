@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _check_getdns_context_set_adaptive_timeouts_h_
+#define _check_getdns_context_set_adaptive_timeouts_h_
+
+    /*
+     **************************************************************************
+     *                                                                        *
+     *  T E S T S  F O R  G E T D N S _ C O N T E X T _ S E T _               *
+     *  A D A P T I V E _ T I M E O U T S                                     *
+     *                                                                        *
+     **************************************************************************
+    */
+
+     /* the largest retry deadline reported in the replies, and of how
+        many requests */
+     struct retry_deadlines {
+       int calls;
+       uint32_t largest;
+     };
+
+     void retry_deadlines_callbackfn(struct getdns_context *context,
+       getdns_callback_type_t callback_type, struct getdns_dict *response,
+       void *userarg, getdns_transaction_t transaction_id)
+     {
+       struct retry_deadlines *deadlines = (struct retry_deadlines *) userarg;
+       struct getdns_list *list;
+       uint32_t deadline;
+       size_t i, count;
+
+       ASSERT_RC(callback_type, GETDNS_CALLBACK_COMPLETE, "Callback type");
+       EXTRACT_RESPONSE;
+       ASSERT_RC(getdns_dict_get_list(ex_response.replies_tree_sub_dict,
+         "retry_deadlines", &list), GETDNS_RETURN_GOOD,
+         "Return code from getdns_dict_get_list()");
+       ASSERT_RC(getdns_list_get_length(list, &count), GETDNS_RETURN_GOOD,
+         "Return code from getdns_list_get_length()");
+       ck_assert_msg(count > 0, "Expected retry deadlines");
+       for (i = 0; i < count; i++) {
+         ASSERT_RC(getdns_list_get_int(list, i, &deadline),
+           GETDNS_RETURN_GOOD, "Return code from getdns_list_get_int()");
+         if (deadline > deadlines->largest)
+           deadlines->largest = deadline;
+       }
+       deadlines->calls++;
+       getdns_dict_destroy(response);
+     }
+
+     START_TEST (getdns_context_set_adaptive_timeouts_1)
+     {
+      /*
+       *  context = NULL
+       *  expect:  GETDNS_RETURN_INVALID_PARAMETER
+       */
+       ASSERT_RC(getdns_context_set_adaptive_timeouts(NULL, 3),
+         GETDNS_RETURN_INVALID_PARAMETER,
+         "Return code from getdns_context_set_adaptive_timeouts()");
+     }
+     END_TEST
+
+     START_TEST (getdns_context_set_adaptive_timeouts_2)
+     {
+      /*
+       *  adaptive timeouts of 50 times the round trip time of an upstream
+       *  answering after 100 ms, with a timeout of 1000 ms, and requests
+       *  made in rounds: the first ones measure the round trip times
+       *  expect:  the replies have the retry_deadlines, those of the last
+       *           round clamped to the timeout of the context
+       */
+       struct mock_upstream_config slow = { .latency_ms = 100 };
+       struct retry_deadlines deadlines = { 0, 0 };
+       struct getdns_context *context = NULL;
+       void* eventloop = NULL;
+       uint16_t port;
+       int i, j;
+
+       ck_assert_msg(mock_upstream_start(&slow, &port) == 0,
+         "Could not start the upstream");
+       /* where the native stub is not available */
+       if (!(context = stub_context_create(&port, 1)))
+         return;
+       ASSERT_RC(getdns_context_set_timeout(context, 1000), GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_timeout()");
+       ASSERT_RC(getdns_context_set_adaptive_timeouts(context, 50),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_adaptive_timeouts()");
+       EVENT_BASE_CREATE;
+
+       for (i = 0; i < 5; i++) {
+         /* of the last round only */
+         deadlines.largest = 0;
+         for (j = 0; j < 10; j++)
+           ASSERT_RC(getdns_general(context, "adaptive.example",
+             GETDNS_RRTYPE_A, NULL, &deadlines, NULL,
+             retry_deadlines_callbackfn), GETDNS_RETURN_GOOD,
+             "Return code from getdns_general()");
+         RUN_EVENT_LOOP;
+       }
+       ck_assert_msg(deadlines.calls == 50, "Expected 50 callbacks, got %d",
+         deadlines.calls);
+       ck_assert_msg(deadlines.largest == 1000,
+         "Expected retry deadlines clamped to 1000 ms, got %d",
+         (int) deadlines.largest);
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     Suite *
+     getdns_context_set_adaptive_timeouts_suite (void)
+     {
+       Suite *s = suite_create ("getdns_context_set_adaptive_timeouts()");
+
+       /* Negative test caseis */
+       TCase *tc_neg = tcase_create("Negative");
+       tcase_add_test(tc_neg, getdns_context_set_adaptive_timeouts_1);
+       suite_add_tcase(s, tc_neg);
+
+       /* Positive test cases */
+       TCase *tc_pos = tcase_create("Positive");
+       tcase_add_test(tc_pos, getdns_context_set_adaptive_timeouts_2);
+       suite_add_tcase(s, tc_pos);
+
+       return s;
+     }
+
+#endif
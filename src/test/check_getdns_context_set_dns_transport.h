@@ -27,6 +27,8 @@
 #ifndef _check_getdns_context_set_dns_transport_h_
 #define _check_getdns_context_set_dns_transport_h_
 
+#include <sys/select.h>
+
     /*
      **************************************************************************
      *                                                                        *
@@ -154,9 +156,188 @@
      }
      END_TEST
 
-    
+     START_TEST (getdns_context_set_dns_transport_4)
+     {
+      /*
+       *  change the transport while a lookup of "localhost" is in flight
+       *  expect:  the lookup completes on the old unbound context instead
+       *           of being canceled, and a new lookup completes too
+       */
+       struct getdns_context *context = NULL;
+       getdns_transaction_t transaction_id = 0;
+       getdns_completion_t completions[2];
+       struct timeval tv;
+       fd_set read_fds;
+       size_t count, i;
+       int completed = 0, fd;
+
+       CONTEXT_CREATE(TRUE);
+       ASSERT_RC(getdns_context_set_completion_queue(context, 1),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_completion_queue()");
+       ASSERT_RC(getdns_address(context, "localhost", NULL,
+         NULL, &transaction_id, NULL),
+         GETDNS_RETURN_GOOD, "Return code from getdns_address()");
+       fd = getdns_context_fd(context);
+
+       ASSERT_RC(getdns_context_set_dns_transport(context, GETDNS_TRANSPORT_TCP_ONLY),
+         GETDNS_RETURN_GOOD, "Return code from getdns_context_set_dns_transport()");
+       ck_assert_msg(getdns_context_fd(context) == fd,
+         "Expected the fd of the context to stay the same");
+       ASSERT_RC(getdns_address(context, "localhost", NULL,
+         NULL, &transaction_id, NULL),
+         GETDNS_RETURN_GOOD, "Return code from getdns_address()");
+
+       while (getdns_context_get_num_pending_requests(context, &tv) > 0) {
+         ASSERT_RC(getdns_context_poll_completions(context, completions, 2, &count),
+           GETDNS_RETURN_GOOD,
+           "Return code from getdns_context_poll_completions()");
+         for (i = 0; i < count; i++) {
+           ck_assert_msg(completions[i].callback_type == GETDNS_CALLBACK_COMPLETE,
+             "Expected a COMPLETE completion, got %d", completions[i].callback_type);
+           getdns_dict_destroy(completions[i].response);
+           completed++;
+         }
+         if (count > 0)
+           continue;
+
+         FD_ZERO(&read_fds);
+         FD_SET(fd, &read_fds);
+         select(fd + 1, &read_fds, NULL, NULL, &tv);
+         ASSERT_RC(getdns_context_process_async(context), GETDNS_RETURN_GOOD,
+           "Return code from getdns_context_process_async()");
+       }
+       ASSERT_RC(getdns_context_poll_completions(context, completions, 2, &count),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_poll_completions()");
+       for (i = 0; i < count; i++) {
+         ck_assert_msg(completions[i].callback_type == GETDNS_CALLBACK_COMPLETE,
+           "Expected a COMPLETE completion, got %d", completions[i].callback_type);
+         getdns_dict_destroy(completions[i].response);
+         completed++;
+       }
+       ck_assert_msg(completed == 2, "Expected 2 completions, got %d", completed);
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     /* a request for name, counted in answered when it is answered */
+     struct transport_query {
+       char name[32];
+       int *answered;
+     };
+
+     void transport_callbackfn(struct getdns_context *context,
+       getdns_callback_type_t callback_type, struct getdns_dict *response,
+       void *userarg, getdns_transaction_t transaction_id)
+     {
+       struct transport_query *query = (struct transport_query *) userarg;
+       struct getdns_bindata *qname;
+       char *fqdn = NULL;
+
+       ASSERT_RC(callback_type, GETDNS_CALLBACK_COMPLETE, "Callback type");
+       EXTRACT_RESPONSE;
+       assert_noerror(&ex_response);
+       assert_address_in_answer(&ex_response, TRUE, FALSE);
+       ASSERT_RC(getdns_dict_get_bindata(ex_response.question, "qname",
+         &qname), GETDNS_RETURN_GOOD,
+         "Return code from getdns_dict_get_bindata()");
+       ASSERT_RC(getdns_convert_dns_name_to_fqdn(qname, &fqdn),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_convert_dns_name_to_fqdn()");
+       ck_assert_msg(strncmp(fqdn, query->name, strlen(query->name)) == 0,
+         "Expected the answer for %s, got %s", query->name, fqdn);
+       free(fqdn);
+       (*query->answered)++;
+       getdns_dict_destroy(response);
+     }
+
+     START_TEST (getdns_context_set_dns_transport_5)
+     {
+      /*
+       *  keep connections open in stub mode, with queries pipelined to an
+       *  upstream that answers the queries it reads together last first
+       *  expect:  every request gets the answer to its own query
+       */
+       struct mock_upstream_config reversing = { .tcp_reverse = 1 };
+       struct transport_query queries[10];
+       struct getdns_context *context = NULL;
+       void* eventloop = NULL;
+       uint16_t port;
+       int answered = 0, i;
+
+       ck_assert_msg(mock_upstream_start(&reversing, &port) == 0,
+         "Could not start the upstream");
+       /* where the native stub is not available */
+       if (!(context = stub_context_create(&port, 1)))
+         return;
+       ASSERT_RC(getdns_context_set_dns_transport(context,
+         GETDNS_TRANSPORT_TCP_ONLY_KEEP_CONNECTIONS_OPEN),
+         GETDNS_RETURN_GOOD, "Return code from getdns_context_set_dns_transport()");
+       EVENT_BASE_CREATE;
+
+       for (i = 0; i < 10; i++) {
+         (void) snprintf(queries[i].name, sizeof(queries[i].name),
+           "q%d.example", i);
+         queries[i].answered = &answered;
+         ASSERT_RC(getdns_general(context, queries[i].name, GETDNS_RRTYPE_A,
+           NULL, &queries[i], NULL, transport_callbackfn), GETDNS_RETURN_GOOD,
+           "Return code from getdns_general()");
+       }
+
+       RUN_EVENT_LOOP;
+       ck_assert_msg(answered == 10, "Expected 10 answers, got %d", answered);
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     START_TEST (getdns_context_set_dns_transport_6)
+     {
+      /*
+       *  keep connections open in stub mode, with a timeout of 2 seconds,
+       *  to an upstream that answers over TCP after 10 seconds and one
+       *  that answers right away
+       *  expect:  the queries not answered in time are written to the
+       *           connection to the other upstream, and every request is
+       *           answered
+       */
+       struct mock_upstream_config slow = { .latency_ms = 10000 };
+       struct mock_upstream_config fast = { 0 };
+       struct transport_query queries[10];
+       struct getdns_context *context = NULL;
+       void* eventloop = NULL;
+       uint16_t ports[2];
+       int answered = 0, i;
+
+       ck_assert_msg(mock_upstream_start(&slow, &ports[0]) == 0,
+         "Could not start the slow upstream");
+       ck_assert_msg(mock_upstream_start(&fast, &ports[1]) == 0,
+         "Could not start the fast upstream");
+       /* where the native stub is not available */
+       if (!(context = stub_context_create(ports, 2)))
+         return;
+       ASSERT_RC(getdns_context_set_dns_transport(context,
+         GETDNS_TRANSPORT_TCP_ONLY_KEEP_CONNECTIONS_OPEN),
+         GETDNS_RETURN_GOOD, "Return code from getdns_context_set_dns_transport()");
+       ASSERT_RC(getdns_context_set_timeout(context, 2000), GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_timeout()");
+       EVENT_BASE_CREATE;
+
+       for (i = 0; i < 10; i++) {
+         (void) snprintf(queries[i].name, sizeof(queries[i].name),
+           "slow%d.example", i);
+         queries[i].answered = &answered;
+         ASSERT_RC(getdns_general(context, queries[i].name, GETDNS_RRTYPE_A,
+           NULL, &queries[i], NULL, transport_callbackfn), GETDNS_RETURN_GOOD,
+           "Return code from getdns_general()");
+       }
+
+       RUN_EVENT_LOOP;
+       ck_assert_msg(answered == 10, "Expected 10 answers, got %d", answered);
+       CONTEXT_DESTROY;
+     }
+     END_TEST
 
-    
     
     Suite *
     getdns_context_set_dns_transport_suite (void)
@@ -172,6 +353,9 @@
       /* Positive test cases */
        TCase *tc_pos = tcase_create("Positive");
        tcase_add_test(tc_pos, getdns_context_set_dns_transport_3);
+       tcase_add_test(tc_pos, getdns_context_set_dns_transport_4);
+       tcase_add_test(tc_pos, getdns_context_set_dns_transport_5);
+      tcase_add_test(tc_pos, getdns_context_set_dns_transport_6);
       
        suite_add_tcase(s, tc_pos);
 
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _check_getdns_context_set_edns_size_negotiation_h_
+#define _check_getdns_context_set_edns_size_negotiation_h_
+
+    /*
+     **************************************************************************
+     *                                                                        *
+     *  T E S T S  F O R  G E T D N S _ C O N T E X T _ S E T _ E D N S _     *
+     *  S I Z E _ N E G O T I A T I O N                                       *
+     *                                                                        *
+     **************************************************************************
+    */
+
+     START_TEST (getdns_context_set_edns_size_negotiation_1)
+     {
+      /*
+       *  context = NULL
+       *  expect:  GETDNS_RETURN_INVALID_PARAMETER
+       */
+       ASSERT_RC(getdns_context_set_edns_size_negotiation(NULL, 4096),
+         GETDNS_RETURN_INVALID_PARAMETER,
+         "Return code from getdns_context_set_edns_size_negotiation()");
+     }
+     END_TEST
+
+     START_TEST (getdns_context_set_edns_size_negotiation_2)
+     {
+      /*
+       *  max_size = 100, below the 512 of plain DNS
+       *  expect:  GETDNS_RETURN_INVALID_PARAMETER
+       */
+       struct getdns_context *context = NULL;
+
+       CONTEXT_CREATE(TRUE);
+       ASSERT_RC(getdns_context_set_edns_size_negotiation(context, 100),
+         GETDNS_RETURN_INVALID_PARAMETER,
+         "Return code from getdns_context_set_edns_size_negotiation()");
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     START_TEST (getdns_context_set_edns_size_negotiation_3)
+     {
+      /*
+       *  negotiate up to 4096 with an upstream that loses all queries,
+       *  for requests that time out after a retry
+       *  expect:  the size advertised goes down from 1232 to 512
+       */
+       struct mock_upstream_config dropping = { .loss_permille = 1000 };
+       struct getdns_context *context = NULL;
+       void* eventloop = NULL;
+       uint16_t port;
+       int calls = 0, i;
+
+       ck_assert_msg(mock_upstream_start(&dropping, &port) == 0,
+         "Could not start the upstream");
+       /* where the native stub is not available */
+       if (!(context = stub_context_create(&port, 1)))
+         return;
+       ASSERT_RC(getdns_context_set_timeout(context, 1000), GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_timeout()");
+       ASSERT_RC(getdns_context_set_edns_size_negotiation(context, 4096),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_edns_size_negotiation()");
+       EVENT_BASE_CREATE;
+
+       for (i = 0; i < 3; i++)
+         ASSERT_RC(getdns_general(context, "lost.example", GETDNS_RRTYPE_A,
+           NULL, &calls, NULL, count_callbackfn), GETDNS_RETURN_GOOD,
+           "Return code from getdns_general()");
+       ck_assert_msg(upstream_stat(context, port, "edns_size") == 1232,
+         "Expected to start with 1232, got %d",
+         (int) upstream_stat(context, port, "edns_size"));
+
+       RUN_EVENT_LOOP;
+       ck_assert_msg(calls == 3, "Expected 3 callbacks, got %d", calls);
+       ck_assert_msg(upstream_stat(context, port, "edns_size") == 512,
+         "Expected to go down to 512, got %d",
+         (int) upstream_stat(context, port, "edns_size"));
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     START_TEST (getdns_context_set_edns_size_negotiation_4)
+     {
+      /*
+       *  negotiate up to 4096 with an upstream that truncates all answers
+       *  over UDP, for 8 requests that fall back to TCP
+       *  expect:  the size advertised goes up from 1232 to 1452 with the
+       *           8th truncated answer, all of which are counted
+       */
+       struct mock_upstream_config truncating = { .truncate_permille = 1000 };
+       struct getdns_context *context = NULL;
+       void* eventloop = NULL;
+       uint16_t port;
+       int calls = 0, i;
+
+       ck_assert_msg(mock_upstream_start(&truncating, &port) == 0,
+         "Could not start the upstream");
+       /* where the native stub is not available */
+       if (!(context = stub_context_create(&port, 1)))
+         return;
+       ASSERT_RC(getdns_context_set_edns_size_negotiation(context, 4096),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_edns_size_negotiation()");
+       EVENT_BASE_CREATE;
+
+       for (i = 0; i < 8; i++)
+         ASSERT_RC(getdns_general(context, "truncated.example",
+           GETDNS_RRTYPE_A, NULL, &calls, NULL, count_callbackfn),
+           GETDNS_RETURN_GOOD, "Return code from getdns_general()");
+
+       RUN_EVENT_LOOP;
+       ck_assert_msg(calls == 8, "Expected 8 callbacks, got %d", calls);
+       ck_assert_msg(upstream_stat(context, port, "truncated") == 8,
+         "Expected 8 truncated answers, got %d",
+         (int) upstream_stat(context, port, "truncated"));
+       ck_assert_msg(upstream_stat(context, port, "edns_size") == 1452,
+         "Expected to go up to 1452, got %d",
+         (int) upstream_stat(context, port, "edns_size"));
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     Suite *
+     getdns_context_set_edns_size_negotiation_suite (void)
+     {
+       Suite *s = suite_create ("getdns_context_set_edns_size_negotiation()");
+
+       /* Negative test caseis */
+       TCase *tc_neg = tcase_create("Negative");
+       tcase_add_test(tc_neg, getdns_context_set_edns_size_negotiation_1);
+       tcase_add_test(tc_neg, getdns_context_set_edns_size_negotiation_2);
+       suite_add_tcase(s, tc_neg);
+
+       /* Positive test cases */
+       TCase *tc_pos = tcase_create("Positive");
+       tcase_add_test(tc_pos, getdns_context_set_edns_size_negotiation_3);
+       tcase_add_test(tc_pos, getdns_context_set_edns_size_negotiation_4);
+       suite_add_tcase(s, tc_pos);
+
+       return s;
+     }
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _check_getdns_context_set_follow_system_files_h_
+#define _check_getdns_context_set_follow_system_files_h_
+
+    /*
+     **************************************************************************
+     *                                                                        *
+     *  T E S T S  F O R  G E T D N S _ C O N T E X T _ S E T _ F O L L O W  *
+     *  _ S Y S T E M _ F I L E S                                             *
+     *                                                                        *
+     **************************************************************************
+    */
+
+     START_TEST (getdns_context_set_follow_system_files_1)
+     {
+      /*
+       *  context = NULL
+       *  expect:  GETDNS_RETURN_INVALID_PARAMETER
+       */
+       ASSERT_RC(getdns_context_set_follow_system_files(NULL, 1),
+         GETDNS_RETURN_INVALID_PARAMETER,
+         "Return code from getdns_context_set_follow_system_files()");
+     }
+     END_TEST
+
+     START_TEST (getdns_context_set_follow_system_files_2)
+     {
+      /*
+       *  follow the system files, resolve "localhost", and stop following
+       *  expect:  GETDNS_RETURN_GOOD for all, also when enabled twice
+       */
+       struct getdns_context *context = NULL;
+       struct getdns_dict *response = NULL;
+
+       CONTEXT_CREATE(TRUE);
+       ASSERT_RC(getdns_context_set_follow_system_files(context, 1),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_follow_system_files()");
+       ASSERT_RC(getdns_context_set_follow_system_files(context, 1),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_follow_system_files()");
+       ASSERT_RC(getdns_address_sync(context, "localhost", NULL, &response),
+         GETDNS_RETURN_GOOD, "Return code from getdns_address_sync()");
+       getdns_dict_destroy(response);
+       ASSERT_RC(getdns_context_set_follow_system_files(context, 0),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_follow_system_files()");
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     START_TEST (getdns_context_set_follow_system_files_3)
+     {
+      /*
+       *  destroy a context while it follows the system files
+       *  expect:  the watcher is stopped with the context
+       */
+       struct getdns_context *context = NULL;
+
+       CONTEXT_CREATE(TRUE);
+       ASSERT_RC(getdns_context_set_follow_system_files(context, 1),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_follow_system_files()");
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     Suite *
+     getdns_context_set_follow_system_files_suite (void)
+     {
+       Suite *s = suite_create ("getdns_context_set_follow_system_files()");
+
+       /* Negative test caseis */
+       TCase *tc_neg = tcase_create("Negative");
+       tcase_add_test(tc_neg, getdns_context_set_follow_system_files_1);
+       suite_add_tcase(s, tc_neg);
+
+       /* Positive test cases */
+       TCase *tc_pos = tcase_create("Positive");
+       tcase_add_test(tc_pos, getdns_context_set_follow_system_files_2);
+       tcase_add_test(tc_pos, getdns_context_set_follow_system_files_3);
+       suite_add_tcase(s, tc_pos);
+
+       return s;
+     }
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _check_getdns_context_set_hedged_queries_h_
+#define _check_getdns_context_set_hedged_queries_h_
+
+    /*
+     **************************************************************************
+     *                                                                        *
+     *  T E S T S  F O R  G E T D N S _ C O N T E X T _ S E T _ H E D G E D  *
+     *  _ Q U E R I E S                                                       *
+     *                                                                        *
+     **************************************************************************
+    */
+
+     START_TEST (getdns_context_set_hedged_queries_1)
+     {
+      /*
+       *  context = NULL
+       *  expect:  GETDNS_RETURN_INVALID_PARAMETER
+       */
+       ASSERT_RC(getdns_context_set_hedged_queries(NULL, 95, 50),
+         GETDNS_RETURN_INVALID_PARAMETER,
+         "Return code from getdns_context_set_hedged_queries()");
+     }
+     END_TEST
+
+     START_TEST (getdns_context_set_hedged_queries_2)
+     {
+      /*
+       *  percentile = 100, and max_permille = 1001
+       *  expect:  GETDNS_RETURN_INVALID_PARAMETER for both
+       */
+       struct getdns_context *context = NULL;
+
+       CONTEXT_CREATE(TRUE);
+       ASSERT_RC(getdns_context_set_hedged_queries(context, 100, 50),
+         GETDNS_RETURN_INVALID_PARAMETER,
+         "Return code from getdns_context_set_hedged_queries()");
+       ASSERT_RC(getdns_context_set_hedged_queries(context, 95, 1001),
+         GETDNS_RETURN_INVALID_PARAMETER,
+         "Return code from getdns_context_set_hedged_queries()");
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     START_TEST (getdns_context_set_hedged_queries_3)
+     {
+      /*
+       *  a fast and a slow upstream, hedging at the median round trip
+       *  time, with requests made in rounds: the first ones measure the
+       *  round trip times, and of the later ones those sent to the slow
+       *  upstream to see if it got faster are not answered in time
+       *  expect:  hedges are sent to the fast upstream, and all requests
+       *           are answered
+       */
+       struct mock_upstream_config fast = { 0 };
+       struct mock_upstream_config slow = { .latency_ms = 200 };
+       struct getdns_context *context = NULL;
+       void* eventloop = NULL;
+       uint16_t ports[2];
+       int calls = 0, i, j;
+
+       ck_assert_msg(mock_upstream_start(&fast, &ports[0]) == 0 &&
+         mock_upstream_start(&slow, &ports[1]) == 0,
+         "Could not start the upstreams");
+       /* where the native stub is not available */
+       if (!(context = stub_context_create(ports, 2)))
+         return;
+       ASSERT_RC(getdns_context_set_hedged_queries(context, 50, 1000),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_hedged_queries()");
+       EVENT_BASE_CREATE;
+
+       for (i = 0; i < 30; i++) {
+         for (j = 0; j < 10; j++)
+           ASSERT_RC(getdns_general(context, "hedged.example", GETDNS_RRTYPE_A,
+             NULL, &calls, NULL, count_callbackfn), GETDNS_RETURN_GOOD,
+             "Return code from getdns_general()");
+         RUN_EVENT_LOOP;
+       }
+       ck_assert_msg(calls == 300, "Expected 300 callbacks, got %d", calls);
+       ck_assert_msg(upstream_stat(context, ports[0], "hedges") > 0,
+         "Expected hedges to the fast upstream");
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     Suite *
+     getdns_context_set_hedged_queries_suite (void)
+     {
+       Suite *s = suite_create ("getdns_context_set_hedged_queries()");
+
+       /* Negative test caseis */
+       TCase *tc_neg = tcase_create("Negative");
+       tcase_add_test(tc_neg, getdns_context_set_hedged_queries_1);
+       tcase_add_test(tc_neg, getdns_context_set_hedged_queries_2);
+       suite_add_tcase(s, tc_neg);
+
+       /* Positive test cases */
+       TCase *tc_pos = tcase_create("Positive");
+       tcase_add_test(tc_pos, getdns_context_set_hedged_queries_3);
+       suite_add_tcase(s, tc_pos);
+
+       return s;
+     }
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _check_getdns_context_set_native_stub_h_
+#define _check_getdns_context_set_native_stub_h_
+
+    /*
+     **************************************************************************
+     *                                                                        *
+     *  T E S T S  F O R  G E T D N S _ C O N T E X T _ S E T _ N A T I V E  *
+     *  _ S T U B                                                             *
+     *                                                                        *
+     **************************************************************************
+    */
+
+     START_TEST (getdns_context_set_native_stub_1)
+     {
+      /*
+       *  context = NULL
+       *  expect:  GETDNS_RETURN_INVALID_PARAMETER
+       */
+       ASSERT_RC(getdns_context_set_native_stub(NULL, 1),
+         GETDNS_RETURN_INVALID_PARAMETER,
+         "Return code from getdns_context_set_native_stub()");
+     }
+     END_TEST
+
+     START_TEST (getdns_context_set_native_stub_2)
+     {
+      /*
+       *  disable the native stub, which is always possible
+       *  expect:  GETDNS_RETURN_GOOD
+       */
+       struct getdns_context *context = NULL;
+
+       CONTEXT_CREATE(TRUE);
+       ASSERT_RC(getdns_context_set_native_stub(context, 0),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_native_stub()");
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     START_TEST (getdns_context_set_native_stub_3)
+     {
+      /*
+       *  enable the native stub in stub mode, and destroy the context
+       *  expect:  GETDNS_RETURN_GOOD where the native stub is available,
+       *           and its sockets are closed with the context
+       */
+       struct getdns_context *context = NULL;
+       getdns_return_t r;
+
+       CONTEXT_CREATE(TRUE);
+       ASSERT_RC(getdns_context_set_resolution_type(context,
+         GETDNS_RESOLUTION_STUB), GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_resolution_type()");
+       r = getdns_context_set_native_stub(context, 1);
+       ck_assert_msg(r == GETDNS_RETURN_GOOD ||
+         r == GETDNS_RETURN_GENERIC_ERROR,
+         "Return code from getdns_context_set_native_stub() was %d", r);
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     START_TEST (getdns_context_set_native_stub_4)
+     {
+      /*
+       *  a fast and a slow upstream, with requests made in rounds so the
+       *  round trip times measured in one are used in the next
+       *  expect:  both in the upstream_stats, with the faster one having
+       *           the lower srtt and answering most of the queries
+       */
+       struct mock_upstream_config fast = { 0 };
+       struct mock_upstream_config slow = { .latency_ms = 150 };
+       struct getdns_context *context = NULL;
+       void* eventloop = NULL;
+       uint16_t ports[2];
+       uint32_t fast_answers, slow_answers;
+       int calls = 0, i, j;
+
+       ck_assert_msg(mock_upstream_start(&fast, &ports[0]) == 0 &&
+         mock_upstream_start(&slow, &ports[1]) == 0,
+         "Could not start the upstreams");
+       /* where the native stub is not available */
+       if (!(context = stub_context_create(ports, 2)))
+         return;
+       EVENT_BASE_CREATE;
+
+       for (i = 0; i < 10; i++) {
+         for (j = 0; j < 10; j++)
+           ASSERT_RC(getdns_general(context, "stats.example", GETDNS_RRTYPE_A,
+             NULL, &calls, NULL, count_callbackfn), GETDNS_RETURN_GOOD,
+             "Return code from getdns_general()");
+         RUN_EVENT_LOOP;
+       }
+       ck_assert_msg(calls == 100, "Expected 100 callbacks, got %d", calls);
+
+       ck_assert_msg(upstream_stat(context, ports[0], "srtt") <
+         upstream_stat(context, ports[1], "srtt"),
+         "Expected the fast upstream to have the lower srtt");
+       fast_answers = upstream_stat(context, ports[0], "answers");
+       slow_answers = upstream_stat(context, ports[1], "answers");
+       ck_assert_msg(fast_answers > 2 * slow_answers,
+         "Expected the fast upstream to be preferred, it answered %d "
+         "and the slow one %d", (int) fast_answers, (int) slow_answers);
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     Suite *
+     getdns_context_set_native_stub_suite (void)
+     {
+       Suite *s = suite_create ("getdns_context_set_native_stub()");
+
+       /* Negative test caseis */
+       TCase *tc_neg = tcase_create("Negative");
+       tcase_add_test(tc_neg, getdns_context_set_native_stub_1);
+       suite_add_tcase(s, tc_neg);
+
+       /* Positive test cases */
+       TCase *tc_pos = tcase_create("Positive");
+       tcase_add_test(tc_pos, getdns_context_set_native_stub_2);
+       tcase_add_test(tc_pos, getdns_context_set_native_stub_3);
+       tcase_add_test(tc_pos, getdns_context_set_native_stub_4);
+       suite_add_tcase(s, tc_pos);
+
+       return s;
+     }
+
+#endif
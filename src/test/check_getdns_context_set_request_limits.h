@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _check_getdns_context_set_request_limits_h_
+#define _check_getdns_context_set_request_limits_h_
+
+    /*
+     **************************************************************************
+     *                                                                        *
+     *  T E S T S  F O R  G E T D N S _ C O N T E X T _ S E T _ R E Q U E S T *
+     *  _ L I M I T S                                                         *
+     *                                                                        *
+     **************************************************************************
+    */
+
+     START_TEST (getdns_context_set_request_limits_1)
+     {
+      /*
+       *  context = NULL
+       *  expect:  GETDNS_RETURN_INVALID_PARAMETER
+       */
+       ASSERT_RC(getdns_context_set_request_limits(NULL, 100, 10, 10, 10),
+         GETDNS_RETURN_INVALID_PARAMETER,
+         "Return code from getdns_context_set_request_limits()");
+     }
+     END_TEST
+
+     START_TEST (getdns_context_set_request_limits_2)
+     {
+      /*
+       *  qps = 100 with a burst of 0, no request could start
+       *  expect:  GETDNS_RETURN_INVALID_PARAMETER
+       */
+       struct getdns_context *context = NULL;
+
+       CONTEXT_CREATE(TRUE);
+       ASSERT_RC(getdns_context_set_request_limits(context, 100, 0, 0, 0),
+         GETDNS_RETURN_INVALID_PARAMETER,
+         "Return code from getdns_context_set_request_limits()");
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     START_TEST (getdns_context_set_request_limits_3)
+     {
+      /*
+       *  1 request in flight and 1 waiting, a third one is rejected
+       *  expect:  GETDNS_RETURN_GOOD twice, GETDNS_RETURN_GENERIC_ERROR,
+       *           "requests_rejected" 1, and none in flight when done
+       */
+       struct getdns_context *context = NULL;
+       void* eventloop = NULL;
+       getdns_transaction_t transaction_id = 0;
+       struct getdns_dict *info = NULL;
+       uint32_t rejected = 0, in_flight = 0;
+
+       CONTEXT_CREATE(TRUE);
+       EVENT_BASE_CREATE;
+       ASSERT_RC(getdns_context_set_request_limits(context, 0, 0, 1, 1),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_request_limits()");
+
+       ASSERT_RC(getdns_address(context, "localhost", NULL,
+         assert_noerror, &transaction_id, callbackfn),
+         GETDNS_RETURN_GOOD, "Return code from getdns_address()");
+       ASSERT_RC(getdns_address(context, "localhost", NULL,
+         assert_noerror, &transaction_id, callbackfn),
+         GETDNS_RETURN_GOOD, "Return code from getdns_address()");
+       ASSERT_RC(getdns_address(context, "localhost", NULL,
+         assert_noerror, &transaction_id, callbackfn),
+         GETDNS_RETURN_GENERIC_ERROR, "Return code from getdns_address()");
+
+       info = getdns_context_get_api_information(context);
+       ck_assert_msg(info != NULL,
+         "getdns_context_get_api_information() returned NULL");
+       ASSERT_RC(getdns_dict_get_int(info, "requests_rejected", &rejected),
+         GETDNS_RETURN_GOOD, "Return code from getdns_dict_get_int()");
+       ck_assert_msg(rejected == 1, "Expected 1 rejected, got %d", rejected);
+       getdns_dict_destroy(info);
+
+       RUN_EVENT_LOOP;
+       /* the rejected one does not keep a slot */
+       info = getdns_context_get_api_information(context);
+       ck_assert_msg(info != NULL,
+         "getdns_context_get_api_information() returned NULL");
+       ASSERT_RC(getdns_dict_get_int(info, "requests_in_flight", &in_flight),
+         GETDNS_RETURN_GOOD, "Return code from getdns_dict_get_int()");
+       ck_assert_msg(in_flight == 0, "Expected 0 in flight, got %d",
+         in_flight);
+       getdns_dict_destroy(info);
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     Suite *
+     getdns_context_set_request_limits_suite (void)
+     {
+       Suite *s = suite_create ("getdns_context_set_request_limits()");
+
+       /* Negative test caseis */
+       TCase *tc_neg = tcase_create("Negative");
+       tcase_add_test(tc_neg, getdns_context_set_request_limits_1);
+       tcase_add_test(tc_neg, getdns_context_set_request_limits_2);
+       suite_add_tcase(s, tc_neg);
+
+       /* Positive test cases */
+       TCase *tc_pos = tcase_create("Positive");
+       tcase_add_test(tc_pos, getdns_context_set_request_limits_3);
+       suite_add_tcase(s, tc_pos);
+
+       return s;
+     }
+
+#endif
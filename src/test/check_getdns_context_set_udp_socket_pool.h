@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _check_getdns_context_set_udp_socket_pool_h_
+#define _check_getdns_context_set_udp_socket_pool_h_
+
+    /*
+     **************************************************************************
+     *                                                                        *
+     *  T E S T S  F O R  G E T D N S _ C O N T E X T _ S E T _ U D P _      *
+     *  S O C K E T _ P O O L                                                 *
+     *                                                                        *
+     **************************************************************************
+    */
+
+     START_TEST (getdns_context_set_udp_socket_pool_1)
+     {
+      /*
+       *  context = NULL
+       *  expect:  GETDNS_RETURN_INVALID_PARAMETER
+       */
+       ASSERT_RC(getdns_context_set_udp_socket_pool(NULL, 4, 10000),
+         GETDNS_RETURN_INVALID_PARAMETER,
+         "Return code from getdns_context_set_udp_socket_pool()");
+     }
+     END_TEST
+
+     START_TEST (getdns_context_set_udp_socket_pool_2)
+     {
+      /*
+       *  pool_size = 0, and pool_size = 65
+       *  expect:  GETDNS_RETURN_INVALID_PARAMETER for both
+       */
+       struct getdns_context *context = NULL;
+
+       CONTEXT_CREATE(TRUE);
+       ASSERT_RC(getdns_context_set_udp_socket_pool(context, 0, 10000),
+         GETDNS_RETURN_INVALID_PARAMETER,
+         "Return code from getdns_context_set_udp_socket_pool()");
+       ASSERT_RC(getdns_context_set_udp_socket_pool(context, 65, 10000),
+         GETDNS_RETURN_INVALID_PARAMETER,
+         "Return code from getdns_context_set_udp_socket_pool()");
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     START_TEST (getdns_context_set_udp_socket_pool_3)
+     {
+      /*
+       *  a pool of 2 sockets rotated every millisecond, and an upstream
+       *  answering after 100 ms, with requests sent in rounds, each of
+       *  which rotates a socket: all sockets are retired while their
+       *  queries are in flight
+       *  expect:  the answers are taken from the retired sockets, so every
+       *           query is sent and answered once
+       */
+       struct mock_upstream_config slow = { .latency_ms = 100 };
+       struct getdns_context *context = NULL;
+       void* eventloop = NULL;
+       uint16_t port;
+       int calls = 0, i, j;
+
+       ck_assert_msg(mock_upstream_start(&slow, &port) == 0,
+         "Could not start the upstream");
+       /* where the native stub is not available */
+       if (!(context = stub_context_create(&port, 1)))
+         return;
+       ASSERT_RC(getdns_context_set_udp_socket_pool(context, 2, 1),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_udp_socket_pool()");
+       EVENT_BASE_CREATE;
+
+       for (i = 0; i < 5; i++) {
+         for (j = 0; j < 10; j++)
+           ASSERT_RC(getdns_general(context, "pool.example", GETDNS_RRTYPE_A,
+             NULL, &calls, NULL, count_callbackfn), GETDNS_RETURN_GOOD,
+             "Return code from getdns_general()");
+         /* sent, after a socket is rotated */
+         (void) usleep(5000);
+         ASSERT_RC(getdns_context_process_async(context), GETDNS_RETURN_GOOD,
+           "Return code from getdns_context_process_async()");
+       }
+       RUN_EVENT_LOOP;
+       ck_assert_msg(calls == 50, "Expected 50 callbacks, got %d", calls);
+       ck_assert_msg(upstream_stat(context, port, "queries_sent") == 50,
+         "Expected every query to be sent once, got %d",
+         (int) upstream_stat(context, port, "queries_sent"));
+       ck_assert_msg(upstream_stat(context, port, "answers") == 50,
+         "Expected every query to be answered, got %d",
+         (int) upstream_stat(context, port, "answers"));
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     Suite *
+     getdns_context_set_udp_socket_pool_suite (void)
+     {
+       Suite *s = suite_create ("getdns_context_set_udp_socket_pool()");
+
+       /* Negative test caseis */
+       TCase *tc_neg = tcase_create("Negative");
+       tcase_add_test(tc_neg, getdns_context_set_udp_socket_pool_1);
+       tcase_add_test(tc_neg, getdns_context_set_udp_socket_pool_2);
+       suite_add_tcase(s, tc_neg);
+
+       /* Positive test cases */
+       TCase *tc_pos = tcase_create("Positive");
+       tcase_add_test(tc_pos, getdns_context_set_udp_socket_pool_3);
+       suite_add_tcase(s, tc_pos);
+
+       return s;
+     }
+
+#endif
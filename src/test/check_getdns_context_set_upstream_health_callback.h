@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _check_getdns_context_set_upstream_health_callback_h_
+#define _check_getdns_context_set_upstream_health_callback_h_
+
+    /*
+     **************************************************************************
+     *                                                                        *
+     *  T E S T S  F O R  G E T D N S _ C O N T E X T _ S E T _             *
+     *  U P S T R E A M _ H E A L T H _ C A L L B A C K                       *
+     *                                                                        *
+     **************************************************************************
+    */
+
+     void upstream_health_callbackfn(struct getdns_context *context,
+       struct getdns_dict *upstream, int healthy, void *userarg)
+     {
+       (*(int *) userarg)++;
+     }
+
+     /* the last health change reported, of the upstream on port */
+     struct upstream_health {
+       int calls;
+       int healthy;
+       uint32_t port;
+     };
+
+     void upstream_health_recordfn(struct getdns_context *context,
+       struct getdns_dict *upstream, int healthy, void *userarg)
+     {
+       struct upstream_health *health = (struct upstream_health *) userarg;
+
+       health->calls++;
+       health->healthy = healthy;
+       ASSERT_RC(getdns_dict_get_int(upstream, "port", &health->port),
+         GETDNS_RETURN_GOOD, "Return code from getdns_dict_get_int()");
+     }
+
+     START_TEST (getdns_context_set_upstream_health_callback_1)
+     {
+      /*
+       *  context = NULL
+       *  expect:  GETDNS_RETURN_INVALID_PARAMETER
+       */
+       ASSERT_RC(getdns_context_set_upstream_health_callback(NULL,
+         upstream_health_callbackfn, NULL),
+         GETDNS_RETURN_INVALID_PARAMETER,
+         "Return code from getdns_context_set_upstream_health_callback()");
+     }
+     END_TEST
+
+     START_TEST (getdns_context_set_upstream_health_callback_2)
+     {
+      /*
+       *  set the callback, resolve "localhost" and unset it
+       *  expect:  GETDNS_RETURN_GOOD, and no call for healthy upstreams
+       */
+       struct getdns_context *context = NULL;
+       struct getdns_dict *response = NULL;
+       int calls = 0;
+
+       CONTEXT_CREATE(TRUE);
+       ASSERT_RC(getdns_context_set_upstream_health_callback(context,
+         upstream_health_callbackfn, &calls), GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_upstream_health_callback()");
+       ASSERT_RC(getdns_address_sync(context, "localhost", NULL, &response),
+         GETDNS_RETURN_GOOD, "Return code from getdns_address_sync()");
+       getdns_dict_destroy(response);
+       ASSERT_RC(getdns_context_set_upstream_health_callback(context,
+         NULL, NULL), GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_upstream_health_callback()");
+       ck_assert_msg(calls == 0, "Expected no health changes, got %d", calls);
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     START_TEST (getdns_context_set_upstream_health_callback_3)
+     {
+      /*
+       *  two upstreams answering SERVFAIL after as long as the first retry
+       *  waits, so that answers come in for queries already queued again
+       *  expect:  every request is called back, without the queue looping
+       */
+       struct mock_upstream_config servfail = { .latency_ms = 400,
+         .rcode = GETDNS_RCODE_SERVFAIL };
+       struct getdns_context *context = NULL;
+       void* eventloop = NULL;
+       uint16_t ports[2];
+       int calls = 0, i;
+
+       ck_assert_msg(mock_upstream_start(&servfail, &ports[0]) == 0 &&
+         mock_upstream_start(&servfail, &ports[1]) == 0,
+         "Could not start the upstreams");
+       /* where the native stub is not available */
+       if (!(context = stub_context_create(ports, 2)))
+         return;
+       ASSERT_RC(getdns_context_set_timeout(context, 3000), GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_timeout()");
+       EVENT_BASE_CREATE;
+
+       for (i = 0; i < 50; i++)
+         ASSERT_RC(getdns_general(context, "servfail.example", GETDNS_RRTYPE_A,
+           NULL, &calls, NULL, count_callbackfn), GETDNS_RETURN_GOOD,
+           "Return code from getdns_general()");
+
+       RUN_EVENT_LOOP;
+       ck_assert_msg(calls == 50, "Expected 50 callbacks, got %d", calls);
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     START_TEST (getdns_context_set_upstream_health_callback_4)
+     {
+      /*
+       *  an upstream that drops all queries, which time out
+       *  expect:  the callback is called with healthy 0 for it, and it is
+       *           not healthy in the upstream_stats
+       */
+       struct mock_upstream_config dropping = { .loss_permille = 1000 };
+       struct upstream_health health = { 0, 1, 0 };
+       struct getdns_context *context = NULL;
+       void* eventloop = NULL;
+       uint16_t port;
+       int calls = 0, i;
+
+       ck_assert_msg(mock_upstream_start(&dropping, &port) == 0,
+         "Could not start the upstream");
+       /* where the native stub is not available */
+       if (!(context = stub_context_create(&port, 1)))
+         return;
+       ASSERT_RC(getdns_context_set_timeout(context, 1000), GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_timeout()");
+       ASSERT_RC(getdns_context_set_upstream_health_callback(context,
+         upstream_health_recordfn, &health), GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_upstream_health_callback()");
+       EVENT_BASE_CREATE;
+
+       for (i = 0; i < 10; i++)
+         ASSERT_RC(getdns_general(context, "dropped.example", GETDNS_RRTYPE_A,
+           NULL, &calls, NULL, count_callbackfn), GETDNS_RETURN_GOOD,
+           "Return code from getdns_general()");
+
+       RUN_EVENT_LOOP;
+       ck_assert_msg(calls == 10, "Expected 10 callbacks, got %d", calls);
+       ck_assert_msg(health.calls > 0, "Expected a health change");
+       ck_assert_msg(health.healthy == 0 && health.port == port,
+         "Expected the upstream to be reported down");
+       ck_assert_msg(upstream_stat(context, port, "healthy") == 0,
+         "Expected the upstream not to be healthy");
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     Suite *
+     getdns_context_set_upstream_health_callback_suite (void)
+     {
+       Suite *s = suite_create ("getdns_context_set_upstream_health_callback()");
+
+       /* Negative test caseis */
+       TCase *tc_neg = tcase_create("Negative");
+       tcase_add_test(tc_neg, getdns_context_set_upstream_health_callback_1);
+       suite_add_tcase(s, tc_neg);
+
+       /* Positive test cases */
+       TCase *tc_pos = tcase_create("Positive");
+       tcase_add_test(tc_pos, getdns_context_set_upstream_health_callback_2);
+       tcase_add_test(tc_pos, getdns_context_set_upstream_health_callback_3);
+       tcase_add_test(tc_pos, getdns_context_set_upstream_health_callback_4);
+       suite_add_tcase(s, tc_pos);
+
+       return s;
+     }
+
+#endif
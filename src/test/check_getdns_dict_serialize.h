@@ -0,0 +1,324 @@
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _check_getdns_dict_serialize_h_
+#define _check_getdns_dict_serialize_h_
+
+    /*
+     **************************************************************************
+     *                                                                        *
+     *  T E S T S  F O R  G E T D N S _ D I C T _ S E R I A L I Z E  A N D    *
+     *  G E T D N S _ D I C T _ D E S E R I A L I Z E                         *
+     *                                                                        *
+     **************************************************************************
+    */
+
+    #define SERIALIZE_FUZZ_ROUNDS 200
+    #define SERIALIZE_BUF_LEN 1048576
+
+    static void serialize_fuzz_fill_dict(struct getdns_dict *dict, int depth);
+
+    /*
+     *  serialize_fuzz_fill_list fills list with random
+     *  ints, bindatas, dicts and lists.
+     */
+    static void
+    serialize_fuzz_fill_list(struct getdns_list *list, int depth)
+    {
+      struct getdns_dict *child_dict = NULL;
+      struct getdns_list *child_list = NULL;
+      uint8_t data[300];
+      struct getdns_bindata bindata = { 0, data };
+      size_t i, j;
+      size_t n = rand() % 6;
+
+      for(i = 0; i < n; i++)
+      {
+        switch (rand() % (depth < 3 ? 4 : 2))
+        {
+          case 0:
+            ASSERT_RC(getdns_list_set_int(list, i, (uint32_t)rand() * (rand() % 3)),
+              GETDNS_RETURN_GOOD, "Return code from getdns_list_set_int()");
+            break;
+          case 1:
+            bindata.size = rand() % 2 ? rand() % 20 : rand() % sizeof(data);
+            for(j = 0; j < bindata.size; j++)
+              data[j] = rand();
+            ASSERT_RC(getdns_list_set_bindata(list, i, &bindata),
+              GETDNS_RETURN_GOOD, "Return code from getdns_list_set_bindata()");
+            break;
+          case 2:
+            DICT_CREATE(child_dict);
+            serialize_fuzz_fill_dict(child_dict, depth + 1);
+            ASSERT_RC(getdns_list_set_dict(list, i, child_dict),
+              GETDNS_RETURN_GOOD, "Return code from getdns_list_set_dict()");
+            DICT_DESTROY(child_dict);
+            break;
+          default:
+            LIST_CREATE(child_list);
+            serialize_fuzz_fill_list(child_list, depth + 1);
+            ASSERT_RC(getdns_list_set_list(list, i, child_list),
+              GETDNS_RETURN_GOOD, "Return code from getdns_list_set_list()");
+            LIST_DESTROY(child_list);
+            break;
+        }
+      }
+    }
+
+    /*
+     *  serialize_fuzz_fill_dict puts the items of a
+     *  randomly filled list in dict under random names.
+     */
+    static void
+    serialize_fuzz_fill_dict(struct getdns_dict *dict, int depth)
+    {
+      struct getdns_list *list = NULL;
+      struct getdns_dict *child_dict = NULL;
+      struct getdns_list *child_list = NULL;
+      struct getdns_bindata *bindata = NULL;
+      getdns_data_type dtype;
+      uint32_t n;
+      size_t i, length;
+      char name[8];
+
+      LIST_CREATE(list);
+      serialize_fuzz_fill_list(list, depth);
+      ASSERT_RC(getdns_list_get_length(list, &length),
+        GETDNS_RETURN_GOOD, "Return code from getdns_list_get_length()");
+
+      for(i = 0; i < length; i++)
+      {
+        snprintf(name, sizeof(name), "n%d", rand() % 100);
+        if (getdns_dict_get_data_type(dict, name, &dtype) == GETDNS_RETURN_GOOD)
+          continue;
+
+        ASSERT_RC(getdns_list_get_data_type(list, i, &dtype),
+          GETDNS_RETURN_GOOD, "Return code from getdns_list_get_data_type()");
+        switch (dtype)
+        {
+          case t_int:
+            ASSERT_RC(getdns_list_get_int(list, i, &n),
+              GETDNS_RETURN_GOOD, "Return code from getdns_list_get_int()");
+            ASSERT_RC(getdns_dict_set_int(dict, name, n),
+              GETDNS_RETURN_GOOD, "Return code from getdns_dict_set_int()");
+            break;
+          case t_bindata:
+            ASSERT_RC(getdns_list_get_bindata(list, i, &bindata),
+              GETDNS_RETURN_GOOD, "Return code from getdns_list_get_bindata()");
+            ASSERT_RC(getdns_dict_set_bindata(dict, name, bindata),
+              GETDNS_RETURN_GOOD, "Return code from getdns_dict_set_bindata()");
+            break;
+          case t_dict:
+            ASSERT_RC(getdns_list_get_dict(list, i, &child_dict),
+              GETDNS_RETURN_GOOD, "Return code from getdns_list_get_dict()");
+            ASSERT_RC(getdns_dict_set_dict(dict, name, child_dict),
+              GETDNS_RETURN_GOOD, "Return code from getdns_dict_set_dict()");
+            break;
+          default:
+            ASSERT_RC(getdns_list_get_list(list, i, &child_list),
+              GETDNS_RETURN_GOOD, "Return code from getdns_list_get_list()");
+            ASSERT_RC(getdns_dict_set_list(dict, name, child_list),
+              GETDNS_RETURN_GOOD, "Return code from getdns_dict_set_list()");
+            break;
+        }
+      }
+      LIST_DESTROY(list);
+    }
+
+    START_TEST (getdns_dict_serialize_1)
+    {
+     /*
+      *  dict = NULL
+      *  expect: GETDNS_RETURN_INVALID_PARAMETER
+      */
+      size_t buf_len = 0;
+
+      ASSERT_RC(getdns_dict_serialize(NULL, NULL, &buf_len),
+        GETDNS_RETURN_INVALID_PARAMETER, "Return code from getdns_dict_serialize()");
+    }
+    END_TEST
+
+    START_TEST (getdns_dict_serialize_2)
+    {
+     /*
+      *  buffer too small
+      *  expect: GETDNS_RETURN_MEMORY_ERROR
+      *          buf_len set to the required size
+      */
+      struct getdns_dict *dict = NULL;
+      uint8_t buf[8];
+      size_t buf_len = sizeof(buf);
+
+      DICT_CREATE(dict);
+      ASSERT_RC(getdns_dict_set_int(dict, "int", 1000), GETDNS_RETURN_GOOD,
+        "Return code from getdns_dict_set_int()");
+
+      ASSERT_RC(getdns_dict_serialize(dict, buf, &buf_len),
+        GETDNS_RETURN_MEMORY_ERROR, "Return code from getdns_dict_serialize()");
+
+      ck_assert_msg(buf_len == 8 + 1 + 4 + 3,
+        "Expected buf_len == 16, got %d", (int)buf_len);
+
+      DICT_DESTROY(dict);
+    }
+    END_TEST
+
+    START_TEST (getdns_dict_serialize_3)
+    {
+     /*
+      *  Truncate and corrupt a valid serialization
+      *  expect: no successful deserialization of truncated input
+      *          no crashes on corrupted input
+      */
+      struct getdns_dict *dict = NULL;
+      struct getdns_dict *result = NULL;
+      uint8_t *buf = malloc(SERIALIZE_BUF_LEN);
+      size_t buf_len;
+      size_t i, j;
+
+      srand(2014);
+      for(i = 0; i < SERIALIZE_FUZZ_ROUNDS; i++)
+      {
+        DICT_CREATE(dict);
+        serialize_fuzz_fill_dict(dict, 0);
+        buf_len = SERIALIZE_BUF_LEN;
+        ASSERT_RC(getdns_dict_serialize(dict, buf, &buf_len),
+          GETDNS_RETURN_GOOD, "Return code from getdns_dict_serialize()");
+
+        ck_assert_msg(getdns_dict_deserialize(NULL, buf, rand() % buf_len,
+          rand() % 2, &result) == GETDNS_RETURN_INVALID_PARAMETER,
+          "Expected truncated input to be rejected");
+
+        for(j = 0; j < 4; j++)
+          buf[rand() % buf_len] = rand();
+        if (getdns_dict_deserialize(NULL, buf, buf_len, rand() % 2, &result)
+          == GETDNS_RETURN_GOOD)
+          getdns_dict_destroy(result);
+
+        DICT_DESTROY(dict);
+      }
+      free(buf);
+    }
+    END_TEST
+
+    START_TEST (getdns_dict_serialize_4)
+    {
+     /*
+      *  Round trip random dicts, copying and in place
+      *  expect: GETDNS_RETURN_GOOD
+      *          the serialization of the result is identical
+      */
+      struct getdns_dict *dict = NULL;
+      struct getdns_dict *result = NULL;
+      uint8_t *buf = malloc(SERIALIZE_BUF_LEN);
+      uint8_t *buf2 = malloc(SERIALIZE_BUF_LEN);
+      size_t buf_len, buf2_len;
+      size_t i;
+      int in_place;
+
+      srand(2014);
+      for(i = 0; i < SERIALIZE_FUZZ_ROUNDS; i++)
+      {
+        DICT_CREATE(dict);
+        serialize_fuzz_fill_dict(dict, 0);
+        buf_len = SERIALIZE_BUF_LEN;
+        ASSERT_RC(getdns_dict_serialize(dict, buf, &buf_len),
+          GETDNS_RETURN_GOOD, "Return code from getdns_dict_serialize()");
+
+        for(in_place = 0; in_place < 2; in_place++)
+        {
+          ASSERT_RC(getdns_dict_deserialize(NULL, buf, buf_len, in_place, &result),
+            GETDNS_RETURN_GOOD, "Return code from getdns_dict_deserialize()");
+
+          buf2_len = SERIALIZE_BUF_LEN;
+          ASSERT_RC(getdns_dict_serialize(result, buf2, &buf2_len),
+            GETDNS_RETURN_GOOD, "Return code from getdns_dict_serialize()");
+
+          ck_assert_msg(buf_len == buf2_len && memcmp(buf, buf2, buf_len) == 0,
+            "Expected round trip %d to give an identical serialization", (int)i);
+
+          DICT_DESTROY(result);
+        }
+        DICT_DESTROY(dict);
+      }
+      free(buf);
+      free(buf2);
+    }
+    END_TEST
+
+    START_TEST (getdns_dict_serialize_5)
+    {
+     /*
+      *  a valid serialization with a non-zero reserved header octet
+      *  expect: GETDNS_RETURN_INVALID_PARAMETER
+      *          GETDNS_RETURN_GOOD once the octet is zero again
+      */
+      struct getdns_dict *dict = NULL;
+      struct getdns_dict *result = NULL;
+      uint8_t buf[16];
+      size_t buf_len = sizeof(buf);
+
+      DICT_CREATE(dict);
+      ASSERT_RC(getdns_dict_set_int(dict, "int", 1000), GETDNS_RETURN_GOOD,
+        "Return code from getdns_dict_set_int()");
+      ASSERT_RC(getdns_dict_serialize(dict, buf, &buf_len),
+        GETDNS_RETURN_GOOD, "Return code from getdns_dict_serialize()");
+
+      buf[3] = 1;
+      ASSERT_RC(getdns_dict_deserialize(NULL, buf, buf_len, 0, &result),
+        GETDNS_RETURN_INVALID_PARAMETER,
+        "Return code from getdns_dict_deserialize()");
+
+      buf[3] = 0;
+      ASSERT_RC(getdns_dict_deserialize(NULL, buf, buf_len, 0, &result),
+        GETDNS_RETURN_GOOD, "Return code from getdns_dict_deserialize()");
+      DICT_DESTROY(result);
+      DICT_DESTROY(dict);
+    }
+    END_TEST
+
+    Suite *
+    getdns_dict_serialize_suite (void)
+    {
+      Suite *s = suite_create ("getdns_dict_serialize()");
+
+      /* Negative test caseis */
+      TCase *tc_neg = tcase_create("Negative");
+      tcase_add_test(tc_neg, getdns_dict_serialize_1);
+      tcase_add_test(tc_neg, getdns_dict_serialize_2);
+      tcase_add_test(tc_neg, getdns_dict_serialize_3);
+      tcase_add_test(tc_neg, getdns_dict_serialize_5);
+      suite_add_tcase(s, tc_neg);
+
+      /* Positive test cases */
+      TCase *tc_pos = tcase_create("Positive");
+      tcase_add_test(tc_pos, getdns_dict_serialize_4);
+      suite_add_tcase(s, tc_pos);
+
+      return s;
+    }
+
+#endif
@@ -162,6 +162,93 @@
     }
     END_TEST
     
+    /* memory functions that count the allocations and frees in the
+       size_t[2] userarg points to */
+    static void *
+    set_bindata_malloc(void *userarg, size_t size)
+    {
+      ((size_t *) userarg)[0]++;
+      return malloc(size);
+    }
+
+    static void *
+    set_bindata_realloc(void *userarg, void *ptr, size_t size)
+    {
+      if (!ptr)
+        ((size_t *) userarg)[0]++;
+      return realloc(ptr, size);
+    }
+
+    static void
+    set_bindata_free(void *userarg, void *ptr)
+    {
+      if (ptr)
+        ((size_t *) userarg)[1]++;
+      free(ptr);
+    }
+
+    START_TEST (getdns_dict_set_bindata_6)
+    {
+     /*
+      *  copies of 4, 16 and 65536 octets, in a dict with counted memory
+      *  functions, each set under a name that already holds an int
+      *  Call getdns_dict_get_bindata() for each of them
+      *  expect:  GETDNS_RETURN_GOOD (all functions)
+      *           one allocation per copy, with the data right after the
+      *           bindata, equal to what was set
+      *           as many frees as allocations after the dict is destroyed
+      */
+      size_t sizes[3] = { 4, 16, 65536 };
+      char names[3][8] = { "small", "medium", "large" };
+      size_t counts[2] = { 0, 0 };
+      struct getdns_dict *this_dict = NULL;
+      struct getdns_bindata bindata;
+      struct getdns_bindata *retrieved_bindata = NULL;
+      uint8_t *data;
+      size_t allocations, i;
+
+      this_dict = getdns_dict_create_with_extended_memory_functions(
+        counts, set_bindata_malloc, set_bindata_realloc, set_bindata_free);
+      ck_assert_msg(this_dict != NULL, "Dict creation failed");
+      ck_assert_msg((data = malloc(sizes[2])) != NULL, "malloc failed");
+      for (i = 0; i < sizes[2]; i++)
+        data[i] = (uint8_t) (i * 7);
+
+      for (i = 0; i < 3; i++) {
+        ASSERT_RC(getdns_dict_set_int(this_dict, names[i], 0),
+          GETDNS_RETURN_GOOD, "Return code from getdns_dict_set_int()");
+        allocations = counts[0];
+        bindata.size = sizes[i];
+        bindata.data = data;
+        ASSERT_RC(getdns_dict_set_bindata(this_dict, names[i], &bindata),
+          GETDNS_RETURN_GOOD, "Return code from getdns_dict_set_bindata()");
+        ck_assert_msg(counts[0] == allocations + 1,
+          "Expected one allocation for %d octets, got %d", (int) sizes[i],
+          (int) (counts[0] - allocations));
+      }
+
+      for (i = 0; i < 3; i++) {
+        ASSERT_RC(getdns_dict_get_bindata(this_dict, names[i],
+          &retrieved_bindata), GETDNS_RETURN_GOOD,
+          "Return code from getdns_dict_get_bindata()");
+        ck_assert_msg(retrieved_bindata->size == sizes[i],
+          "Expected retrieved bindata size == %d, got: %d",
+          (int) sizes[i], (int) retrieved_bindata->size);
+        ck_assert_msg(retrieved_bindata->data ==
+          (uint8_t *) (retrieved_bindata + 1),
+          "Expected the data of %s inline with its bindata", names[i]);
+        ck_assert_msg(memcmp(retrieved_bindata->data, data, sizes[i]) == 0,
+          "Expected the data of %s to be copied", names[i]);
+      }
+
+      DICT_DESTROY(this_dict);
+      free(data);
+      ck_assert_msg(counts[0] == counts[1],
+        "Expected as many frees as allocations, got %d and %d",
+        (int) counts[1], (int) counts[0]);
+    }
+    END_TEST
+    
     Suite *
     getdns_dict_set_bindata_suite (void)
     {
@@ -178,6 +265,7 @@
       TCase *tc_pos = tcase_create("Positive");
       tcase_add_test(tc_pos, getdns_dict_set_bindata_4);
       tcase_add_test(tc_pos, getdns_dict_set_bindata_5);
+      tcase_add_test(tc_pos, getdns_dict_set_bindata_6);
       suite_add_tcase(s, tc_pos);
     
       return s;
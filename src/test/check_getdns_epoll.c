@@ -0,0 +1,65 @@
+/**
+ * \file
+ * \brief Public interfaces to getdns, include in your application to use getdns API.
+ *
+ * This source was taken from the original pseudo-implementation by
+ * Paul Hoffman.
+ */
+
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "check_getdns_eventloop.h"
+
+#include <getdns/getdns_ext_epoll.h>
+#include <check.h>
+#include "check_getdns_common.h"
+
+/* one loop drives the contexts of all tests */
+static struct getdns_epoll* epoll_loop = NULL;
+
+void run_event_loop_impl(struct getdns_context* context, void* eventloop) {
+    struct getdns_epoll* loop = (struct getdns_epoll*) eventloop;
+    getdns_epoll_run(loop);
+}
+
+void run_event_loop_once_impl(struct getdns_context* context, void* eventloop,
+    int timeout) {
+    getdns_epoll_run_once((struct getdns_epoll*) eventloop, timeout);
+}
+
+void* create_eventloop_impl(struct getdns_context* context) {
+    if (!epoll_loop) {
+        ASSERT_RC(getdns_epoll_create(&epoll_loop),
+            GETDNS_RETURN_GOOD,
+            "Return code from getdns_epoll_create()");
+    }
+    ASSERT_RC(getdns_extension_set_epoll(context, epoll_loop),
+        GETDNS_RETURN_GOOD,
+        "Return code from getdns_extension_set_epoll()");
+    return epoll_loop;
+}
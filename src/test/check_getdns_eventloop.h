@@ -42,5 +42,9 @@
 struct getdns_context* context;
 void run_event_loop_impl(struct getdns_context* context, void* eventloop);
 void* create_eventloop_impl(struct getdns_context* context);
+/* handle the events and timeouts that are due, waiting at most timeout
+   milliseconds for them */
+void run_event_loop_once_impl(struct getdns_context* context, void* eventloop,
+    int timeout);
 
 #endif
@@ -27,6 +27,8 @@
 #ifndef _check_getdns_general_sync_h_
 #define _check_getdns_general_sync_h_
 
+#include <pthread.h>
+
     /*
      **************************************************************************
      *                                                                        *
@@ -318,6 +320,91 @@
      }
      END_TEST
      
+     /* resolves "localhost" ten times on the shared context in arg */
+     static void *
+     getdns_general_sync_thread(void *arg)
+     {
+       struct getdns_context *context = (struct getdns_context *) arg;
+       struct getdns_dict *response;
+       long failures = 0;
+       int i;
+
+       for (i = 0; i < 10; i++) {
+         response = NULL;
+         if (getdns_general_sync(context, "localhost", GETDNS_RRTYPE_A,
+             NULL, &response) != GETDNS_RETURN_GOOD || !response)
+           failures++;
+         getdns_dict_destroy(response);
+       }
+       return (void *) failures;
+     }
+
+     START_TEST (getdns_general_sync_13)
+     {
+      /*
+       *  four threads calling getdns_general_sync on the same context
+       *  expect: all calls return GETDNS_RETURN_GOOD with a response
+       */
+       struct getdns_context *context = NULL;
+       pthread_t threads[4];
+       void *failures;
+       int i;
+
+       CONTEXT_CREATE(TRUE);
+
+       for (i = 0; i < 4; i++) {
+         ck_assert_msg(pthread_create(&threads[i], NULL,
+           getdns_general_sync_thread, context) == 0,
+           "Could not create thread %d", i);
+       }
+       for (i = 0; i < 4; i++) {
+         (void) pthread_join(threads[i], &failures);
+         ck_assert_msg(failures == NULL,
+           "Thread %d had %ld failed calls", i, (long) failures);
+       }
+
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     START_TEST (getdns_general_sync_14)
+     {
+      /*
+       *  four threads calling getdns_general_sync while the context is
+       *  reconfigured, which sets up a new unbound context each time
+       *  expect: all calls return GETDNS_RETURN_GOOD with a response,
+       *    on the unbound context they started on
+       */
+       struct getdns_context *context = NULL;
+       pthread_t threads[4];
+       void *failures;
+       int i;
+
+       CONTEXT_CREATE(TRUE);
+
+       for (i = 0; i < 4; i++) {
+         ck_assert_msg(pthread_create(&threads[i], NULL,
+           getdns_general_sync_thread, context) == 0,
+           "Could not create thread %d", i);
+       }
+       for (i = 0; i < 20; i++) {
+         ASSERT_RC(getdns_context_set_dnssec_allowed_skew(context, i),
+           GETDNS_RETURN_GOOD,
+           "Return code from getdns_context_set_dnssec_allowed_skew()");
+         /* deletes the old ones without requests */
+         ASSERT_RC(getdns_context_process_async(context), GETDNS_RETURN_GOOD,
+           "Return code from getdns_context_process_async()");
+       }
+       for (i = 0; i < 4; i++) {
+         (void) pthread_join(threads[i], &failures);
+         ck_assert_msg(failures == NULL,
+           "Thread %d had %ld failed calls", i, (long) failures);
+       }
+
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
      Suite *
      getdns_general_sync_suite (void)
      {
@@ -341,6 +428,8 @@
        tcase_add_test(tc_pos, getdns_general_sync_10);
        tcase_add_test(tc_pos, getdns_general_sync_11);
        tcase_add_test(tc_pos, getdns_general_sync_12);
+       tcase_add_test(tc_pos, getdns_general_sync_13);
+       tcase_add_test(tc_pos, getdns_general_sync_14);
        suite_add_tcase(s, tc_pos);
      
        return s;
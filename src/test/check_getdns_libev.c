@@ -45,6 +45,19 @@ void run_event_loop_impl(struct getdns_context* context, void* eventloop) {
     ev_run(loop, 0);
 }
 
+static void wakeup_cb(struct ev_loop* loop, ev_timer* w, int revents) {
+}
+
+void run_event_loop_once_impl(struct getdns_context* context, void* eventloop,
+    int timeout) {
+    struct ev_loop* loop = (struct ev_loop*) eventloop;
+    ev_timer wakeup;
+    ev_timer_init(&wakeup, wakeup_cb, timeout / 1000.0, 0.);
+    ev_timer_start(loop, &wakeup);
+    ev_run(loop, EVRUN_ONCE);
+    ev_timer_stop(loop, &wakeup);
+}
+
 void* create_eventloop_impl(struct getdns_context* context) {
     struct ev_loop* result = ev_default_loop(0);
     ck_assert_msg(result != NULL, "EV loop creation failed");
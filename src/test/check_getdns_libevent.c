@@ -45,6 +45,29 @@ void run_event_loop_impl(struct getdns_context* context, void* eventloop) {
     event_base_dispatch(base);
 }
 
+static void wakeup_cb(int fd, short what, void* arg) {
+}
+
+void run_event_loop_once_impl(struct getdns_context* context, void* eventloop,
+    int timeout) {
+    struct event_base* base = (struct event_base*) eventloop;
+    struct timeval tv = { timeout / 1000, (timeout % 1000) * 1000 };
+#ifdef HAVE_EVENT2_EVENT_H
+    struct event* wakeup = evtimer_new(base, wakeup_cb, NULL);
+#else
+    struct event wakeup_event;
+    struct event* wakeup = &wakeup_event;
+    evtimer_set(wakeup, wakeup_cb, NULL);
+    event_base_set(base, wakeup);
+#endif
+    evtimer_add(wakeup, &tv);
+    event_base_loop(base, EVLOOP_ONCE);
+    evtimer_del(wakeup);
+#ifdef HAVE_EVENT2_EVENT_H
+    event_free(wakeup);
+#endif
+}
+
 void* create_eventloop_impl(struct getdns_context* context) {
     struct event_base* result = event_base_new();
     ck_assert_msg(result != NULL, "Event base creation failed");
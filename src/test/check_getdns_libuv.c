@@ -45,6 +45,20 @@ void run_event_loop_impl(struct getdns_context* context, void* eventloop) {
     uv_run(loop, UV_RUN_DEFAULT);
 }
 
+static void wakeup_cb(uv_timer_t* handle, int status) {
+}
+
+void run_event_loop_once_impl(struct getdns_context* context, void* eventloop,
+    int timeout) {
+    uv_loop_t* loop = (uv_loop_t*) eventloop;
+    uv_timer_t wakeup;
+    uv_timer_init(loop, &wakeup);
+    uv_timer_start(&wakeup, wakeup_cb, timeout, 0);
+    uv_run(loop, UV_RUN_ONCE);
+    /* the handle lives on the stack, so see it closed */
+    uv_close((uv_handle_t*) &wakeup, NULL);
+    uv_run(loop, UV_RUN_NOWAIT);
+}
 
 void* create_eventloop_impl(struct getdns_context* context) {
     uv_loop_t* result = uv_default_loop();
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _check_getdns_list_create_with_capacity_h_
+#define _check_getdns_list_create_with_capacity_h_
+
+    /*
+     **************************************************************************
+     *                                                                        *
+     *  T E S T S  F O R  G E T D N S _ L I S T _ C R E A T E _              *
+     *  W I T H _ C A P A C I T Y                                             *
+     *                                                                        *
+     **************************************************************************
+    */
+
+    START_TEST (getdns_list_create_with_capacity_1)
+    {
+     /*
+      *  context = NULL, capacity = 0
+      *  expect: an empty list
+      */
+      struct getdns_list *list = NULL;
+      size_t length;
+
+      list = getdns_list_create_with_capacity(NULL, 0);
+      ck_assert_msg(list != NULL, "getdns_list_create_with_capacity() failed");
+
+      ASSERT_RC(getdns_list_get_length(list, &length),
+        GETDNS_RETURN_GOOD, "Return code from getdns_list_get_length()");
+
+      ck_assert_msg(length == 0, "Expected length == 0, got %d", (int)length);
+
+      LIST_DESTROY(list);
+    }
+    END_TEST
+
+    START_TEST (getdns_list_create_with_capacity_2)
+    {
+     /*
+      *  Create a list with capacity 3 and add more items than the hint.
+      *  expect: GETDNS_RETURN_GOOD
+      *          all items retrievable in order
+      */
+      struct getdns_context *context = NULL;
+      struct getdns_list *list = NULL;
+      size_t i;
+      size_t length;
+      uint32_t value;
+
+      CONTEXT_CREATE(TRUE);
+
+      list = getdns_list_create_with_capacity(context, 3);
+      ck_assert_msg(list != NULL, "getdns_list_create_with_capacity() failed");
+
+      for(i = 0; i < 100; i++)
+      {
+        ASSERT_RC(getdns_list_set_int(list, i, i), GETDNS_RETURN_GOOD,
+          "Return code from getdns_list_set_int()");
+      }
+
+      ASSERT_RC(getdns_list_get_length(list, &length),
+        GETDNS_RETURN_GOOD, "Return code from getdns_list_get_length()");
+
+      ck_assert_msg(length == 100, "Expected length == 100, got %d", (int)length);
+
+      for(i = 0; i < 100; i++)
+      {
+        ASSERT_RC(getdns_list_get_int(list, i, &value), GETDNS_RETURN_GOOD,
+          "Return code from getdns_list_get_int()");
+        ck_assert_msg(value == i, "Expected value == %d, got %d",
+          (int)i, (int)value);
+      }
+
+      LIST_DESTROY(list);
+      CONTEXT_DESTROY;
+    }
+    END_TEST
+
+    Suite *
+    getdns_list_create_with_capacity_suite (void)
+    {
+      Suite *s = suite_create ("getdns_list_create_with_capacity()");
+
+      /* Positive test cases */
+      TCase *tc_pos = tcase_create("Positive");
+      tcase_add_test(tc_pos, getdns_list_create_with_capacity_1);
+      tcase_add_test(tc_pos, getdns_list_create_with_capacity_2);
+      suite_add_tcase(s, tc_pos);
+
+      return s;
+    }
+
+#endif
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _check_getdns_path_h_
+#define _check_getdns_path_h_
+
+    /*
+     **************************************************************************
+     *                                                                        *
+     *  T E S T S  F O R  G E T D N S _ P A T H _ C O M P I L E  A N D        *
+     *  G E T D N S _ P A T H _ E X T R A C T                                 *
+     *                                                                        *
+     **************************************************************************
+    */
+
+    START_TEST (getdns_path_1)
+    {
+     /*
+      *  expression does not start with a '/'
+      *  expect: GETDNS_RETURN_INVALID_PARAMETER
+      */
+      struct getdns_path *path = NULL;
+
+      ASSERT_RC(getdns_path_compile(NULL, "answer/0", &path),
+        GETDNS_RETURN_INVALID_PARAMETER, "Return code from getdns_path_compile()");
+    }
+    END_TEST
+
+    START_TEST (getdns_path_2)
+    {
+     /*
+      *  expression contains an invalid escape
+      *  expect: GETDNS_RETURN_INVALID_PARAMETER
+      */
+      struct getdns_path *path = NULL;
+
+      ASSERT_RC(getdns_path_compile(NULL, "/answer~2", &path),
+        GETDNS_RETURN_INVALID_PARAMETER, "Return code from getdns_path_compile()");
+    }
+    END_TEST
+
+    START_TEST (getdns_path_3)
+    {
+     /*
+      *  path = NULL
+      *  expect: GETDNS_RETURN_INVALID_PARAMETER
+      */
+      struct getdns_dict *dict = NULL;
+      getdns_path_match matches[1];
+      size_t count;
+
+      DICT_CREATE(dict);
+
+      ASSERT_RC(getdns_path_extract(NULL, dict, matches, 1, &count),
+        GETDNS_RETURN_INVALID_PARAMETER, "Return code from getdns_path_extract()");
+
+      DICT_DESTROY(dict);
+    }
+    END_TEST
+
+    START_TEST (getdns_path_4)
+    {
+     /*
+      *  Create a dict with a list of 3 dicts, of which the first and the
+      *  last have an "ipv4_address", and extract them with a wildcard.
+      *  expect: GETDNS_RETURN_GOOD
+      *          count = 2, both bindatas in list order
+      *          count = 2 as well when only room for 1 match
+      */
+      struct getdns_dict *dict = NULL;
+      struct getdns_dict *rdata = NULL;
+      struct getdns_list *list = NULL;
+      struct getdns_path *path = NULL;
+      getdns_path_match matches[3];
+      uint8_t address[4] = { 192, 0, 2, 0 };
+      struct getdns_bindata bindata = { 4, address };
+      size_t i;
+      size_t count;
+
+      DICT_CREATE(dict);
+      LIST_CREATE(list);
+
+      for(i = 0; i < 3; i++)
+      {
+        DICT_CREATE(rdata);
+        address[3] = i;
+        if (i != 1)
+        {
+          ASSERT_RC(getdns_dict_set_bindata(rdata, "ipv4_address", &bindata),
+            GETDNS_RETURN_GOOD, "Return code from getdns_dict_set_bindata()");
+        }
+        ASSERT_RC(getdns_list_set_dict(list, i, rdata), GETDNS_RETURN_GOOD,
+          "Return code from getdns_list_set_dict()");
+        DICT_DESTROY(rdata);
+      }
+      ASSERT_RC(getdns_dict_set_list(dict, "answer", list), GETDNS_RETURN_GOOD,
+        "Return code from getdns_dict_set_list()");
+
+      ASSERT_RC(getdns_path_compile(NULL, "/answer/*/ipv4_address", &path),
+        GETDNS_RETURN_GOOD, "Return code from getdns_path_compile()");
+
+      ASSERT_RC(getdns_path_extract(path, dict, matches, 3, &count),
+        GETDNS_RETURN_GOOD, "Return code from getdns_path_extract()");
+
+      ck_assert_msg(count == 2, "Expected count == 2, got %d", (int)count);
+      ck_assert_msg(matches[0].dtype == t_bindata && matches[1].dtype == t_bindata,
+        "Expected matches of type t_bindata");
+      ck_assert_msg(matches[0].data.bindata->data[3] == 0 &&
+        matches[1].data.bindata->data[3] == 2,
+        "Expected addresses 192.0.2.0 and 192.0.2.2");
+
+      ASSERT_RC(getdns_path_extract(path, dict, matches, 1, &count),
+        GETDNS_RETURN_GOOD, "Return code from getdns_path_extract()");
+
+      ck_assert_msg(count == 2, "Expected count == 2, got %d", (int)count);
+
+      getdns_path_destroy(path);
+      LIST_DESTROY(list);
+      DICT_DESTROY(dict);
+    }
+    END_TEST
+
+    START_TEST (getdns_path_5)
+    {
+     /*
+      *  Select a list item by index and a dict member with an escaped name
+      *  expect: GETDNS_RETURN_GOOD
+      *          count = 1, n = 42
+      */
+      struct getdns_dict *dict = NULL;
+      struct getdns_dict *item = NULL;
+      struct getdns_list *list = NULL;
+      struct getdns_path *path = NULL;
+      getdns_path_match match;
+      size_t count;
+
+      DICT_CREATE(dict);
+      LIST_CREATE(list);
+      DICT_CREATE(item);
+
+      ASSERT_RC(getdns_dict_set_int(item, "a/b", 42), GETDNS_RETURN_GOOD,
+        "Return code from getdns_dict_set_int()");
+      ASSERT_RC(getdns_list_set_dict(list, 0, item), GETDNS_RETURN_GOOD,
+        "Return code from getdns_list_set_dict()");
+      ASSERT_RC(getdns_dict_set_list(dict, "list", list), GETDNS_RETURN_GOOD,
+        "Return code from getdns_dict_set_list()");
+
+      ASSERT_RC(getdns_path_compile(NULL, "/list/0/a~1b", &path),
+        GETDNS_RETURN_GOOD, "Return code from getdns_path_compile()");
+
+      ASSERT_RC(getdns_path_extract(path, dict, &match, 1, &count),
+        GETDNS_RETURN_GOOD, "Return code from getdns_path_extract()");
+
+      ck_assert_msg(count == 1, "Expected count == 1, got %d", (int)count);
+      ck_assert_msg(match.dtype == t_int && match.data.n == 42,
+        "Expected int 42, got type %d", match.dtype);
+
+      getdns_path_destroy(path);
+      DICT_DESTROY(item);
+      LIST_DESTROY(list);
+      DICT_DESTROY(dict);
+    }
+    END_TEST
+
+    START_TEST (getdns_path_6)
+    {
+     /*
+      *  expression has an index that does not fit a size_t
+      *  expect: GETDNS_RETURN_INVALID_PARAMETER
+      */
+      struct getdns_path *path = NULL;
+
+      ASSERT_RC(getdns_path_compile(NULL,
+        "/answer/999999999999999999999999999999", &path),
+        GETDNS_RETURN_INVALID_PARAMETER, "Return code from getdns_path_compile()");
+    }
+    END_TEST
+
+    Suite *
+    getdns_path_suite (void)
+    {
+      Suite *s = suite_create ("getdns_path_extract()");
+
+      /* Negative test caseis */
+      TCase *tc_neg = tcase_create("Negative");
+      tcase_add_test(tc_neg, getdns_path_1);
+      tcase_add_test(tc_neg, getdns_path_2);
+      tcase_add_test(tc_neg, getdns_path_3);
+      tcase_add_test(tc_neg, getdns_path_6);
+      suite_add_tcase(s, tc_neg);
+
+      /* Positive test cases */
+      TCase *tc_pos = tcase_create("Positive");
+      tcase_add_test(tc_pos, getdns_path_4);
+      tcase_add_test(tc_pos, getdns_path_5);
+      suite_add_tcase(s, tc_pos);
+
+      return s;
+    }
+
+#endif
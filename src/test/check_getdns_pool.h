@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _check_getdns_pool_h_
+#define _check_getdns_pool_h_
+
+#include <poll.h>
+
+    /*
+     **************************************************************************
+     *                                                                        *
+     *  T E S T S  F O R  G E T D N S _ P O O L                              *
+     *                                                                        *
+     **************************************************************************
+    */
+
+     START_TEST (getdns_pool_1)
+     {
+      /*
+       *  num_workers = 0
+       *  expect:  GETDNS_RETURN_INVALID_PARAMETER
+       */
+       getdns_pool *pool = NULL;
+
+       ASSERT_RC(getdns_pool_create(&pool, 0, TRUE, NULL, NULL),
+         GETDNS_RETURN_INVALID_PARAMETER,
+         "Return code from getdns_pool_create()");
+     }
+     END_TEST
+
+     START_TEST (getdns_pool_2)
+     {
+      /*
+       *  pool = NULL
+       *  expect:  GETDNS_RETURN_INVALID_PARAMETER
+       */
+       ASSERT_RC(getdns_pool_submit_general(NULL, NULL, "localhost",
+         GETDNS_RRTYPE_A, NULL, NULL),
+         GETDNS_RETURN_INVALID_PARAMETER,
+         "Return code from getdns_pool_submit_general()");
+     }
+     END_TEST
+
+     START_TEST (getdns_pool_3)
+     {
+      /*
+       *  submit eight lookups of "localhost" to a pool of two workers
+       *  expect:  eight COMPLETE completions with their userarg on the
+       *           completion queue of the pool
+       */
+       getdns_pool *pool = NULL;
+       getdns_completion_queue *queue;
+       getdns_completion_t completions[8];
+       int userargs[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+       struct pollfd pfd;
+       size_t count, i;
+       int completed = 0;
+
+       ASSERT_RC(getdns_pool_create(&pool, 2, TRUE, NULL, NULL),
+         GETDNS_RETURN_GOOD, "Return code from getdns_pool_create()");
+       queue = getdns_pool_get_completion_queue(pool);
+       ck_assert_msg(queue != NULL, "Expected a completion queue");
+
+       for (i = 0; i < 8; i++) {
+         ASSERT_RC(getdns_pool_submit_general(pool, NULL, "localhost",
+           GETDNS_RRTYPE_A, NULL, &userargs[i]),
+           GETDNS_RETURN_GOOD, "Return code from getdns_pool_submit_general()");
+       }
+       pfd.fd = getdns_completion_queue_fd(queue);
+       pfd.events = POLLIN;
+       while (completed < 8) {
+         ck_assert_msg(poll(&pfd, 1, 5000) == 1,
+           "Expected completions within 5 seconds");
+         ASSERT_RC(getdns_completion_queue_poll(queue, completions, 8, &count),
+           GETDNS_RETURN_GOOD,
+           "Return code from getdns_completion_queue_poll()");
+         for (i = 0; i < count; i++, completed++) {
+           ck_assert_msg(completions[i].callback_type == GETDNS_CALLBACK_COMPLETE,
+             "Expected a COMPLETE completion, got %d", completions[i].callback_type);
+           (*(int *) completions[i].userarg)++;
+           getdns_dict_destroy(completions[i].response);
+         }
+       }
+       for (i = 0; i < 8; i++) {
+         ck_assert_msg(userargs[i] == 1,
+           "Expected one completion for request %d, got %d", (int) i, userargs[i]);
+       }
+       getdns_pool_destroy(pool);
+     }
+     END_TEST
+
+     /* sets up a worker context to resolve in stub with the upstream on
+      * port *userarg, over UDP and with a timeout of 500 ms
+      */
+     static getdns_return_t
+     pool_stub_setup(getdns_context *context, void *userarg)
+     {
+       uint8_t localhost[4] = { 127, 0, 0, 1 };
+       struct getdns_bindata address_data = { 4, localhost };
+       struct getdns_list *upstreams = getdns_list_create();
+       struct getdns_dict *upstream = getdns_dict_create();
+       getdns_return_t r = GETDNS_RETURN_MEMORY_ERROR;
+
+       if (upstreams && upstream &&
+         !(r = getdns_dict_util_set_string(upstream, "address_type", "IPv4")) &&
+         !(r = getdns_dict_set_bindata(upstream, "address_data", &address_data)) &&
+         !(r = getdns_dict_set_int(upstream, "port", *(uint16_t *) userarg)) &&
+         !(r = getdns_list_set_dict(upstreams, 0, upstream)) &&
+         !(r = getdns_context_set_resolution_type(context,
+           GETDNS_RESOLUTION_STUB)) &&
+         !(r = getdns_context_set_upstream_recursive_servers(context,
+           upstreams)) &&
+         !(r = getdns_context_set_dns_transport(context,
+           GETDNS_TRANSPORT_UDP_ONLY)))
+         r = getdns_context_set_timeout(context, 500);
+
+       getdns_dict_destroy(upstream);
+       getdns_list_destroy(upstreams);
+       return r;
+     }
+
+     START_TEST (getdns_pool_4)
+     {
+      /*
+       *  submit two lookups to a pool of one worker, resolving in stub with
+       *  an upstream that answers no queries
+       *  expect:  two TIMEOUT completions on the completion queue of the
+       *           pool, so the worker wakes up for the timeouts
+       */
+       struct mock_upstream_config lossy = { .loss_permille = 1000 };
+       getdns_pool *pool = NULL;
+       getdns_completion_queue *queue;
+       getdns_completion_t completions[2];
+       struct pollfd pfd;
+       uint16_t port;
+       size_t count, i;
+       int completed = 0;
+
+       ck_assert_msg(mock_upstream_start(&lossy, &port) == 0,
+         "Could not start the upstream");
+       ASSERT_RC(getdns_pool_create(&pool, 1, FALSE, pool_stub_setup, &port),
+         GETDNS_RETURN_GOOD, "Return code from getdns_pool_create()");
+       queue = getdns_pool_get_completion_queue(pool);
+
+       for (i = 0; i < 2; i++) {
+         ASSERT_RC(getdns_pool_submit_general(pool, NULL, "lost.example",
+           GETDNS_RRTYPE_A, NULL, NULL),
+           GETDNS_RETURN_GOOD, "Return code from getdns_pool_submit_general()");
+       }
+       pfd.fd = getdns_completion_queue_fd(queue);
+       pfd.events = POLLIN;
+       while (completed < 2) {
+         ck_assert_msg(poll(&pfd, 1, 5000) == 1,
+           "Expected the timeouts within 5 seconds");
+         ASSERT_RC(getdns_completion_queue_poll(queue, completions, 2, &count),
+           GETDNS_RETURN_GOOD,
+           "Return code from getdns_completion_queue_poll()");
+         for (i = 0; i < count; i++, completed++) {
+           ck_assert_msg(completions[i].callback_type == GETDNS_CALLBACK_TIMEOUT,
+             "Expected a TIMEOUT completion, got %d", completions[i].callback_type);
+           getdns_dict_destroy(completions[i].response);
+         }
+       }
+       getdns_pool_destroy(pool);
+     }
+     END_TEST
+
+     Suite *
+     getdns_pool_suite (void)
+     {
+       Suite *s = suite_create ("getdns_pool");
+
+       /* Negative test caseis */
+       TCase *tc_neg = tcase_create("Negative");
+       tcase_add_test(tc_neg, getdns_pool_1);
+       tcase_add_test(tc_neg, getdns_pool_2);
+       suite_add_tcase(s, tc_neg);
+
+       /* Positive test cases */
+       TCase *tc_pos = tcase_create("Positive");
+       tcase_add_test(tc_pos, getdns_pool_3);
+       tcase_add_test(tc_pos, getdns_pool_4);
+       suite_add_tcase(s, tc_pos);
+
+       return s;
+     }
+
+#endif
@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _check_getdns_print_json_dict_h_
+#define _check_getdns_print_json_dict_h_
+
+    /*
+     **************************************************************************
+     *                                                                        *
+     *  T E S T S  F O R  G E T D N S _ P R I N T _ J S O N _ D I C T  A N D  *
+     *  G E T D N S _ W R I T E _ J S O N _ D I C T                           *
+     *                                                                        *
+     **************************************************************************
+    */
+
+    #define JSON_EXPECTED "{\"address_data\":\"192.0.2.1\"," \
+      "\"list\":[7,\"0x0001ff\"],\"name\":\"www.ex\\\\.ample.\"," \
+      "\"string\":\"say \\\"hi\\\" \\\\o/\",\"ttl\":3600}"
+
+    /*
+     *  json_test_dict creates a dict with one item
+     *  of each kind rendered by the JSON functions.
+     */
+    static struct getdns_dict *
+    json_test_dict(void)
+    {
+      struct getdns_dict *dict = NULL;
+      struct getdns_list *list = NULL;
+      uint8_t address[] = { 192, 0, 2, 1 };
+      uint8_t opaque[] = { 0, 1, 255 };
+      uint8_t name[] = "\x03www\x08""ex.ample";
+      struct getdns_bindata address_bindata = { sizeof(address), address };
+      struct getdns_bindata opaque_bindata = { sizeof(opaque), opaque };
+      struct getdns_bindata name_bindata = { sizeof(name), name };
+
+      DICT_CREATE(dict);
+      LIST_CREATE(list);
+
+      ASSERT_RC(getdns_dict_set_bindata(dict, "address_data", &address_bindata),
+        GETDNS_RETURN_GOOD, "Return code from getdns_dict_set_bindata()");
+      ASSERT_RC(getdns_list_set_int(list, 0, 7),
+        GETDNS_RETURN_GOOD, "Return code from getdns_list_set_int()");
+      ASSERT_RC(getdns_list_set_bindata(list, 1, &opaque_bindata),
+        GETDNS_RETURN_GOOD, "Return code from getdns_list_set_bindata()");
+      ASSERT_RC(getdns_dict_set_list(dict, "list", list),
+        GETDNS_RETURN_GOOD, "Return code from getdns_dict_set_list()");
+      ASSERT_RC(getdns_dict_set_bindata(dict, "name", &name_bindata),
+        GETDNS_RETURN_GOOD, "Return code from getdns_dict_set_bindata()");
+      ASSERT_RC(getdns_dict_util_set_string(dict, "string", "say \"hi\" \\o/"),
+        GETDNS_RETURN_GOOD, "Return code from getdns_dict_util_set_string()");
+      ASSERT_RC(getdns_dict_set_int(dict, "ttl", 3600),
+        GETDNS_RETURN_GOOD, "Return code from getdns_dict_set_int()");
+
+      LIST_DESTROY(list);
+      return dict;
+    }
+
+    struct json_test_output
+    {
+      char buf[512];
+      size_t len;
+      size_t max_len;
+    };
+
+    /*
+     *  json_test_write collects the output in a
+     *  json_test_output and aborts after max_len.
+     */
+    static int
+    json_test_write(void *userarg, const char *data, size_t len)
+    {
+      struct json_test_output *output = userarg;
+
+      if (output->len + len > output->max_len)
+        return 1;
+      memcpy(output->buf + output->len, data, len);
+      output->len += len;
+      return 0;
+    }
+
+    START_TEST (getdns_print_json_dict_1)
+    {
+     /*
+      *  dict = NULL
+      *  expect: GETDNS_RETURN_INVALID_PARAMETER
+      */
+      char buf[10];
+      size_t buf_len = sizeof(buf);
+
+      ASSERT_RC(getdns_print_json_dict(NULL, 0, buf, &buf_len),
+        GETDNS_RETURN_INVALID_PARAMETER, "Return code from getdns_print_json_dict()");
+    }
+    END_TEST
+
+    START_TEST (getdns_print_json_dict_2)
+    {
+     /*
+      *  buffer too small
+      *  expect: GETDNS_RETURN_MEMORY_ERROR
+      *          buf_len set to the length of the JSON
+      */
+      struct getdns_dict *dict = json_test_dict();
+      char buf[10];
+      size_t buf_len = sizeof(buf);
+
+      ASSERT_RC(getdns_print_json_dict(dict, 0, buf, &buf_len),
+        GETDNS_RETURN_MEMORY_ERROR, "Return code from getdns_print_json_dict()");
+
+      ck_assert_msg(buf_len == strlen(JSON_EXPECTED),
+        "Expected buf_len == %d, got %d", (int)strlen(JSON_EXPECTED), (int)buf_len);
+
+      DICT_DESTROY(dict);
+    }
+    END_TEST
+
+    START_TEST (getdns_print_json_dict_3)
+    {
+     /*
+      *  write callback aborts the output
+      *  expect: GETDNS_RETURN_GENERIC_ERROR
+      */
+      struct getdns_dict *dict = json_test_dict();
+      struct json_test_output output = { "", 0, 10 };
+
+      ASSERT_RC(getdns_write_json_dict(dict, 0, json_test_write, &output),
+        GETDNS_RETURN_GENERIC_ERROR, "Return code from getdns_write_json_dict()");
+
+      DICT_DESTROY(dict);
+    }
+    END_TEST
+
+    START_TEST (getdns_print_json_dict_4)
+    {
+     /*
+      *  print to a buffer
+      *  expect: GETDNS_RETURN_GOOD
+      *          addresses, names and strings in text form
+      */
+      struct getdns_dict *dict = json_test_dict();
+      char buf[512];
+      size_t buf_len = sizeof(buf);
+
+      ASSERT_RC(getdns_print_json_dict(dict, 0, buf, &buf_len),
+        GETDNS_RETURN_GOOD, "Return code from getdns_print_json_dict()");
+
+      ck_assert_msg(strcmp(buf, JSON_EXPECTED) == 0,
+        "Expected %s, got %s", JSON_EXPECTED, buf);
+      ck_assert_msg(buf_len == strlen(JSON_EXPECTED),
+        "Expected buf_len == %d, got %d", (int)strlen(JSON_EXPECTED), (int)buf_len);
+
+      DICT_DESTROY(dict);
+    }
+    END_TEST
+
+    START_TEST (getdns_print_json_dict_5)
+    {
+     /*
+      *  stream to a callback with GETDNS_JSON_BASE64
+      *  expect: GETDNS_RETURN_GOOD
+      *          opaque bindata in base64
+      */
+      struct getdns_dict *dict = json_test_dict();
+      struct json_test_output output = { "", 0, 511 };
+
+      ASSERT_RC(getdns_write_json_dict(dict, GETDNS_JSON_BASE64,
+        json_test_write, &output),
+        GETDNS_RETURN_GOOD, "Return code from getdns_write_json_dict()");
+
+      output.buf[output.len] = 0;
+      ck_assert_msg(strstr(output.buf, "[7,\"AAH/\"]") != NULL,
+        "Expected base64 AAH/ in %s", output.buf);
+
+      DICT_DESTROY(dict);
+    }
+    END_TEST
+
+    START_TEST (getdns_print_json_dict_6)
+    {
+     /*
+      *  strings and names in UTF-8, valid and not
+      *  expect: GETDNS_RETURN_GOOD
+      *          valid UTF-8 as is, octets of invalid UTF-8 in names as
+      *          \u00XX, and strings with invalid UTF-8 in hex
+      */
+      const char *expected = "{\"bad\\u00ff\":1,"
+        "\"n\xc3\xa4me\":\"caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80\","
+        "\"truncated\":\"0x636166c300\"}";
+      struct getdns_dict *dict = NULL;
+      char buf[128];
+      size_t buf_len = sizeof(buf);
+
+      DICT_CREATE(dict);
+      ASSERT_RC(getdns_dict_set_int(dict, "bad\xff", 1),
+        GETDNS_RETURN_GOOD, "Return code from getdns_dict_set_int()");
+      ASSERT_RC(getdns_dict_util_set_string(dict, "n\xc3\xa4me",
+        "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80"),
+        GETDNS_RETURN_GOOD, "Return code from getdns_dict_util_set_string()");
+      ASSERT_RC(getdns_dict_util_set_string(dict, "truncated", "caf\xc3"),
+        GETDNS_RETURN_GOOD, "Return code from getdns_dict_util_set_string()");
+
+      ASSERT_RC(getdns_print_json_dict(dict, 0, buf, &buf_len),
+        GETDNS_RETURN_GOOD, "Return code from getdns_print_json_dict()");
+
+      ck_assert_msg(strcmp(buf, expected) == 0,
+        "Expected %s, got %s", expected, buf);
+
+      DICT_DESTROY(dict);
+    }
+    END_TEST
+
+    Suite *
+    getdns_print_json_dict_suite (void)
+    {
+      Suite *s = suite_create ("getdns_print_json_dict()");
+
+      /* Negative test caseis */
+      TCase *tc_neg = tcase_create("Negative");
+      tcase_add_test(tc_neg, getdns_print_json_dict_1);
+      tcase_add_test(tc_neg, getdns_print_json_dict_2);
+      tcase_add_test(tc_neg, getdns_print_json_dict_3);
+      suite_add_tcase(s, tc_neg);
+
+      /* Positive test cases */
+      TCase *tc_pos = tcase_create("Positive");
+      tcase_add_test(tc_pos, getdns_print_json_dict_4);
+      tcase_add_test(tc_pos, getdns_print_json_dict_5);
+      tcase_add_test(tc_pos, getdns_print_json_dict_6);
+      suite_add_tcase(s, tc_pos);
+
+      return s;
+    }
+
+#endif
@@ -51,6 +51,21 @@ void run_event_loop_impl(struct getdns_context* context, void* eventloop) {
     }
 }
 
+void run_event_loop_once_impl(struct getdns_context* context, void* eventloop,
+    int timeout) {
+    struct timeval tv;
+    int fd = getdns_context_fd(context);
+    fd_set read_fds;
+    if (getdns_context_get_num_pending_requests(context, &tv) == 0 ||
+        tv.tv_sec * 1000 + tv.tv_usec / 1000 > timeout) {
+        tv.tv_sec = timeout / 1000;
+        tv.tv_usec = (timeout % 1000) * 1000;
+    }
+    FD_ZERO(&read_fds);
+    FD_SET(fd, &read_fds);
+    select(fd + 1, &read_fds, NULL, NULL, &tv);
+    getdns_context_process_async(context);
+}
 
 void* create_eventloop_impl(struct getdns_context* context) {
     return NULL;
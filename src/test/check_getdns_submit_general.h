@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _check_getdns_submit_general_h_
+#define _check_getdns_submit_general_h_
+
+#include <sys/select.h>
+#include <pthread.h>
+
+    /*
+     **************************************************************************
+     *                                                                        *
+     *  T E S T S  F O R  G E T D N S _ S U B M I T _ G E N E R A L          *
+     *                                                                        *
+     **************************************************************************
+    */
+
+     START_TEST (getdns_submit_general_1)
+     {
+      /*
+       *  context = NULL
+       *  expect:  GETDNS_RETURN_INVALID_PARAMETER
+       */
+       getdns_completion_queue *queue = NULL;
+
+       ASSERT_RC(getdns_completion_queue_create(&queue), GETDNS_RETURN_GOOD,
+         "Return code from getdns_completion_queue_create()");
+       ASSERT_RC(getdns_submit_general(NULL, queue, "localhost",
+         GETDNS_RRTYPE_A, NULL, NULL),
+         GETDNS_RETURN_INVALID_PARAMETER,
+         "Return code from getdns_submit_general()");
+       getdns_completion_queue_destroy(queue);
+     }
+     END_TEST
+
+     START_TEST (getdns_submit_general_2)
+     {
+      /*
+       *  submission queue not enabled
+       *  expect:  GETDNS_RETURN_BAD_CONTEXT and no submission fd
+       */
+       struct getdns_context *context = NULL;
+       getdns_completion_queue *queue = NULL;
+
+       CONTEXT_CREATE(TRUE);
+       ASSERT_RC(getdns_completion_queue_create(&queue), GETDNS_RETURN_GOOD,
+         "Return code from getdns_completion_queue_create()");
+       ck_assert_msg(getdns_context_submission_fd(context) == -1,
+         "Expected no submission fd");
+       ASSERT_RC(getdns_submit_general(context, queue, "localhost",
+         GETDNS_RRTYPE_A, NULL, NULL),
+         GETDNS_RETURN_BAD_CONTEXT,
+         "Return code from getdns_submit_general()");
+       getdns_completion_queue_destroy(queue);
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     START_TEST (getdns_submit_general_3)
+     {
+      /*
+       *  submit three lookups of "localhost"
+       *  expect:  three COMPLETE completions with their userarg on the
+       *           completion queue
+       */
+       struct getdns_context *context = NULL;
+       getdns_completion_queue *queue = NULL;
+       getdns_completion_t completions[3];
+       int userargs[3] = { 0, 0, 0 };
+       struct timeval tv;
+       fd_set read_fds;
+       size_t count, i;
+       int completed = 0, fd, sfd, max_fd;
+
+       CONTEXT_CREATE(TRUE);
+       ASSERT_RC(getdns_completion_queue_create(&queue), GETDNS_RETURN_GOOD,
+         "Return code from getdns_completion_queue_create()");
+       ASSERT_RC(getdns_context_set_submission_queue(context, 1),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_submission_queue()");
+       sfd = getdns_context_submission_fd(context);
+       ck_assert_msg(sfd != -1, "Expected a submission fd");
+
+       for (i = 0; i < 3; i++) {
+         ASSERT_RC(getdns_submit_general(context, queue, "localhost",
+           GETDNS_RRTYPE_A, NULL, &userargs[i]),
+           GETDNS_RETURN_GOOD, "Return code from getdns_submit_general()");
+       }
+       while (completed < 3) {
+         fd = getdns_context_fd(context);
+         max_fd = fd > sfd ? fd : sfd;
+         FD_ZERO(&read_fds);
+         FD_SET(fd, &read_fds);
+         FD_SET(sfd, &read_fds);
+         tv.tv_sec = 1;
+         tv.tv_usec = 0;
+         (void) getdns_context_get_num_pending_requests(context, &tv);
+         select(max_fd + 1, &read_fds, NULL, NULL, &tv);
+         ASSERT_RC(getdns_context_process_async(context), GETDNS_RETURN_GOOD,
+           "Return code from getdns_context_process_async()");
+
+         ASSERT_RC(getdns_completion_queue_poll(queue, completions, 3, &count),
+           GETDNS_RETURN_GOOD,
+           "Return code from getdns_completion_queue_poll()");
+         for (i = 0; i < count; i++, completed++) {
+           ck_assert_msg(completions[i].callback_type == GETDNS_CALLBACK_COMPLETE,
+             "Expected a COMPLETE completion, got %d", completions[i].callback_type);
+           (*(int *) completions[i].userarg)++;
+           getdns_dict_destroy(completions[i].response);
+         }
+       }
+       for (i = 0; i < 3; i++) {
+         ck_assert_msg(userargs[i] == 1,
+           "Expected one completion for submission %d, got %d", (int) i, userargs[i]);
+       }
+       ASSERT_RC(getdns_context_set_submission_queue(context, 0),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_submission_queue()");
+       ck_assert_msg(getdns_context_submission_fd(context) == -1,
+         "Expected no submission fd");
+       getdns_completion_queue_destroy(queue);
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     /* a thread submitting until the queue is disabled */
+     struct submit_producer {
+       struct getdns_context *context;
+       getdns_completion_queue *queue;
+       size_t submitted;
+     };
+
+     static void *
+     submit_producer_run(void *arg)
+     {
+       struct submit_producer *producer = arg;
+
+       while (producer->submitted < 100000 &&
+         getdns_submit_general(producer->context, producer->queue,
+         "localhost", GETDNS_RRTYPE_A, NULL, NULL) == GETDNS_RETURN_GOOD)
+         producer->submitted++;
+       return NULL;
+     }
+
+     START_TEST (getdns_submit_general_4)
+     {
+      /*
+       *  disable the submission queue while two threads submit to it
+       *  expect:  the threads stop with GETDNS_RETURN_BAD_CONTEXT, and
+       *           one CANCEL completion for each submission they made
+       */
+       struct getdns_context *context = NULL;
+       getdns_completion_queue *queue = NULL;
+       getdns_completion_t completions[64];
+       struct submit_producer producers[2];
+       pthread_t threads[2];
+       size_t count, submitted = 0, completed = 0, i;
+
+       CONTEXT_CREATE(TRUE);
+       ASSERT_RC(getdns_completion_queue_create(&queue), GETDNS_RETURN_GOOD,
+         "Return code from getdns_completion_queue_create()");
+       ASSERT_RC(getdns_context_set_submission_queue(context, 1),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_submission_queue()");
+
+       for (i = 0; i < 2; i++) {
+         producers[i].context = context;
+         producers[i].queue = queue;
+         producers[i].submitted = 0;
+         ck_assert_msg(pthread_create(&threads[i], NULL, submit_producer_run,
+           &producers[i]) == 0, "Could not create a thread");
+       }
+       (void) usleep(10000);
+       ASSERT_RC(getdns_context_set_submission_queue(context, 0),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_submission_queue()");
+       for (i = 0; i < 2; i++) {
+         (void) pthread_join(threads[i], NULL);
+         submitted += producers[i].submitted;
+       }
+
+       do {
+         ASSERT_RC(getdns_completion_queue_poll(queue, completions, 64, &count),
+           GETDNS_RETURN_GOOD,
+           "Return code from getdns_completion_queue_poll()");
+         for (i = 0; i < count; i++, completed++)
+           ck_assert_msg(completions[i].callback_type == GETDNS_CALLBACK_CANCEL,
+             "Expected a CANCEL completion, got %d",
+             completions[i].callback_type);
+       } while (count);
+       ck_assert_msg(completed == submitted,
+         "Expected %d completions, got %d", (int) submitted, (int) completed);
+
+       getdns_completion_queue_destroy(queue);
+       CONTEXT_DESTROY;
+     }
+     END_TEST
+
+     /* memory functions counting the frees into *userarg */
+     static void *
+     submit_general_malloc(void *userarg, size_t size)
+     {
+       return malloc(size);
+     }
+
+     static void *
+     submit_general_realloc(void *userarg, void *ptr, size_t size)
+     {
+       return realloc(ptr, size);
+     }
+
+     static void
+     submit_general_free(void *userarg, void *ptr)
+     {
+       if (ptr)
+         (*(size_t *) userarg)++;
+       free(ptr);
+     }
+
+     START_TEST (getdns_submit_general_5)
+     {
+      /*
+       *  destroy a completion queue holding the completions of three
+       *  lookups of "localhost", after the context that answered them
+       *  expect:  the responses are freed by the queue
+       */
+       struct getdns_context *context = NULL;
+       getdns_completion_queue *queue = NULL;
+       struct timeval tv;
+       fd_set read_fds;
+       size_t frees = 0, before, i;
+       int fd, sfd, qfd, max_fd, ready = 0;
+
+       ASSERT_RC(getdns_context_create_with_extended_memory_functions(
+         &context, TRUE, &frees, submit_general_malloc,
+         submit_general_realloc, submit_general_free),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_create_with_extended_memory_functions()");
+       ASSERT_RC(getdns_completion_queue_create(&queue), GETDNS_RETURN_GOOD,
+         "Return code from getdns_completion_queue_create()");
+       ASSERT_RC(getdns_context_set_submission_queue(context, 1),
+         GETDNS_RETURN_GOOD,
+         "Return code from getdns_context_set_submission_queue()");
+       sfd = getdns_context_submission_fd(context);
+       qfd = getdns_completion_queue_fd(queue);
+
+       for (i = 0; i < 3; i++) {
+         ASSERT_RC(getdns_submit_general(context, queue, "localhost",
+           GETDNS_RRTYPE_A, NULL, NULL),
+           GETDNS_RETURN_GOOD, "Return code from getdns_submit_general()");
+       }
+       /* submissions are all taken by the first round, so the queue is
+        * full once nothing is pending and the queue fd is readable
+        */
+       while (!ready) {
+         fd = getdns_context_fd(context);
+         max_fd = fd > sfd ? fd : sfd;
+         FD_ZERO(&read_fds);
+         FD_SET(fd, &read_fds);
+         FD_SET(sfd, &read_fds);
+         tv.tv_sec = 1;
+         tv.tv_usec = 0;
+         (void) getdns_context_get_num_pending_requests(context, &tv);
+         select(max_fd + 1, &read_fds, NULL, NULL, &tv);
+         ASSERT_RC(getdns_context_process_async(context), GETDNS_RETURN_GOOD,
+           "Return code from getdns_context_process_async()");
+
+         if (getdns_context_get_num_pending_requests(context, NULL) > 0)
+           continue;
+         FD_ZERO(&read_fds);
+         FD_SET(qfd, &read_fds);
+         tv.tv_sec = 0;
+         tv.tv_usec = 0;
+         ready = select(qfd + 1, &read_fds, NULL, NULL, &tv) == 1;
+       }
+       CONTEXT_DESTROY;
+
+       before = frees;
+       getdns_completion_queue_destroy(queue);
+       ck_assert_msg(frees > before,
+         "Expected the queue to free the responses");
+     }
+     END_TEST
+
+     Suite *
+     getdns_submit_general_suite (void)
+     {
+       Suite *s = suite_create ("getdns_submit_general()");
+
+       /* Negative test caseis */
+       TCase *tc_neg = tcase_create("Negative");
+       tcase_add_test(tc_neg, getdns_submit_general_1);
+       tcase_add_test(tc_neg, getdns_submit_general_2);
+       suite_add_tcase(s, tc_neg);
+
+       /* Positive test cases */
+       TCase *tc_pos = tcase_create("Positive");
+       tcase_add_test(tc_pos, getdns_submit_general_3);
+       tcase_add_test(tc_pos, getdns_submit_general_4);
+       tcase_add_test(tc_pos, getdns_submit_general_5);
+       suite_add_tcase(s, tc_pos);
+
+       return s;
+     }
+
+#endif
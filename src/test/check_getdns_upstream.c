@@ -0,0 +1,537 @@
+/**
+ * \file
+ * the mock upstream of the tests and benchmarks (see
+ * check_getdns_upstream.h).  Answers are built from the question of the
+ * query, or with ldns from the zone file.  Every UDP thread keeps the
+ * answers it delays in order of their due time, which is the order they
+ * were made in with one latency for all.
+ */
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <ldns/ldns.h>
+#include "check_getdns_upstream.h"
+
+#define UPSTREAM_THREADS 2
+/* the largest answer, over TCP */
+#define UPSTREAM_MAX 65535
+/* answers held back to be sent in reverse, over a TCP connection */
+#define UPSTREAM_REVERSE 64
+
+struct upstream {
+	struct mock_upstream_config config;
+	/* NULL without a zone file */
+	ldns_zone *zone;
+	int udp_fd;
+	int tcp_fd;
+};
+
+struct udp_thread {
+	struct upstream *upstream;
+	/* for the losses and truncations of this thread */
+	unsigned int seed;
+};
+
+/* an answer waiting for the latency to pass */
+struct delayed {
+	struct delayed *next;
+	uint64_t due;
+	struct sockaddr_storage to;
+	socklen_t to_len;
+	size_t len;
+	uint8_t wire[];
+};
+
+struct tcp_conn {
+	struct upstream *upstream;
+	int fd;
+};
+
+/*---------------------------------------- now_usec */
+static uint64_t
+now_usec(void)
+{
+	struct timeval tv;
+
+	(void) gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}				/* now_usec */
+
+/*---------------------------------------- question_end */
+/**
+ * Returns the size of the header and the (one) question of the query in
+ * wire, of len octets, or 0 when it is malformed.
+ */
+static size_t
+question_end(const uint8_t *wire, size_t len)
+{
+	size_t pos;
+
+	if (len < 12 || wire[4] != 0 || wire[5] != 1)
+		return 0;
+	for (pos = 12; pos < len && wire[pos]; pos += wire[pos] + 1)
+		if (wire[pos] & 0xc0)
+			return 0;
+	return pos + 5 <= len ? pos + 5 : 0;
+}				/* question_end */
+
+/*---------------------------------------- payload_size */
+/**
+ * Returns the payload size in the OPT record that follows the question
+ * at qend, and 512 for queries without one.
+ */
+static size_t
+payload_size(const uint8_t *wire, size_t len, size_t qend)
+{
+	size_t size;
+
+	if (wire[10] != 0 || wire[11] != 1 || qend + 11 > len ||
+	    wire[qend] != 0 || wire[qend + 1] != 0 || wire[qend + 2] != 41)
+		return 512;
+	size = wire[qend + 3] << 8 | wire[qend + 4];
+	return size < 512 ? 512 : size;
+}				/* payload_size */
+
+/*---------------------------------------- synthetic_answer */
+/**
+ * answer A queries with 127.0.0.1, and others with no data
+ */
+static size_t
+synthetic_answer(const uint8_t *query, size_t qend, uint8_t *buf)
+{
+	static const uint8_t answer[] = {
+		0xc0, 0x0c, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x0e, 0x10,
+		0x00, 0x04, 127, 0, 0, 1 };
+
+	(void) memcpy(buf, query, qend);
+	buf[2] = 0x84 | (buf[2] & 0x01); /* QR, AA and RD */
+	buf[3] = 0x80;                   /* RA, NOERROR */
+	buf[6] = buf[8] = buf[9] = buf[10] = buf[11] = 0;
+	buf[7] = buf[qend - 3] == 1 && buf[qend - 4] == 0;
+	if (!buf[7])
+		return qend;
+	(void) memcpy(buf + qend, answer, sizeof(answer));
+	return qend + sizeof(answer);
+}				/* synthetic_answer */
+
+/*---------------------------------------- zone_answer */
+/**
+ * answer the query from the zone.  Names that are not in it exist when a
+ * wildcard matches them.  Returns the size of the answer in buf, of
+ * UPSTREAM_MAX octets, or 0 when it could not be made.
+ */
+static size_t
+zone_answer(struct upstream *upstream, const uint8_t *query, size_t len,
+    uint8_t *buf)
+{
+	ldns_rr_list *rrs = ldns_zone_rrs(upstream->zone);
+	ldns_pkt *q = NULL, *reply;
+	ldns_rr *question, *rr, *copy;
+	ldns_rdf *qname;
+	ldns_rr_type qtype;
+	uint8_t *wire = NULL;
+	size_t i, wire_len = 0;
+	int exists = 0;
+
+	if (ldns_wire2pkt(&q, query, len) != LDNS_STATUS_OK)
+		return 0;
+	if (!(reply = ldns_pkt_new())) {
+		ldns_pkt_free(q);
+		return 0;
+	}
+	question = ldns_rr_list_rr(ldns_pkt_question(q), 0);
+	qname = ldns_rr_owner(question);
+	qtype = ldns_rr_get_type(question);
+	ldns_pkt_set_id(reply, ldns_pkt_id(q));
+	ldns_pkt_set_qr(reply, true);
+	ldns_pkt_set_aa(reply, true);
+	ldns_pkt_set_rd(reply, ldns_pkt_rd(q));
+	ldns_pkt_set_ra(reply, true);
+	(void) ldns_pkt_push_rr(reply, LDNS_SECTION_QUESTION,
+	    ldns_rr_clone(question));
+	if (ldns_pkt_edns(q)) {
+		ldns_pkt_set_edns_udp_size(reply, 4096);
+		ldns_pkt_set_edns_do(reply, ldns_pkt_edns_do(q));
+	}
+
+	for (i = 0; i < ldns_rr_list_rr_count(rrs); i++) {
+		rr = ldns_rr_list_rr(rrs, i);
+		if (ldns_dname_compare(ldns_rr_owner(rr), qname) != 0)
+			continue;
+		exists = 1;
+		if (qtype == LDNS_RR_TYPE_ANY || ldns_rr_get_type(rr) == qtype)
+			(void) ldns_pkt_push_rr(reply, LDNS_SECTION_ANSWER,
+			    ldns_rr_clone(rr));
+	}
+	for (i = 0; !exists && i < ldns_rr_list_rr_count(rrs); i++) {
+		rr = ldns_rr_list_rr(rrs, i);
+		if (!ldns_dname_is_wildcard(ldns_rr_owner(rr)) ||
+		    ldns_dname_match_wildcard(qname, ldns_rr_owner(rr)) != 1)
+			continue;
+		if (qtype != LDNS_RR_TYPE_ANY && ldns_rr_get_type(rr) != qtype)
+			continue;
+		copy = ldns_rr_clone(rr);
+		ldns_rdf_deep_free(ldns_rr_owner(copy));
+		ldns_rr_set_owner(copy, ldns_rdf_clone(qname));
+		(void) ldns_pkt_push_rr(reply, LDNS_SECTION_ANSWER, copy);
+	}
+	if (!exists && !ldns_pkt_ancount(reply))
+		ldns_pkt_set_rcode(reply, LDNS_RCODE_NXDOMAIN);
+	if (!ldns_pkt_ancount(reply) && ldns_zone_soa(upstream->zone))
+		(void) ldns_pkt_push_rr(reply, LDNS_SECTION_AUTHORITY,
+		    ldns_rr_clone(ldns_zone_soa(upstream->zone)));
+
+	if (ldns_pkt2wire(&wire, reply, &wire_len) != LDNS_STATUS_OK ||
+	    wire_len > UPSTREAM_MAX)
+		wire_len = 0;
+	else
+		(void) memcpy(buf, wire, wire_len);
+	free(wire);
+	ldns_pkt_free(reply);
+	ldns_pkt_free(q);
+	return wire_len;
+}				/* zone_answer */
+
+/*---------------------------------------- error_answer */
+/**
+ * answer with just the question and rcode
+ */
+static size_t
+error_answer(const uint8_t *query, size_t qend, uint8_t *buf,
+    unsigned int rcode)
+{
+	(void) memcpy(buf, query, qend);
+	buf[2] = 0x80 | (buf[2] & 0x01); /* QR and RD */
+	buf[3] = 0x80 | (rcode & 0x0f);  /* RA */
+	buf[6] = buf[7] = buf[8] = buf[9] = buf[10] = buf[11] = 0;
+	return qend;
+}				/* error_answer */
+
+/*---------------------------------------- answer_query */
+/**
+ * Returns the size of the answer to the query in buf, or 0 when there is
+ * none.  *offered is the payload size of the query, and *qend where the
+ * question ends, which is the size of the answer when it is truncated.
+ */
+static size_t
+answer_query(struct upstream *upstream, const uint8_t *query, size_t len,
+    uint8_t *buf, size_t *offered, size_t *qend)
+{
+	if (!(*qend = question_end(query, len)))
+		return 0;
+	*offered = payload_size(query, len, *qend);
+	if (upstream->config.rcode)
+		return error_answer(query, *qend, buf, upstream->config.rcode);
+	return upstream->zone ? zone_answer(upstream, query, len, buf)
+	    : synthetic_answer(query, *qend, buf);
+}				/* answer_query */
+
+/*---------------------------------------- truncate_answer */
+/**
+ * leave just the header and question of the answer in buf, with TC
+ */
+static size_t
+truncate_answer(uint8_t *buf, size_t qend)
+{
+	buf[2] |= 0x02;
+	buf[6] = buf[7] = buf[8] = buf[9] = buf[10] = buf[11] = 0;
+	return qend;
+}				/* truncate_answer */
+
+/*---------------------------------------- udp_run */
+static void *
+udp_run(void *arg)
+{
+	struct udp_thread *thread = (struct udp_thread *)arg;
+	struct upstream *upstream = thread->upstream;
+	struct delayed *first = NULL, **last = &first, *delayed;
+	uint8_t *answer = malloc(UPSTREAM_MAX);
+	uint8_t query[4096];
+	struct sockaddr_storage from;
+	socklen_t from_len;
+	struct pollfd pfd;
+	uint64_t now;
+	ssize_t len;
+	size_t size, offered, qend;
+	int timeout;
+
+	pfd.fd = upstream->udp_fd;
+	pfd.events = POLLIN;
+	while (answer) {
+		timeout = -1;
+		if (first) {
+			now = now_usec();
+			timeout = first->due <= now ? 0
+			    : (int)((first->due - now + 999) / 1000);
+		}
+		from_len = sizeof(from);
+		if (poll(&pfd, 1, timeout) > 0 &&
+		    (len = recvfrom(upstream->udp_fd, query, sizeof(query),
+		    MSG_DONTWAIT, (struct sockaddr *)&from, &from_len)) > 0 &&
+		    (unsigned int)(rand_r(&thread->seed) % 1000) >=
+		    upstream->config.loss_permille &&
+		    (size = answer_query(upstream, query, len, answer,
+		    &offered, &qend))) {
+
+			if (size > offered ||
+			    (unsigned int)(rand_r(&thread->seed) % 1000) <
+			    upstream->config.truncate_permille)
+				size = truncate_answer(answer, qend);
+
+			if (!upstream->config.latency_ms)
+				(void) sendto(upstream->udp_fd, answer, size, 0,
+				    (struct sockaddr *)&from, from_len);
+
+			else if ((delayed = malloc(sizeof(*delayed) + size))) {
+				delayed->next = NULL;
+				delayed->due = now_usec() +
+				    upstream->config.latency_ms * 1000;
+				(void) memcpy(&delayed->to, &from, from_len);
+				delayed->to_len = from_len;
+				delayed->len = size;
+				(void) memcpy(delayed->wire, answer, size);
+				*last = delayed;
+				last = &delayed->next;
+			}
+		}
+		for (now = now_usec(); first && first->due <= now; ) {
+			delayed = first;
+			(void) sendto(upstream->udp_fd, delayed->wire,
+			    delayed->len, 0, (struct sockaddr *)&delayed->to,
+			    delayed->to_len);
+			if (!(first = delayed->next))
+				last = &first;
+			free(delayed);
+		}
+	}
+	return NULL;
+}				/* udp_run */
+
+/*---------------------------------------- write_all */
+static int
+write_all(int fd, const uint8_t *buf, size_t len)
+{
+	ssize_t written;
+
+	while (len) {
+		if ((written = write(fd, buf, len)) == -1 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return -1;
+		buf += written;
+		len -= written;
+	}
+	return 0;
+}				/* write_all */
+
+/*---------------------------------------- tcp_conn_run */
+/**
+ * answer the queries of one connection, in full, in order or for those
+ * read together last first
+ */
+static void *
+tcp_conn_run(void *arg)
+{
+	struct tcp_conn *conn = (struct tcp_conn *)arg;
+	struct upstream *upstream = conn->upstream;
+	uint8_t *query = malloc(2 + UPSTREAM_MAX);
+	uint8_t *answer = malloc(2 + UPSTREAM_MAX);
+	uint8_t *held[UPSTREAM_REVERSE];
+	size_t held_len[UPSTREAM_REVERSE], num_held = 0;
+	size_t have = 0, len, size, offered, qend;
+	ssize_t n;
+	int r;
+
+	while (query && answer &&
+	    (n = read(conn->fd, query + have, 2 + UPSTREAM_MAX - have)) > 0) {
+		for (have += n; have >= 2 &&
+		    have >= 2 + (len = query[0] << 8 | query[1]);
+		    have -= 2 + len) {
+
+			if (!(size = answer_query(upstream, query + 2, len,
+			    answer + 2, &offered, &qend)))
+				goto done;
+			if (upstream->config.latency_ms)
+				(void) usleep(upstream->config.latency_ms * 1000);
+			answer[0] = size >> 8;
+			answer[1] = size & 0xff;
+			if (upstream->config.tcp_reverse &&
+			    num_held < UPSTREAM_REVERSE &&
+			    (held[num_held] = malloc(2 + size))) {
+				(void) memcpy(held[num_held], answer, 2 + size);
+				held_len[num_held++] = 2 + size;
+			} else if (write_all(conn->fd, answer, 2 + size) == -1)
+				goto done;
+			(void) memmove(query, query + 2 + len, have - 2 - len);
+		}
+		while (num_held) {
+			num_held--;
+			r = write_all(conn->fd, held[num_held], held_len[num_held]);
+			free(held[num_held]);
+			if (r == -1)
+				goto done;
+		}
+	}
+done:
+	while (num_held)
+		free(held[--num_held]);
+	(void) close(conn->fd);
+	free(query);
+	free(answer);
+	free(conn);
+	return NULL;
+}				/* tcp_conn_run */
+
+/*---------------------------------------- tcp_run */
+static void *
+tcp_run(void *arg)
+{
+	struct upstream *upstream = (struct upstream *)arg;
+	struct tcp_conn *conn;
+	pthread_t thread;
+	int fd;
+
+	for (;;) {
+		if ((fd = accept(upstream->tcp_fd, NULL, NULL)) == -1) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			break;
+		}
+		if (!(conn = malloc(sizeof(*conn)))) {
+			(void) close(fd);
+			continue;
+		}
+		conn->upstream = upstream;
+		conn->fd = fd;
+		if (pthread_create(&thread, NULL, tcp_conn_run, conn) != 0) {
+			(void) close(fd);
+			free(conn);
+		} else
+			(void) pthread_detach(thread);
+	}
+	return NULL;
+}				/* tcp_run */
+
+/*---------------------------------------- read_zone */
+static ldns_zone *
+read_zone(const char *zone_file)
+{
+	ldns_zone *zone = NULL;
+	ldns_status s;
+	FILE *in;
+
+	if (!(in = fopen(zone_file, "r")))
+		return NULL;
+	s = ldns_zone_new_frm_fp(&zone, in, NULL, 3600, LDNS_RR_CLASS_IN);
+	(void) fclose(in);
+	if (s != LDNS_STATUS_OK) {
+		fprintf(stderr, "%s: %s\n", zone_file, ldns_get_errorstr_by_id(s));
+		return NULL;
+	}
+	/* the SOA is kept apart, but is looked up like the rest */
+	if (ldns_zone_soa(zone))
+		(void) ldns_rr_list_push_rr(ldns_zone_rrs(zone),
+		    ldns_rr_clone(ldns_zone_soa(zone)));
+	return zone;
+}				/* read_zone */
+
+/*---------------------------------------- mock_upstream_start */
+int
+mock_upstream_start(const struct mock_upstream_config *config,
+    uint16_t *port)
+{
+	size_t num_threads = config->threads ? config->threads
+	    : UPSTREAM_THREADS;
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	struct upstream *upstream;
+	struct udp_thread *threads;
+	pthread_t thread;
+	size_t i;
+
+	if (!(upstream = calloc(1, sizeof(*upstream))) ||
+	    !(threads = calloc(num_threads, sizeof(*threads)))) {
+		free(upstream);
+		return -1;
+	}
+	upstream->config = *config;
+	upstream->udp_fd = upstream->tcp_fd = -1;
+	if (config->zone_file && !(upstream->zone = read_zone(config->zone_file)))
+		goto error;
+
+	(void) memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((upstream->udp_fd = socket(AF_INET, SOCK_DGRAM, 0)) == -1 ||
+	    bind(upstream->udp_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+	    getsockname(upstream->udp_fd, (struct sockaddr *)&addr,
+	    &addr_len) == -1)
+		goto error;
+	/* on the same port for fallbacks after truncation */
+	if ((upstream->tcp_fd = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
+	    bind(upstream->tcp_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+	    listen(upstream->tcp_fd, 64) == -1)
+		goto error;
+
+	/* the threads and upstream are never freed */
+	for (i = 0; i < num_threads; i++) {
+		threads[i].upstream = upstream;
+		threads[i].seed = (unsigned int)i + 1;
+		if (pthread_create(&thread, NULL, udp_run, &threads[i]) != 0)
+			return -1;
+		(void) pthread_detach(thread);
+	}
+	if (pthread_create(&thread, NULL, tcp_run, upstream) != 0)
+		return -1;
+	(void) pthread_detach(thread);
+
+	*port = ntohs(addr.sin_port);
+	return 0;
+
+error:
+	if (upstream->udp_fd != -1)
+		(void) close(upstream->udp_fd);
+	if (upstream->tcp_fd != -1)
+		(void) close(upstream->tcp_fd);
+	if (upstream->zone)
+		ldns_zone_deep_free(upstream->zone);
+	free(threads);
+	free(upstream);
+	return -1;
+}				/* mock_upstream_start */
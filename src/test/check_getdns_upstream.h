@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _check_getdns_upstream_h_
+#define _check_getdns_upstream_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A mock upstream for the tests and benchmarks, on a random port of
+   127.0.0.1, over UDP and TCP.  It answers with 127.0.0.1 for A queries
+   of any name and with no data for other types, or from a zone file.  It
+   may wait before every answer, lose or truncate a part of the UDP
+   answers, answer out of order over TCP, or answer every query with an
+   error. */
+struct mock_upstream_config {
+    /* to wait before every answer */
+    unsigned int latency_ms;
+    /* of UDP queries not answered at all */
+    unsigned int loss_permille;
+    /* of UDP answers with just the question and TC, on top of those that
+       do not fit the payload size of the query */
+    unsigned int truncate_permille;
+    /* answering UDP queries, 0 for 2 */
+    size_t threads;
+    /* to answer the queries read from a TCP connection together last
+       first, instead of in order */
+    int tcp_reverse;
+    /* of the answers to all queries, with just the question, 0 to answer
+       them */
+    unsigned int rcode;
+    /* with the records to answer from (owner names may be wildcards),
+       NULL for 127.0.0.1 to every A query */
+    const char *zone_file;
+};
+
+/* start answering on a new port, returned in port.  Returns 0, or -1 when
+   the upstream could not be started (errno is set when there is one) */
+int
+mock_upstream_start(const struct mock_upstream_config *config,
+    uint16_t *port);
+
+#endif
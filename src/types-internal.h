@@ -100,8 +100,16 @@ struct getdns_context;
 /* declarations */
 struct getdns_dns_req;
 struct getdns_network_req;
+struct ub_ctx;
+struct priv_getdns_upstreams;
+struct priv_getdns_upstream;
+struct priv_getdns_tcp_conn;
+struct priv_getdns_udp_socket;
 
 
+/* retry deadlines remembered per network request */
+#define NETREQ_DEADLINES 8
+
 #define MF_PLAIN ((void *)&plain_mem_funcs_user_arg)
 extern void *plain_mem_funcs_user_arg;
 
@@ -165,6 +173,44 @@ typedef struct getdns_network_req
 
 	/* next request to issue after this one */
 	struct getdns_network_req *next;
+
+	/* in flight with the native stub (see stub.h) instead of unbound */
+	int stub;
+	uint16_t query_id;
+	uint8_t *wire;
+	size_t wire_len;
+	/* the upstreams it may be answered by, and the one sent to last */
+	struct priv_getdns_upstreams *upstreams;
+	size_t upstream;
+	unsigned int tries;
+	/* of the timeout to send it again, 0 when not scheduled */
+	getdns_transaction_t retry_id;
+	/* in the queries in flight of the stub, hashed on query_id and name */
+	struct getdns_network_req *hash_next;
+	uint32_t hash;
+	/* the UDP sockets it was sent from, per address family */
+	struct priv_getdns_udp_socket *sockets[2];
+	/* in the queue of the stub, pending_pprev is NULL when not queued */
+	struct getdns_network_req *pending_next;
+	struct getdns_network_req **pending_pprev;
+	/* over a TCP connection of the stub instead of UDP */
+	int tcp;
+	/* the connection it is written to, NULL when not (yet) */
+	struct priv_getdns_tcp_conn *conn;
+	/* when last sent, in microseconds, for the round trip time, and the
+	 * EDNS payload size it was sent with */
+	uint64_t sent_usec;
+	uint16_t edns_size;
+	/* the timeout to send it again is for a hedge */
+	int hedging;
+	/* counted in the queries in flight of this upstream, with limits per
+	 * upstream, or waiting in the held queue for one with room */
+	struct priv_getdns_upstream *charged;
+	int held;
+	/* the first deadlines to send it again, in milliseconds, as reported
+	 * in the reply */
+	uint16_t deadlines[NETREQ_DEADLINES];
+	size_t n_deadlines;
 } getdns_network_req;
 
 /**
@@ -189,6 +235,9 @@ typedef struct getdns_dns_req
 	/* context that owns the request */
 	struct getdns_context *context;
 
+	/* the unbound context of the context when the request was made */
+	struct ub_ctx *unbound_ctx;
+
 	/* request extensions */
 	struct getdns_dict *extensions;
 
@@ -205,6 +254,18 @@ typedef struct getdns_dns_req
     /* dnssec status */
     int return_dnssec_status;
 
+    /* resolved by the sync functions, without timeouts in the context */
+    int sync;
+
+    /* resolved with the native stub instead of unbound */
+    int native_stub;
+
+    /* counted in the requests in flight of the context, or waiting in its
+     * admission queue, admission_pprev is NULL when not (see admission.h) */
+    int admitted;
+    struct getdns_dns_req *admission_next;
+    struct getdns_dns_req **admission_pprev;
+
     /* mem funcs */
     struct mem_funcs my_mf;
 
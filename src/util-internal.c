@@ -282,7 +282,8 @@ create_list_from_rr_list(struct getdns_context *context, ldns_rr_list * rr_list)
 	size_t i = 0;
 	size_t idx = 0;
 	int r = GETDNS_RETURN_GOOD;
-	struct getdns_list *result = getdns_list_create_with_context(context);
+	struct getdns_list *result = getdns_list_create_with_capacity(context,
+	    ldns_rr_list_rr_count(rr_list));
 	struct getdns_dict *rrdict;
 	for (i = 0; i < ldns_rr_list_rr_count(rr_list) && r == GETDNS_RETURN_GOOD;
 	    ++i) {
@@ -358,6 +359,24 @@ add_only_addresses(struct getdns_list * addrs, ldns_rr_list * rr_list)
 	return r;
 }
 
+static getdns_return_t
+create_deadlines_list(struct getdns_context *context,
+    getdns_network_req *req, struct getdns_list **list)
+{
+	getdns_return_t r = GETDNS_RETURN_GOOD;
+	size_t i;
+
+	if (!(*list = getdns_list_create_with_context(context)))
+		return GETDNS_RETURN_MEMORY_ERROR;
+	for (i = 0; i < req->n_deadlines && r == GETDNS_RETURN_GOOD; i++)
+		r = getdns_list_set_int(*list, i, req->deadlines[i]);
+	if (r != GETDNS_RETURN_GOOD) {
+		getdns_list_destroy(*list);
+		*list = NULL;
+	}
+	return r;
+}
+
 static struct getdns_dict *
 create_reply_dict(struct getdns_context *context, getdns_network_req * req,
     struct getdns_list * just_addrs)
@@ -489,6 +508,19 @@ create_reply_dict(struct getdns_context *context, getdns_network_req * req,
     	r = getdns_dict_util_set_string(result,
     	    GETDNS_STR_KEY_CANONICAL_NM, name);
     	free(name);
+        if (r != GETDNS_RETURN_GOOD) {
+            break;
+        }
+
+    	/* the retry deadlines of the native stub */
+    	if (req->n_deadlines) {
+    		r = create_deadlines_list(context, req, &sublist);
+    		if (r != GETDNS_RETURN_GOOD) {
+    			break;
+    		}
+    		r = getdns_dict_set_list(result, "retry_deadlines", sublist);
+    		getdns_list_destroy(sublist);
+    	}
 
     } while (0);
 
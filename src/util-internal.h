@@ -60,6 +60,26 @@ getdns_return_t getdns_apply_network_result(getdns_network_req* netreq, struct u
  */
 getdns_return_t getdns_list_add_item(struct getdns_list *list, size_t * index);
 
+/**
+ * make sure a list has room for at least size items, so that adding items
+ * up to that number does not need to reallocate the list
+ * @param list list to grow
+ * @param size number of items the list should be able to hold
+ * @return GETDNS_RETURN_GOOD on success
+ * @return GETDNS_RETURN_GENERIC_ERROR if out of memory
+ */
+getdns_return_t priv_getdns_list_reserve(struct getdns_list *list, size_t size);
+
+/**
+ * create an empty list with the given memory functions and room for capacity
+ * items (0 selects the default)
+ * @param mf memory functions for the list
+ * @param capacity number of items to preallocate
+ * @return the new list or NULL if out of memory
+ */
+struct getdns_list *priv_getdns_list_create_with_mf(const struct mem_funcs *mf,
+    size_t capacity);
+
 /**
   * private function (API users should not be calling this), this uses library
   * routines to make a copy of the list - would be faster to make the copy directly
@@ -86,6 +106,14 @@ getdns_return_t
 getdns_dict_copy(const struct getdns_dict *srcdict,
     struct getdns_dict **dstdict);
 
+/**
+ * private function to determine whether bindata looks like a domain name
+ * in wire format (a sequence of labels ending with the root label)
+ * @param bindata the bindata to inspect
+ * @return 1 when bindata is a dname with at least one non root label, 0 otherwise
+ */
+int priv_getdns_bindata_is_dname(const struct getdns_bindata *bindata);
+
 /**
  * convert an ip address (v4/v6) dict to a sock storage
  * expects dict to contain keys GETDNS_STR_PORT, GETDNS_STR_ADDRESS_TYPE
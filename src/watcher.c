@@ -0,0 +1,295 @@
+/**
+ *
+ * /brief getdns following changes to the system files
+ *
+ * A thread waits with inotify for changes to resolv.conf and the hosts
+ * file, and reads the changed files.  The loop thread picks up the result
+ * when it starts a request, so the request path does no system calls for
+ * this.
+ *
+ */
+
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+#include "types-internal.h"
+#include "util-internal.h"
+#include "context.h"
+#include "submission.h"
+#include "watcher.h"
+
+#define WATCH_RESOLVCONF 1
+#define WATCH_HOSTS      2
+
+/* quiet time after a change before reading the file, as files are often
+ * written in more than one step */
+#define WATCHER_SETTLE_MS 100
+
+void
+priv_getdns_sysfiles_update_free(struct getdns_context *context,
+    struct priv_getdns_sysfiles_update *update)
+{
+	if (!update)
+		return;
+	getdns_list_destroy(update->upstreams);
+	getdns_list_destroy(update->suffix);
+	GETDNS_FREE(context->my_mf, update);
+}
+
+struct priv_getdns_sysfiles_update *
+priv_getdns_watcher_take(struct priv_getdns_watcher *watcher)
+{
+	if (!__atomic_load_n(&watcher->pending, __ATOMIC_RELAXED))
+		return NULL;
+	return __atomic_exchange_n(&watcher->pending, NULL, __ATOMIC_ACQUIRE);
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+/*
+ * Watch the directory of fn for fn being written, replaced or removed.
+ * When fn is a symbolic link, the directory of the file it points to is
+ * watched as well.
+ */
+static void
+watch_file(struct priv_getdns_watcher *w, const char *fn, int what)
+{
+	char path[PATH_MAX];
+	const char *paths[2];
+	char dir[PATH_MAX];
+	const char *slash;
+	size_t i, dir_len;
+	int wd;
+
+	paths[0] = fn;
+	paths[1] = realpath(fn, path) && strcmp(path, fn) != 0 ? path : NULL;
+	for (i = 0; i < 2 && paths[i]; i++) {
+		if (w->num_watched == sizeof(w->watched) / sizeof(w->watched[0]))
+			return;
+		if (!(slash = strrchr(paths[i], '/')) ||
+		    strlen(slash + 1) >= sizeof(w->watched[0].name))
+			continue;
+		dir_len = slash == paths[i] ? 1 : (size_t)(slash - paths[i]);
+		(void) memcpy(dir, paths[i], dir_len);
+		dir[dir_len] = 0;
+
+		wd = inotify_add_watch(w->inotify_fd, dir, IN_CLOSE_WRITE |
+		    IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE);
+		if (wd == -1)
+			continue;
+		w->watched[w->num_watched].wd = wd;
+		(void) strcpy(w->watched[w->num_watched].name, slash + 1);
+		w->watched[w->num_watched].what = what;
+		w->num_watched++;
+	}
+}
+
+/* the files (WATCH_* flags) the pending inotify events are about */
+static int
+read_events(struct priv_getdns_watcher *w)
+{
+	union {
+		struct inotify_event ev;
+		char buf[4096];
+	} u;
+	const struct inotify_event *ev;
+	const char *p;
+	ssize_t len;
+	size_t i;
+	int what = 0;
+
+	for (;;) {
+		len = read(w->inotify_fd, u.buf, sizeof(u.buf));
+		if (len == -1 && errno == EINTR)
+			continue;
+		if (len <= 0)
+			break;
+		for (p = u.buf; p < u.buf + len;
+		    p += sizeof(struct inotify_event) + ev->len) {
+			ev = (const struct inotify_event *) p;
+			if (!ev->len)
+				continue;
+			for (i = 0; i < w->num_watched; i++)
+				if (w->watched[i].wd == ev->wd &&
+				    strcmp(w->watched[i].name, ev->name) == 0)
+					what |= w->watched[i].what;
+		}
+	}
+	return what;
+}
+
+/* read the changed files and leave the result for the loop thread.  The
+ * memory functions of the context are used from this thread as well, which
+ * getdns_context_set_follow_system_files requires to be thread-safe.
+ */
+static void
+publish(struct priv_getdns_watcher *w, int what)
+{
+	struct getdns_context *context = w->context;
+	struct priv_getdns_sysfiles_update *update, *prev;
+
+	update = GETDNS_MALLOC(context->my_mf, struct priv_getdns_sysfiles_update);
+	if (!update)
+		return;
+	update->resolvconf = 0;
+	update->upstreams = NULL;
+	update->suffix = NULL;
+	update->hosts = (what & WATCH_HOSTS) != 0;
+	/* a file that is (still) missing will be read at its next change */
+	if ((what & WATCH_RESOLVCONF) && priv_getdns_read_resolvconf(context,
+	    &update->upstreams, &update->suffix) == GETDNS_RETURN_GOOD)
+		update->resolvconf = 1;
+	if (!update->resolvconf && !update->hosts) {
+		GETDNS_FREE(context->my_mf, update);
+		return;
+	}
+
+	/* merge with the changes the loop thread has not taken yet */
+	prev = __atomic_exchange_n(&w->pending, NULL, __ATOMIC_ACQUIRE);
+	if (prev) {
+		update->hosts |= prev->hosts;
+		if (!update->resolvconf && prev->resolvconf) {
+			update->resolvconf = 1;
+			update->upstreams = prev->upstreams;
+			update->suffix = prev->suffix;
+			prev->upstreams = NULL;
+			prev->suffix = NULL;
+		}
+		priv_getdns_sysfiles_update_free(context, prev);
+	}
+	__atomic_store_n(&w->pending, update, __ATOMIC_RELEASE);
+}
+
+static void *
+watcher_thread(void *arg)
+{
+	struct priv_getdns_watcher *w = (struct priv_getdns_watcher *) arg;
+	struct pollfd fds[2];
+	int what = 0;
+
+	fds[0].fd = w->inotify_fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = w->stop[0];
+	fds[1].events = POLLIN;
+	for (;;) {
+		switch (poll(fds, 2, what ? WATCHER_SETTLE_MS : -1)) {
+		case -1:
+			if (errno == EINTR)
+				continue;
+			return NULL;
+		case 0:
+			/* settled */
+			publish(w, what);
+			what = 0;
+			continue;
+		}
+		if (fds[1].revents)
+			return NULL;
+		if (fds[0].revents)
+			what |= read_events(w);
+	}
+}
+#endif
+
+getdns_return_t
+priv_getdns_watcher_start(struct getdns_context *context)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	struct priv_getdns_watcher *w;
+
+	w = GETDNS_MALLOC(context->my_mf, struct priv_getdns_watcher);
+	if (!w)
+		return GETDNS_RETURN_MEMORY_ERROR;
+	(void) memset(w, 0, sizeof(struct priv_getdns_watcher));
+	w->context = context;
+	w->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (w->inotify_fd == -1) {
+		GETDNS_FREE(context->my_mf, w);
+		return GETDNS_RETURN_GENERIC_ERROR;
+	}
+	if (priv_getdns_wakeup_open(w->stop) == -1) {
+		(void) close(w->inotify_fd);
+		GETDNS_FREE(context->my_mf, w);
+		return GETDNS_RETURN_GENERIC_ERROR;
+	}
+	watch_file(w, GETDNS_FN_RESOLVCONF, WATCH_RESOLVCONF);
+	watch_file(w, GETDNS_FN_HOSTS, WATCH_HOSTS);
+	if (w->num_watched == 0 ||
+	    pthread_create(&w->thread, NULL, watcher_thread, w) != 0) {
+		priv_getdns_wakeup_close(w->stop);
+		(void) close(w->inotify_fd);
+		GETDNS_FREE(context->my_mf, w);
+		return GETDNS_RETURN_GENERIC_ERROR;
+	}
+	context->watcher = w;
+	return GETDNS_RETURN_GOOD;
+#else
+	return GETDNS_RETURN_GENERIC_ERROR;
+#endif
+}
+
+void
+priv_getdns_watcher_stop(struct getdns_context *context)
+{
+	struct priv_getdns_watcher *w = context->watcher;
+
+	if (!w)
+		return;
+	priv_getdns_wakeup_signal(w->stop);
+	(void) pthread_join(w->thread, NULL);
+	priv_getdns_wakeup_close(w->stop);
+	(void) close(w->inotify_fd);
+	priv_getdns_sysfiles_update_free(context, w->pending);
+	GETDNS_FREE(context->my_mf, w);
+	context->watcher = NULL;
+}
+
+/*---------------------------------------- public */
+getdns_return_t
+getdns_context_set_follow_system_files(getdns_context *context, int enable)
+{
+	if (!context)
+		return GETDNS_RETURN_INVALID_PARAMETER;
+
+	if (enable && !context->watcher)
+		return priv_getdns_watcher_start(context);
+	if (!enable)
+		priv_getdns_watcher_stop(context);
+	return GETDNS_RETURN_GOOD;
+}
+
+/* watcher.c */
@@ -0,0 +1,85 @@
+/**
+ * \file
+ * \brief Following changes to the system files
+ */
+
+/*
+ * Copyright (c) 2013, NLNet Labs, Verisign, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the names of the copyright holders nor the
+ *   names of its contributors may be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL Verisign, Inc. BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _GETDNS_WATCHER_H_
+#define _GETDNS_WATCHER_H_
+
+#include <pthread.h>
+#include <getdns/getdns.h>
+
+/* settings read from changed system files, for the loop thread */
+struct priv_getdns_sysfiles_update {
+    /* resolv.conf changed, with the upstreams and suffixes it has now */
+    int resolvconf;
+    struct getdns_list *upstreams;
+    struct getdns_list *suffix;
+    /* the hosts file changed */
+    int hosts;
+};
+
+/* a file to watch, by the directory it is in */
+struct priv_getdns_watched {
+    int wd;
+    char name[256];
+    int what;
+};
+
+/*
+ * A thread blocking on an inotify fd for changes to resolv.conf and the
+ * hosts file.  It reads the changed files and leaves the result in pending
+ * for the loop thread, which looks at it before starting requests.
+ */
+struct priv_getdns_watcher {
+    struct getdns_context *context;
+    pthread_t thread;
+    int inotify_fd;
+    /* signaled to stop the thread */
+    int stop[2];
+    struct priv_getdns_watched watched[4];
+    size_t num_watched;
+    /* exchanged atomically, NULL when there is nothing new */
+    struct priv_getdns_sysfiles_update *pending;
+};
+
+/* start and stop following the system files for context */
+getdns_return_t priv_getdns_watcher_start(struct getdns_context *context);
+void priv_getdns_watcher_stop(struct getdns_context *context);
+
+/* take the settings read since the last call, NULL if none.  Only an
+   atomic load when nothing changed, so cheap enough for every request */
+struct priv_getdns_sysfiles_update *priv_getdns_watcher_take(
+    struct priv_getdns_watcher *watcher);
+
+void priv_getdns_sysfiles_update_free(struct getdns_context *context,
+    struct priv_getdns_sysfiles_update *update);
+
+#endif